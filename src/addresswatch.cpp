@@ -0,0 +1,107 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addresswatch.h"
+
+#include <map>
+#include <tuple>
+
+CAddressWatchList addressWatchList;
+
+// Key used to aggregate all deltas of one address within one transaction
+typedef std::tuple<uint256, int, uint160> AddressWatchEventKey;
+
+static void AddToEvent(std::map<AddressWatchEventKey, size_t>& mapEvents, std::vector<CAddressWatchEvent>& events,
+                       int type, const uint160& hashBytes, const uint256& txhash, CAmount amount)
+{
+    AddressWatchEventKey key(txhash, type, hashBytes);
+    std::map<AddressWatchEventKey, size_t>::iterator it = mapEvents.find(key);
+
+    if (it == mapEvents.end()) {
+        it = mapEvents.insert(std::make_pair(key, events.size())).first;
+        events.push_back(CAddressWatchEvent(type, hashBytes, txhash));
+    }
+
+    CAddressWatchEvent& event = events[it->second];
+
+    if (amount < 0)
+        event.debit -= amount;
+    else
+        event.credit += amount;
+}
+
+size_t CAddressWatchList::Add(const std::vector<std::pair<uint160, int> >& addresses)
+{
+    LOCK(cs);
+    size_t nAdded = 0;
+    for (const auto& address : addresses)
+        nAdded += setWatched.insert(address).second ? 1 : 0;
+    return nAdded;
+}
+
+size_t CAddressWatchList::Remove(const std::vector<std::pair<uint160, int> >& addresses)
+{
+    LOCK(cs);
+    size_t nRemoved = 0;
+    for (const auto& address : addresses)
+        nRemoved += setWatched.erase(address);
+    return nRemoved;
+}
+
+void CAddressWatchList::Clear()
+{
+    LOCK(cs);
+    setWatched.clear();
+}
+
+bool CAddressWatchList::IsEmpty() const
+{
+    LOCK(cs);
+    return setWatched.empty();
+}
+
+size_t CAddressWatchList::Size() const
+{
+    LOCK(cs);
+    return setWatched.size();
+}
+
+std::vector<std::pair<uint160, int> > CAddressWatchList::GetAddresses() const
+{
+    LOCK(cs);
+    return std::vector<std::pair<uint160, int> >(setWatched.begin(), setWatched.end());
+}
+
+void CAddressWatchList::Match(const std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& deltas,
+                              std::vector<CAddressWatchEvent>& events) const
+{
+    std::map<AddressWatchEventKey, size_t> mapEvents;
+
+    LOCK(cs);
+    if (setWatched.empty())
+        return;
+
+    for (const auto& delta : deltas) {
+        if (!setWatched.count(std::make_pair(delta.first.addressBytes, delta.first.type)))
+            continue;
+        AddToEvent(mapEvents, events, delta.first.type, delta.first.addressBytes, delta.first.txhash, delta.second.amount);
+    }
+}
+
+void CAddressWatchList::Match(const std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                              std::vector<CAddressWatchEvent>& events) const
+{
+    std::map<AddressWatchEventKey, size_t> mapEvents;
+
+    LOCK(cs);
+    if (setWatched.empty())
+        return;
+
+    for (const auto& entry : addressIndex) {
+        int type = (int)entry.first.type;
+        if (!setWatched.count(std::make_pair(entry.first.hashBytes, type)))
+            continue;
+        AddToEvent(mapEvents, events, type, entry.first.hashBytes, entry.first.txhash, entry.second);
+    }
+}
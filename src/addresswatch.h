@@ -0,0 +1,62 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_ADDRESSWATCH_H
+#define SMARTCASH_ADDRESSWATCH_H
+
+#include "addressindex.h"
+#include "amount.h"
+#include "spentindex.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <set>
+#include <vector>
+
+/** Credit and debit of one watched address caused by one transaction */
+struct CAddressWatchEvent
+{
+    int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    CAmount credit;
+    CAmount debit;
+
+    CAddressWatchEvent(int typeIn, const uint160& hashBytesIn, const uint256& txhashIn) :
+        type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), credit(0), debit(0) {}
+};
+
+/**
+ * Set of (hash160, address type) pairs registered through the watchaddresses
+ * RPC. Push notifiers use it to filter the address deltas classified for the
+ * address index down to the addresses their clients care about.
+ */
+class CAddressWatchList
+{
+private:
+    mutable CCriticalSection cs;
+    std::set<std::pair<uint160, int> > setWatched;
+
+public:
+    /** Add addresses to the list, returns the number of new entries */
+    size_t Add(const std::vector<std::pair<uint160, int> >& addresses);
+    /** Remove addresses from the list, returns the number of removed entries */
+    size_t Remove(const std::vector<std::pair<uint160, int> >& addresses);
+    void Clear();
+
+    bool IsEmpty() const;
+    size_t Size() const;
+    std::vector<std::pair<uint160, int> > GetAddresses() const;
+
+    /** Aggregate the mempool deltas of watched addresses per address and transaction */
+    void Match(const std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& deltas,
+               std::vector<CAddressWatchEvent>& events) const;
+    /** Aggregate the block address index entries of watched addresses per address and transaction */
+    void Match(const std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+               std::vector<CAddressWatchEvent>& events) const;
+};
+
+extern CAddressWatchList addressWatchList;
+
+#endif // SMARTCASH_ADDRESSWATCH_H
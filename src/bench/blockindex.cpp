@@ -0,0 +1,112 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "random.h"
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define HAVE_MALLINFO2 1
+#include <malloc.h>
+#endif
+
+// A mainnet sized block index, allocated in random (hash) order like
+// LoadBlockIndexDB does. Every entry comes with a 56 byte allocation
+// standing in for its mapBlockIndex node.
+static const int BLOCK_INDEX_ENTRIES = 2000000;
+static const size_t MAP_NODE_SIZE = 56;
+static const int WALKS_PER_ITERATION = 1000;
+
+/** Bytes allocated from the heap including the allocator overhead, 0 where it can't be read */
+static size_t GetHeapUsage()
+{
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+class CBenchBlockIndex
+{
+private:
+    CBlockIndexArena* pArena;
+    std::vector<CBlockIndex*>& vIndex;
+    std::vector<char*> vMapNodes;
+
+public:
+    CBenchBlockIndex(CBlockIndexArena* pArenaIn, std::vector<CBlockIndex*>& vIndexIn) : pArena(pArenaIn), vIndex(vIndexIn)
+    {
+        FastRandomContext rng(true);
+        std::vector<int> vOrder(BLOCK_INDEX_ENTRIES);
+        for (int i = 0; i < BLOCK_INDEX_ENTRIES; i++)
+            vOrder[i] = i;
+        for (int i = BLOCK_INDEX_ENTRIES - 1; i > 0; i--)
+            std::swap(vOrder[i], vOrder[rng.rand32() % (i + 1)]);
+
+        vMapNodes.reserve(BLOCK_INDEX_ENTRIES);
+        for (int i = 0; i < BLOCK_INDEX_ENTRIES; i++) {
+            vIndex[vOrder[i]] = pArena ? pArena->Create() : new CBlockIndex();
+            vMapNodes.push_back(new char[MAP_NODE_SIZE]);
+        }
+
+        for (int i = 0; i < BLOCK_INDEX_ENTRIES; i++) {
+            CBlockIndex* pindex = vIndex[i];
+            pindex->nHeight = i;
+            pindex->nTime = 1500000000 + i * 55;
+            pindex->pprev = i ? vIndex[i - 1] : NULL;
+            pindex->BuildSkip();
+        }
+    }
+
+    ~CBenchBlockIndex()
+    {
+        if (!pArena) {
+            for (size_t i = 0; i < vIndex.size(); i++)
+                delete vIndex[i];
+        }
+        for (size_t i = 0; i < vMapNodes.size(); i++)
+            delete[] vMapNodes[i];
+    }
+};
+
+static void BlockIndexWalk(benchmark::State& state, CBlockIndexArena* pArena, const char* strName)
+{
+    // The lookup vector is allocated first, so only the entries and map nodes count
+    std::vector<CBlockIndex*> vIndex(BLOCK_INDEX_ENTRIES);
+    size_t nMemoryBefore = GetHeapUsage();
+    CBenchBlockIndex index(pArena, vIndex);
+    size_t nMemoryAfter = GetHeapUsage();
+    if (nMemoryBefore && nMemoryAfter)
+        std::cout << "# " << strName << " heap usage of the index: " << (nMemoryAfter - nMemoryBefore) / (1024 * 1024) << " MiB\n";
+
+    FastRandomContext rng(true);
+    int64_t nSum = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < WALKS_PER_ITERATION; i++) {
+            const CBlockIndex* pindex = vIndex[1 + rng.rand32() % (BLOCK_INDEX_ENTRIES - 1)];
+            nSum += pindex->GetAncestor(rng.rand32() % pindex->nHeight)->GetMedianTimePast();
+        }
+    }
+}
+
+// Chain walks over entries allocated one by one ...
+static void BlockIndexWalkHeap(benchmark::State& state)
+{
+    BlockIndexWalk(state, NULL, "BlockIndexWalkHeap");
+}
+
+// ... and over entries allocated from CBlockIndexArena slabs
+static void BlockIndexWalkArena(benchmark::State& state)
+{
+    CBlockIndexArena arena;
+    BlockIndexWalk(state, &arena, "BlockIndexWalkArena");
+}
+
+BENCHMARK(BlockIndexWalkHeap);
+BENCHMARK(BlockIndexWalkArena);
@@ -9,10 +9,13 @@
 #include "hash.h"
 #include "uint256.h"
 #include "utiltime.h"
+#include "consensus/merkle.h"
+#include "crypto/keccak256.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "crypto/sph_keccak.h"
 
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
@@ -51,6 +54,70 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+static void MerkleRoot(benchmark::State& state)
+{
+    std::vector<uint256> leaves(2000);
+    for (size_t i = 0; i < leaves.size(); i++)
+        *((uint64_t*)leaves[i].begin()) = i;
+    bool mutated = false;
+    while (state.KeepRunning()) {
+        uint256 root = ComputeMerkleRoot(leaves, &mutated);
+        leaves[mutated ? 1 : 0] = root;
+    }
+}
+
+static void Keccak256(benchmark::State& state)
+{
+    uint8_t hash[CKeccak256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning())
+        CKeccak256().Write(begin_ptr(in), in.size()).Finalize(hash);
+}
+
+// One block header at a time, as in CBlockHeader::GetHash()
+static void Keccak256_80b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(80,0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100000; i++) {
+            CKeccak256().Write(begin_ptr(in), in.size()).Finalize(&in[0]);
+        }
+    }
+}
+
+// The same with the generic sph implementation, for comparison
+static void Keccak256_80b_sph(benchmark::State& state)
+{
+    std::vector<uint8_t> in(80,0);
+    sph_keccak256_context ctx;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100000; i++) {
+            sph_keccak256_init(&ctx);
+            sph_keccak256(&ctx, begin_ptr(in), in.size());
+            sph_keccak256_close(&ctx, &in[0]);
+        }
+    }
+}
+
+// Batches of headers, as hashed by the miner and header validation
+static void Keccak256Short_80b_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(80 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning()) {
+        Keccak256Short(out.data(), in.data(), 80, 1024);
+        in[0] = out[0];
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -74,5 +141,11 @@ static void SipHash_32b(benchmark::State& state)
 //BENCHMARK(SHA256);
 //BENCHMARK(SHA512);
 
-//BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256_32b);
 //BENCHMARK(SipHash_32b);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(MerkleRoot);
+BENCHMARK(Keccak256);
+BENCHMARK(Keccak256_80b);
+BENCHMARK(Keccak256_80b_sph);
+BENCHMARK(Keccak256Short_80b_1024);
@@ -0,0 +1,64 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bip39.h"
+#include "chainparams.h"
+#include "hdchain.h"
+#include "key.h"
+
+static const char* BENCH_MNEMONIC = "abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about";
+
+// BIP39 mnemonic to seed, 2048 rounds of PBKDF2-HMAC-SHA512
+static void MnemonicToSeed(benchmark::State& state)
+{
+    SecureString mnemonic(BENCH_MNEMONIC);
+    SecureString passphrase("TREZOR");
+    SecureVector seed;
+    while (state.KeepRunning()) {
+        CMnemonic::ToSeed(mnemonic, passphrase, seed);
+    }
+}
+
+static void SetupBenchHDChain(CHDChain& chain)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    SecureVector seed;
+    CMnemonic::ToSeed(SecureString(BENCH_MNEMONIC), SecureString(), seed);
+    chain.SetSeed(seed, true);
+}
+
+// Deriving every key from the seed along the whole BIP44 path
+static void HDDeriveKeyFullPath(benchmark::State& state)
+{
+    CHDChain chain;
+    SetupBenchHDChain(chain);
+    uint32_t nChildIndex = 0;
+    while (state.KeepRunning()) {
+        CExtKey childKey;
+        chain.DeriveChildExtKey(0, false, nChildIndex++, childKey);
+        CExtPubKey childPubKey = childKey.Neuter();
+        assert(childKey.key.VerifyPubKey(childPubKey.pubkey));
+    }
+}
+
+// Deriving keys from the cached key of the external chain, as the wallet does
+static void HDDeriveKeyFromChainKey(benchmark::State& state)
+{
+    CHDChain chain;
+    SetupBenchHDChain(chain);
+    CExtKey chainKey;
+    chain.DeriveChainExtKey(0, false, chainKey);
+    uint32_t nChildIndex = 0;
+    while (state.KeepRunning()) {
+        CExtKey childKey;
+        chainKey.Derive(childKey, nChildIndex++);
+        CExtPubKey childPubKey = childKey.Neuter();
+        assert(childKey.key.VerifyPubKey(childPubKey.pubkey));
+    }
+}
+
+BENCHMARK(MnemonicToSeed);
+BENCHMARK(HDDeriveKeyFullPath);
+BENCHMARK(HDDeriveKeyFromChainKey);
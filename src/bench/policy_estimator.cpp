@@ -0,0 +1,74 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/fees.h"
+#include "txmempool.h"
+
+#include <deque>
+
+static const int BENCH_TXS_PER_BLOCK = 500;
+
+static CTxMemPoolEntry MakeBenchEntry(int nHeight, CAmount nFee)
+{
+    static uint32_t nextLockTime = 0;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    tx.nLockTime = nextLockTime++; // so all transactions get different hashes
+    return CTxMemPoolEntry(tx, nFee, 0, 0, nHeight, true, 10 * COIN, false, 1, LockPoints());
+}
+
+// Feed the estimator a synthetic block stream, where higher fee transactions
+// confirm sooner, and ask for the smart fee of every target after each block.
+static void FeeEstimatorBlockStream(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator(CFeeRate(1000));
+    CTxMemPool pool(CFeeRate(0));
+    std::deque<std::vector<CTxMemPoolEntry> > vPending(5);
+    unsigned int nHeight = 1;
+
+    while (state.KeepRunning()) {
+        // New transactions spread over two orders of magnitude of fee rates
+        std::vector<CTxMemPoolEntry> vNew;
+        for (int i = 0; i < BENCH_TXS_PER_BLOCK; i++) {
+            vNew.push_back(MakeBenchEntry(nHeight, 100 + (i * 37) % 10000));
+            estimator.processTransaction(vNew.back(), true);
+        }
+
+        // The block confirms the higher fee half of each earlier batch,
+        // the oldest batch gets confirmed completely
+        std::vector<CTxMemPoolEntry> vConfirmed;
+        std::vector<CTxMemPoolEntry> vOldest = vPending.front();
+        vPending.pop_front();
+        for (size_t i = 0; i < vOldest.size(); i++)
+            vConfirmed.push_back(vOldest[i]);
+        for (size_t n = 0; n < vPending.size(); n++) {
+            std::vector<CTxMemPoolEntry> vLeft;
+            for (size_t i = 0; i < vPending[n].size(); i++) {
+                if (vPending[n][i].GetFee() > 5000)
+                    vConfirmed.push_back(vPending[n][i]);
+                else
+                    vLeft.push_back(vPending[n][i]);
+            }
+            vPending[n].swap(vLeft);
+        }
+        vPending.push_back(vNew);
+
+        nHeight++;
+        for (size_t i = 0; i < vConfirmed.size(); i++)
+            estimator.removeTx(vConfirmed[i].GetTx().GetHash());
+        estimator.processBlock(nHeight, vConfirmed, true);
+
+        for (int nTarget = 1; nTarget <= (int)MAX_BLOCK_CONFIRMS; nTarget++) {
+            int nFoundAt;
+            estimator.estimateSmartFee(nTarget, &nFoundAt, pool);
+        }
+    }
+}
+
+BENCHMARK(FeeEstimatorBlockStream);
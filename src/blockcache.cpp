@@ -0,0 +1,117 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+CBlockCache blockcache;
+
+CBlockCache::CBlockCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn), nSize(0)
+{
+}
+
+void CBlockCache::Trim()
+{
+    AssertLockHeld(cs);
+    while (nSize > nMaxSize && !lruEntries.empty()) {
+        nSize -= lruEntries.back().second->size();
+        mapEntries.erase(lruEntries.back().first);
+        lruEntries.pop_back();
+    }
+}
+
+void CBlockCache::SetMaxSize(size_t nMaxSizeIn)
+{
+    LOCK(cs);
+    nMaxSize = nMaxSizeIn;
+    Trim();
+}
+
+bool CBlockCache::IsEnabled() const
+{
+    LOCK(cs);
+    return nMaxSize > 0;
+}
+
+CBlockCache::BlockData CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return BlockData();
+    lruEntries.splice(lruEntries.begin(), lruEntries, it->second);
+    return it->second->second;
+}
+
+bool CBlockCache::Get(const uint256& hash, CBlock& block)
+{
+    BlockData data = Get(hash);
+    if (!data)
+        return false;
+    try {
+        CDataStream ssBlock(*data, SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock >> block;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s for %s", __func__, e.what(), hash.ToString());
+    }
+    return true;
+}
+
+void CBlockCache::Put(const uint256& hash, const BlockData& data)
+{
+    LOCK(cs);
+    if (!data || data->size() > nMaxSize)
+        return;
+    auto it = mapEntries.find(hash);
+    if (it != mapEntries.end()) {
+        lruEntries.splice(lruEntries.begin(), lruEntries, it->second);
+        return;
+    }
+    lruEntries.emplace_front(hash, data);
+    mapEntries.emplace(hash, lruEntries.begin());
+    nSize += data->size();
+    Trim();
+}
+
+CBlockCache::BlockData CBlockCache::Serialize(const CBlock& block)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock.reserve(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    ssBlock << block;
+    return std::make_shared<const std::vector<unsigned char> >(ssBlock.begin(), ssBlock.end());
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    lruEntries.clear();
+    mapEntries.clear();
+    nSize = 0;
+}
+
+bool ReadBlockFromCacheOrDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    if (blockcache.Get(pindex->GetBlockHash(), block))
+        return true;
+    return ReadBlockFromDisk(block, pindex, consensusParams);
+}
+
+CBlockCache::BlockData ReadBlockDataFromCacheOrDisk(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    CBlockCache::BlockData data = blockcache.Get(pindex->GetBlockHash());
+    if (data)
+        return data;
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, consensusParams))
+        return data;
+    data = CBlockCache::Serialize(block);
+    blockcache.Put(pindex->GetBlockHash(), data);
+    return data;
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_BLOCKCACHE_H
+#define SMARTCASH_BLOCKCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+namespace Consensus { struct Params; }
+
+//! -blockcachesize default (MiB)
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+
+/**
+ * Bounded LRU cache of blocks in their serialized network form, keyed by
+ * block hash. A block is cached the first time it is served serialized, so
+ * the peers, REST and SAPI requests that follow for the same block are
+ * answered from memory instead of being read from disk, checked and
+ * serialized again for every request.
+ */
+class CBlockCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char> > BlockData;
+
+private:
+    struct CheapHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    typedef std::list<std::pair<uint256, BlockData> > EntryList;
+
+    mutable CCriticalSection cs;
+    //! Most recently used entries first
+    EntryList lruEntries;
+    std::unordered_map<uint256, EntryList::iterator, CheapHasher> mapEntries;
+    size_t nMaxSize;
+    size_t nSize;
+
+    void Trim();
+
+public:
+    explicit CBlockCache(size_t nMaxSizeIn = DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+    //! Set the maximum number of serialized bytes to keep, 0 disables the cache
+    void SetMaxSize(size_t nMaxSizeIn);
+    bool IsEnabled() const;
+
+    //! The serialized block, or an empty pointer if it is not cached
+    BlockData Get(const uint256& hash);
+    //! Deserialize a cached block, returns false if it is not cached
+    bool Get(const uint256& hash, CBlock& block);
+
+    void Put(const uint256& hash, const BlockData& data);
+
+    //! The block in the network serialization the cache holds
+    static BlockData Serialize(const CBlock& block);
+
+    void Clear();
+};
+
+extern CBlockCache blockcache;
+
+/** ReadBlockFromDisk which takes the block from the block cache if it is there. */
+bool ReadBlockFromCacheOrDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
+/** The serialized block from the block cache, read from disk and cached if it is not there yet. Empty if it can't be read. */
+CBlockCache::BlockData ReadBlockDataFromCacheOrDisk(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
+#endif // SMARTCASH_BLOCKCACHE_H
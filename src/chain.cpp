@@ -143,3 +143,24 @@ int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& fr
     }
     return sign * r.GetLow64();
 }
+
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    if (nUsed == SLAB_ENTRIES) {
+        vSlabs.push_back(static_cast<CBlockIndex*>(::operator new(SLAB_ENTRIES * sizeof(CBlockIndex))));
+        nUsed = 0;
+    }
+    return vSlabs.back() + nUsed++;
+}
+
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < vSlabs.size(); i++) {
+        size_t nEntries = (i + 1 == vSlabs.size()) ? nUsed : SLAB_ENTRIES;
+        for (size_t j = 0; j < nEntries; j++)
+            vSlabs[i][j].~CBlockIndex();
+        ::operator delete(vSlabs[i]);
+    }
+    vSlabs.clear();
+    nUsed = SLAB_ENTRIES;
+}
@@ -12,6 +12,7 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <new>
 #include <vector>
 
 static const int64_t MAX_FUTURE_BLOCK_TIME = 15 * 60;
@@ -158,8 +159,10 @@ enum BlockStatus: uint32_t {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
-    const uint256* phashBlock;
+    // The fields used by chain walks (GetAncestor, skip list, LastCommonAncestor),
+    // difficulty retargeting and chain selection come first so they share the
+    // first cache line of the entry. The rest is only read when the block
+    // itself is accessed.
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex* pprev;
@@ -170,40 +173,45 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
 
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! block header: time and target
+    unsigned int nTime;
+    unsigned int nBits;
 
     //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
     arith_uint256 nChainWork;
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied upon
-    unsigned int nTx;
+    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    const uint256* phashBlock;
 
     //! (memory only) Number of transactions in the chain up to and including this block.
     //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
+
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied upon
+    unsigned int nTx;
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
 
-    //! block header
+    //! block header: remaining fields
     int nVersion;
     uint256 hashMerkleRoot;
-    unsigned int nTime;
-    unsigned int nBits;
     unsigned int nNonce;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
-
     void SetNull()
     {
         phashBlock = NULL;
@@ -382,7 +390,7 @@ public:
         READWRITE(nNonce);
     }
 
-    uint256 GetBlockHash() const
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
@@ -391,7 +399,12 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
-        return block.GetHash();
+        return block;
+    }
+
+    uint256 GetBlockHash() const
+    {
+        return GetBlockHeader().GetHash();
     }
 
 
@@ -406,6 +419,43 @@ public:
     }
 };
 
+/**
+ * Slab allocator for the CBlockIndex entries of mapBlockIndex.
+ *
+ * Entries are constructed in contiguous slabs instead of one heap allocation
+ * each. With millions of entries this saves the per-allocation overhead and
+ * fragmentation, and keeps entries created together (e.g. while loading the
+ * block index or syncing headers) close in memory. Entries are never freed
+ * individually, only all at once by Clear().
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t SLAB_ENTRIES = 4096;
+
+    std::vector<CBlockIndex*> vSlabs;
+    //! Number of entries used in the last slab
+    size_t nUsed;
+
+    CBlockIndex* Allocate();
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : nUsed(SLAB_ENTRIES) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    CBlockIndex* Create() { return new (Allocate()) CBlockIndex(); }
+    CBlockIndex* Create(const CBlockHeader& block) { return new (Allocate()) CBlockIndex(block); }
+
+    /** Destroy all entries and release the slabs */
+    void Clear();
+
+    size_t size() const { return vSlabs.empty() ? 0 : (vSlabs.size() - 1) * SLAB_ENTRIES + nUsed; }
+    size_t DynamicMemoryUsage() const { return vSlabs.size() * SLAB_ENTRIES * sizeof(CBlockIndex); }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
@@ -0,0 +1,300 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/keccak256.h"
+
+#include "crypto/common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_AVX2)
+#define HAVE_KECCAK256_DISPATCH 1
+#endif
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace keccak256_avx2
+{
+void Short_4way(unsigned char* out, const unsigned char* in, size_t len);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal Keccak-f[1600] implementation.
+namespace keccak
+{
+static const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+uint64_t inline Rotl(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+
+/** One round from state A into state E. The lanes be, bi, go, ki, mi and sa
+ *  are kept complemented ("lane complementing"), which turns most of the
+ *  NOT operations of chi into plain AND/OR. */
+#define KECCAK_ROUND(A, E, rc) do { \
+    uint64_t Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa; \
+    uint64_t Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se; \
+    uint64_t Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si; \
+    uint64_t Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so; \
+    uint64_t Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su; \
+    uint64_t Da = Cu ^ Rotl(Ce, 1); \
+    uint64_t De = Ca ^ Rotl(Ci, 1); \
+    uint64_t Di = Ce ^ Rotl(Co, 1); \
+    uint64_t Do = Ci ^ Rotl(Cu, 1); \
+    uint64_t Du = Co ^ Rotl(Ca, 1); \
+    uint64_t B0, B1, B2, B3, B4; \
+    B0 = A##ba ^ Da; B1 = Rotl(A##ge ^ De, 44); B2 = Rotl(A##ki ^ Di, 43); \
+    B3 = Rotl(A##mo ^ Do, 21); B4 = Rotl(A##su ^ Du, 14); \
+    E##ba = B0 ^ (B1 | B2) ^ (rc); \
+    E##be = B1 ^ (~B2 | B3); \
+    E##bi = B2 ^ (B3 & B4); \
+    E##bo = B3 ^ (B4 | B0); \
+    E##bu = B4 ^ (B0 & B1); \
+    B0 = Rotl(A##bo ^ Do, 28); B1 = Rotl(A##gu ^ Du, 20); B2 = Rotl(A##ka ^ Da, 3); \
+    B3 = Rotl(A##me ^ De, 45); B4 = Rotl(A##si ^ Di, 61); \
+    E##ga = B0 ^ (B1 | B2); \
+    E##ge = B1 ^ (B2 & B3); \
+    E##gi = B2 ^ (B3 | ~B4); \
+    E##go = B3 ^ (B4 | B0); \
+    E##gu = B4 ^ (B0 & B1); \
+    B0 = Rotl(A##be ^ De, 1); B1 = Rotl(A##gi ^ Di, 6); B2 = Rotl(A##ko ^ Do, 25); \
+    B3 = Rotl(A##mu ^ Du, 8); B4 = Rotl(A##sa ^ Da, 18); \
+    E##ka = B0 ^ (B1 | B2); \
+    E##ke = B1 ^ (B2 & B3); \
+    E##ki = B2 ^ (~B3 & B4); \
+    E##ko = ~B3 ^ (B4 | B0); \
+    E##ku = B4 ^ (B0 & B1); \
+    B0 = Rotl(A##bu ^ Du, 27); B1 = Rotl(A##ga ^ Da, 36); B2 = Rotl(A##ke ^ De, 10); \
+    B3 = Rotl(A##mi ^ Di, 15); B4 = Rotl(A##so ^ Do, 56); \
+    E##ma = B0 ^ (B1 & B2); \
+    E##me = B1 ^ (B2 | B3); \
+    E##mi = B2 ^ (~B3 | B4); \
+    E##mo = ~B3 ^ (B4 & B0); \
+    E##mu = B4 ^ (B0 | B1); \
+    B0 = Rotl(A##bi ^ Di, 62); B1 = Rotl(A##go ^ Do, 55); B2 = Rotl(A##ku ^ Du, 39); \
+    B3 = Rotl(A##ma ^ Da, 41); B4 = Rotl(A##se ^ De, 2); \
+    E##sa = B0 ^ (~B1 & B2); \
+    E##se = ~B1 ^ (B2 | B3); \
+    E##si = B2 ^ (B3 & B4); \
+    E##so = B3 ^ (B4 | B0); \
+    E##su = B4 ^ (B0 & B1); \
+} while (0)
+
+/** Perform the Keccak-f[1600] permutation on s. */
+void Permute(uint64_t* s)
+{
+    uint64_t Aba = s[0], Abe = ~s[1], Abi = ~s[2], Abo = s[3], Abu = s[4];
+    uint64_t Aga = s[5], Age = s[6], Agi = s[7], Ago = ~s[8], Agu = s[9];
+    uint64_t Aka = s[10], Ake = s[11], Aki = ~s[12], Ako = s[13], Aku = s[14];
+    uint64_t Ama = s[15], Ame = s[16], Ami = ~s[17], Amo = s[18], Amu = s[19];
+    uint64_t Asa = ~s[20], Ase = s[21], Asi = s[22], Aso = s[23], Asu = s[24];
+    uint64_t Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku;
+    uint64_t Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu;
+
+    for (int round = 0; round < 24; round += 2) {
+        KECCAK_ROUND(A, E, RC[round]);
+        KECCAK_ROUND(E, A, RC[round + 1]);
+    }
+
+    s[0] = Aba; s[1] = ~Abe; s[2] = ~Abi; s[3] = Abo; s[4] = Abu;
+    s[5] = Aga; s[6] = Age; s[7] = Agi; s[8] = ~Ago; s[9] = Agu;
+    s[10] = Aka; s[11] = Ake; s[12] = ~Aki; s[13] = Ako; s[14] = Aku;
+    s[15] = Ama; s[16] = Ame; s[17] = ~Ami; s[18] = Amo; s[19] = Amu;
+    s[20] = ~Asa; s[21] = Ase; s[22] = Asi; s[23] = Aso; s[24] = Asu;
+}
+
+#undef KECCAK_ROUND
+
+/** XOR one rate-sized block into the state and permute. */
+void inline Absorb(uint64_t* s, const unsigned char* block)
+{
+    for (int i = 0; i < 17; ++i)
+        s[i] ^= ReadLE64(block + 8 * i);
+    Permute(s);
+}
+
+void inline Squeeze(const uint64_t* s, unsigned char* out)
+{
+    for (int i = 0; i < 4; ++i)
+        WriteLE64(out + 8 * i, s[i]);
+}
+
+/** Hash a single input shorter than the rate: it is one padded block
+ *  absorbed into the zero state, so the state can be loaded directly. */
+void Short(unsigned char* out, const unsigned char* in, size_t len)
+{
+    unsigned char block[CKeccak256::RATE] = {0};
+    memcpy(block, in, len);
+    block[len] ^= 0x01;
+    block[CKeccak256::RATE - 1] ^= 0x80;
+    uint64_t s[25] = {0};
+    Absorb(s, block);
+    Squeeze(s, out);
+}
+
+void Short_4way(unsigned char* out, const unsigned char* in, size_t len)
+{
+    for (int i = 0; i < 4; ++i)
+        Short(out + 32 * i, in + len * i, len);
+}
+
+} // namespace keccak
+
+typedef void (*ShortFourWayFn)(unsigned char*, const unsigned char*, size_t);
+
+ShortFourWayFn Short_4way = keccak::Short_4way;
+
+bool SelfTest() {
+    // Keccak-256 of the empty string and of "abc".
+    static const unsigned char empty_hash[32] = {
+        0xc5, 0xd2, 0x46, 0x01, 0x86, 0xf7, 0x23, 0x3c, 0x92, 0x7e, 0x7d, 0xb2, 0xdc, 0xc7, 0x03, 0xc0,
+        0xe5, 0x00, 0xb6, 0x53, 0xca, 0x82, 0x27, 0x3b, 0x7b, 0xfa, 0xd8, 0x04, 0x5d, 0x85, 0xa4, 0x70
+    };
+    static const unsigned char abc_hash[32] = {
+        0x4e, 0x03, 0x65, 0x7a, 0xea, 0x45, 0xa9, 0x4f, 0xc7, 0xd4, 0x7b, 0xa8, 0x26, 0xc8, 0xd6, 0x67,
+        0xc0, 0xd1, 0xe6, 0xe3, 0x3a, 0x64, 0xa0, 0x36, 0xec, 0x44, 0xf5, 0x8f, 0xa1, 0x2d, 0x6c, 0x45
+    };
+    unsigned char out[32];
+    CKeccak256().Finalize(out);
+    if (memcmp(out, empty_hash, 32)) return false;
+    CKeccak256().Write((const unsigned char*)"abc", 3).Finalize(out);
+    if (memcmp(out, abc_hash, 32)) return false;
+
+    // The multi-lane implementation must agree with the one-at-a-time code
+    // for header-sized inputs.
+    unsigned char in[4 * 80];
+    for (int i = 0; i < 4 * 80; ++i)
+        in[i] = (unsigned char)(i * 7 + 3);
+    unsigned char out1[32 * 4], out2[32 * 4];
+    Short_4way(out1, in, 80);
+    for (int i = 0; i < 4; ++i)
+        CKeccak256().Write(in + 80 * i, 80).Finalize(out2 + 32 * i);
+    return memcmp(out1, out2, 32 * 4) == 0;
+}
+
+#if defined(HAVE_KECCAK256_DISPATCH)
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+}
+
+/** Whether the OS saves the AVX register state on context switches */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+std::string Keccak256AutoDetect(keccak256_implementation::UseImplementation use_implementation)
+{
+    std::string ret = "64bit-lc";
+    Short_4way = keccak::Short_4way;
+#if defined(HAVE_KECCAK256_DISPATCH)
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    uint32_t nMaxLeaf = eax;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    have_xsave = (ecx >> 27) & 1;
+    have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        enabled_avx = AVXEnabled();
+    }
+    if (nMaxLeaf >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+    }
+
+#if defined(ENABLE_AVX2)
+    if (have_avx2 && have_avx && enabled_avx && (use_implementation & keccak256_implementation::USE_AVX2)) {
+        Short_4way = keccak256_avx2::Short_4way;
+        ret += ",avx2(4way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+////// Keccak-256
+
+CKeccak256::CKeccak256()
+{
+    Reset();
+}
+
+CKeccak256& CKeccak256::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end = data + len;
+    if (bufsize && bufsize + len >= RATE) {
+        // Fill the buffer, and process it.
+        memcpy(buf + bufsize, data, RATE - bufsize);
+        data += RATE - bufsize;
+        keccak::Absorb(s, buf);
+        bufsize = 0;
+    }
+    while ((size_t)(end - data) >= RATE) {
+        // Process full blocks directly from the source.
+        keccak::Absorb(s, data);
+        data += RATE;
+    }
+    if (end > data) {
+        // Fill the buffer with what remains.
+        memcpy(buf + bufsize, data, end - data);
+        bufsize += end - data;
+    }
+    return *this;
+}
+
+void CKeccak256::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    memset(buf + bufsize, 0, RATE - bufsize);
+    buf[bufsize] ^= 0x01;
+    buf[RATE - 1] ^= 0x80;
+    keccak::Absorb(s, buf);
+    keccak::Squeeze(s, hash);
+}
+
+CKeccak256& CKeccak256::Reset()
+{
+    memset(s, 0, sizeof(s));
+    bufsize = 0;
+    return *this;
+}
+
+void Keccak256Short(unsigned char* out, const unsigned char* in, size_t len, size_t count)
+{
+    assert(len < CKeccak256::RATE);
+    while (count >= 4) {
+        Short_4way(out, in, len);
+        out += 32 * 4;
+        in += len * 4;
+        count -= 4;
+    }
+    while (count > 0) {
+        keccak::Short(out, in, len);
+        out += 32;
+        in += len;
+        --count;
+    }
+}
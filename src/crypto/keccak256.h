@@ -0,0 +1,55 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_CRYPTO_KECCAK256_H
+#define SMARTCASH_CRYPTO_KECCAK256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for Keccak-256 with the original Keccak padding, as used
+ *  for SmartCash block hashes (same output as sph_keccak256). */
+class CKeccak256
+{
+public:
+    static const size_t OUTPUT_SIZE = 32;
+    static const size_t RATE = 136;
+
+private:
+    uint64_t s[25];
+    unsigned char buf[RATE];
+    size_t bufsize;
+
+public:
+    CKeccak256();
+    CKeccak256& Write(const unsigned char* data, size_t len);
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+    CKeccak256& Reset();
+};
+
+namespace keccak256_implementation {
+enum UseImplementation : uint8_t {
+    USE_STANDARD = 0,          //!< Portable implementation only
+    USE_AVX2 = 1 << 0,         //!< AVX2 multi-lane kernel, if the CPU has it
+    USE_ALL = USE_AVX2
+};
+}
+
+/** Autodetect the best available Keccak-256 implementation.
+ *  Returns the name of the implementation. Tests may restrict the
+ *  implementations used, to check each of them.
+ */
+std::string Keccak256AutoDetect(keccak256_implementation::UseImplementation use_implementation = keccak256_implementation::USE_ALL);
+
+/** Compute the Keccak-256 hashes of several short inputs of equal length,
+ *  e.g. 80-byte block headers.
+ *  output:  pointer to a count*32 byte output buffer
+ *  input:   pointer to a count*len byte input buffer
+ *  len:     the length of each input, less than CKeccak256::RATE
+ *  count:   the number of hashes to compute.
+ */
+void Keccak256Short(unsigned char* output, const unsigned char* input, size_t len, size_t count);
+
+#endif // SMARTCASH_CRYPTO_KECCAK256_H
@@ -0,0 +1,140 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way Keccak-256 of short inputs using AVX2, one 64-bit lane per input.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace keccak256_avx2 {
+namespace {
+
+static const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Xor(Xor(x, y), Xor(z, w), v); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+template<int n> __m256i inline Rotl(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+/** One round from state A into state E. AVX2 has a native and-not, so
+ *  chi needs no lane complementing here. */
+#define KECCAK_ROUND(A, E, rc) do { \
+    __m256i Ca = Xor(A##ba, A##ga, A##ka, A##ma, A##sa); \
+    __m256i Ce = Xor(A##be, A##ge, A##ke, A##me, A##se); \
+    __m256i Ci = Xor(A##bi, A##gi, A##ki, A##mi, A##si); \
+    __m256i Co = Xor(A##bo, A##go, A##ko, A##mo, A##so); \
+    __m256i Cu = Xor(A##bu, A##gu, A##ku, A##mu, A##su); \
+    __m256i Da = Xor(Cu, Rotl<1>(Ce)); \
+    __m256i De = Xor(Ca, Rotl<1>(Ci)); \
+    __m256i Di = Xor(Ce, Rotl<1>(Co)); \
+    __m256i Do = Xor(Ci, Rotl<1>(Cu)); \
+    __m256i Du = Xor(Co, Rotl<1>(Ca)); \
+    __m256i B0, B1, B2, B3, B4; \
+    B0 = Xor(A##ba, Da); B1 = Rotl<44>(Xor(A##ge, De)); B2 = Rotl<43>(Xor(A##ki, Di)); \
+    B3 = Rotl<21>(Xor(A##mo, Do)); B4 = Rotl<14>(Xor(A##su, Du)); \
+    E##ba = Xor(B0, AndNot(B1, B2), _mm256_set1_epi64x(rc)); \
+    E##be = Xor(B1, AndNot(B2, B3)); \
+    E##bi = Xor(B2, AndNot(B3, B4)); \
+    E##bo = Xor(B3, AndNot(B4, B0)); \
+    E##bu = Xor(B4, AndNot(B0, B1)); \
+    B0 = Rotl<28>(Xor(A##bo, Do)); B1 = Rotl<20>(Xor(A##gu, Du)); B2 = Rotl<3>(Xor(A##ka, Da)); \
+    B3 = Rotl<45>(Xor(A##me, De)); B4 = Rotl<61>(Xor(A##si, Di)); \
+    E##ga = Xor(B0, AndNot(B1, B2)); \
+    E##ge = Xor(B1, AndNot(B2, B3)); \
+    E##gi = Xor(B2, AndNot(B3, B4)); \
+    E##go = Xor(B3, AndNot(B4, B0)); \
+    E##gu = Xor(B4, AndNot(B0, B1)); \
+    B0 = Rotl<1>(Xor(A##be, De)); B1 = Rotl<6>(Xor(A##gi, Di)); B2 = Rotl<25>(Xor(A##ko, Do)); \
+    B3 = Rotl<8>(Xor(A##mu, Du)); B4 = Rotl<18>(Xor(A##sa, Da)); \
+    E##ka = Xor(B0, AndNot(B1, B2)); \
+    E##ke = Xor(B1, AndNot(B2, B3)); \
+    E##ki = Xor(B2, AndNot(B3, B4)); \
+    E##ko = Xor(B3, AndNot(B4, B0)); \
+    E##ku = Xor(B4, AndNot(B0, B1)); \
+    B0 = Rotl<27>(Xor(A##bu, Du)); B1 = Rotl<36>(Xor(A##ga, Da)); B2 = Rotl<10>(Xor(A##ke, De)); \
+    B3 = Rotl<15>(Xor(A##mi, Di)); B4 = Rotl<56>(Xor(A##so, Do)); \
+    E##ma = Xor(B0, AndNot(B1, B2)); \
+    E##me = Xor(B1, AndNot(B2, B3)); \
+    E##mi = Xor(B2, AndNot(B3, B4)); \
+    E##mo = Xor(B3, AndNot(B4, B0)); \
+    E##mu = Xor(B4, AndNot(B0, B1)); \
+    B0 = Rotl<62>(Xor(A##bi, Di)); B1 = Rotl<55>(Xor(A##go, Do)); B2 = Rotl<39>(Xor(A##ku, Du)); \
+    B3 = Rotl<41>(Xor(A##ma, Da)); B4 = Rotl<2>(Xor(A##se, De)); \
+    E##sa = Xor(B0, AndNot(B1, B2)); \
+    E##se = Xor(B1, AndNot(B2, B3)); \
+    E##si = Xor(B2, AndNot(B3, B4)); \
+    E##so = Xor(B3, AndNot(B4, B0)); \
+    E##su = Xor(B4, AndNot(B0, B1)); \
+} while (0)
+
+void Permute(__m256i* s)
+{
+    __m256i Aba = s[0], Abe = s[1], Abi = s[2], Abo = s[3], Abu = s[4];
+    __m256i Aga = s[5], Age = s[6], Agi = s[7], Ago = s[8], Agu = s[9];
+    __m256i Aka = s[10], Ake = s[11], Aki = s[12], Ako = s[13], Aku = s[14];
+    __m256i Ama = s[15], Ame = s[16], Ami = s[17], Amo = s[18], Amu = s[19];
+    __m256i Asa = s[20], Ase = s[21], Asi = s[22], Aso = s[23], Asu = s[24];
+    __m256i Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku;
+    __m256i Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu;
+
+    for (int round = 0; round < 24; round += 2) {
+        KECCAK_ROUND(A, E, RC[round]);
+        KECCAK_ROUND(E, A, RC[round + 1]);
+    }
+
+    s[0] = Aba; s[1] = Abe; s[2] = Abi; s[3] = Abo; s[4] = Abu;
+    s[5] = Aga; s[6] = Age; s[7] = Agi; s[8] = Ago; s[9] = Agu;
+    s[10] = Aka; s[11] = Ake; s[12] = Aki; s[13] = Ako; s[14] = Aku;
+    s[15] = Ama; s[16] = Ame; s[17] = Ami; s[18] = Amo; s[19] = Amu;
+    s[20] = Asa; s[21] = Ase; s[22] = Asi; s[23] = Aso; s[24] = Asu;
+}
+
+#undef KECCAK_ROUND
+
+}
+
+void Short_4way(unsigned char* out, const unsigned char* in, size_t len)
+{
+    static const size_t RATE = 136;
+    unsigned char block[4][RATE];
+    for (int i = 0; i < 4; ++i) {
+        memset(block[i], 0, RATE);
+        memcpy(block[i], in + len * i, len);
+        block[i][len] ^= 0x01;
+        block[i][RATE - 1] ^= 0x80;
+    }
+
+    // The input fits in one block, so the state is that block and zeros.
+    __m256i a[25];
+    for (int j = 0; j < 17; ++j)
+        a[j] = _mm256_set_epi64x(ReadLE64(block[3] + 8 * j), ReadLE64(block[2] + 8 * j), ReadLE64(block[1] + 8 * j), ReadLE64(block[0] + 8 * j));
+    for (int j = 17; j < 25; ++j)
+        a[j] = _mm256_setzero_si256();
+
+    Permute(a);
+
+    alignas(32) uint64_t lanes[4][4];
+    for (int j = 0; j < 4; ++j)
+        _mm256_store_si256((__m256i*)lanes[j], a[j]);
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            WriteLE64(out + 32 * i + 8 * j, lanes[j][i]);
+}
+
+}
+
+#endif
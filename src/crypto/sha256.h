@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,28 @@ public:
     CSHA256& Reset();
 };
 
+namespace sha256_implementation {
+enum UseImplementation : uint8_t {
+    USE_STANDARD = 0,          //!< Portable implementation only
+    USE_SSE4 = 1 << 0,         //!< SSE4.1 4-way double-SHA256 kernel, if the CPU has it
+    USE_AVX2 = 1 << 1,         //!< AVX2 8-way double-SHA256 kernel, if the CPU has it
+    USE_SHANI = 1 << 2,        //!< SHA-NI transform, if the CPU has it
+    USE_ALL = USE_SSE4 | USE_AVX2 | USE_SHANI
+};
+}
+
+/** Autodetect the best available SHA256 implementation.
+ *  Returns the name of the implementation. Tests may restrict the
+ *  implementations used, to check each of them.
+ */
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation = sha256_implementation::USE_ALL);
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  Output and input may point to the same buffer.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -6,7 +6,12 @@
 
 #include "util.h"
 #include "random.h"
+#include "sync.h"
 
+#include <set>
+#include <stdio.h>
+
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
 #include <leveldb/cache.h>
@@ -73,13 +78,111 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static const char* const DB_PROFILE_NAMES[] = {"chainstate", "blockindex", "indexes", "rewards"};
+
+static CDBProfile DefaultDBProfile(const std::string& strName)
+{
+    CDBProfile profile;
+    profile.strName = strName;
+    if (strName == "indexes") {
+        // The address, spent, deposit and timestamp indexes. Their keys share
+        // long prefixes and are mostly read by range scans, so larger
+        // compressed blocks pay off.
+        profile.fCompression = true;
+        profile.nBlockSize = 16 * 1024;
+    } else if (strName == "rewards") {
+        profile.fCompression = true;
+    }
+    // The chainstate is obfuscated and looked up at random, and the block
+    // index is dominated by random txindex lookups; compressing them would
+    // cost CPU on every cache miss for little space.
+    return profile;
+}
+
+/** Apply one -dbprofile argument ("<db>:<opt>=<n>,...") to profile if it
+ *  names the same database. */
+static bool ApplyDBProfileArg(const std::string& strArg, CDBProfile& profile, std::string& strError)
+{
+    size_t nColon = strArg.find(':');
+    std::string strName = strArg.substr(0, nColon);
+    if (std::find(std::begin(DB_PROFILE_NAMES), std::end(DB_PROFILE_NAMES), strName) == std::end(DB_PROFILE_NAMES)) {
+        strError = strprintf("unknown database '%s'", strName);
+        return false;
+    }
+    if (nColon == std::string::npos) {
+        strError = strprintf("no options given for '%s'", strName);
+        return false;
+    }
+    std::string strOptions = strArg.substr(nColon + 1);
+    std::vector<std::string> vOptions;
+    boost::split(vOptions, strOptions, boost::is_any_of(","));
+    CDBProfile result = profile;
+    for (const std::string& strOption : vOptions) {
+        size_t nEqual = strOption.find('=');
+        std::string strKey = strOption.substr(0, nEqual);
+        int64_t n;
+        if (nEqual == std::string::npos || !ParseInt64(strOption.substr(nEqual + 1), &n)) {
+            strError = strprintf("invalid option '%s' for '%s'", strOption, strName);
+            return false;
+        }
+        if (strKey == "compression" && (n == 0 || n == 1)) {
+            result.fCompression = n;
+        } else if (strKey == "blocksize" && n >= 1024 && n <= 4 * 1024 * 1024) {
+            result.nBlockSize = n;
+        } else if (strKey == "writebuffer" && (n == 0 || (n >= 64 * 1024 && n <= 1024 * 1024 * 1024))) {
+            result.nWriteBuffer = n;
+        } else if (strKey == "bloombits" && n >= 0 && n <= 32) {
+            result.nBloomBits = n;
+        } else {
+            strError = strprintf("invalid option '%s' for '%s'", strOption, strName);
+            return false;
+        }
+    }
+    if (strName == profile.strName)
+        profile = result;
+    return true;
+}
+
+CDBProfile GetDBProfile(const std::string& strName)
+{
+    CDBProfile profile = DefaultDBProfile(strName);
+    std::string strError;
+    if (mapMultiArgs.count("-dbprofile")) {
+        for (const std::string& strArg : mapMultiArgs.at("-dbprofile"))
+            ApplyDBProfileArg(strArg, profile, strError);
+    }
+    return profile;
+}
+
+bool CheckDBProfileArgs(std::string& strError)
+{
+    if (!mapMultiArgs.count("-dbprofile"))
+        return true;
+    for (const std::string& strArg : mapMultiArgs.at("-dbprofile")) {
+        CDBProfile profile;
+        if (!ApplyDBProfileArg(strArg, profile, strError))
+            return false;
+    }
+    return true;
+}
+
+bool DBCompressionAvailable()
+{
+#ifdef USE_SNAPPY
+    return true;
+#else
+    return false;
+#endif
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile& profile)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
+    options.write_buffer_size = profile.nWriteBuffer ? profile.nWriteBuffer : nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_size = profile.nBlockSize;
+    options.filter_policy = profile.nBloomBits ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.max_open_files = 64;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -90,14 +193,18 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+static CCriticalSection cs_dbwrappers;
+static std::set<const CDBWrapper*> setDBWrappers;
+
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSizeIn, bool fMemory, bool fWipe, bool obfuscate, const std::string& strProfile)
+    : profile(GetDBProfile(strProfile)), nCacheSize(nCacheSizeIn), nReads(0), nBytesRead(0), nBatches(0), nBytesWritten(0)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -110,6 +217,13 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
         }
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
+        pathDB = path;
+    }
+    if (!strProfile.empty()) {
+        LogPrintf("Using LevelDB profile %s: compression=%d blocksize=%u writebuffer=%u bloombits=%d\n", profile.strName,
+            profile.fCompression, options.block_size, options.write_buffer_size, profile.nBloomBits);
+        if (profile.fCompression && !DBCompressionAvailable())
+            LogPrintf("Warning: LevelDB was built without Snappy, %s is stored uncompressed\n", profile.strName);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -139,10 +253,17 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(cs_dbwrappers);
+    setDBWrappers.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_dbwrappers);
+        setDBWrappers.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -159,9 +280,64 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
+    nBatches++;
+    nBytesWritten += batch.SizeEstimate();
     return true;
 }
 
+CDBWrapperStats CDBWrapper::GetStats() const
+{
+    CDBWrapperStats stats;
+    stats.profile = profile;
+    stats.strPath = pathDB.string();
+    stats.nCacheSize = nCacheSize;
+    stats.nDiskSize = 0;
+    if (!pathDB.empty()) {
+        try {
+            for (boost::filesystem::directory_iterator it(pathDB); it != boost::filesystem::directory_iterator(); ++it) {
+                if (boost::filesystem::is_regular_file(it->status()))
+                    stats.nDiskSize += boost::filesystem::file_size(it->path());
+            }
+        } catch (const boost::filesystem::filesystem_error& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+    }
+
+    std::string strValue;
+    for (int nLevel = 0; pdb->GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), &strValue); nLevel++)
+        stats.vFilesPerLevel.push_back(atoi(strValue));
+
+    // One line per level after a three line header, see DBImpl::GetProperty
+    stats.nCompactionRead = stats.nCompactionWritten = 0;
+    if (pdb->GetProperty("leveldb.stats", &strValue)) {
+        std::vector<std::string> vLines;
+        boost::split(vLines, strValue, boost::is_any_of("\n"));
+        for (size_t i = 3; i < vLines.size(); i++) {
+            int nLevel, nFiles;
+            double dSize, dTime, dRead, dWritten;
+            if (sscanf(vLines[i].c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nFiles, &dSize, &dTime, &dRead, &dWritten) == 6) {
+                stats.nCompactionRead += dRead * 1048576;
+                stats.nCompactionWritten += dWritten * 1048576;
+            }
+        }
+    }
+
+    stats.nReads = nReads;
+    stats.nBytesRead = nBytesRead;
+    stats.nBatches = nBatches;
+    stats.nBytesWritten = nBytesWritten;
+    return stats;
+}
+
+std::vector<CDBWrapperStats> GetDBWrapperStats()
+{
+    std::vector<CDBWrapperStats> vStats;
+    LOCK(cs_dbwrappers);
+    for (const CDBWrapper* pdbw : setDBWrappers)
+        vStats.push_back(pdbw->GetStats());
+    return vStats;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -195,6 +371,12 @@ void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::Next() { piter->Next(); }
 void CDBIterator::Prev() { piter->Prev(); }
 
+void CDBIterator::CountRead(size_t nBytes)
+{
+    parent.nReads++;
+    parent.nBytesRead += nBytes;
+}
+
 namespace dbwrapper_private {
 
 void HandleError(const leveldb::Status& status)
@@ -12,6 +12,8 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <atomic>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -28,6 +30,54 @@ public:
 
 class CDBWrapper;
 
+/** LevelDB settings of one kind of database, see GetDBProfile(). */
+struct CDBProfile
+{
+    //! name used by -dbprofile and getdbstats
+    std::string strName;
+    //! compress table blocks with Snappy (a no-op when LevelDB was built without it)
+    bool fCompression;
+    //! approximate size of the uncompressed data in one table block
+    size_t nBlockSize;
+    //! size of the memtable, 0 to use a quarter of the database cache
+    size_t nWriteBuffer;
+    //! bits per key of the bloom filter, 0 to disable it
+    int nBloomBits;
+
+    CDBProfile() : fCompression(false), nBlockSize(4096), nWriteBuffer(0), nBloomBits(10) {}
+};
+
+/** Return the settings for database strName: the built-in defaults
+ *  overridden by any -dbprofile arguments. */
+CDBProfile GetDBProfile(const std::string& strName);
+
+/** Check the -dbprofile arguments, setting strError on the first bad one. */
+bool CheckDBProfileArgs(std::string& strError);
+
+/** Whether the bundled LevelDB was built with Snappy compression. */
+bool DBCompressionAvailable();
+
+/** Usage and on-disk figures of an open database, see getdbstats. */
+struct CDBWrapperStats
+{
+    CDBProfile profile;
+    std::string strPath;
+    size_t nCacheSize;
+    uint64_t nDiskSize;
+    std::vector<int> vFilesPerLevel;
+    //! bytes read and written by compactions, summed over all levels
+    uint64_t nCompactionRead;
+    uint64_t nCompactionWritten;
+    //! point lookups plus the values read by iterators
+    uint64_t nReads;
+    uint64_t nBytesRead;
+    uint64_t nBatches;
+    uint64_t nBytesWritten;
+};
+
+/** Collect the statistics of all open databases. */
+std::vector<CDBWrapperStats> GetDBWrapperStats();
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -128,6 +178,12 @@ public:
         parent(_parent), piter(_piter) { };
     ~CDBIterator();
 
+private:
+    //! add a value read through this iterator to the statistics of the parent
+    void CountRead(size_t nBytes);
+
+public:
+
     bool Valid();
 
     void SeekToFirst();
@@ -160,6 +216,7 @@ public:
 
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
+        CountRead(slValue.size());
         try {
             CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
@@ -179,6 +236,7 @@ public:
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBIterator;
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -212,6 +270,20 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! settings the database was opened with
+    CDBProfile profile;
+
+    //! where the database lives, empty for memory-only databases
+    boost::filesystem::path pathDB;
+
+    size_t nCacheSize;
+
+    //! lookups and iterator values, bytes read, write batches and bytes written, for getdbstats
+    mutable std::atomic<uint64_t> nReads;
+    mutable std::atomic<uint64_t> nBytesRead;
+    std::atomic<uint64_t> nBatches;
+    std::atomic<uint64_t> nBytesWritten;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -220,10 +292,13 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] strProfile  Name of the settings profile, see GetDBProfile().
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const std::string& strProfile = "");
     ~CDBWrapper();
 
+    CDBWrapperStats GetStats() const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -234,12 +309,14 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        nReads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        nBytesRead += strValue.size();
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(obfuscate_key);
@@ -268,6 +345,7 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        nReads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -5,6 +5,7 @@
 #include "chainparams.h"
 #include "dsnotificationinterface.h"
 #include "smartnode/instantx.h"
+#include "smartnode/smartnodemaintenance.h"
 #include "smartnode/smartnodeman.h"
 #include "smartnode/smartnodepayments.h"
 #include "smartnode/smartnodesync.h"
@@ -42,6 +43,7 @@ void CDSNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, con
     mnodeman.UpdatedBlockTip(pindexNew);
     instantsend.UpdatedBlockTip(pindexNew);
     mnpayments.UpdatedBlockTip(pindexNew, connman);
+    smartnodeMaintenance.NotifyListChanged();
 
 // WIP-VOTING uncomment
 //    smartVoting.UpdatedBlockTip(pindexNew, connman);
@@ -50,5 +52,11 @@ void CDSNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, con
 void CDSNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
 {
     instantsend.SyncTransaction(tx, pblock);
+    mnodeman.SyncTransaction(tx, pblock);
     //CPrivateSend::SyncTransaction(tx, pblock);
 }
+
+void CDSNotificationInterface::BlockDisconnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    mnodeman.BlockDisconnected(block);
+}
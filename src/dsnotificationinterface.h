@@ -22,6 +22,7 @@ protected:
     void NotifyHeaderTip(const CBlockIndex *pindexNew, bool fInitialDownload) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock) override;
+    void BlockDisconnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) override;
 
 private:
     CConnman& connman;
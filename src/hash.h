@@ -8,7 +8,7 @@
 
 #include "crypto/ripemd160.h"
 #include "crypto/sha256.h"
-#include "crypto/sph_keccak.h"
+#include "crypto/keccak256.h"
 #include "prevector.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -16,6 +16,7 @@
 #include "version.h"
 #include <openssl/sha.h>
 
+#include <algorithm>
 #include <vector>
 
 typedef uint256 ChainCode;
@@ -129,17 +130,16 @@ inline uint160 Hash160(const prevector<N, unsigned char>& vch)
     return Hash160(vch.begin(), vch.end());
 }
 
+/** Compute the Keccak-256 hash of an object. */
 template<typename T1>
 inline uint256 HashKeccak(const T1 pbegin, const T1 pend)
-{        {
-    sph_keccak256_context ctx_keccak;
-    static unsigned char pblank[1];
+{
+    static const unsigned char pblank[1] = {};
     uint256 hash;
-    sph_keccak256_init(&ctx_keccak);
-    sph_keccak256 (&ctx_keccak, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_keccak256_close(&ctx_keccak, static_cast<void*>(&hash));
+    CKeccak256().Write(pbegin == pend ? pblank : (const unsigned char*)&pbegin[0], (pend - pbegin) * sizeof(pbegin[0]))
+                .Finalize((unsigned char*)&hash);
     return hash;
-}        }
+}
 
 template<typename T1, typename T2>
 inline uint256 Hash4(const T1 p1begin, const T1 p1end,
@@ -202,6 +202,65 @@ public:
     }
 };
 
+/** Reads the first nSize bytes of an underlying stream, while computing the
+ *  double SHA-256 (as Hash()) of everything read. */
+template<typename Source>
+class CHashVerifier
+{
+private:
+    Source* source;
+    CHash256 hasher;
+    uint64_t nBytesRead;
+    uint64_t nBytesTotal;
+
+public:
+    int nType;
+    int nVersion;
+
+    CHashVerifier(Source* sourceIn, uint64_t nSize) : source(sourceIn), nBytesRead(0), nBytesTotal(nSize), nType(sourceIn->GetType()), nVersion(sourceIn->GetVersion()) {}
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+    //! bytes left to read
+    uint64_t size() const { return nBytesTotal - nBytesRead; }
+
+    CHashVerifier& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CHashVerifier::read: end of data");
+        source->read(pch, nSize);
+        hasher.Write((const unsigned char*)pch, nSize);
+        nBytesRead += nSize;
+        return (*this);
+    }
+
+    CHashVerifier& ignore(size_t nSize)
+    {
+        char data[1024];
+        while (nSize > 0) {
+            size_t nNow = std::min<size_t>(nSize, sizeof(data));
+            read(data, nNow);
+            nSize -= nNow;
+        }
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash() {
+        uint256 result;
+        hasher.Finalize((unsigned char*)&result);
+        return result;
+    }
+
+    template<typename T>
+    CHashVerifier<Source>& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Compute the 256-bit hash of an object's serialization. */
 template<typename T>
 uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL_VERSION)
@@ -479,10 +479,65 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
     assert(!replySent && req);
-    // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
+    SendReply(nStatus);
+}
+
+/** Writer that serializes JSON into a reply evbuffer.
+ * Output is staged in a small local buffer so the evbuffer is only touched
+ * once per chunk instead of once per token.
+ */
+class HTTPReplyWriter : public UniValueWriter
+{
+private:
+    struct evbuffer* evb;
+    char buf[16384];
+    size_t nUsed;
+
+public:
+    HTTPReplyWriter(struct evbuffer* evbIn) : evb(evbIn), nUsed(0) {}
+    ~HTTPReplyWriter() { Flush(); }
+
+    void append(const char* data, size_t len)
+    {
+        if (nUsed + len > sizeof(buf)) {
+            Flush();
+            if (len > sizeof(buf)) {
+                evbuffer_add(evb, data, len);
+                return;
+            }
+        }
+        memcpy(buf + nUsed, data, len);
+        nUsed += len;
+    }
+
+    void Flush()
+    {
+        if (nUsed) {
+            evbuffer_add(evb, buf, nUsed);
+            nUsed = 0;
+        }
+    }
+};
+
+void HTTPRequest::WriteJSONReply(int nStatus, const UniValue& obj, unsigned int prettyIndent)
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    {
+        HTTPReplyWriter writer(evb);
+        obj.write(writer, prettyIndent);
+        writer.append("\n", 1);
+    }
+    SendReply(nStatus);
+}
+
+void HTTPRequest::SendReply(int nStatus)
+{
+    // Send event to main http thread to send reply message
     HTTPEvent* ev = new HTTPEvent(eventBase, true,
         boost::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
@@ -20,6 +20,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+class UniValue;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -114,6 +115,19 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write HTTP reply with a JSON body.
+     * obj is serialized directly into the reply buffer followed by a newline,
+     * without building the document as a string first.
+     *
+     * @note Same rules as WriteReply.
+     */
+    void WriteJSONReply(int nStatus, const UniValue& obj, unsigned int prettyIndent = 0);
+
+private:
+    /** Hand the request back to the main thread to send the buffered reply */
+    void SendReply(int nStatus);
 };
 
 /** Event handler closure.
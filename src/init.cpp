@@ -12,11 +12,14 @@
 #include "addrman.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/keccak256.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -45,6 +48,7 @@
 #include "version.h"
 #include "warnings.h"
 #ifdef ENABLE_WALLET
+#include "wallet/consolidate.h"
 #include "wallet/db.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
@@ -60,6 +64,7 @@
 // #endif
 #include "smartnode/smartnodepayments.h"
 #include "smartnode/smartnodesync.h"
+#include "smartnode/smartnodemaintenance.h"
 #include "smartnode/smartnodeman.h"
 #include "smartnode/smartnodeconfig.h"
 #include "smartnode/spork.h"
@@ -258,38 +263,17 @@ void PrepareShutdown()
 #endif
     //GenerateBitcoins(false, 0, Params(), *g_connman);
     MapPort(false);
+    blockTemplateCache.Disconnect();
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
     g_connman.reset();
 
     // STORE DATA CACHES INTO SERIALIZED DAT FILES
 
-    bool fCache;
-
-    fCache = GetBoolArg("-cachenodelist", DEFAULT_CACHE_NODES);
-    if( fCache ){
-        CFlatDB<CSmartnodeMan> flatdb("sncache.dat", "magicSmartnodeCache");
-        flatdb.Dump(mnodeman);
-    }
-
-    fCache = GetBoolArg("-cachewinners", DEFAULT_CACHE_WINNERS);
-    if( fCache ){
-        CFlatDB<CSmartnodePayments> flatdb("snpayments.dat", "magicSmartnodePaymentsCache");
-        flatdb.Dump(mnpayments);
-    }
-
-    fCache = GetBoolArg("-cachefulfilled", DEFAULT_CACHE_NETFULLFILLED);
-    if( fCache ){
-        CFlatDB<CNetFulfilledRequestManager> flatdb("netfulfilled.dat", "magicFulfilledCache");
-        flatdb.Dump(netfulfilledman);
-    }
+    DumpSmartnodeCaches();
 
     /* WIP-VOTING uncomment
-    fCache = GetBoolArg("-cachevoting", DEFAULT_CACHE_VOTING);
-    if( fCache ){
-        CFlatDB<CSmartVotingManager> flatdb("smartvoting.dat", "magicSmartVotingCache");
-        flatdb.Dump(smartVoting);
-    }
+    bool fCache;
 
     fCache = GetBoolArg("-sapi", false);
     if( fCache ){
@@ -324,6 +308,8 @@ void PrepareShutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete pindexdb;
+        pindexdb = NULL;
         delete prewards;
         prewards = NULL;
     }
@@ -435,9 +421,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-? or -help", _("Show options and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(_("Keep up to <n> megabytes of recently served blocks in memory for serving them again to peers, REST and SAPI (0 to disable, default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-cacheflushinterval=<n>", strprintf(_("Write the smartnode caches to disk every <n> seconds once synced, 0 = only at shutdown (default: %u)"), DEFAULT_CACHE_FLUSH_INTERVAL));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
@@ -449,6 +437,8 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbprofile=<db>:<opt>=<n>,...", _("Override the LevelDB settings of database <db> (chainstate, blockindex, indexes or rewards). "
+        "Options are compression=<0|1>, blocksize=<bytes>, writebuffer=<bytes> (0 = a quarter of its cache) and bloombits=<n>. Can be specified multiple times"));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
@@ -457,6 +447,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parheaders=<n>", strprintf(_("Set the number of threads helping to hash received block headers (0 to %d, 0 = hash on the calling thread only, default: %d)"),
+        MAX_HEADERHASH_THREADS, DEFAULT_HEADERHASH_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -472,6 +464,7 @@ std::string HelpMessage(HelpMessageMode mode)
     // txindex option is currently disabled, defaults to true.
     //strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
     strUsage += HelpMessageOpt("-depositindex", strprintf(_("Maintain a address deposit index, used by the SAPI and the getdeposits rpc call (not yet implemented) (default: %u)"), DEFAULT_DEPOSITINDEX));
+    strUsage += HelpMessageOpt("-indexqueue=<n>", strprintf(_("Let up to <n> connected blocks wait for their address, spent and deposit index updates to be written (default: %u)"), DEFAULT_INDEX_QUEUE_SIZE));
 
     strUsage += HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -491,6 +484,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
     strUsage += HelpMessageOpt("-minpeerprotocol=<n>", strprintf(_("Minimimum protocol <n> to connect (default: %u)"), MIN_PEER_PROTO_VERSION));
+    strUsage += HelpMessageOpt("-msgthreads=<n>", strprintf(_("Number of threads processing peer messages, each peer is always handled by the same thread (1 to %d, default: %d)"), MAX_MSGPROC_THREADS, DEFAULT_MSGPROC_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -500,6 +494,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-rpcserialversion", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef HAVE_SYS_EPOLL_H
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("How to wait for socket events, <mode> can be epoll or select. select limits connections to FD_SETSIZE (default: %s)"), GetSocketEventsModeName(DEFAULT_SOCKETEVENTS)));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -527,6 +524,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubaddress=<address>", _("Enable publish credit/debit events of addresses registered with watchaddresses in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -547,7 +545,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-bip9params=deployment:start:end", "Use given start/end times for specified bip9 deployment (regtest-only)");
     }
-    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
+    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, miner, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -606,6 +604,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), BaseParams(CBaseChainParams::MAIN).RPCPort(), BaseParams(CBaseChainParams::TESTNET).RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcparallelbatch", strprintf(_("Execute read-only calls of a JSON-RPC batch in parallel (default: %u)"), DEFAULT_RPC_PARALLEL_BATCH));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads used by -rpcparallelbatch (default: %d)"), DEFAULT_RPC_BATCH_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
@@ -617,6 +617,13 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sapiworkqueue=<n>",_("Set the queue for SAPI requests (default: 16)"));
     strUsage += HelpMessageOpt("-sapiservertimeout=<n>",_("Set the seconds before SAPI timeout (default: 30)"));
     strUsage += HelpMessageOpt("-sapiwhitelist=<ip>",_("Whitelist ip for SAPI"));
+
+    strUsage += HelpMessageGroup(_("Smartnode options:"));
+    strUsage += HelpMessageOpt("-cachefulfilled", strprintf(_("Keep the fulfilled network requests in netfulfilled.dat across restarts (default: %u)"), DEFAULT_CACHE_NETFULLFILLED));
+    strUsage += HelpMessageOpt("-cachenodelist", strprintf(_("Keep the smartnode list in sncache.dat across restarts (default: %u)"), DEFAULT_CACHE_NODES));
+    strUsage += HelpMessageOpt("-cachewinners", strprintf(_("Keep the smartnode payment votes in snpayments.dat across restarts (default: %u)"), DEFAULT_CACHE_WINNERS));
+    strUsage += HelpMessageOpt("-smartnode", _("Run as a smartnode (default: 0)"));
+    strUsage += HelpMessageOpt("-smartnodeprivkey=<key>", _("Set the smartnode private key"));
     return strUsage;
 }
 
@@ -1111,13 +1118,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Override minimum protocol version if specified
     minPeerProtoVersion = GetArg("-minpeerprotocol", MIN_PEER_PROTO_VERSION);
 
+    SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
+    if (mapArgs.count("-socketevents") && !ParseSocketEventsMode(GetArg("-socketevents", ""), socketEventsMode))
+        return InitError(strprintf(_("Invalid -socketevents mode: '%s'"), GetArg("-socketevents", "")));
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     int nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (socketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1149,6 +1161,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-whitelistalwaysrelay", false))
         InitWarning(_("Unsupported argument -whitelistalwaysrelay ignored, use -whitelistrelay and/or -whitelistforcerelay."));
 
+    std::string strDBProfileError;
+    if (!CheckDBProfileArgs(strDBProfileError))
+        return InitError(strprintf(_("Invalid -dbprofile: %s"), strDBProfileError));
+
     // Checkmempool and checkblockindex default to true in regtest mode
     int ratio = std::min<int>(std::max<int>(GetArg("-checkmempool", chainparams.DefaultConsistencyChecks() ? 1 : 0), 0), 1000000);
     if (ratio != 0) {
@@ -1178,6 +1194,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nHeaderHashThreads = std::max(0, std::min((int)GetArg("-parheaders", DEFAULT_HEADERHASH_THREADS), MAX_HEADERHASH_THREADS));
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1302,6 +1320,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    // Select the fastest SHA256 and Keccak-256 implementations the CPU supports
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string keccak256_algo = Keccak256AutoDetect();
+    LogPrintf("Using the '%s' Keccak-256 implementation\n", keccak256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1359,6 +1383,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    LogPrintf("Using %u additional threads for header hashing\n", nHeaderHashThreads);
+    for (int i=0; i<nHeaderHashThreads; i++)
+        threadGroup.create_thread(&ThreadHeaderHash);
+
     if (!sporkManager.SetSporkAddress(GetArg("-sporkaddr", Params().SporkAddress())))
         return InitError(_("Invalid spork address specified with -sporkaddr"));
 
@@ -1599,6 +1627,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     pdsNotificationInterface = new CDSNotificationInterface(connman);
     RegisterValidationInterface(pdsNotificationInterface);
 
+    // Keep the block template selection in sync with the mempool
+    blockTemplateCache.Connect(mempool);
+
     if (mapArgs.count("-maxuploadtarget")) {
         connman.SetMaxOutboundTarget(GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)*1024*1024);
     }
@@ -1644,6 +1675,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // txindex option is currently disabled, defaults to true.
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, ( (1 || GetBoolArg("-txindex", DEFAULT_TXINDEX)) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nIndexDBCache = std::min(nTotalCache / 8, nMaxIndexDBCache << 20);
+    nTotalCache -= nIndexDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1651,8 +1684,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for address/spent/deposit index database\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    int64_t nBlockCacheSize = std::max(GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE), (int64_t)0) << 20;
+    blockcache.SetMaxSize(nBlockCacheSize);
+    LogPrintf("* Using %.1fMiB for the serialized block cache\n", nBlockCacheSize * (1.0 / 1024 / 1024));
 
 
     int64_t nRewardsCache = (GetArg("-rewardsdbcache", nRewardsDefaultDbCache) << 20);
@@ -1730,8 +1767,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete pindexdb;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
+                pindexdb = new CIndexDB(nIndexDBCache, false, fReindex, GetArg("-indexqueue", DEFAULT_INDEX_QUEUE_SIZE));
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
@@ -1803,6 +1842,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
+
+                uiInterface.InitMessage(_("Catching up indexes..."));
+                if (!CatchUpIndexes(chainparams)) {
+                    strLoadError = _("Error catching up the address, spent and deposit indexes");
+                    break;
+                }
             } catch (const std::exception& e) {
                 if (fDebug) LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1842,6 +1887,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    threadGroup.create_thread(&ThreadIndexWriter);
+
     // As LoadBlockIndex can take several minutes, it's possible the user
     // requested to kill the GUI during the last operation. If so, exit.
     // As the program has not fully started yet, Shutdown() is possibly overkill.
@@ -2163,8 +2210,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         if( fCache ){
             strDBName = "sncache.dat";
             uiInterface.InitMessage(_("Loading smartnode cache..."));
-            CFlatDB<CSmartnodeMan> flatdb(strDBName, "magicSmartnodeCache");
-            if(!flatdb.Load(mnodeman)) {
+            if(!flatlogSmartnodes.Load(mnodeman)) {
                 InitError(_("Failed to load smartnode cache from") + "\n" + (pathDB / strDBName).string());
                 try {
                     boost::filesystem::remove((pathDB / strDBName).string());
@@ -2178,8 +2224,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         if( fCache ){
             strDBName = "snpayments.dat";
             uiInterface.InitMessage(_("Loading smartnode payment cache..."));
-            CFlatDB<CSmartnodePayments> flatdb(strDBName, "magicSmartnodePaymentsCache");
-            if(!flatdb.Load(mnpayments)) {
+            if(!flatlogSmartnodePayments.Load(mnpayments)) {
                 InitWarning(_("Failed to load smartnode payments cache from") + "\n" + (pathDB / strDBName).string());
                 try {
                     boost::filesystem::remove((pathDB / strDBName).string());
@@ -2193,8 +2238,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         if( fCache ){
             strDBName = "netfulfilled.dat";
             uiInterface.InitMessage(_("Loading fulfilled requests cache..."));
-            CFlatDB<CNetFulfilledRequestManager> flatdb(strDBName, "magicFulfilledCache");
-            if(!flatdb.Load(netfulfilledman)) {
+            if(!flatlogFulfilledRequests.Load(netfulfilledman)) {
                 InitError(_("Failed to load fulfilled requests cache from") + "\n" + (pathDB / strDBName).string());
                 try {
                     boost::filesystem::remove((pathDB / strDBName).string());
@@ -2231,12 +2275,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // GetMainSignals().UpdatedBlockTip(chainActive.Tip());
     pdsNotificationInterface->InitializeCurrentBlockTip();
 
-    // ********************************************************* Step 11d: start smartcash threads
+    // ********************************************************* Step 11d: schedule smartcash maintenance
 
-    threadGroup.create_thread(boost::bind(&ThreadSmartnode, boost::ref(*g_connman)));
-
-//  WIP-VOTING uncomment
-//    threadGroup.create_thread(&ThreadSmartVoting);
+    smartnodeMaintenance.Start(threadGroup, *g_connman);
+#ifdef ENABLE_WALLET
+    walletConsolidator.SetScheduler(scheduler);
+#endif
 
     // ********************************************************* Step 12: start node
 
@@ -2281,6 +2325,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.uiInterface = &uiInterface;
     connOptions.nSendBufferMaxSize = 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.socketEventsMode = socketEventsMode;
+    connOptions.nMsgProcThreads = std::max(1, std::min((int)GetArg("-msgthreads", DEFAULT_MSGPROC_THREADS), MAX_MSGPROC_THREADS));
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
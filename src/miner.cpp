@@ -13,6 +13,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/keccak256.h"
 #include "hash.h"
 #include "net.h"
 #include "policy/policy.h"
@@ -32,6 +34,7 @@
 #include "smartmining/miningpayments.h"
 
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -131,38 +134,257 @@ void BlockAssembler::resetBlock()
     blockFinished = false;
 }
 
-CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CSmartAddress &signingAddress)
+CBlockTemplateCache blockTemplateCache;
+
+CBlockTemplateCache::CBlockTemplateCache()
+    : pool(NULL), fSelectionValid(false), nSelectionHeight(0), nLockTimeCutoff(0), nSelectionDeltasUpdated(0), nBlockMaxSize(0), nTxMaxCount(0),
+      nBlockSize(0), nBlockSigOps(0), nFees(0), fCoinbaseValid(false), nCoinbaseHeight(0), nCoinbaseGeneration(0)
 {
-    resetBlock();
-    pblocktemplate.reset(new CBlockTemplate());
+}
 
-    if(!pblocktemplate.get())
-        return NULL;
-    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
-    LOCK(cs_main);
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    nHeight = pindexPrev->nHeight + 1;
+void CBlockTemplateCache::Connect(CTxMemPool& poolIn)
+{
+    LOCK(cs);
+    pool = &poolIn;
+    ClearSelection();
+    pool->NotifyEntryAdded.connect(boost::bind(&CBlockTemplateCache::TransactionAddedToMempool, this, _1));
+    pool->NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateCache::TransactionRemovedFromMempool, this, _1));
+}
 
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vin[0].scriptSig = CScript() << OP_0 << OP_0;
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+void CBlockTemplateCache::Disconnect()
+{
+    LOCK(cs);
+    if (!pool)
+        return;
+    pool->NotifyEntryAdded.disconnect(boost::bind(&CBlockTemplateCache::TransactionAddedToMempool, this, _1));
+    pool->NotifyEntryRemoved.disconnect(boost::bind(&CBlockTemplateCache::TransactionRemovedFromMempool, this, _1));
+    pool = NULL;
+    ClearSelection();
+    fCoinbaseValid = false;
+}
+
+void CBlockTemplateCache::ClearSelection()
+{
+    fSelectionValid = false;
+    vSelected.clear();
+    setSelected.clear();
+    nBlockSize = 1000;
+    nBlockSigOps = 100;
+    nFees = 0;
+    minFeeRate = CFeeRate();
+}
+
+void CBlockTemplateCache::RemoveFromSelection(CTxMemPool::txiter iter)
+{
+    // The selection is in block order, so every selected descendant of iter
+    // comes after it and spends an output of a transaction dropped before it.
+    // Only the selected entries are touched, the mempool links of iter may
+    // already point to removed entries.
+    std::set<uint256> setRemoved;
+    std::vector<CTxMemPool::txiter> vKeep;
+    vKeep.reserve(vSelected.size());
+    BOOST_FOREACH(CTxMemPool::txiter it, vSelected) {
+        const CTransaction& tx = it->GetTx();
+        bool fRemove = it == iter;
+        if (!fRemove && !setRemoved.empty()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (setRemoved.count(txin.prevout.hash)) {
+                    fRemove = true;
+                    break;
+                }
+            }
+        }
+        if (!fRemove) {
+            vKeep.push_back(it);
+            continue;
+        }
+        setRemoved.insert(tx.GetHash());
+        setSelected.erase(it);
+        nBlockSize -= it->GetTxSize();
+        nBlockSigOps -= it->GetSigOpCount();
+        nFees -= it->GetFee();
+        LogPrint("miner", "CBlockTemplateCache::%s -- dropped tx=%s\n", __func__, tx.GetHash().ToString());
+    }
+    vSelected.swap(vKeep);
+}
+
+void CBlockTemplateCache::GetCoinbase(CBlockIndex* pindexPrev, const CScript& scriptPubKeyIn, const CSmartAddress& signingAddress,
+                                      CMutableTransaction& txNew, CBlock& block)
+{
+    {
+        LOCK(cs);
+        if (fCoinbaseValid && hashCoinbasePrev == pindexPrev->GetBlockHash() &&
+            coinbaseScript == scriptPubKeyIn && coinbaseSigningAddress == signingAddress) {
+            txNew = coinbaseTx;
+            block.outSignature = outSignature;
+            block.voutSmartNodes = voutSmartNodes;
+            block.voutSmartHives = voutSmartHives;
+            block.voutSmartRewards = voutSmartRewards;
+            return;
+        }
+    }
+
+    // The payment modules take their own locks, don't hold cs while asking them.
+    // A payment vote for this block arriving in the meantime bumps the
+    // generation, the result is then not kept.
+    int nHeight = pindexPrev->nHeight + 1;
+    uint64_t nGeneration;
+    {
+        LOCK(cs);
+        nCoinbaseHeight = nHeight;
+        nGeneration = nCoinbaseGeneration;
+    }
+
+    txNew = CMutableTransaction();
+    txNew.vin.resize(1);
+    txNew.vin[0].prevout.SetNull();
+    txNew.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    txNew.vout.resize(1);
+    txNew.vout[0].scriptPubKey = scriptPubKeyIn;
 
     CAmount blockReward = GetBlockValue(nHeight, 0, pindexPrev->GetBlockTime());
 
     // Add the SmartMining payout for the current block.
-    SmartMining::FillPayment(coinbaseTx, nHeight, pindexPrev, blockReward, pblock->outSignature, signingAddress);
+    SmartMining::FillPayment(txNew, nHeight, pindexPrev, blockReward, block.outSignature, signingAddress);
 
     // Add the SmartHive payout for the current block.
-    SmartHivePayments::FillPayments(coinbaseTx,nHeight, pindexPrev->GetBlockTime(), blockReward, pblock->voutSmartHives);
+    SmartHivePayments::FillPayments(txNew, nHeight, pindexPrev->GetBlockTime(), blockReward, block.voutSmartHives);
 
     // Add smartnode payments if there are any pending at the current block.
-    SmartNodePayments::FillPayments(coinbaseTx, nHeight, blockReward, pblock->voutSmartNodes);
+    SmartNodePayments::FillPayments(txNew, nHeight, blockReward, block.voutSmartNodes);
 
     // Add SmartReward payments if there are any pending at the current block.
-    SmartRewardPayments::FillPayments(coinbaseTx, nHeight, pindexPrev->GetBlockTime(), pblock->voutSmartRewards);
+    SmartRewardPayments::FillPayments(txNew, nHeight, pindexPrev->GetBlockTime(), block.voutSmartRewards);
+
+    LOCK(cs);
+    if (!pool || nCoinbaseHeight != nHeight || nCoinbaseGeneration != nGeneration)
+        return;
+    fCoinbaseValid = true;
+    hashCoinbasePrev = pindexPrev->GetBlockHash();
+    coinbaseScript = scriptPubKeyIn;
+    coinbaseSigningAddress = signingAddress;
+    coinbaseTx = txNew;
+    outSignature = block.outSignature;
+    voutSmartNodes = block.voutSmartNodes;
+    voutSmartHives = block.voutSmartHives;
+    voutSmartRewards = block.voutSmartRewards;
+}
+
+bool CBlockTemplateCache::IsSelectionValid(const CBlockIndex* pindexPrev, int64_t nLockTimeCutoffIn, uint64_t nBlockMaxSizeIn, unsigned int nTxMaxCountIn) const
+{
+    AssertLockHeld(cs);
+    // Without notifications we can't tell whether the selected entries still exist.
+    // Transactions skipped as non-final aren't offered again, and prioritised
+    // ones may now outbid the selection, so both force a rebuild.
+    return pool && fSelectionValid && hashSelectionPrev == pindexPrev->GetBlockHash() &&
+           nLockTimeCutoff == nLockTimeCutoffIn && nSelectionDeltasUpdated == pool->GetDeltasUpdated() &&
+           nBlockMaxSize == nBlockMaxSizeIn && nTxMaxCount == nTxMaxCountIn;
+}
+
+void CBlockTemplateCache::ResetSelection(const CBlockIndex* pindexPrev, int64_t nLockTimeCutoffIn, uint64_t nBlockMaxSizeIn, unsigned int nTxMaxCountIn)
+{
+    AssertLockHeld(cs);
+    ClearSelection();
+    fSelectionValid = true;
+    hashSelectionPrev = pindexPrev->GetBlockHash();
+    nSelectionHeight = pindexPrev->nHeight + 1;
+    nLockTimeCutoff = nLockTimeCutoffIn;
+    nSelectionDeltasUpdated = pool ? pool->GetDeltasUpdated() : 0;
+    nBlockMaxSize = nBlockMaxSizeIn;
+    nTxMaxCount = nTxMaxCountIn;
+}
+
+void CBlockTemplateCache::AddToSelection(CTxMemPool::txiter iter)
+{
+    AssertLockHeld(cs);
+    CFeeRate feeRate(iter->GetModifiedFee(), iter->GetTxSize());
+    if (vSelected.empty() || feeRate < minFeeRate)
+        minFeeRate = feeRate;
+    vSelected.push_back(iter);
+    setSelected.insert(iter);
+    nBlockSize += iter->GetTxSize();
+    nBlockSigOps += iter->GetSigOpCount();
+    nFees += iter->GetFee();
+}
+
+void CBlockTemplateCache::InvalidateSelection()
+{
+    LOCK(cs);
+    ClearSelection();
+}
+
+void CBlockTemplateCache::InvalidateCoinbase(int nHeight)
+{
+    LOCK(cs);
+    if (nHeight != nCoinbaseHeight)
+        return;
+    LogPrint("miner", "CBlockTemplateCache::%s -- payment vote for height=%d\n", __func__, nHeight);
+    fCoinbaseValid = false;
+    nCoinbaseGeneration++;
+}
+
+void CBlockTemplateCache::TransactionAddedToMempool(const CTxMemPoolEntry& entry)
+{
+    LOCK(cs);
+    if (!pool || !fSelectionValid)
+        return;
+
+    AssertLockHeld(pool->cs);
+    CTxMemPool::txiter iter = pool->mapTx.find(entry.GetTx().GetHash());
+    if (iter == pool->mapTx.end())
+        return;
+
+    const CTransaction& tx = entry.GetTx();
+    if (tx.IsCoinBase() || !IsFinalTx(tx, nSelectionHeight, nLockTimeCutoff))
+        return;
+    BOOST_FOREACH(CTxMemPool::txiter parent, pool->GetMemPoolParents(iter)) {
+        if (!setSelected.count(parent))
+            return;
+    }
+    if (nBlockSize + entry.GetTxSize() >= nBlockMaxSize ||
+        nBlockSigOps + entry.GetSigOpCount() >= MAX_BLOCK_SIGOPS_COST ||
+        (nTxMaxCount > 0 && vSelected.size() >= nTxMaxCount)) {
+        // Appending can't make room for it, rebuild if it would displace a
+        // cheaper selected transaction.
+        if (CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()) > minFeeRate) {
+            LogPrint("miner", "CBlockTemplateCache::%s -- tx=%s outbids the selection\n", __func__, tx.GetHash().ToString());
+            ClearSelection();
+        }
+        return;
+    }
+
+    AddToSelection(iter);
+    LogPrint("miner", "CBlockTemplateCache::%s -- appended tx=%s\n", __func__, tx.GetHash().ToString());
+}
+
+void CBlockTemplateCache::TransactionRemovedFromMempool(const CTxMemPoolEntry& entry)
+{
+    LOCK(cs);
+    if (!pool || !fSelectionValid)
+        return;
+
+    CTxMemPool::txiter iter = pool->mapTx.find(entry.GetTx().GetHash());
+    if (iter != pool->mapTx.end() && setSelected.count(iter)) {
+        LogPrint("miner", "CBlockTemplateCache::%s -- selected tx=%s left the mempool\n", __func__, entry.GetTx().GetHash().ToString());
+        RemoveFromSelection(iter);
+    }
+}
+
+CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CSmartAddress &signingAddress)
+{
+    resetBlock();
+    pblocktemplate.reset(new CBlockTemplate());
+
+    if(!pblocktemplate.get())
+        return NULL;
+    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
+    LOCK(cs_main);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    nHeight = pindexPrev->nHeight + 1;
+
+    // Coinbase with all SmartMining, SmartHive, smartnode and SmartReward payees
+    CMutableTransaction coinbaseTx;
+    blockTemplateCache.GetCoinbase(pindexPrev, scriptPubKeyIn, signingAddress, coinbaseTx, *pblock);
 
     // Add coinbase tx as first transaction here. Will
     pblock->vtx.push_back(coinbaseTx);
@@ -184,24 +406,7 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, co
     unsigned int nBlockMinSize = GetArg("-blockminsize", 0);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
-
-    // This vector will be sorted into a priority queue:
-    vector<TxCoinAgePriority> vecPriority;
-    TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
     bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
 
     {
         LOCK(mempool.cs);
@@ -218,164 +423,185 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, co
                                   ? nMedianTimePast
                                   : pblock->GetBlockTime();
 
-        bool fPriorityBlock = nBlockPrioritySize > 0;
-        if (fPriorityBlock) {
-            vecPriority.reserve(mempool.mapTx.size());
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                 mi != mempool.mapTx.end(); ++mi)
-            {
-                double dPriority = mi->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-            }
-            std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-        }
-
-        CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-        CTxMemPool::txiter iter;
-
-        while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
+        // The payment modules lock their maps while blockTemplateCache.cs is
+        // taken from a payment vote, so don't hold it through TestBlockValidity.
+        CAmount nFees = 0;
         {
-            bool priorityTx = false;
-            if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
-                priorityTx = true;
-                iter = vecPriority.front().second;
-                actualPriority = vecPriority.front().first;
-                std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                vecPriority.pop_back();
-            }
-            else if (clearedTxs.empty()) { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else {  // try to add a previously postponed child tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
+            LOCK(blockTemplateCache.cs);
+            // Collect memory pool transactions into the selection, unless the one
+            // of the last template is still good for this tip.
+            if (!blockTemplateCache.IsSelectionValid(pindexPrev, nLockTimeCutoff, nBlockMaxSize, nTxMaxCount)) {
+                blockTemplateCache.ResetSelection(pindexPrev, nLockTimeCutoff, nBlockMaxSize, nTxMaxCount);
 
-            if (inBlock.count(iter)) {
-                LogPrintf("skip, due to exist!\n");
-                continue; // could have been added to the priorityBlock
-            }
+                CTxMemPool::setEntries waitSet;
 
-            const CTransaction& tx = iter->GetTx();
-            LogPrintf("Trying to add tx=%s\n", tx.GetHash().ToString());
+                // This vector will be sorted into a priority queue:
+                vector<TxCoinAgePriority> vecPriority;
+                TxCoinAgePriorityCompare pricomparer;
+                std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+                typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
+                double actualPriority = -1;
 
-            bool fOrphan = false;
-            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-            {
-                if (!inBlock.count(parent)) {
-                    fOrphan = true;
-                    break;
+                std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
+                int lastFewTxs = 0;
+
+                bool fPriorityBlock = nBlockPrioritySize > 0;
+                if (fPriorityBlock) {
+                    vecPriority.reserve(mempool.mapTx.size());
+                    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+                         mi != mempool.mapTx.end(); ++mi)
+                    {
+                        double dPriority = mi->GetPriority(nHeight);
+                        CAmount dummy;
+                        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+                        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+                    }
+                    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
                 }
-            }
-            if (fOrphan) {
-                if (priorityTx)
-                    waitPriMap.insert(std::make_pair(iter,actualPriority));
-                else waitSet.insert(iter);
-                LogPrintf("skip tx=%s, due to fOrphan=%s\n", tx.GetHash().ToString(), fOrphan);
-                continue;
-            }
 
-            unsigned int nTxSize = iter->GetTxSize();
-            if (fPriorityBlock &&
-                (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
-                fPriorityBlock = false;
-                waitPriMap.clear();
-            }
+                CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
+                CTxMemPool::txiter iter;
 
-            if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-                    LogPrintf("tx=%s, stop due to size overweight", tx.GetHash().ToString());
-                    LogPrintf("nBlockSize=%s\n", nBlockSize);
-                    LogPrintf("nBlockMaxSize=%s\n", nBlockMaxSize);
-                    break;
-                }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
-                if (nBlockSize > nBlockMaxSize - 1000) {
-                    lastFewTxs++;
-                }
-                LogPrintf("skip tx=%s\n", tx.GetHash().ToString());
-                LogPrintf("nBlockSize=%s\n", nBlockSize);
-                LogPrintf("nBlockMaxSize=%s\n", nBlockMaxSize);
-                continue;
-            }
-            if (tx.IsCoinBase()) {
-                LogPrintf("skip tx=%s, coinbase tx\n", tx.GetHash().ToString());
-                continue;
-            }
+                while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
+                {
+                    bool priorityTx = false;
+                    if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
+                        priorityTx = true;
+                        iter = vecPriority.front().second;
+                        actualPriority = vecPriority.front().first;
+                        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                        vecPriority.pop_back();
+                    }
+                    else if (clearedTxs.empty()) { // add tx with next highest score
+                        iter = mempool.mapTx.project<0>(mi);
+                        mi++;
+                    }
+                    else {  // try to add a previously postponed child tx
+                        iter = clearedTxs.top();
+                        clearedTxs.pop();
+                    }
 
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff)) {
-                LogPrintf("skip tx=%s, not IsFinalTx\n", tx.GetHash().ToString());
-                continue;
-            }
+                    if (blockTemplateCache.IsSelected(iter)) {
+                        continue; // could have been added to the priorityBlock
+                    }
 
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            LogPrintf("nTxSigOps=%s\n", nTxSigOps);
-            LogPrintf("nBlockSigOps=%s\n", nBlockSigOps);
-            LogPrintf("MAX_BLOCK_SIGOPS_COST=%s\n", MAX_BLOCK_SIGOPS_COST);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_COST) {
-                if (nBlockSigOps > MAX_BLOCK_SIGOPS_COST - 2) {
-                    LogPrintf("tx=%s, stop due to cross fee\n", tx.GetHash().ToString());
-                    break;
-                }
-                LogPrintf("skip tx=%s, nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_COST\n", tx.GetHash().ToString());
-                continue;
-            }
-            CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOpsCost.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-            LogPrintf("added to block=%s\n", tx.GetHash().ToString());
-            if (fPrintPriority)
-            {
-                double dPriority = iter->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                          dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
-            }
+                    const CTransaction& tx = iter->GetTx();
+                    uint64_t nBlockSize = blockTemplateCache.GetBlockSize();
+                    unsigned int nBlockSigOps = blockTemplateCache.GetBlockSigOps();
 
-            inBlock.insert(iter);
+                    bool fOrphan = false;
+                    BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
+                    {
+                        if (!blockTemplateCache.IsSelected(parent)) {
+                            fOrphan = true;
+                            break;
+                        }
+                    }
+                    if (fOrphan) {
+                        if (priorityTx)
+                            waitPriMap.insert(std::make_pair(iter,actualPriority));
+                        else waitSet.insert(iter);
+                        LogPrint("miner", "skip tx=%s, parent not in block yet\n", tx.GetHash().ToString());
+                        continue;
+                    }
 
-            // Add transactions that depend on this one to the priority queue
-            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-            {
-                if (fPriorityBlock) {
-                    waitPriIter wpiter = waitPriMap.find(child);
-                    if (wpiter != waitPriMap.end()) {
-                        vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-                        std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                        waitPriMap.erase(wpiter);
+                    unsigned int nTxSize = iter->GetTxSize();
+                    if (fPriorityBlock &&
+                        (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
+                        fPriorityBlock = false;
+                        waitPriMap.clear();
                     }
-                }
-                else {
-                    if (waitSet.count(child)) {
-                        clearedTxs.push(child);
-                        waitSet.erase(child);
+
+                    if (nBlockSize + nTxSize >= nBlockMaxSize) {
+                        if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
+                            LogPrint("miner", "stop at tx=%s, block full nBlockSize=%u nBlockMaxSize=%u\n", tx.GetHash().ToString(), nBlockSize, nBlockMaxSize);
+                            break;
+                        }
+                        // Once we're within 1000 bytes of a full block, only look at 50 more txs
+                        // to try to fill the remaining space.
+                        if (nBlockSize > nBlockMaxSize - 1000) {
+                            lastFewTxs++;
+                        }
+                        LogPrint("miner", "skip tx=%s, too large nBlockSize=%u nBlockMaxSize=%u\n", tx.GetHash().ToString(), nBlockSize, nBlockMaxSize);
+                        continue;
+                    }
+                    if (tx.IsCoinBase()) {
+                        LogPrint("miner", "skip tx=%s, coinbase tx\n", tx.GetHash().ToString());
+                        continue;
+                    }
+
+                    if (!IsFinalTx(tx, nHeight, nLockTimeCutoff)) {
+                        LogPrint("miner", "skip tx=%s, not IsFinalTx\n", tx.GetHash().ToString());
+                        continue;
+                    }
+
+                    unsigned int nTxSigOps = iter->GetSigOpCount();
+                    if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_COST) {
+                        if (nBlockSigOps > MAX_BLOCK_SIGOPS_COST - 2) {
+                            LogPrint("miner", "stop at tx=%s, block sigops limit reached\n", tx.GetHash().ToString());
+                            break;
+                        }
+                        LogPrint("miner", "skip tx=%s, nTxSigOps=%u nBlockSigOps=%u\n", tx.GetHash().ToString(), nTxSigOps, nBlockSigOps);
+                        continue;
+                    }
+
+                    blockTemplateCache.AddToSelection(iter);
+                    LogPrint("miner", "added to block=%s\n", tx.GetHash().ToString());
+
+                    // Add transactions that depend on this one to the priority queue
+                    BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
+                    {
+                        if (fPriorityBlock) {
+                            waitPriIter wpiter = waitPriMap.find(child);
+                            if (wpiter != waitPriMap.end()) {
+                                vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
+                                std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                                waitPriMap.erase(wpiter);
+                            }
+                        }
+                        else {
+                            if (waitSet.count(child)) {
+                                clearedTxs.push(child);
+                                waitSet.erase(child);
+                            }
+                        }
+                    }
+
+                    if(blockTemplateCache.GetSelection().size() >= nTxMaxCount && nTxMaxCount > 0){
+                        LogPrint("miner", "stop at tx=%s, over the max tx count set\n", tx.GetHash().ToString());
+                        break;
                     }
                 }
             }
 
-            if(nBlockTx >= nTxMaxCount && nTxMaxCount > 0){
-                LogPrintf("skip tx=%s, over the max tx count set\n", tx.GetHash().ToString());
-                break;
+            BOOST_FOREACH(CTxMemPool::txiter iter, blockTemplateCache.GetSelection())
+            {
+                const CTransaction& tx = iter->GetTx();
+                pblock->vtx.push_back(tx);
+                pblocktemplate->vTxFees.push_back(iter->GetFee());
+                pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCount());
+                if (fPrintPriority)
+                {
+                    double dPriority = iter->GetPriority(nHeight);
+                    CAmount dummy;
+                    mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
+                    LogPrintf("priority %.1f fee %s txid %s\n",
+                              dPriority , CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(), tx.GetHash().ToString());
+                }
             }
-        }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
+            uint64_t nBlockSize = blockTemplateCache.GetBlockSize();
+            uint64_t nBlockTx = blockTemplateCache.GetSelection().size();
+            unsigned int nBlockSigOps = blockTemplateCache.GetBlockSigOps();
+            nFees = blockTemplateCache.GetFees();
+
+            nLastBlockTx = nBlockTx;
+            nLastBlockSize = nBlockSize;
+            LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
 
-        // Finally now that we know the fees add them to the mining reward!
-        pblock->vtx[0].vout[0].nValue += nFees;
+            // Finally now that we know the fees add them to the mining reward!
+            pblock->vtx[0].vout[0].nValue += nFees;
+        }
 
         // Fill in header
         pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
@@ -387,6 +613,8 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, co
 
         CValidationState state;
         if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+            // Don't hand out the same broken selection again
+            blockTemplateCache.InvalidateSelection();
             throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
         }
     }
@@ -801,6 +1029,39 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = txCoinbase;
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);}
 
+bool ScanHeaderNonces(CBlockHeader& header, const arith_uint256& hashTarget, uint32_t nCount)
+{
+    // Hash the candidates in batches so the multi-lane Keccak-256 kernel can be used
+    static const uint32_t BATCH = 8;
+    static const size_t HEADER_SIZE = 80;
+    unsigned char in[BATCH * HEADER_SIZE];
+    unsigned char out[BATCH * CKeccak256::OUTPUT_SIZE];
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    assert(ss.size() == HEADER_SIZE);
+    for (uint32_t i = 0; i < BATCH; i++)
+        memcpy(in + i * HEADER_SIZE, &ss[0], HEADER_SIZE);
+
+    while (nCount > 0) {
+        uint32_t n = std::min(nCount, BATCH);
+        for (uint32_t i = 0; i < n; i++)
+            WriteLE32(in + i * HEADER_SIZE + HEADER_SIZE - 4, header.nNonce + i);
+        Keccak256Short(out, in, HEADER_SIZE, n);
+        for (uint32_t i = 0; i < n; i++) {
+            uint256 hash;
+            memcpy(hash.begin(), out + i * CKeccak256::OUTPUT_SIZE, CKeccak256::OUTPUT_SIZE);
+            if (UintToArith256(hash) <= hashTarget) {
+                header.nNonce += i;
+                return true;
+            }
+        }
+        header.nNonce += n;
+        nCount -= n;
+    }
+    return false;
+}
+
 
 static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainparams)
 {
@@ -882,32 +1143,21 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
             while (true)
             {
-                unsigned int nHashesDone = 0;
-
-                uint256 hash;
-                while (true)
+                // Scan up to the next multiple of 256 nonces
+                if (ScanHeaderNonces(*pblock, hashTarget, 0x100 - (pblock->nNonce & 0xFF)))
                 {
-                    hash = pblock->GetHash();
-                    if (UintToArith256(hash) <= hashTarget)
-                    {
-                        // Found a solution
-                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        LogPrintf("SmartCashMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
-                        ProcessBlockFound(pblock, chainparams);
-                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                        coinbaseScript->KeepScript();
-
-                        // In regression test mode, stop mining after a block is found. This
-                        // allows developers to controllably generate a block on demand.
-                        if (chainparams.MineBlocksOnDemand())
-                            throw boost::thread_interrupted();
-
-                        break;
-                    }
-                    pblock->nNonce += 1;
-                    nHashesDone += 1;
-                    if ((pblock->nNonce & 0xFF) == 0)
-                        break;
+                    // Found a solution
+                    uint256 hash = pblock->GetHash();
+                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                    LogPrintf("SmartCashMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
+                    ProcessBlockFound(pblock, chainparams);
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                    coinbaseScript->KeepScript();
+
+                    // In regression test mode, stop mining after a block is found. This
+                    // allows developers to controllably generate a block on demand.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
                 }
 
                 // Check for stop or if block needs to be rebuilt
@@ -15,6 +15,7 @@
 #include "boost/multi_index/ordered_index.hpp"
 #include "smarthive/hive.h"
 
+class arith_uint256;
 class CBlockIndex;
 class CChainParams;
 class CConnman;
@@ -37,6 +38,99 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
+/**
+ * Transaction selection and coinbase payees of the most recent block template.
+ *
+ * The selection is built once per chain tip and then kept up to date from the
+ * mempool notifications: transactions entering the pool are appended if their
+ * parents are already selected and they still fit. A transaction that does not
+ * fit but pays a higher feerate than the cheapest selected one forces a rebuild.
+ * Transactions leaving the pool are dropped from the selection together with
+ * their selected descendants. The coinbase payee outputs (SmartMining
+ * signature, SmartHive, smartnode and SmartRewards payouts) are only recomputed
+ * when the tip, the coinbase script or the signing address changes, or when a
+ * smartnode payment vote for the block arrives.
+ *
+ * Lock order: cs_main, mempool.cs, cs. The mempool handlers are called with
+ * mempool.cs held.
+ */
+class CBlockTemplateCache
+{
+private:
+    CTxMemPool* pool;
+
+    // Chain context and limits the selection was built for
+    bool fSelectionValid;
+    uint256 hashSelectionPrev;
+    int nSelectionHeight;
+    int64_t nLockTimeCutoff;
+    unsigned int nSelectionDeltasUpdated;
+    uint64_t nBlockMaxSize;
+    unsigned int nTxMaxCount;
+
+    // Selected transactions in block order and their totals
+    std::vector<CTxMemPool::txiter> vSelected;
+    CTxMemPool::setEntries setSelected;
+    uint64_t nBlockSize;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    CFeeRate minFeeRate;
+
+    // Coinbase payees of the last template
+    bool fCoinbaseValid;
+    int nCoinbaseHeight;
+    uint64_t nCoinbaseGeneration;
+    uint256 hashCoinbasePrev;
+    CScript coinbaseScript;
+    CSmartAddress coinbaseSigningAddress;
+    CMutableTransaction coinbaseTx;
+    CTxOut outSignature;
+    std::vector<CTxOut> voutSmartNodes;
+    std::vector<CTxOut> voutSmartHives;
+    std::vector<CTxOut> voutSmartRewards;
+
+    void ClearSelection();
+    void RemoveFromSelection(CTxMemPool::txiter iter);
+
+public:
+    mutable CCriticalSection cs;
+
+    CBlockTemplateCache();
+
+    /** Start/stop following add/remove notifications of the given mempool */
+    void Connect(CTxMemPool& poolIn);
+    void Disconnect();
+
+    /** Fill the coinbase transaction and the payee outputs of block for the
+     *  block on top of pindexPrev, reusing the last result if possible. */
+    void GetCoinbase(CBlockIndex* pindexPrev, const CScript& scriptPubKeyIn, const CSmartAddress& signingAddress,
+                     CMutableTransaction& txNew, CBlock& block);
+
+    /** Whether the selection can be reused for a block on top of pindexPrev
+     *  with the given lock time cutoff and the current fee deltas of the
+     *  mempool. Requires cs and the mempool lock. */
+    bool IsSelectionValid(const CBlockIndex* pindexPrev, int64_t nLockTimeCutoffIn, uint64_t nBlockMaxSizeIn, unsigned int nTxMaxCountIn) const;
+    /** Drop the selection and start a new one. Requires cs. */
+    void ResetSelection(const CBlockIndex* pindexPrev, int64_t nLockTimeCutoffIn, uint64_t nBlockMaxSizeIn, unsigned int nTxMaxCountIn);
+    /** Append a transaction to the selection. Requires cs. */
+    void AddToSelection(CTxMemPool::txiter iter);
+    /** Force a rebuild with the next template. */
+    void InvalidateSelection();
+    /** Recompute the coinbase payees if they were built for block nHeight. */
+    void InvalidateCoinbase(int nHeight);
+
+    bool IsSelected(CTxMemPool::txiter iter) const { return setSelected.count(iter) != 0; }
+    const std::vector<CTxMemPool::txiter>& GetSelection() const { return vSelected; }
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    unsigned int GetBlockSigOps() const { return nBlockSigOps; }
+    CAmount GetFees() const { return nFees; }
+
+    void TransactionAddedToMempool(const CTxMemPoolEntry& entry);
+    void TransactionRemovedFromMempool(const CTxMemPoolEntry& entry);
+};
+
+extern CBlockTemplateCache blockTemplateCache;
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams, CConnman& connman);
 
@@ -213,6 +307,10 @@ private:
     //void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/** Hash nCount nonces of header starting at header.nNonce and stop at the first
+ *  one whose hash does not exceed hashTarget. Returns true with header.nNonce
+ *  set to that nonce, otherwise header.nNonce is advanced past the nonces tried. */
+bool ScanHeaderNonces(CBlockHeader& header, const arith_uint256& hashTarget, uint32_t nCount);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
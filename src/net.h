@@ -91,6 +91,28 @@ static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
+/** How the socket handler waits for socket readiness */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT = 0,
+    SOCKETEVENTS_EPOLL = 1,
+};
+/** -socketevents default */
+#ifdef HAVE_SYS_EPOLL_H
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
+/** -msgthreads default: number of threads processing peer messages */
+static const int DEFAULT_MSGPROC_THREADS = 1;
+/** Maximum number of threads processing peer messages */
+static const int MAX_MSGPROC_THREADS = 16;
+/** Maximum number of socket events handled per epoll_wait() call */
+static const int MAX_SOCKET_EVENTS = 256;
+
+/** Parse a -socketevents value, returns false if the mode is unknown or not supported on this platform */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
@@ -121,8 +143,16 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+namespace net_tests
+{
+    class TestSocketEvents;
+    class TestMessageHandler;
+}
+
 class CConnman
 {
+friend class net_tests::TestSocketEvents; // for test access to the socket handler
+friend class net_tests::TestMessageHandler; // for test access to the message handler threads
 public:
 
     enum NumConnections {
@@ -146,6 +176,8 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
+        int nMsgProcThreads = DEFAULT_MSGPROC_THREADS;
     };
     CConnman(uint64_t nSeed0In, uint64_t nSeed1In);
     ~CConnman();
@@ -413,6 +445,13 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id) const;
 
     unsigned int GetReceiveFloodSize() const;
+
+    /** Re-evaluate which readiness events the socket handler waits for on this node's socket.
+     *  Must be called after the node's send queue or fPauseRecv may have changed. */
+    void UpdateSocketEvents(CNode* pnode);
+    /** Remove the node's socket from the socket handler before it is closed.
+     *  Requires pnode->cs_hSocket. */
+    void UnregisterSocketEvents(CNode* pnode);
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -421,18 +460,38 @@ private:
         ListenSocket(SOCKET socket_, bool whitelisted_) : socket(socket_), whitelisted(whitelisted_) {}
     };
 
+    /** Readiness of a node's socket, as reported by SocketEvents*(). The node is referenced. */
+    struct NodeSocketEvents {
+        CNode* pnode;
+        bool fRecv;
+        bool fSend;
+        bool fError;
+
+        NodeSocketEvents(CNode* pnode_, bool fRecv_, bool fSend_, bool fError_) : pnode(pnode_), fRecv(fRecv_), fSend(fSend_), fError(fError_) {}
+    };
+
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nWorker);
+    int GetMessageHandlerWorker(const CNode* pnode) const;
     void AcceptConnection(const ListenSocket& hListenSocket);
+    void AddNodeToSocketHandler(CNode* pnode);
+    bool CanHandleSocket(SOCKET hSocket) const;
+    /** Set up the socket handler for socketEventsMode, falling back to select() if that fails */
+    void StartSocketEvents();
+    void StopSocketEvents();
+    bool SocketEventsSelect(std::vector<const ListenSocket*>& vListenReady, std::vector<NodeSocketEvents>& vNodeEvents);
+    bool SocketEventsEpoll(std::vector<const ListenSocket*>& vListenReady, std::vector<NodeSocketEvents>& vNodeEvents);
+    void SocketRecvData(CNode* pnode);
+    void InactivityCheck(CNode* pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
     void ThreadOpenSmartnodeConnections();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
 
-    void WakeMessageHandler();
+    void WakeMessageHandler(const CNode* pnode);
 
     CNode* FindNode(const CNetAddr& ip);
     CNode* FindNode(const CSubNet& subNet);
@@ -490,6 +549,9 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    SocketEventsMode socketEventsMode;
+    //! epoll instance all node and listen sockets are registered with, -1 when select() is used
+    int epollfd;
     bool fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -523,8 +585,11 @@ private:
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Number of message processing threads. Each node is handled by one of them only. */
+    int nMsgProcThreads;
+
+    /** flags for waking the message processors, one per thread. */
+    std::vector<bool> vMsgProcWake;
 
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
@@ -540,7 +605,7 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadOpenSmartnodeConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group& threadGroup);
@@ -643,6 +708,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -711,6 +777,8 @@ public:
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
+    //! events hSocket is registered for with the socket handler's epoll set, -1 if not registered (guarded by cs_hSocket)
+    int nSocketEvents;
 
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
@@ -771,6 +839,8 @@ protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    //! microseconds spent processing received messages per command (guarded by cs_vProcessMsg)
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
 
 public:
     uint256 hashContinue;
@@ -854,6 +924,7 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    void RecordProcessTime(const std::string& strCommand, int64_t nTimeMicros);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -938,7 +1009,7 @@ public:
 
     void AskFor(const CInv& inv);
 
-    void CloseSocketDisconnect();
+    void CloseSocketDisconnect(CConnman* connman);
 
     void copyStats(CNodeStats &stats);
 
@@ -8,6 +8,7 @@
 #include "alert.h"
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
@@ -41,6 +42,9 @@
 //#endif // ENABLE_WALLET
 //#include "privatesend-server.h"
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -645,29 +649,45 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         return instantsend.AlreadyHave(inv.hash);
 
     case MSG_SPORK:
-        return mapSporks.count(inv.hash);
+        {
+            LOCK(cs_mapSporks);
+            return mapSporks.count(inv.hash);
+        }
 
     case MSG_SMARTNODE_PAYMENT_VOTE:
-        return mnpayments.mapSmartnodePaymentVotes.count(inv.hash);
+        {
+            LOCK(cs_mapSmartnodePaymentVotes);
+            return mnpayments.mapSmartnodePaymentVotes.count(inv.hash);
+        }
 
     case MSG_SMARTNODE_PAYMENT_BLOCK:
         {
             BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+            LOCK(cs_mapSmartnodeBlocks);
             return mi != mapBlockIndex.end() && mnpayments.mapSmartnodeBlocks.find(mi->second->nHeight) != mnpayments.mapSmartnodeBlocks.end();
         }
 
     case MSG_SMARTNODE_ANNOUNCE:
-        return mnodeman.mapSeenSmartnodeBroadcast.count(inv.hash) && !mnodeman.IsMnbRecoveryRequested(inv.hash);
+        {
+            LOCK(mnodeman.cs);
+            return mnodeman.mapSeenSmartnodeBroadcast.count(inv.hash) && !mnodeman.IsMnbRecoveryRequested(inv.hash);
+        }
 
     case MSG_SMARTNODE_PING:
-        return mnodeman.mapSeenSmartnodePing.count(inv.hash);
+        {
+            LOCK(mnodeman.cs);
+            return mnodeman.mapSeenSmartnodePing.count(inv.hash);
+        }
 
     case MSG_VOTING_PROPOSAL:
     case MSG_VOTING_PROPOSAL_VOTE:
         return true; // WIP-VOTING replace with => return !smartVoting.ConfirmInventoryRequest(inv);
 
     case MSG_SMARTNODE_VERIFY:
-        return mnodeman.mapSeenSmartnodeVerification.count(inv.hash);
+        {
+            LOCK(mnodeman.cs);
+            return mnodeman.mapSeenSmartnodeVerification.count(inv.hash);
+        }
     }
 
     // Don't know what it is, just say we already got one
@@ -762,14 +782,18 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, NetMsgType::BLOCK, block);
+                    if (inv.type == MSG_BLOCK) {
+                        // Send the serialized block, the block cache keeps it for the next peers asking
+                        CBlockCache::BlockData blockData = ReadBlockDataFromCacheOrDisk((*mi).second, consensusParams);
+                        if (!blockData)
+                            assert(!"cannot load block from disk");
+                        connman.PushMessage(pfrom, NetMsgType::BLOCK, CFlatData((void*)blockData->data(), (void*)(blockData->data() + blockData->size())));
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        if (!ReadBlockFromCacheOrDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
@@ -854,6 +878,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_SPORK) {
+                    LOCK(cs_mapSporks);
                     if(mapSporks.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
@@ -864,6 +889,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_SMARTNODE_PAYMENT_VOTE) {
+                    LOCK(cs_mapSmartnodePaymentVotes);
                     if(mnpayments.HasVerifiedPaymentVote(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
@@ -875,7 +901,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
                 if (!pushed && inv.type == MSG_SMARTNODE_PAYMENT_BLOCK) {
                     BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                    LOCK(cs_mapSmartnodeBlocks);
+                    LOCK2(cs_mapSmartnodeBlocks, cs_mapSmartnodePaymentVotes);
                     if (mi != mapBlockIndex.end() && mnpayments.mapSmartnodeBlocks.count(mi->second->nHeight)) {
                         BOOST_FOREACH(CSmartnodePayee& payee, mnpayments.mapSmartnodeBlocks[mi->second->nHeight].vecPayees) {
                             std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
@@ -893,6 +919,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_SMARTNODE_ANNOUNCE) {
+                    LOCK(mnodeman.cs);
                     if(mnodeman.mapSeenSmartnodeBroadcast.count(inv.hash)){
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
@@ -903,6 +930,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_SMARTNODE_PING) {
+                    LOCK(mnodeman.cs);
                     if(mnodeman.mapSeenSmartnodePing.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
@@ -952,6 +980,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 */
 
                 if (!pushed && inv.type == MSG_SMARTNODE_VERIFY) {
+                    LOCK(mnodeman.cs);
                     if(mnodeman.mapSeenSmartnodeVerification.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
@@ -987,6 +1016,72 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+typedef std::unordered_map<std::string, SmartCashMessageHandler> SmartCashMessageHandlers;
+
+void ProcessSmartnodeManMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
+}
+
+void ProcessSmartnodePaymentsMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
+}
+
+void ProcessInstantSendMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    instantsend.ProcessMessage(pfrom, strCommand, vRecv, connman);
+}
+
+void ProcessSporkMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    sporkManager.ProcessSpork(pfrom, strCommand, vRecv, connman);
+}
+
+void ProcessSmartnodeSyncMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    smartnodeSync.ProcessMessage(pfrom, strCommand, vRecv, connman);
+}
+
+/** The handler of each SmartCash specific message type, so a message is
+ *  passed to the one manager that processes it. Built on first use. */
+static const SmartCashMessageHandlers& GetSmartCashMessageHandlers()
+{
+    static const SmartCashMessageHandlers handlers = [] {
+        SmartCashMessageHandlers h;
+
+        h[NetMsgType::MNANNOUNCE] = ProcessSmartnodeManMessage;
+        h[NetMsgType::MNPING] = ProcessSmartnodeManMessage;
+        h[NetMsgType::DSEG] = ProcessSmartnodeManMessage;
+        h[NetMsgType::MNVERIFY] = ProcessSmartnodeManMessage;
+        h[NetMsgType::SMARTNODEPAYMENTSYNC] = ProcessSmartnodePaymentsMessage;
+        h[NetMsgType::SMARTNODEPAYMENTVOTE] = ProcessSmartnodePaymentsMessage;
+        h[NetMsgType::TXLOCKVOTE] = ProcessInstantSendMessage;
+        h[NetMsgType::SPORK] = ProcessSporkMessage;
+        h[NetMsgType::GETSPORKS] = ProcessSporkMessage;
+        h[NetMsgType::SYNCSTATUSCOUNT] = ProcessSmartnodeSyncMessage;
+
+        //WIP-VOTING register smartVoting.ProcessMessage for the voting messages
+
+        return h;
+    }();
+    return handlers;
+}
+
+SmartCashMessageHandler GetSmartCashMessageHandler(const std::string& strCommand)
+{
+    const SmartCashMessageHandlers& handlers = GetSmartCashMessageHandlers();
+    SmartCashMessageHandlers::const_iterator it = handlers.find(strCommand);
+    return it != handlers.end() ? it->second : NULL;
+}
+
+/** Whether strCommand is one of the message types this node knows about */
+static bool IsKnownNetMessageType(const std::string& strCommand)
+{
+    static const std::unordered_set<std::string> setKnown(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    return setKnown.count(strCommand) != 0;
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -2109,27 +2204,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
     else
     {
-        bool found = false;
-        const std::vector<std::string> &allMessages = getAllNetMessageTypes();
-        BOOST_FOREACH(const std::string msg, allMessages) {
-            if(msg == strCommand) {
-                found = true;
-                break;
-            }
-        }
+        SmartCashMessageHandler handler = GetSmartCashMessageHandler(strCommand);
 
-        if (found)
+        if (handler)
         {
-            mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            instantsend.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            sporkManager.ProcessSpork(pfrom, strCommand, vRecv, connman);
-            smartnodeSync.ProcessMessage(pfrom, strCommand, vRecv, connman);
-
-            //WIP-VOTING uncomment => smartVoting.ProcessMessage(pfrom, strCommand, vRecv, connman);
-
+            handler(pfrom, strCommand, vRecv, connman);
         }
-        else
+        else if (!IsKnownNetMessageType(strCommand))
         {
             // Ignore unknown commands for extensibility
             LogPrint("net", "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
@@ -2166,6 +2247,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
             return false;
 
         std::list<CNetMessage> msgs;
+        bool fResumeRecv = false;
         {
             LOCK(pfrom->cs_vProcessMsg);
             if (pfrom->vProcessMsg.empty())
@@ -2173,9 +2255,12 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
             // Just take one message
             msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
             pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+            fResumeRecv = pfrom->fPauseRecv && pfrom->nProcessQueueSize <= connman.GetReceiveFloodSize();
             pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman.GetReceiveFloodSize();
             fMoreWork = !pfrom->vProcessMsg.empty();
         }
+        if (fResumeRecv)
+            connman.UpdateSocketEvents(pfrom);
         CNetMessage& msg(msgs.front());
 
         msg.SetVersion(pfrom->GetRecvVersion());
@@ -2212,6 +2297,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
@@ -2243,6 +2329,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        pfrom->RecordProcessTime(strCommand, GetTimeMicros() - nTimeStart);
 
         if (!fRet)
             LogPrint("net", "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -134,4 +134,15 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
  */
 bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interrupt);
 
+typedef void (*SmartCashMessageHandler)(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+
+/** Pass a SmartCash specific message on to the manager that processes it */
+void ProcessSmartnodeManMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+void ProcessSmartnodePaymentsMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+void ProcessInstantSendMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+void ProcessSporkMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+void ProcessSmartnodeSyncMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+/** The handler of a SmartCash specific message type, NULL if it has none */
+SmartCashMessageHandler GetSmartCashMessageHandler(const std::string& strCommand);
+
 #endif // BITCOIN_NET_PROCESSING_H
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
@@ -192,9 +193,8 @@ static bool rest_headers(HTTPRequest* req,
         BOOST_FOREACH(const CBlockIndex *pindex, headers) {
             jsonHeaders.push_back(blockheaderToJSON(pindex));
         }
-        string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, jsonHeaders);
         return true;
     }
     default: {
@@ -221,6 +221,9 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    // The binary and hex formats are served through the block cache, which
+    // holds blocks in the default network serialization
+    CBlockCache::BlockData blockData;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -230,24 +233,38 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if ((rf == RF_BINARY || rf == RF_HEX) && RPCSerializationFlags() == 0) {
+            blockData = ReadBlockDataFromCacheOrDisk(pblockindex, Params().GetConsensus());
+            if (!blockData)
+                return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not found");
+        } else if (!ReadBlockFromCacheOrDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not found");
     }
 
     switch (rf) {
     case RF_BINARY: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        string binaryBlock = ssBlock.str();
+        string binaryBlock;
+        if (blockData) {
+            binaryBlock.assign(blockData->begin(), blockData->end());
+        } else {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            binaryBlock = ssBlock.str();
+        }
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTPStatus::OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex;
+        if (blockData) {
+            strHex = HexStr(blockData->begin(), blockData->end()) + "\n";
+        } else {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        }
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTPStatus::OK, strHex);
         return true;
@@ -255,9 +272,8 @@ static bool rest_block(HTTPRequest* req,
 
     case RF_JSON: {
         UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, objBlock);
         return true;
     }
 
@@ -294,9 +310,8 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     case RF_JSON: {
         UniValue rpcParams(UniValue::VARR);
         UniValue chainInfoObject = getblockchaininfo(rpcParams, false);
-        string strJSON = chainInfoObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, chainInfoObject);
         return true;
     }
     default: {
@@ -319,9 +334,8 @@ static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
     case RF_JSON: {
         UniValue mempoolInfoObject = mempoolInfoToJSON();
 
-        string strJSON = mempoolInfoObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, mempoolInfoObject);
         return true;
     }
     default: {
@@ -344,9 +358,8 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
     case RF_JSON: {
         UniValue mempoolObject = mempoolToJSON(true);
 
-        string strJSON = mempoolObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, mempoolObject);
         return true;
     }
     default: {
@@ -396,9 +409,8 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     case RF_JSON: {
         UniValue objTx(UniValue::VOBJ);
         TxToJSON(tx, hashBlock, objTx);
-        string strJSON = objTx.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, objTx);
         return true;
     }
 
@@ -582,9 +594,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         objGetUTXOResponse.push_back(Pair("utxos", utxos));
 
         // return json string
-        string strJSON = objGetUTXOResponse.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTPStatus::OK, strJSON);
+        req->WriteJSONReply(HTTPStatus::OK, objGetUTXOResponse);
         return true;
     }
     default: {
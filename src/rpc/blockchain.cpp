@@ -9,6 +9,7 @@
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "dbwrapper.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
@@ -114,12 +115,12 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
+            txs.push_back(std::move(objTx));
         }
         else
             txs.push_back(tx.GetHash().GetHex());
     }
-    result.push_back(Pair("tx", txs));
+    result.pushKV("tx", std::move(txs));
     result.push_back(Pair("time", block.GetBlockTime()));
     result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
@@ -1225,3 +1226,71 @@ UniValue getchaintxstats(const UniValue& params, bool fHelp)
 
     return ret;
 }
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the settings, disk footprint and I/O counters of the open LevelDB databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"snappy\": true|false,         (boolean) whether LevelDB was built with Snappy compression\n"
+            "  \"databases\": {\n"
+            "    \"name\": {                   (string) the database, e.g. chainstate, blockindex, indexes or rewards, the path if the name is taken\n"
+            "      \"path\": \"xxx\",            (string) the database directory\n"
+            "      \"compression\": true|false, (boolean) whether new tables are compressed, false if the profile asks for it but Snappy is not available\n"
+            "      \"blocksize\": xxxxx,         (numeric) table block size in bytes\n"
+            "      \"writebuffer\": xxxxx,       (numeric) memtable size in bytes, 0 for a quarter of the cache\n"
+            "      \"bloombits\": xxxxx,         (numeric) bloom filter bits per key\n"
+            "      \"cachesize\": xxxxx,         (numeric) database cache in bytes\n"
+            "      \"disksize\": xxxxx,          (numeric) size of the database directory in bytes\n"
+            "      \"filesperlevel\": [n,...],   (array) number of table files on each level\n"
+            "      \"compactionread\": xxxxx,    (numeric) bytes read by compactions since startup\n"
+            "      \"compactionwritten\": xxxxx, (numeric) bytes written by compactions since startup\n"
+            "      \"reads\": xxxxx,             (numeric) point lookups and values read by iterators since startup\n"
+            "      \"readbytes\": xxxxx,         (numeric) value bytes returned by those reads\n"
+            "      \"writebatches\": xxxxx,      (numeric) write batches since startup\n"
+            "      \"writtenbytes\": xxxxx       (numeric) bytes in those batches\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue databases(UniValue::VOBJ);
+    for (const CDBWrapperStats& stats : GetDBWrapperStats()) {
+        if (stats.strPath.empty())
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("path", stats.strPath));
+        obj.push_back(Pair("compression", stats.profile.fCompression && DBCompressionAvailable()));
+        obj.push_back(Pair("blocksize", (uint64_t)stats.profile.nBlockSize));
+        obj.push_back(Pair("writebuffer", (uint64_t)stats.profile.nWriteBuffer));
+        obj.push_back(Pair("bloombits", stats.profile.nBloomBits));
+        obj.push_back(Pair("cachesize", (uint64_t)stats.nCacheSize));
+        obj.push_back(Pair("disksize", stats.nDiskSize));
+        UniValue files(UniValue::VARR);
+        for (int nFiles : stats.vFilesPerLevel)
+            files.push_back(nFiles);
+        obj.push_back(Pair("filesperlevel", files));
+        obj.push_back(Pair("compactionread", stats.nCompactionRead));
+        obj.push_back(Pair("compactionwritten", stats.nCompactionWritten));
+        obj.push_back(Pair("reads", stats.nReads));
+        obj.push_back(Pair("readbytes", stats.nBytesRead));
+        obj.push_back(Pair("writebatches", stats.nBatches));
+        obj.push_back(Pair("writtenbytes", stats.nBytesWritten));
+        std::string strName = stats.profile.strName.empty() ? boost::filesystem::path(stats.strPath).filename().string() : stats.profile.strName;
+        // Several databases may share a profile or directory name, the paths are unique
+        if (databases.exists(strName))
+            strName = stats.strPath;
+        databases.push_back(Pair(strName, obj));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("snappy", DBCompressionAvailable()));
+    ret.push_back(Pair("databases", databases));
+    return ret;
+}
@@ -109,6 +109,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "sendrawtransaction", 1 },
     { "sendrawtransaction", 2 },
     { "fundrawtransaction", 1 },
+    { "consolidateutxos", 2 },
     { "gettxout", 1 },
     { "gettxout", 2 },
     { "gettxoutproof", 0 },
@@ -143,6 +144,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddressdeltas", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
+    { "watchaddresses", 0},
+    { "unwatchaddresses", 0},
     { "getaddresses", 0},
     { "getaddresses", 1},
     { "getnewaddress", 1},
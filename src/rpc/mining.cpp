@@ -128,9 +128,14 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
+        arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
         while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(nHeight, pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
             ++pblock->nNonce;
             --nMaxTries;
+            // Batch-hash the following nonces up to the next one meeting the target
+            uint32_t nStart = pblock->nNonce;
+            ScanHeaderNonces(*pblock, hashTarget, std::min<uint64_t>(nMaxTries, nInnerLoopCount - nStart));
+            nMaxTries -= pblock->nNonce - nStart;
         }
         if (nMaxTries == 0) {
             break;
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addresswatch.h"
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
@@ -20,6 +21,7 @@
 #endif
 
 #include "smarthive/hive.h"
+#include "smartnode/smartnodemaintenance.h"
 #include "smartnode/smartnodesync.h"
 #include "smartnode/spork.h"
 #include "smarthive/hive.h"
@@ -403,6 +405,7 @@ UniValue snsync(const UniValue& params, bool fHelp)
     {
         smartnodeSync.Reset();
         smartnodeSync.SwitchToNextAsset(*g_connman);
+        smartnodeMaintenance.NotifySyncReset();
         return "success";
     }
     return "failure";
@@ -907,6 +910,122 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
 
 }
 
+UniValue watchaddresses(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "watchaddresses\n"
+            "\nAdds addresses to the list published by the zmq address notifier (requires -zmqpubaddress).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"added\"  (number) The number of addresses which were not watched before\n"
+            "  \"watched\"  (number) The total number of watched addresses\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("watchaddresses", "'{\"addresses\": [\"SwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
+            + HelpExampleRpc("watchaddresses", "{\"addresses\": [\"SwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
+        );
+
+    // Events are classified by the address index
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Address index not enabled, restart with -addressindex");
+
+    std::vector<std::pair<uint160, int> > addresses;
+
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("added", (uint64_t)addressWatchList.Add(addresses)));
+    result.push_back(Pair("watched", (uint64_t)addressWatchList.Size()));
+
+    return result;
+}
+
+UniValue unwatchaddresses(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "unwatchaddresses\n"
+            "\nRemoves addresses from the list published by the zmq address notifier.\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+            "or \"all\" to clear the list\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"removed\"  (number) The number of addresses removed from the list\n"
+            "  \"watched\"  (number) The total number of watched addresses\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("unwatchaddresses", "'{\"addresses\": [\"SwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
+            + HelpExampleCli("unwatchaddresses", "'\"all\"'")
+            + HelpExampleRpc("unwatchaddresses", "{\"addresses\": [\"SwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
+        );
+
+    size_t nRemoved;
+
+    if (params[0].isStr() && params[0].get_str() == "all") {
+        nRemoved = addressWatchList.Size();
+        addressWatchList.Clear();
+    } else {
+        std::vector<std::pair<uint160, int> > addresses;
+
+        if (!getAddressesFromParams(params, addresses)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        }
+
+        nRemoved = addressWatchList.Remove(addresses);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("removed", (uint64_t)nRemoved));
+    result.push_back(Pair("watched", (uint64_t)addressWatchList.Size()));
+
+    return result;
+}
+
+UniValue listwatchedaddresses(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "listwatchedaddresses\n"
+            "\nReturns the addresses published by the zmq address notifier.\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"address\"  (string) The base58check encoded address\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("listwatchedaddresses", "")
+            + HelpExampleRpc("listwatchedaddresses", "")
+        );
+
+    UniValue result(UniValue::VARR);
+
+    for (const auto& entry : addressWatchList.GetAddresses()) {
+        std::string address;
+        if (getAddressFromIndex(entry.second, entry.first, address))
+            result.push_back(address);
+    }
+
+    return result;
+}
+
 UniValue getaddresstxids(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
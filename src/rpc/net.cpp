@@ -109,6 +109,10 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The total time in microseconds spent processing received messages, aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -180,6 +184,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue processTimePerMsgCmd(UniValue::VOBJ);
+        BOOST_FOREACH(const mapMsgCmdSize::value_type &i, stats.mapProcessTimePerMsgCmd) {
+            if (i.second > 0)
+                processTimePerMsgCmd.push_back(Pair(i.first, i.second));
+        }
+        obj.push_back(Pair("processtime_per_msg", processTimePerMsgCmd));
+
         ret.push_back(obj);
     }
 
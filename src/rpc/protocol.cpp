@@ -35,13 +35,13 @@ string JSONRPCRequest(const string& strMethod, const UniValue& params, const Uni
     return request.write() + "\n";
 }
 
-UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const UniValue& id)
+UniValue JSONRPCReplyObj(UniValue result, const UniValue& error, const UniValue& id)
 {
     UniValue reply(UniValue::VOBJ);
     if (!error.isNull())
         reply.push_back(Pair("result", NullUniValue));
     else
-        reply.push_back(Pair("result", result));
+        reply.pushKV("result", std::move(result));
     reply.push_back(Pair("error", error));
     reply.push_back(Pair("id", id));
     return reply;
@@ -25,6 +25,10 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <atomic>
+#include <deque>
+#include <set>
+
 using namespace RPCServer;
 using namespace std;
 
@@ -38,6 +42,14 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+/* Thread pool for parallel batch execution (-rpcparallelbatch) */
+static boost::thread_group threadGroupRPCBatch;
+static boost::mutex csRPCBatchQueue;
+static boost::condition_variable condRPCBatchQueue;
+static std::deque<boost::function<void ()> > queueRPCBatch;
+static std::atomic<bool> fRPCBatchRunning(false);
+static int nRPCBatchThreads = 0;
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -266,8 +278,8 @@ UniValue stop(const UniValue& params, bool fHelp)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode concurrent
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
     /* Overall control/query calls */
     { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
     { "control",            "debug",                  &debug,                  true  },
@@ -290,24 +302,25 @@ static const CRPCCommand vRPCCommands[] =
 
     /* Block chain and UTXO */
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getblockheaders",        &getblockheaders,        true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,      true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,      true  },
+    { "blockchain",         "getblock",               &getblock,               true,      true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,      true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,      true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,      true  },
+    { "blockchain",         "getblockheaders",        &getblockheaders,        true,      true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,      true  },
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
     { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false,     true  },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        false },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,      true  },
 
     /* Mining */
     { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
@@ -324,9 +337,9 @@ static const CRPCCommand vRPCCommands[] =
     /* Raw transactions */
     { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
     { "rawtransactions",    "splitinputs",            &splitinputs,            true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,      true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,      true  },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,      true  },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
@@ -334,13 +347,16 @@ static const CRPCCommand vRPCCommands[] =
 #endif
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,      true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false,     true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false,     true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false,     true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false,     true  },
     { "addressindex",       "getaddresses",           &getaddresses,           false },
     { "addressindex",       "getmoneysupply",         &getmoneysupply,         false },
+    { "addressindex",       "watchaddresses",         &watchaddresses,         true  },
+    { "addressindex",       "unwatchaddresses",       &unwatchaddresses,       true  },
+    { "addressindex",       "listwatchedaddresses",   &listwatchedaddresses,   true  },
 
     /* Utility functions */
     { "util",               "createmultisig",         &createmultisig,         true  },
@@ -460,10 +476,35 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
     return true;
 }
 
+static void ThreadRPCBatch()
+{
+    RenameThread("smartcash-rpcbatch");
+    while (true) {
+        boost::function<void ()> job;
+        {
+            boost::unique_lock<boost::mutex> lock(csRPCBatchQueue);
+            while (fRPCBatchRunning && queueRPCBatch.empty())
+                condRPCBatchQueue.wait(lock);
+            if (!fRPCBatchRunning)
+                return;
+            job = queueRPCBatch.front();
+            queueRPCBatch.pop_front();
+        }
+        job();
+    }
+}
+
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
     fRPCRunning = true;
+    if (GetBoolArg("-rpcparallelbatch", DEFAULT_RPC_PARALLEL_BATCH)) {
+        nRPCBatchThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+        LogPrint("rpc", "Starting %d RPC batch threads\n", nRPCBatchThreads);
+        fRPCBatchRunning = true;
+        for (int i = 0; i < nRPCBatchThreads; i++)
+            threadGroupRPCBatch.create_thread(&ThreadRPCBatch);
+    }
     g_rpcSignals.Started();
     return true;
 }
@@ -479,6 +520,13 @@ void StopRPC()
 {
     LogPrint("rpc", "Stopping RPC\n");
     deadlineTimers.clear();
+    {
+        boost::unique_lock<boost::mutex> lock(csRPCBatchQueue);
+        fRPCBatchRunning = false;
+        queueRPCBatch.clear();
+        condRPCBatchQueue.notify_all();
+    }
+    threadGroupRPCBatch.join_all();
     g_rpcSignals.Stopped();
 }
 
@@ -547,7 +595,7 @@ static UniValue JSONRPCExecOne(const UniValue& req)
         jreq.parse(req);
 
         UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
+        rpc_result = JSONRPCReplyObj(std::move(result), NullUniValue, jreq.id);
     }
     catch (const UniValue& objError)
     {
@@ -562,13 +610,105 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Whether a batch entry names a command that is marked as concurrent */
+static bool IsConcurrentRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req, "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->fConcurrent;
+}
+
+/** A run of consecutive concurrent batch entries, shared by the pool threads.
+ * Threads claim entries through nNext until all are taken, so a job that is
+ * only picked up after the run has finished does nothing.
+ */
+struct CRPCBatchRun
+{
+    const UniValue* pReq;
+    std::vector<UniValue>* pResults;
+    std::vector<unsigned int> vIndex;
+    std::atomic<size_t> nNext;
+    size_t nDone;
+    boost::mutex cs;
+    boost::condition_variable cond;
+
+    CRPCBatchRun(const UniValue* pReqIn, std::vector<UniValue>* pResultsIn, const std::vector<unsigned int>& vIndexIn) :
+        pReq(pReqIn), pResults(pResultsIn), vIndex(vIndexIn), nNext(0), nDone(0) {}
+};
+
+static void ExecBatchRun(boost::shared_ptr<CRPCBatchRun> run)
 {
+    size_t i;
+    while ((i = run->nNext++) < run->vIndex.size()) {
+        unsigned int reqIdx = run->vIndex[i];
+        (*run->pResults)[reqIdx] = JSONRPCExecOne((*run->pReq)[reqIdx]);
+
+        boost::unique_lock<boost::mutex> lock(run->cs);
+        if (++run->nDone == run->vIndex.size())
+            run->cond.notify_all();
+    }
+}
+
+static void ExecBatchParallel(const UniValue& vReq, const std::vector<unsigned int>& vIndex, std::vector<UniValue>& vResults)
+{
+    if (vIndex.empty())
+        return;
+    if (vIndex.size() == 1) {
+        vResults[vIndex[0]] = JSONRPCExecOne(vReq[vIndex[0]]);
+        return;
+    }
+
+    boost::shared_ptr<CRPCBatchRun> run(new CRPCBatchRun(&vReq, &vResults, vIndex));
+    {
+        boost::unique_lock<boost::mutex> lock(csRPCBatchQueue);
+        size_t nJobs = std::min(vIndex.size() - 1, (size_t)nRPCBatchThreads);
+        for (size_t i = 0; i < nJobs; i++)
+            queueRPCBatch.push_back(boost::bind(&ExecBatchRun, run));
+        condRPCBatchQueue.notify_all();
+    }
+
+    // Work on the run from this thread as well, so the batch completes even
+    // if the pool is busy with other batches.
+    ExecBatchRun(run);
+
+    boost::unique_lock<boost::mutex> lock(run->cs);
+    while (run->nDone < vIndex.size())
+        run->cond.wait(lock);
+}
+
+UniValue JSONRPCExecBatch(const UniValue& vReq)
+{
+    std::vector<UniValue> vResults(vReq.size());
+
+    if (fRPCBatchRunning && vReq.size() > 1) {
+        // Consecutive concurrent entries run in parallel, every other entry
+        // runs on its own in batch order, so a call never overtakes a
+        // non-concurrent call that came before it.
+        std::vector<unsigned int> vConcurrent;
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
+            if (IsConcurrentRequest(vReq[reqIdx])) {
+                vConcurrent.push_back(reqIdx);
+                continue;
+            }
+            ExecBatchParallel(vReq, vConcurrent, vResults);
+            vConcurrent.clear();
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+        }
+        ExecBatchParallel(vReq, vConcurrent, vResults);
+    } else {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (unsigned int reqIdx = 0; reqIdx < vResults.size(); reqIdx++)
+        ret.push_back(std::move(vResults[reqIdx]));
 
-    return ret.write() + "\n";
+    return ret;
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
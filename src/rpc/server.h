@@ -124,13 +124,23 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+//! Execute concurrency-safe calls of a JSON-RPC batch in parallel
+static const bool DEFAULT_RPC_PARALLEL_BATCH = false;
+//! Number of threads used for parallel batch execution
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
 class CRPCCommand
 {
 public:
+    CRPCCommand(const std::string& categoryIn, const std::string& nameIn, rpcfn_type actorIn, bool okSafeModeIn, bool fConcurrentIn = false) :
+        category(categoryIn), name(nameIn), actor(actorIn), okSafeMode(okSafeModeIn), fConcurrent(fConcurrentIn) {}
+
     std::string category;
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Read-only call that may run in parallel with its neighbours in a batch
+    bool fConcurrent;
 };
 
 /**
@@ -195,6 +205,9 @@ extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
 extern UniValue getaddressdeltas(const UniValue& params, bool fHelp);
 extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
 extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue watchaddresses(const UniValue& params, bool fHelp);
+extern UniValue unwatchaddresses(const UniValue& params, bool fHelp);
+extern UniValue listwatchedaddresses(const UniValue& params, bool fHelp);
 
 extern UniValue getpeerinfo(const UniValue& params, bool fHelp);
 extern UniValue ping(const UniValue& params, bool fHelp);
@@ -317,6 +330,7 @@ extern UniValue getchaintips(const UniValue& params, bool fHelp);
 extern UniValue invalidateblock(const UniValue& params, bool fHelp);
 extern UniValue reconsiderblock(const UniValue& params, bool fHelp);
 extern UniValue getchaintxstats(const UniValue& params, bool fHelp);
+extern UniValue getdbstats(const UniValue& params, bool fHelp);
 extern UniValue getspentinfo(const UniValue& params, bool fHelp);
 extern UniValue getaddresses(const UniValue& params, bool fHelp);
 extern UniValue getmoneysupply(const UniValue& params, bool fHelp);
@@ -329,7 +343,7 @@ extern void EnsureVotingIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+UniValue JSONRPCExecBatch(const UniValue& vReq);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
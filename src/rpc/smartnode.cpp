@@ -10,6 +10,7 @@
 #include "rpc/server.h"
 #include "smartnode/activesmartnode.h"
 #include "smartnode/smartnodeconfig.h"
+#include "smartnode/smartnodemaintenance.h"
 #include "smartnode/smartnodeman.h"
 #include "smartnode/smartnodepayments.h"
 #include "smartnode/smartnodesync.h"
@@ -122,7 +123,7 @@ UniValue smartnode(const UniValue& params, bool fHelp)
 #endif // ENABLE_WALLET
          strCommand != "list" && strCommand != "list-conf" && strCommand != "count" && strCommand != "roi" &&
          strCommand != "debug" && strCommand != "current" && strCommand != "winner" && strCommand != "winners" && strCommand != "genkey" &&
-         strCommand != "connect" && strCommand != "status" && strCommand != "protocol"))
+         strCommand != "connect" && strCommand != "status" && strCommand != "protocol" && strCommand != "maintenance"))
             throw std::runtime_error(
                 "smartnode \"command\"...\n"
                 "Set of commands to execute smartnode related actions\n"
@@ -141,6 +142,7 @@ UniValue smartnode(const UniValue& params, bool fHelp)
                 "  status       - Print smartnode status information\n"
                 "  list         - Print list of all known smartnodes (see smartnodelist for more info)\n"
                 "  list-conf    - Print smartnode.conf in JSON format\n"
+                "  maintenance  - Print run statistics of the smartnode maintenance tasks\n"
                 "  winner       - Print info on next smartnode winner to vote for\n"
                 "  winners      - Print list of smartnode winners\n"
                 );
@@ -464,6 +466,23 @@ UniValue smartnode(const UniValue& params, bool fHelp)
         return mnObj;
     }
 
+    if (strCommand == "maintenance")
+    {
+        UniValue obj(UniValue::VOBJ);
+        for (const auto& task : smartnodeMaintenance.GetTaskStats()) {
+            const CMaintenanceTaskStats& stats = task.second;
+            UniValue taskObj(UniValue::VOBJ);
+            taskObj.push_back(Pair("period", stats.nPeriod));
+            taskObj.push_back(Pair("runs", stats.nRuns));
+            taskObj.push_back(Pair("lastrun", stats.nLastRunTime));
+            taskObj.push_back(Pair("last_us", stats.nLastMicros));
+            taskObj.push_back(Pair("max_us", stats.nMaxMicros));
+            taskObj.push_back(Pair("total_us", stats.nTotalMicros));
+            obj.push_back(Pair(task.first, taskObj));
+        }
+        return obj;
+    }
+
     if (strCommand == "winners")
     {
         int nHeight;
@@ -623,7 +642,7 @@ UniValue smartnodelist(const UniValue& params, bool fHelp)
     } else {
         std::map<COutPoint, CSmartnode> mapSmartnodes = mnodeman.GetFullSmartnodeMap();
         for (auto& mnpair : mapSmartnodes) {
-            CSmartnode mn = mnpair.second;
+            const CSmartnode& mn = mnpair.second;
             std::string strOutpoint = mnpair.first.ToStringShort();
             if (strMode == "activeseconds") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
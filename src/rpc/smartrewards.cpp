@@ -181,7 +181,7 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
             addrObj.pushKV("address", payout.entry.id.ToString());
             addrObj.pushKV("reward", format(payout.reward));
 
-            obj.push_back(addrObj);
+            obj.push_back(std::move(addrObj));
         }
 
         return obj;
@@ -229,7 +229,7 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
             addrObj.pushKV("address", s.entry.id.ToString());
             addrObj.pushKV("balance", format(s.entry.balance));
 
-            obj.push_back(addrObj);
+            obj.push_back(std::move(addrObj));
         }
 
         return obj;
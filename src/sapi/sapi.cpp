@@ -686,11 +686,6 @@ static bool SAPIExecuteEndpoint(HTTPRequest *req, const std::map<std::string, st
     return endpoint->handler(req, mapPathParams, bodyParameter );
 }
 
-std::string JsonString(const UniValue &obj)
-{
-    return obj.write(DEFAULT_SAPI_JSON_INDENT) + "\n";
-}
-
 void SAPI::AddDefaultHeaders(HTTPRequest* req)
 {
     req->WriteHeader("User-Agent", CLIENT_NAME);
@@ -707,11 +702,9 @@ bool SAPI::Error(HTTPRequest* req, HTTPStatus::Codes status, const std::vector<S
         arr.push_back(error.ToUniValue());
     }
 
-    string strJSON = arr.write(1,1) + "\n";
-
     AddDefaultHeaders(req);
     req->WriteHeader("Content-Type", "application/json");
-    req->WriteReply(status, strJSON);
+    req->WriteJSONReply(status, arr, 1);
     return false;
 }
 
@@ -734,7 +727,7 @@ void SAPI::WriteReply(HTTPRequest *req, HTTPStatus::Codes status, const UniValue
 {
     AddDefaultHeaders(req);
     req->WriteHeader("Content-Type", "application/json");
-    req->WriteReply(status, JsonString(obj));
+    req->WriteJSONReply(status, obj, DEFAULT_SAPI_JSON_INDENT);
 }
 
 void SAPI::WriteReply(HTTPRequest *req, HTTPStatus::Codes status, const std::string &str)
@@ -356,8 +356,6 @@ extern bool getAddressFromIndex(const int &type, const uint160 &hash, std::strin
 
 extern bool ParseHashStr(const string& strHash, uint256& v);
 
-inline std::string JsonString(const UniValue& obj);
-
 /** Initialize SAPI server. */
 bool InitSAPIServer();
 /** Start SAPI server. */
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockcache.h"
 #include "core_io.h"
 #include "sapi.h"
 #include "consensus/validation.h"
@@ -65,10 +66,10 @@ static bool GetBlockInfo(HTTPRequest* req, CBlockIndex *blockindex, const CBlock
         if (!GetTransactionInfo(req, tx.GetHash(), tx, txObj, false))
             return false;
 
-        txs.push_back(txObj);
+        txs.push_back(std::move(txObj));
     }
 
-    blockObj.push_back(Pair("tx", txs));
+    blockObj.pushKV("tx", std::move(txs));
     blockObj.push_back(Pair("time", block.GetBlockTime()));
     blockObj.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
     blockObj.push_back(Pair("nonce", (uint64_t)block.nNonce));
@@ -117,13 +118,13 @@ bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx,
             in.pushKV("n", (int64_t)txin.prevout.n);
             UniValue o(UniValue::VOBJ);
             ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-            in.pushKV("scriptPubKey", o);
+            in.pushKV("scriptPubKey", std::move(o));
         }
 
         in.pushKV("sequence", (int64_t)txin.nSequence);
-        vin.push_back(in);
+        vin.push_back(std::move(in));
     }
-    txObj.pushKV("vin", vin);
+    txObj.pushKV("vin", std::move(vin));
     UniValue vout(UniValue::VARR);
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut& txout = tx.vout[i];
@@ -132,10 +133,10 @@ bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx,
         out.pushKV("n", (int64_t)i);
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-        out.pushKV("scriptPubKey", o);
-        vout.push_back(out);
+        out.pushKV("scriptPubKey", std::move(o));
+        vout.push_back(std::move(out));
     }
-    txObj.pushKV("vout", vout);
+    txObj.pushKV("vout", std::move(vout));
 
     if (!nHash.IsNull()) {
         txObj.pushKV("blockhash", nHash.GetHex());
@@ -223,7 +224,7 @@ static bool blockchain_block(HTTPRequest* req, const std::map<std::string, std::
     if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
         return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+    if(!ReadBlockFromCacheOrDisk(block, blockindex, Params().GetConsensus()))
         return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk");
 
     UniValue result(UniValue::VOBJ);
@@ -271,7 +272,7 @@ static bool blockchain_block_transactions(HTTPRequest* req, const std::map<std::
     if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
         return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
 
-    if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+    if(!ReadBlockFromCacheOrDisk(block, blockindex, Params().GetConsensus()))
         return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
     int nTxCount = block.vtx.size();
@@ -308,7 +309,7 @@ static bool blockchain_block_transactions(HTTPRequest* req, const std::map<std::
         if (!GetTransactionInfo(req, nHash, *tx, txObj, false)) {
             return false;
         }
-        txs.push_back(txObj);
+        txs.push_back(std::move(txObj));
         ++tx;
     }
 
@@ -367,14 +368,14 @@ bool blockchain_blocks_latest(HTTPRequest* req, const std::map<std::string, std:
         if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
             return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
 
-        if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+        if(!ReadBlockFromCacheOrDisk(block, blockindex, Params().GetConsensus()))
             return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
         UniValue blockInfo(UniValue::VOBJ);
         if (!GetBlockInfo(req, blockindex, block, blockInfo))
             return false;
 
-        response.push_back(blockInfo);
+        response.push_back(std::move(blockInfo));
     }
 
     SAPI::WriteReply(req, response);
@@ -430,14 +431,14 @@ bool blockchain_blocks_range(HTTPRequest* req, const std::map<std::string, std::
         if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
             return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
 
-        if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+        if(!ReadBlockFromCacheOrDisk(block, blockindex, Params().GetConsensus()))
             return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
         UniValue blockInfo(UniValue::VOBJ);
         if (!GetBlockInfo(req, blockindex, block, blockInfo))
             return false;
 
-        response.push_back(blockInfo);
+        response.push_back(std::move(blockInfo));
     }
 
     SAPI::WriteReply(req, response);
@@ -472,7 +473,7 @@ bool blockchain_transactions_latest(HTTPRequest* req, const std::map<std::string
         if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
             return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
 
-        if (!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+        if (!ReadBlockFromCacheOrDisk(block, blockindex, Params().GetConsensus()))
             return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
         auto tx = block.vtx.begin();
@@ -481,7 +482,7 @@ bool blockchain_transactions_latest(HTTPRequest* req, const std::map<std::string
             if (!GetTransactionInfo(req, blockindex->GetBlockHash(), *tx, txObj, false)) {
                 return false;
             }
-            response.push_back(txObj);
+            response.push_back(std::move(txObj));
             numTxs--;
         }
 
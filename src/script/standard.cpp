@@ -255,6 +255,29 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, vecto
     return true;
 }
 
+int ExtractIndexAddress(const CScript& script, uint160& hashBytes)
+{
+    // The common templates are matched by their layout, without the Solver
+    if (script.IsPayToScriptHash()) {
+        memcpy(hashBytes.begin(), &script[2], 20);
+        return 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        memcpy(hashBytes.begin(), &script[3], 20);
+        return 1;
+    } else if (script.IsPayToPublicKey()) {
+        hashBytes = CPubKey(script.begin() + 1, script.begin() + 34).GetID();
+        return 1;
+    } else if (script.IsPayToScriptHashLocked()) {
+        memcpy(hashBytes.begin(), &script[script[0] + 5], 20);
+        return 2;
+    } else if (script.IsPayToPublicKeyHashLocked()) {
+        memcpy(hashBytes.begin(), &script[script[0] + 6], 20);
+        return 1;
+    }
+    hashBytes.SetNull();
+    return 0;
+}
+
 namespace
 {
 class CScriptVisitor : public boost::static_visitor<bool>
@@ -75,6 +75,12 @@ const char* GetTxnOutputType(txnouttype t);
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet);
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet);
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet);
+/**
+ * Get the address type (1 = pubkey hash, 2 = script hash) and hash the address,
+ * spent and deposit indexes record for a script, or 0 if they don't track it.
+ * Pay-to-pubkey is recorded as its pubkey hash.
+ */
+int ExtractIndexAddress(const CScript& script, uint160& hashBytes);
 
 CScript GetScriptForDestination(const CTxDestination& dest);
 CScript GetLockedScriptForDestination(const CTxDestination& dest, int nLockTime);
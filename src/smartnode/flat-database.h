@@ -8,11 +8,14 @@
 #include "chainparams.h"
 #include "clientversion.h"
 #include "hash.h"
+#include "random.h"
 #include "streams.h"
 #include "util.h"
 
 #include <boost/filesystem.hpp>
 
+#include <functional>
+
 /** 
 *   Generic Dumping and Loading
 *   ---------------------------
@@ -37,7 +40,7 @@ private:
     std::string strFilename;
     std::string strMagicMessage;
 
-    bool Write(const T& objToSave)
+    bool Write(const T& objToSave, uint256* pHashLastWrite)
     {
         // LOCK(objToSave.cs);
 
@@ -49,35 +52,83 @@ private:
         ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
         ssObj << objToSave;
         uint256 hash = Hash(ssObj.begin(), ssObj.end());
+        if (pHashLastWrite && *pHashLastWrite == hash) {
+            LogPrintf("%s unchanged since the last write, skipping\n", strFilename);
+            return true;
+        }
         ssObj << hash;
 
+        // write to a temporary file first and move it over the old one once
+        // it is on disk, so a crash never leaves a truncated file behind
+        unsigned short randv = 0;
+        GetRandBytes((unsigned char*)&randv, sizeof(randv));
+        boost::filesystem::path pathTmp = GetDataDir() / strprintf("%s.%04x", strFilename, randv);
+
         // open output file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "wb");
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
         CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
         if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDB.string());
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
         // Write and commit header, data
         try {
             fileout << ssObj;
         }
         catch (std::exception &e) {
+            fileout.fclose();
+            boost::filesystem::remove(pathTmp);
             return error("%s: Serialize or I/O error - %s", __func__, e.what());
         }
+        FileCommit(fileout.Get());
         fileout.fclose();
 
+        if (!RenameOver(pathTmp, pathDB)) {
+            boost::filesystem::remove(pathTmp);
+            return error("%s: Rename-into-place failed", __func__);
+        }
+
+        if (pHashLastWrite)
+            *pHashLastWrite = hash;
+
         LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
 
         return true;
     }
 
-    ReadResult Read(T& objToLoad, bool fDryRun = false)
+    /** Check the file specific magic message and the network magic number */
+    template<typename Stream>
+    ReadResult ReadHeader(Stream& s)
     {
-        //LOCK(objToLoad.cs);
+        unsigned char pchMsgTmp[4];
+        std::string strMagicMessageTmp;
 
-        int64_t nStart = GetTimeMillis();
-        // open input file, and associate with CAutoFile
+        // de-serialize file header (file specific magic message) and ..
+        s >> strMagicMessageTmp;
+
+        // ... verify the message matches predefined one
+        if (strMagicMessage != strMagicMessageTmp)
+        {
+            error("%s: Invalid magic message", __func__);
+            return IncorrectMagicMessage;
+        }
+
+        // de-serialize file header (network specific magic number) and ..
+        s >> FLATDATA(pchMsgTmp);
+
+        // ... verify the network matches ours
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+        {
+            error("%s: Invalid network magic number", __func__);
+            return IncorrectMagicNumber;
+        }
+
+        return Ok;
+    }
+
+    /** Only verify the header, used before overwriting the file */
+    ReadResult VerifyHeader()
+    {
         FILE *file = fopen(pathDB.string().c_str(), "rb");
         CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
         if (filein.IsNull())
@@ -86,64 +137,45 @@ private:
             return FileError;
         }
 
-        // use file size to size memory buffer
-        int fileSize = boost::filesystem::file_size(pathDB);
-        int dataSize = fileSize - sizeof(uint256);
-        // Don't try to resize to a negative number if file is small
-        if (dataSize < 0)
-            dataSize = 0;
-        std::vector<unsigned char> vchData;
-        vchData.resize(dataSize);
-        uint256 hashIn;
-
-        // read data and checksum from file
         try {
-            filein.read((char *)&vchData[0], dataSize);
-            filein >> hashIn;
+            return ReadHeader(filein);
         }
         catch (std::exception &e) {
             error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            return HashReadError;
+            return IncorrectFormat;
         }
-        filein.fclose();
+    }
 
-        CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
+    ReadResult Read(T& objToLoad)
+    {
+        //LOCK(objToLoad.cs);
 
-        // verify stored checksum matches input data
-        uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-        if (hashIn != hashTmp)
+        int64_t nStart = GetTimeMillis();
+        // open input file, and associate with CAutoFile
+        FILE *file = fopen(pathDB.string().c_str(), "rb");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
         {
-            error("%s: Checksum mismatch, data corrupted", __func__);
-            return IncorrectHash;
+            error("%s: Failed to open file %s", __func__, pathDB.string());
+            return FileError;
         }
 
-
-        unsigned char pchMsgTmp[4];
-        std::string strMagicMessageTmp;
+        // data is followed by its checksum
+        uint64_t nFileSize = boost::filesystem::file_size(pathDB);
+        if (nFileSize < sizeof(uint256))
+        {
+            error("%s: File too small", __func__);
+            return HashReadError;
+        }
+        // de-serialize straight from the file, hashing everything read
+        CHashVerifier<CAutoFile> verifier(&filein, nFileSize - sizeof(uint256));
         try {
-            // de-serialize file header (file specific magic message) and ..
-            ssObj >> strMagicMessageTmp;
-
-            // ... verify the message matches predefined one
-            if (strMagicMessage != strMagicMessageTmp)
-            {
-                error("%s: Invalid magic message", __func__);
-                return IncorrectMagicMessage;
-            }
-
-
-            // de-serialize file header (network specific magic number) and ..
-            ssObj >> FLATDATA(pchMsgTmp);
-
-            // ... verify the network matches ours
-            if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
-            {
-                error("%s: Invalid network magic number", __func__);
-                return IncorrectMagicNumber;
-            }
+            ReadResult result = ReadHeader(verifier);
+            if (result != Ok)
+                return result;
 
             // de-serialize data into T object
-            ssObj >> objToLoad;
+            verifier >> objToLoad;
         }
         catch (std::exception &e) {
             objToLoad.Clear();
@@ -151,13 +183,32 @@ private:
             return IncorrectFormat;
         }
 
+        // read checksum from file
+        uint256 hashIn;
+        try {
+            verifier.ignore(verifier.size());
+            filein >> hashIn;
+        }
+        catch (std::exception &e) {
+            objToLoad.Clear();
+            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            return HashReadError;
+        }
+        filein.fclose();
+
+        // verify stored checksum matches input data
+        if (hashIn != verifier.GetHash())
+        {
+            objToLoad.Clear();
+            error("%s: Checksum mismatch, data corrupted", __func__);
+            return IncorrectHash;
+        }
+
         LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToLoad.ToString());
-        if(!fDryRun) {
-            LogPrintf("%s: Cleaning....\n", __func__);
-            objToLoad.CheckAndRemove();
-            LogPrintf("     %s\n", objToLoad.ToString());
-        }
+        LogPrintf("%s: Cleaning....\n", __func__);
+        objToLoad.CheckAndRemove();
+        LogPrintf("     %s\n", objToLoad.ToString());
 
         return Ok;
     }
@@ -194,13 +245,17 @@ public:
         return true;
     }
 
-    bool Dump(T& objToSave)
+    /**
+     * Write objToSave to the file. If pHashLastWrite is given, the write is
+     * skipped when the content matches that checksum, which is updated after
+     * every successful write.
+     */
+    bool Dump(T& objToSave, uint256* pHashLastWrite = NULL)
     {
         int64_t nStart = GetTimeMillis();
 
         LogPrintf("Verifying %s format...\n", strFilename);
-        T tmpObjToLoad;
-        ReadResult readResult = Read(tmpObjToLoad, true);
+        ReadResult readResult = VerifyHeader();
 
         // there was an error and it was not an error on file opening => do not proceed
         if (readResult == FileError)
@@ -218,7 +273,8 @@ public:
         }
 
         LogPrintf("Writing info to %s...\n", strFilename);
-        Write(objToSave);
+        if (!Write(objToSave, pHashLastWrite))
+            return false;
         LogPrintf("%s dump finished  %dms\n", strFilename, GetTimeMillis() - nStart);
 
         return true;
@@ -227,4 +283,403 @@ public:
 };
 
 
+
+/**
+*   Incremental Dumping and Loading
+*   -------------------------------
+*
+*   CFlatLog keeps an object as an append-only log of checksummed records,
+*   one per map entry or value the object lists in its LogRecords(Visitor&)
+*   method. Every record is keyed by a section number, unique within the
+*   object, and the serialized map key.
+*/
+
+typedef std::pair<unsigned char, std::vector<unsigned char> > CFlatLogKey;
+
+/**
+ * Collects the records of an object for CFlatLog. Given the hashes of the
+ * logged records, only the ones which changed since are kept.
+ */
+class CFlatLogWriter
+{
+private:
+    const std::map<CFlatLogKey, uint256>* pmapLogged;
+
+    template<typename V>
+    void Add(const CFlatLogKey& key, const V& value)
+    {
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << value;
+        uint256 hash = Hash(ssValue.begin(), ssValue.end());
+        mapHashes[key] = hash;
+        if (pmapLogged) {
+            std::map<CFlatLogKey, uint256>::const_iterator it = pmapLogged->find(key);
+            if (it != pmapLogged->end() && it->second == hash)
+                return;
+        }
+        vRecords.push_back(std::make_pair(key, std::vector<unsigned char>(ssValue.begin(), ssValue.end())));
+    }
+
+public:
+    std::string strFormat;
+    // hashes of all live records
+    std::map<CFlatLogKey, uint256> mapHashes;
+    // records to write
+    std::vector<std::pair<CFlatLogKey, std::vector<unsigned char> > > vRecords;
+
+    explicit CFlatLogWriter(const std::map<CFlatLogKey, uint256>* pmapLoggedIn) : pmapLogged(pmapLoggedIn) {}
+
+    void Format(const std::string& strFormatIn) { strFormat = strFormatIn; }
+
+    template<typename V>
+    void Value(unsigned char nSection, const V& value)
+    {
+        Add(CFlatLogKey(nSection, std::vector<unsigned char>()), value);
+    }
+
+    template<typename K, typename V, typename C, typename A>
+    void Map(unsigned char nSection, const std::map<K, V, C, A>& map)
+    {
+        for (typename std::map<K, V, C, A>::const_iterator it = map.begin(); it != map.end(); ++it) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey << it->first;
+            Add(CFlatLogKey(nSection, std::vector<unsigned char>(ssKey.begin(), ssKey.end())), it->second);
+        }
+    }
+};
+
+/**
+ * Applies the records of a log to an object. The handlers keep references
+ * into the object, so loading has to happen before other threads use it.
+ */
+class CFlatLogReader
+{
+public:
+    typedef std::function<void(const std::vector<unsigned char>& vchKey, const std::vector<unsigned char>* pvchValue)> Handler;
+
+    std::string strFormat;
+    std::map<unsigned char, Handler> mapSections;
+
+    void Format(const std::string& strFormatIn) { strFormat = strFormatIn; }
+
+    template<typename V>
+    void Value(unsigned char nSection, V& value)
+    {
+        mapSections[nSection] = [&value](const std::vector<unsigned char>& vchKey, const std::vector<unsigned char>* pvchValue) {
+            if (pvchValue) {
+                CDataStream ssValue(*pvchValue, SER_DISK, CLIENT_VERSION);
+                ssValue >> value;
+            }
+        };
+    }
+
+    template<typename K, typename V, typename C, typename A>
+    void Map(unsigned char nSection, std::map<K, V, C, A>& map)
+    {
+        mapSections[nSection] = [&map](const std::vector<unsigned char>& vchKey, const std::vector<unsigned char>* pvchValue) {
+            K key;
+            CDataStream ssKey(vchKey, SER_DISK, CLIENT_VERSION);
+            ssKey >> key;
+            if (pvchValue) {
+                V value;
+                CDataStream ssValue(*pvchValue, SER_DISK, CLIENT_VERSION);
+                ssValue >> value;
+                map[key] = value;
+            } else {
+                map.erase(key);
+            }
+        };
+    }
+};
+
+template<typename T>
+class CFlatLog
+{
+private:
+    //! The log is rewritten once it holds this many times the live records ...
+    static const unsigned int COMPACT_FACTOR = 2;
+    //! ... but not before it holds this many records
+    static const unsigned int COMPACT_MIN_RECORDS = 1000;
+
+    std::string strFilename;
+    std::string strMagicMessage;
+    // magic message of the CFlatDB file the log replaces, loaded once if found
+    std::string strLegacyMagicMessage;
+
+    // hashes of the live records as last logged
+    std::map<CFlatLogKey, uint256> mapLogged;
+    // records in the file, live or not
+    uint64_t nRecords;
+    // the file exists and can be appended to
+    bool fOpen;
+
+    boost::filesystem::path GetPath() const { return GetDataDir() / strFilename; }
+
+    static void WriteRecord(CDataStream& s, const CFlatLogKey& key, const std::vector<unsigned char>* pvchValue)
+    {
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << key.first << (pvchValue == NULL) << key.second;
+        if (pvchValue)
+            ssRecord << *pvchValue;
+        uint256 hash = Hash(ssRecord.begin(), ssRecord.end());
+        uint32_t nChecksum;
+        memcpy(&nChecksum, hash.begin(), sizeof(nChecksum));
+        s << (uint32_t)ssRecord.size() << ssRecord << nChecksum;
+    }
+
+    void WriteHeader(CDataStream& s, const std::string& strFormat) const
+    {
+        s << strMagicMessage; // specific magic message for this type of object
+        s << FLATDATA(Params().MessageStart()); // network specific magic number
+        s << strFormat; // version of the records, given by the object
+    }
+
+    /** Rewrite the log with only the live records */
+    bool Compact(const CFlatLogWriter& writer)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        WriteHeader(ss, writer.strFormat);
+        for (size_t i = 0; i < writer.vRecords.size(); i++)
+            WriteRecord(ss, writer.vRecords[i].first, &writer.vRecords[i].second);
+
+        unsigned short randv = 0;
+        GetRandBytes((unsigned char*)&randv, sizeof(randv));
+        boost::filesystem::path pathTmp = GetDataDir() / strprintf("%s.%04x", strFilename, randv);
+
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+        try {
+            fileout << ss;
+        }
+        catch (std::exception &e) {
+            fileout.fclose();
+            boost::filesystem::remove(pathTmp);
+            return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        }
+        FileCommit(fileout.Get());
+        fileout.fclose();
+
+        if (!RenameOver(pathTmp, GetPath())) {
+            boost::filesystem::remove(pathTmp);
+            return error("%s: Rename-into-place failed", __func__);
+        }
+
+        mapLogged = writer.mapHashes;
+        nRecords = writer.vRecords.size();
+        fOpen = true;
+        return true;
+    }
+
+    /** Append the changed records and tombstones for the erased ones */
+    bool Append(const CFlatLogWriter& writer, const std::vector<CFlatLogKey>& vErased)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        for (size_t i = 0; i < writer.vRecords.size(); i++)
+            WriteRecord(ss, writer.vRecords[i].first, &writer.vRecords[i].second);
+        for (size_t i = 0; i < vErased.size(); i++)
+            WriteRecord(ss, vErased[i], NULL);
+
+        FILE *file = fopen(GetPath().string().c_str(), "ab");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s: Failed to open file %s", __func__, GetPath().string());
+
+        // a failed write may leave a partial record behind, so start over
+        // with a fresh file on the next flush
+        fOpen = false;
+        try {
+            fileout << ss;
+        }
+        catch (std::exception &e) {
+            return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        }
+        FileCommit(fileout.Get());
+        fileout.fclose();
+
+        mapLogged = writer.mapHashes;
+        nRecords += writer.vRecords.size() + vErased.size();
+        fOpen = true;
+        return true;
+    }
+
+public:
+    CFlatLog(std::string strFilenameIn, std::string strMagicMessageIn, std::string strLegacyMagicMessageIn = "") :
+        strFilename(strFilenameIn),
+        strMagicMessage(strMagicMessageIn),
+        strLegacyMagicMessage(strLegacyMagicMessageIn),
+        nRecords(0),
+        fOpen(false)
+    {}
+
+    /**
+     * Replay the log into objToLoad. A torn or corrupted record ends the
+     * replay and is cut off the file. Returns false only if the file
+     * isn't a log of this kind.
+     */
+    bool Load(T& objToLoad)
+    {
+        int64_t nStart = GetTimeMillis();
+        boost::filesystem::path pathDB = GetPath();
+
+        mapLogged.clear();
+        nRecords = 0;
+        fOpen = false;
+
+        LogPrintf("Reading info from %s...\n", strFilename);
+        FILE *file = fopen(pathDB.string().c_str(), "rb+");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            LogPrintf("Missing file %s, will try to recreate\n", strFilename);
+            return true;
+        }
+
+        CFlatLogReader reader;
+        objToLoad.LogRecords(reader);
+
+        uint64_t nFileSize = boost::filesystem::file_size(pathDB);
+        uint64_t nPos = 0;
+        try {
+            std::string strMagicMessageTmp;
+            filein >> strMagicMessageTmp;
+            if (!strLegacyMagicMessage.empty() && strMagicMessageTmp == strLegacyMagicMessage) {
+                // the next flush replaces the snapshot with a log
+                filein.fclose();
+                LogPrintf("%s: Found a snapshot in %s, loading it\n", __func__, strFilename);
+                CFlatDB<T> flatdb(strFilename, strLegacyMagicMessage);
+                return flatdb.Load(objToLoad);
+            }
+            if (strMagicMessageTmp != strMagicMessage) {
+                error("%s: Invalid magic message", __func__);
+                LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
+                return false;
+            }
+
+            unsigned char pchMsgTmp[4];
+            filein >> FLATDATA(pchMsgTmp);
+            if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
+                error("%s: Invalid network magic number", __func__);
+                LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
+                return false;
+            }
+
+            std::string strFormatTmp;
+            filein >> strFormatTmp;
+            if (strFormatTmp != reader.strFormat) {
+                LogPrintf("%s: Outdated format %s in %s, will try to recreate\n", __func__, strFormatTmp, strFilename);
+                return true;
+            }
+            nPos = ftell(filein.Get());
+        }
+        catch (std::exception &e) {
+            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
+            return false;
+        }
+
+        while (nPos < nFileSize) {
+            unsigned char nSection;
+            bool fErase;
+            std::vector<unsigned char> vchKey, vchValue;
+            try {
+                uint32_t nSize, nChecksum;
+                filein >> nSize;
+                if (nSize > MAX_SIZE || nSize > nFileSize - nPos)
+                    throw std::ios_base::failure("record size out of range");
+                std::vector<char> vchRecord(nSize);
+                filein.read(vchRecord.data(), nSize);
+                filein >> nChecksum;
+                uint256 hash = Hash(vchRecord.begin(), vchRecord.end());
+                if (memcmp(&nChecksum, hash.begin(), sizeof(nChecksum)))
+                    throw std::ios_base::failure("checksum mismatch");
+
+                CDataStream ssRecord(vchRecord, SER_DISK, CLIENT_VERSION);
+                ssRecord >> nSection >> fErase >> vchKey;
+                if (!fErase)
+                    ssRecord >> vchValue;
+            }
+            catch (std::exception &e) {
+                LogPrintf("%s: Dropping a torn record at %d in %s - %s\n", __func__, nPos, strFilename, e.what());
+                if (!TruncateFile(filein.Get(), nPos))
+                    return error("%s: Failed to truncate %s", __func__, strFilename);
+                break;
+            }
+
+            try {
+                std::map<unsigned char, CFlatLogReader::Handler>::iterator it = reader.mapSections.find(nSection);
+                if (it != reader.mapSections.end())
+                    it->second(vchKey, fErase ? NULL : &vchValue);
+            }
+            catch (std::exception &e) {
+                objToLoad.Clear();
+                mapLogged.clear();
+                nRecords = 0;
+                error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                LogPrintf("%s: Magic is ok but data has invalid format, will try to recreate\n", __func__);
+                return true;
+            }
+
+            CFlatLogKey key(nSection, vchKey);
+            if (fErase)
+                mapLogged.erase(key);
+            else
+                mapLogged[key] = Hash(vchValue.begin(), vchValue.end());
+            nRecords++;
+            nPos = ftell(filein.Get());
+        }
+        filein.fclose();
+        fOpen = true;
+
+        LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
+        LogPrintf("     %s\n", objToLoad.ToString());
+        LogPrintf("%s: Cleaning....\n", __func__);
+        objToLoad.CheckAndRemove();
+        LogPrintf("     %s\n", objToLoad.ToString());
+
+        return true;
+    }
+
+    /**
+     * Log the records of objToSave which changed since the last flush, or
+     * rewrite the log if it grew too large or doesn't exist yet.
+     */
+    bool Flush(T& objToSave)
+    {
+        int64_t nStart = GetTimeMillis();
+
+        if (fOpen) {
+            CFlatLogWriter writer(&mapLogged);
+            objToSave.LogRecords(writer);
+
+            std::vector<CFlatLogKey> vErased;
+            for (std::map<CFlatLogKey, uint256>::const_iterator it = mapLogged.begin(); it != mapLogged.end(); ++it)
+                if (!writer.mapHashes.count(it->first))
+                    vErased.push_back(it->first);
+
+            size_t nAppend = writer.vRecords.size() + vErased.size();
+            if (nAppend == 0) {
+                LogPrintf("%s unchanged since the last flush, skipping\n", strFilename);
+                return true;
+            }
+            if (nRecords + nAppend <= std::max<uint64_t>(COMPACT_FACTOR * writer.mapHashes.size(), COMPACT_MIN_RECORDS)) {
+                if (!Append(writer, vErased))
+                    return false;
+                LogPrintf("Appended %d records to %s  %dms\n", nAppend, strFilename, GetTimeMillis() - nStart);
+                return true;
+            }
+        }
+
+        CFlatLogWriter writer(NULL);
+        objToSave.LogRecords(writer);
+        if (!Compact(writer))
+            return false;
+        LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
+        LogPrintf("     %s\n", objToSave.ToString());
+        return true;
+    }
+};
+
+
 #endif
@@ -710,7 +710,7 @@ void CInstantSend::CheckAndRemove()
             ++itLockCandidate;
         }
 
-        if( !pblocktree->WriteInstantPayLocks(mapLockIndex) ){
+        if( !pindexdb->WriteInstantPayLocks(mapLockIndex) ){
             LogPrintf("CInstantSend::CheckAndRemove() - Failed to write instantpay index\n");
         }
     }
@@ -36,6 +36,13 @@ public:
         READWRITE(mapFulfilledRequests);
     }
 
+    /** List the serialized state as records for CFlatLog */
+    template <typename Visitor>
+    void LogRecords(Visitor& v) {
+        LOCK(cs_mapFulfilledRequests);
+        v.Map(1, mapFulfilledRequests);
+    }
+
     void AddFulfilledRequest(const CService& addr, const std::string& strRequest); // expire after 1 hour by default
     bool HasFulfilledRequest(const CService& addr, const std::string& strRequest);
     void RemoveFulfilledRequest(const CService& addr, const std::string& strRequest);
@@ -6,6 +6,7 @@
 #include "consensus/validation.h"
 #include "consensus/consensus.h"
 #include "../init.h"
+#include "flat-database.h"
 #include "instantx.h"
 #include "../messagesigner.h"
 //#include "governance.h"
@@ -45,7 +46,8 @@ CSmartnode::CSmartnode(const CSmartnode& other) :
     nPoSeBanScore(other.nPoSeBanScore),
     nPoSeBanHeight(other.nPoSeBanHeight),
     fAllowMixingTx(other.fAllowMixingTx),
-    fUnitTest(other.fUnitTest)
+    fUnitTest(other.fUnitTest),
+    fCollateralChecked(other.fCollateralChecked)
 {}
 
 CSmartnode::CSmartnode(const CSmartnodeBroadcast& mnb) :
@@ -147,11 +149,16 @@ void CSmartnode::Check(bool fForce)
     int nHeight = 0;
     if(!fUnitTest) {
         nHeight = chainActive.Height();
-        CollateralStatus err = CheckCollateral(vin.prevout, nHeight);
-        if (err == COLLATERAL_UTXO_NOT_FOUND) {
-            nActiveState = SMARTNODE_OUTPOINT_SPENT;
-            LogPrint("smartnode", "CSmartnode::Check -- Failed to find Smartnode UTXO, smartnode=%s\n", vin.prevout.ToStringShort());
-            return;
+        // Look the collateral up once, CSmartnodeMan flags it as spent
+        // when a connected or disconnected block removes it afterwards
+        if(!fCollateralChecked) {
+            CollateralStatus err = CheckCollateral(vin.prevout, nHeight);
+            if (err == COLLATERAL_UTXO_NOT_FOUND) {
+                nActiveState = SMARTNODE_OUTPOINT_SPENT;
+                LogPrint("smartnode", "CSmartnode::Check -- Failed to find Smartnode UTXO, smartnode=%s\n", vin.prevout.ToStringShort());
+                return;
+            }
+            fCollateralChecked = true;
         }
     }
 
@@ -232,6 +239,25 @@ void CSmartnode::Check(bool fForce)
     }
 }
 
+void CSmartnode::FlagCollateralSpent()
+{
+    LOCK(cs);
+    if(IsOutpointSpent()) return;
+    nActiveState = SMARTNODE_OUTPOINT_SPENT;
+    LogPrint("smartnode", "CSmartnode::FlagCollateralSpent -- Smartnode UTXO spent, smartnode=%s\n", vin.prevout.ToStringShort());
+}
+
+void CSmartnode::ClearCollateralSpent()
+{
+    LOCK(cs);
+    if(!IsOutpointSpent()) return;
+    // let the next check look the collateral up again and find the real state
+    nActiveState = SMARTNODE_PRE_ENABLED;
+    fCollateralChecked = false;
+    nTimeLastChecked = 0;
+    LogPrint("smartnode", "CSmartnode::ClearCollateralSpent -- Smartnode UTXO unspent by reorg, smartnode=%s\n", vin.prevout.ToStringShort());
+}
+
 bool CSmartnode::IsInputAssociatedWithPubkey()
 {
     CScript payee;
@@ -910,62 +936,37 @@ void CSmartnode::FlagGovernanceItemsAsDirty()
     }
 }
 
-void ThreadSmartnode(CConnman& connman)
-{
-    static bool fOneThread;
-    if(fOneThread) return;
-    fOneThread = true;
-
-    // Make this thread recognisable as the PrivateSend thread
-    RenameThread("smartnode");
-
-    unsigned int nTick = 0;
+CFlatLog<CSmartnodeMan> flatlogSmartnodes("sncache.dat", "magicSmartnodeCacheLog", "magicSmartnodeCache");
+CFlatLog<CSmartnodePayments> flatlogSmartnodePayments("snpayments.dat", "magicSmartnodePaymentsCacheLog", "magicSmartnodePaymentsCache");
+CFlatLog<CNetFulfilledRequestManager> flatlogFulfilledRequests("netfulfilled.dat", "magicFulfilledCacheLog", "magicFulfilledCache");
 
-    while (true)
-    {
-        MilliSleep(1000);
-
-        // try to sync from all available nodes, one step at a time
-        smartnodeSync.ProcessTick(connman);
-
-        if( fLiteMode ){
-            if(smartnodeSync.IsSynced() ) return;
-            else continue;
-        }
-
-        if(smartnodeSync.IsSmartNodeSyncStarted() && !ShutdownRequested()) {
-
-            nTick++;
-
-            // make sure to check all smartnodes first
-            mnodeman.Check();
-
-            mnodeman.ProcessPendingMnbRequests(connman);
-            mnodeman.ProcessPendingMnvRequests(connman);
+void DumpSmartnodeCaches()
+{
+    static CCriticalSection cs_dump;
 
-            // check if we should activate or ping every few minutes,
-            // slightly postpone first run to give net thread a chance to connect to some peers
-            if(nTick % SMARTNODE_MIN_MNP_SECONDS == 15)
-                activeSmartnode.ManageState(connman);
+    LOCK(cs_dump);
+    bool fCache;
 
-            if(nTick % 60 == 0) {
-                netfulfilledman.CheckAndRemove();
-                mnodeman.ProcessSmartnodeConnections(connman);
-                mnodeman.CheckAndRemove(connman);
-                mnpayments.CheckAndRemove();
-                instantsend.CheckAndRemove();
-            }
+    fCache = GetBoolArg("-cachenodelist", DEFAULT_CACHE_NODES);
+    if( fCache ){
+        flatlogSmartnodes.Flush(mnodeman);
+    }
 
-            if(fSmartNode && (nTick % (60 * 5) == 0)) {
-                mnodeman.DoFullVerificationStep(connman);
-            }
+    fCache = GetBoolArg("-cachewinners", DEFAULT_CACHE_WINNERS);
+    if( fCache ){
+        flatlogSmartnodePayments.Flush(mnpayments);
+    }
 
-            /* WIP-VOTING uncomment
-            if(nTick % (60 * 5) == 0) {
-                smartVoting.DoMaintenance(connman);
-            }
-            */
+    fCache = GetBoolArg("-cachefulfilled", DEFAULT_CACHE_NETFULLFILLED);
+    if( fCache ){
+        flatlogFulfilledRequests.Flush(netfulfilledman);
+    }
 
-        }
+    /* WIP-VOTING uncomment
+    fCache = GetBoolArg("-cachevoting", DEFAULT_CACHE_VOTING);
+    if( fCache ){
+        CFlatDB<CSmartVotingManager> flatdb("smartvoting.dat", "magicSmartVotingCache");
+        flatdb.Dump(smartVoting);
     }
+    */
 }
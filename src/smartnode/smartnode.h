@@ -175,6 +175,8 @@ public:
     int nPoSeBanHeight{};
     bool fAllowMixingTx{};
     bool fUnitTest = false;
+    // collateral was found in the UTXO set once, spends are flagged by CSmartnodeMan from then on
+    bool fCollateralChecked{};
 
     // KEEP TRACK OF GOVERNANCE ITEMS EACH SMARTNODE HAS VOTE UPON FOR RECALCULATION
     std::map<uint256, int> mapGovernanceObjectsVotedOn;
@@ -219,6 +221,10 @@ public:
     static CollateralStatus CheckCollateral(const COutPoint& outpoint, int nHeight);
     static CollateralStatus CheckCollateral(const COutPoint& outpoint, int& nHeightRet, int nHeight);
     void Check(bool fForce = false);
+    /// Called by CSmartnodeMan when the collateral leaves the UTXO set
+    void FlagCollateralSpent();
+    /// Called by CSmartnodeMan when a reorg puts the spent collateral back
+    void ClearCollateralSpent();
 
     bool IsBroadcastedWithin(int nSeconds) { return GetAdjustedTime() - sigTime < nSeconds; }
 
@@ -256,6 +262,16 @@ public:
         return nActiveState == SMARTNODE_ENABLED;
     }
 
+    /// Hash of the CSmartnodeBroadcast this smartnode was created from, without building it
+    uint256 GetBroadcastHash() const
+    {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << vin;
+        ss << pubKeyCollateralAddress;
+        ss << sigTime;
+        return ss.GetHash();
+    }
+
     /// Is the input associated with collateral public key? (and there is 100000 SMART - checking if valid smartnode)
     bool IsInputAssociatedWithPubkey();
 
@@ -272,8 +288,8 @@ public:
     std::string GetStateString() const;
     std::string GetStatus() const;
 
-    int GetLastPaidTime() { return nTimeLastPaid; }
-    int GetLastPaidBlock() { return nBlockLastPaid; }
+    int GetLastPaidTime() const { return nTimeLastPaid; }
+    int GetLastPaidBlock() const { return nBlockLastPaid; }
     void UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack);
 
     // KEEP TRACK OF EACH GOVERNANCE ITEM INCASE THIS NODE GOES OFFLINE, SO WE CAN RECALC THEIR STATUS
@@ -296,6 +312,7 @@ public:
         nPoSeBanHeight = from.nPoSeBanHeight;
         fAllowMixingTx = from.fAllowMixingTx;
         fUnitTest = from.fUnitTest;
+        fCollateralChecked = from.fCollateralChecked;
         mapGovernanceObjectsVotedOn = from.mapGovernanceObjectsVotedOn;
         return *this;
     }
@@ -412,6 +429,17 @@ public:
     }
 };
 
-void ThreadSmartnode(CConnman& connman);
+template<typename T> class CFlatLog;
+class CSmartnodeMan;
+class CSmartnodePayments;
+class CNetFulfilledRequestManager;
+
+/** Record logs of the smartnode caches, loaded at startup and flushed by DumpSmartnodeCaches() */
+extern CFlatLog<CSmartnodeMan> flatlogSmartnodes;
+extern CFlatLog<CSmartnodePayments> flatlogSmartnodePayments;
+extern CFlatLog<CNetFulfilledRequestManager> flatlogFulfilledRequests;
+
+/** Log the changes to the smartnode caches enabled with -cachenodelist, -cachewinners and -cachefulfilled */
+void DumpSmartnodeCaches();
 
 #endif
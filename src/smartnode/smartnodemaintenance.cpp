@@ -0,0 +1,171 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "smartnodemaintenance.h"
+
+#include "activesmartnode.h"
+#include "instantx.h"
+#include "netfulfilledman.h"
+#include "smartnode.h"
+#include "smartnodeman.h"
+#include "smartnodepayments.h"
+#include "smartnodesync.h"
+#include "../init.h"
+#include "../scheduler.h"
+#include "../util.h"
+#include "../utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+CSmartnodeMaintenance smartnodeMaintenance;
+
+CSmartnodeMaintenance::CSmartnodeMaintenance() :
+    connman(NULL),
+    fSyncRunning(true),
+    fSyncTasksScheduled(false),
+    fCheckQueued(false)
+{
+}
+
+void CSmartnodeMaintenance::Schedule(const std::string& strName, int64_t nPeriod, bool fNeedsSync, Function func)
+{
+    {
+        LOCK(cs);
+        mapTaskStats[strName].nPeriod = nPeriod;
+    }
+    scheduler.scheduleEvery(boost::bind(&CSmartnodeMaintenance::RunTask, this, strName, fNeedsSync, func), nPeriod);
+}
+
+void CSmartnodeMaintenance::RunTask(const std::string& strName, bool fNeedsSync, Function func)
+{
+    if (ShutdownRequested())
+        return;
+    // The sync may have been reset, e.g. after the system slept
+    if (fNeedsSync && !smartnodeSync.IsSmartNodeSyncStarted())
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    func();
+    int64_t nTimeRun = GetTimeMicros() - nTimeStart;
+
+    LOCK(cs);
+    CMaintenanceTaskStats& stats = mapTaskStats[strName];
+    stats.nRuns++;
+    stats.nLastRunTime = GetTime();
+    stats.nLastMicros = nTimeRun;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nTimeRun);
+    stats.nTotalMicros += nTimeRun;
+}
+
+void CSmartnodeMaintenance::Start(boost::thread_group& threadGroup, CConnman& connmanIn)
+{
+    connman = &connmanIn;
+
+    CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
+    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "smartnode", serviceLoop));
+
+    // try to sync from all available nodes, one step at a time
+    {
+        LOCK(cs);
+        mapTaskStats["sync"].nPeriod = SMARTNODE_SYNC_TICK_SECONDS;
+    }
+    scheduler.scheduleFromNow(boost::bind(&CSmartnodeMaintenance::ProcessSync, this), SMARTNODE_SYNC_TICK_SECONDS);
+}
+
+void CSmartnodeMaintenance::ProcessSync()
+{
+    RunTask("sync", false, [this]() { smartnodeSync.ProcessTick(*connman); });
+
+    if (ShutdownRequested())
+        return;
+
+    // Lite mode only needs the sync, there is nothing to maintain afterwards.
+    // NotifySyncReset restarts the task if the sync starts over.
+    if (fLiteMode && smartnodeSync.IsSynced()) {
+        fSyncRunning = false;
+        // the sync may have been reset before the flag was cleared
+        if (smartnodeSync.IsSynced() || fSyncRunning.exchange(true))
+            return;
+    }
+
+    if (!fLiteMode && smartnodeSync.IsSmartNodeSyncStarted() && !fSyncTasksScheduled.exchange(true))
+        ScheduleSyncTasks();
+
+    scheduler.scheduleFromNow(boost::bind(&CSmartnodeMaintenance::ProcessSync, this), SMARTNODE_SYNC_TICK_SECONDS);
+}
+
+void CSmartnodeMaintenance::NotifySyncReset()
+{
+    // The flag is set until Start, and while the sync task is queued or running
+    if (fSyncRunning.exchange(true))
+        return;
+    scheduler.scheduleFromNow(boost::bind(&CSmartnodeMaintenance::ProcessSync, this), SMARTNODE_SYNC_TICK_SECONDS);
+}
+
+void CSmartnodeMaintenance::ScheduleSyncTasks()
+{
+    int64_t nCacheFlushInterval = GetArg("-cacheflushinterval", DEFAULT_CACHE_FLUSH_INTERVAL);
+
+    // Smartnode states only change with time, new broadcasts and new blocks,
+    // the latter two wake the check through NotifyListChanged.
+    Schedule("check", SMARTNODE_CHECK_SECONDS, true, boost::bind(&CSmartnodeMan::Check, &mnodeman));
+
+    Schedule("pendingrequests", 1, true, [this]() {
+        mnodeman.ProcessPendingMnbRequests(*connman);
+        mnodeman.ProcessPendingMnvRequests(*connman);
+    });
+
+    // check if we should activate or ping every few minutes
+    Function manageState = [this]() { activeSmartnode.ManageState(*connman); };
+    scheduler.scheduleFromNow([this, manageState]() {
+        RunTask("managestate", true, manageState);
+        Schedule("managestate", SMARTNODE_MIN_MNP_SECONDS, true, manageState);
+    }, SMARTNODE_MANAGE_STATE_DELAY);
+
+    Schedule("netfulfilled", SMARTNODE_CLEANUP_SECONDS, true, boost::bind(&CNetFulfilledRequestManager::CheckAndRemove, &netfulfilledman));
+    Schedule("connections", SMARTNODE_CLEANUP_SECONDS, true, [this]() { mnodeman.ProcessSmartnodeConnections(*connman); });
+    Schedule("smartnodes", SMARTNODE_CLEANUP_SECONDS, true, [this]() { mnodeman.CheckAndRemove(*connman); });
+    Schedule("payments", SMARTNODE_CLEANUP_SECONDS, true, boost::bind(&CSmartnodePayments::CheckAndRemove, &mnpayments));
+    Schedule("instantsend", SMARTNODE_CLEANUP_SECONDS, true, boost::bind(&CInstantSend::CheckAndRemove, &instantsend));
+
+    if (fSmartNode)
+        Schedule("verification", SMARTNODE_VERIFICATION_SECONDS, true, [this]() { mnodeman.DoFullVerificationStep(*connman); });
+
+    // persist the caches while running so a crash doesn't lose them
+    if (nCacheFlushInterval > 0) {
+        Schedule("dumpcaches", nCacheFlushInterval, true, []() {
+            if (smartnodeSync.IsSynced())
+                DumpSmartnodeCaches();
+        });
+    }
+
+    /* WIP-VOTING uncomment
+    Schedule("smartvoting", 60 * 5, true, [this]() { smartVoting.DoMaintenance(*connman); });
+    Schedule("votingpower", SMARTNODE_SYNC_TICK_SECONDS, false, UpdateVotingPower);
+    */
+}
+
+void CSmartnodeMaintenance::RunQueuedCheck()
+{
+    // Clear the flag first so changes during the check queue another one
+    fCheckQueued = false;
+    RunTask("check", true, boost::bind(&CSmartnodeMan::Check, &mnodeman));
+}
+
+void CSmartnodeMaintenance::NotifyListChanged()
+{
+    // Nothing to wake before the check task exists
+    if (!fSyncTasksScheduled)
+        return;
+    if (fCheckQueued.exchange(true))
+        return;
+    scheduler.scheduleFromNow(boost::bind(&CSmartnodeMaintenance::RunQueuedCheck, this), 0);
+}
+
+std::map<std::string, CMaintenanceTaskStats> CSmartnodeMaintenance::GetTaskStats() const
+{
+    LOCK(cs);
+    return mapTaskStats;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTNODE_MAINTENANCE_H
+#define SMARTNODE_MAINTENANCE_H
+
+#include "scheduler.h"
+#include "sync.h"
+
+#include <atomic>
+#include <map>
+#include <string>
+
+#include <boost/function.hpp>
+
+class CConnman;
+class CSmartnodeMaintenance;
+
+namespace boost
+{
+class thread_group;
+} // namespace boost
+
+namespace smartnode_tests
+{
+class TestSmartnodeMaintenance;
+} // namespace smartnode_tests
+
+//! Seconds between the periodic cleanups of the smartnode managers
+static const int SMARTNODE_CLEANUP_SECONDS = 60;
+//! Seconds between full verification steps of a smartnode
+static const int SMARTNODE_VERIFICATION_SECONDS = 5 * 60;
+//! Delay of the first ManageState after the smartnode sync started, gives the net thread a chance to connect to some peers
+static const int SMARTNODE_MANAGE_STATE_DELAY = 15;
+
+extern CSmartnodeMaintenance smartnodeMaintenance;
+
+/** Run statistics of a single smartnode maintenance task */
+struct CMaintenanceTaskStats
+{
+    int64_t nPeriod;
+    uint64_t nRuns;
+    int64_t nLastRunTime;
+    int64_t nLastMicros;
+    int64_t nMaxMicros;
+    int64_t nTotalMicros;
+
+    CMaintenanceTaskStats() : nPeriod(0), nRuns(0), nLastRunTime(0), nLastMicros(0), nMaxMicros(0), nTotalMicros(0) {}
+};
+
+/**
+ * Runs the periodic maintenance of the smartnode modules (sync, list checks,
+ * cleanups, pings and cache flushes) as tasks of its own scheduler, each with
+ * its own period. The scheduler is serviced by a dedicated thread, so the long
+ * running list checks and cleanups don't hold up the tasks of the node
+ * scheduler. The smartnode list check additionally runs right away when the
+ * list or the chain tip changed, so it doesn't have to poll every second.
+ */
+class CSmartnodeMaintenance
+{
+    friend class smartnode_tests::TestSmartnodeMaintenance; // for test access to the scheduler
+public:
+    typedef boost::function<void(void)> Function;
+
+private:
+    mutable CCriticalSection cs;
+    std::map<std::string, CMaintenanceTaskStats> mapTaskStats;
+
+    CScheduler scheduler;
+    CConnman* connman;
+
+    //! Cleared while the sync task is stopped, see ProcessSync
+    std::atomic<bool> fSyncRunning;
+
+    //! Set once the tasks which wait for the smartnode sync have been scheduled
+    std::atomic<bool> fSyncTasksScheduled;
+    //! Set while a list check requested by NotifyListChanged is queued
+    std::atomic<bool> fCheckQueued;
+
+    void Schedule(const std::string& strName, int64_t nPeriod, bool fNeedsSync, Function func);
+    void RunTask(const std::string& strName, bool fNeedsSync, Function func);
+
+    void ProcessSync();
+    void ScheduleSyncTasks();
+    void RunQueuedCheck();
+
+public:
+    CSmartnodeMaintenance();
+
+    /** Start the maintenance thread and schedule the sync, called once at startup */
+    void Start(boost::thread_group& threadGroup, CConnman& connmanIn);
+
+    /** Restart the sync task after the smartnode sync was reset */
+    void NotifySyncReset();
+
+    /** Wake the smartnode list check after new broadcasts or a new tip */
+    void NotifyListChanged();
+
+    std::map<std::string, CMaintenanceTaskStats> GetTaskStats() const;
+};
+
+#endif
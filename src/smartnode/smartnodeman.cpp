@@ -7,6 +7,7 @@
 #include "../messagesigner.h"
 #include "script/standard.h"
 #include "smartnodepayments.h"
+#include "smartnodemaintenance.h"
 #include "smartnodesync.h"
 #include "netfulfilledman.h"
 #include "smartnodeman.h"
@@ -187,10 +188,9 @@ void CSmartnodeMan::CheckAndRemove(CConnman& connman)
         int nAskForMnbRecovery = MNB_RECOVERY_MAX_ASK_ENTRIES;
         std::map<COutPoint, CSmartnode>::iterator it = mapSmartnodes.begin();
         while (it != mapSmartnodes.end()) {
-            CSmartnodeBroadcast mnb = CSmartnodeBroadcast(it->second);
-            uint256 hash = mnb.GetHash();
             // If collateral was spent ...
             if (it->second.IsOutpointSpent()) {
+                uint256 hash = it->second.GetBroadcastHash();
                 LogPrint("smartnode", "CSmartnodeMan::CheckAndRemove -- Removing Smartnode: %s  addr=%s  %i now\n", it->second.GetStateString(), it->second.addr.ToString(), size() - 1);
 
                 // erase all of the broadcasts we've seen from this txin, ...
@@ -204,8 +204,13 @@ void CSmartnodeMan::CheckAndRemove(CConnman& connman)
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
                             smartnodeSync.IsSynced() &&
-                            it->second.IsNewStartRequired() &&
-                            !IsMnbRecoveryRequested(hash);
+                            it->second.IsNewStartRequired();
+                uint256 hash;
+                if(fAsk) {
+                    // only hash the broadcast of the few nodes that may need recovery
+                    hash = it->second.GetBroadcastHash();
+                    fAsk = !IsMnbRecoveryRequested(hash);
+                }
                 if(fAsk) {
                     // this mn is in a non-recoverable state and we haven't asked other nodes yet
                     std::set<CNetAddr> setRequested;
@@ -827,11 +832,16 @@ void CSmartnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
 
         LogPrint("smartnode", "MNPING -- Smartnode ping, smartnode=%s\n", mnp.outpoint.ToStringShort());
 
+        // Most pings are relays of ones we have already seen, drop those without waiting for cs_main
+        {
+            LOCK(cs);
+            if(mapSeenSmartnodePing.count(nHash)) return; //seen
+        }
+
         // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
         LOCK2(cs_main, cs);
 
-        if(mapSeenSmartnodePing.count(nHash)) return; //seen
-        mapSeenSmartnodePing.insert(std::make_pair(nHash, mnp));
+        if(!mapSeenSmartnodePing.insert(std::make_pair(nHash, mnp)).second) return; //seen
 
         LogPrint("smartnode", "MNPING -- Smartnode ping, smartnode=%s new\n", mnp.outpoint.ToStringShort());
 
@@ -1478,12 +1488,14 @@ void CSmartnodeMan::UpdateSmartnodeList(CSmartnodeBroadcast mnb, CConnman& connm
     if(pmn == NULL) {
         if(Add(mnb)) {
             smartnodeSync.BumpAssetLastTime("CSmartnodeMan::UpdateSmartnodeList - new");
+            smartnodeMaintenance.NotifyListChanged();
         }
     } else {
         CSmartnodeBroadcast mnbOld = mapSeenSmartnodeBroadcast[CSmartnodeBroadcast(*pmn).GetHash()].second;
         if(pmn->UpdateFromNewBroadcast(mnb, connman)) {
             smartnodeSync.BumpAssetLastTime("CSmartnodeMan::UpdateSmartnodeList - seen");
             mapSeenSmartnodeBroadcast.erase(mnbOld.GetHash());
+            smartnodeMaintenance.NotifyListChanged();
         }
     }
 }
@@ -1687,6 +1699,52 @@ void CSmartnodeMan::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
+void CSmartnodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    // only spends confirmed in the active chain count
+    if(!pblock || tx.IsCoinBase()) return;
+
+    LOCK(cs);
+
+    if(mapSmartnodes.empty()) return;
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+        std::map<COutPoint, CSmartnode>::iterator it = mapSmartnodes.find(txin.prevout);
+        if(it != mapSmartnodes.end()) {
+            it->second.FlagCollateralSpent();
+        }
+    }
+}
+
+void CSmartnodeMan::BlockDisconnected(const CBlock& block)
+{
+    LOCK(cs);
+
+    if(mapSmartnodes.empty()) return;
+
+    // collateral spent by the block is unspent again ...
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if(tx.IsCoinBase()) continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            std::map<COutPoint, CSmartnode>::iterator it = mapSmartnodes.find(txin.prevout);
+            if(it != mapSmartnodes.end()) {
+                it->second.ClearCollateralSpent();
+            }
+        }
+    }
+
+    // ... and collateral created by it is gone
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        const uint256& txid = tx.GetHash();
+        for(unsigned int i = 0; i < tx.vout.size(); i++) {
+            std::map<COutPoint, CSmartnode>::iterator it = mapSmartnodes.find(COutPoint(txid, i));
+            if(it != mapSmartnodes.end()) {
+                it->second.FlagCollateralSpent();
+            }
+        }
+    }
+}
+
 void CSmartnodeMan::NotifySmartnodeUpdates(CConnman& connman)
 {
     // Avoid double locking
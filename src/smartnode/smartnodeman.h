@@ -19,6 +19,9 @@ extern CSmartnodeMan mnodeman;
 class CSmartnodeMan
 {
 public:
+    // critical section to protect the inner data structures
+    mutable CCriticalSection cs;
+
     typedef std::pair<arith_uint256, CSmartnode*> score_pair_t;
     typedef std::vector<score_pair_t> score_pair_vec_t;
     typedef std::pair<int, CSmartnode> rank_pair_t;
@@ -42,9 +45,6 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
-    // critical section to protect the inner data structures
-    mutable CCriticalSection cs;
-
     // Keep track of current block height
     int nCachedBlockHeight;
 
@@ -124,6 +124,23 @@ public:
         }
     }
 
+    /** List the serialized state as records for CFlatLog */
+    template <typename Visitor>
+    void LogRecords(Visitor& v) {
+        LOCK(cs);
+        v.Format(SERIALIZATION_VERSION_STRING);
+        v.Map(1, mapSmartnodes);
+        v.Map(2, mAskedUsForSmartnodeList);
+        v.Map(3, mWeAskedForSmartnodeList);
+        v.Map(4, mWeAskedForSmartnodeListEntry);
+        v.Map(5, mMnbRecoveryRequests);
+        v.Map(6, mMnbRecoveryGoodReplies);
+        v.Value(7, nLastWatchdogVoteTime);
+        v.Value(8, nDsqCount);
+        v.Map(9, mapSeenSmartnodeBroadcast);
+        v.Map(10, mapSeenSmartnodePing);
+    }
+
     CSmartnodeMan();
 
     /// Add an entry
@@ -236,6 +253,11 @@ public:
 
     void UpdatedBlockTip(const CBlockIndex *pindex);
 
+    /// Flag smartnodes whose collateral is spent by a transaction of a connected block
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    /// Un-flag collateral spent by a disconnected block, flag collateral it created
+    void BlockDisconnected(const CBlock& block);
+
     /**
      * Called to notify CSmartVotingManager that the smartnode index has been updated.
      * Must be called while not holding the CSmartnodeMan::cs mutex
@@ -9,6 +9,7 @@
 #include "smartnodeman.h"
 #include "smarthive/hive.h"
 #include "../messagesigner.h"
+#include "../miner.h"
 #include "netfulfilledman.h"
 #include "script/standard.h"
 #include "spork.h"
@@ -203,6 +204,8 @@ void CSmartnodePayments::Clear()
     LOCK2(cs_mapSmartnodeBlocks, cs_mapSmartnodePaymentVotes);
     mapSmartnodeBlocks.clear();
     mapSmartnodePaymentVotes.clear();
+    mapScheduledBlocks.clear();
+    mapScheduledPayees.clear();
 }
 
 bool CSmartnodePayments::UpdateLastVote(const CSmartnodePaymentVote& vote)
@@ -498,20 +501,60 @@ bool CSmartnodePayments::IsScheduled(CSmartnode& mn, int nNotBlockHeight)
     CScript mnpayee;
     mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
+    auto it = mapScheduledPayees.find(mnpayee);
+    if(it == mapScheduledPayees.end()) return false;
+
+    // scheduled for any height other than nNotBlockHeight
+    return it->second.size() > 1 || *it->second.begin() != nNotBlockHeight;
+}
+
+// Refresh the best payees of nBlockHeight in the scheduled payee index
+void CSmartnodePayments::UpdateScheduledPayees(int nBlockHeight)
+{
+    AssertLockHeld(cs_mapSmartnodeBlocks);
+
+    auto itBlock = mapScheduledBlocks.find(nBlockHeight);
+    if(itBlock != mapScheduledBlocks.end()) {
+        BOOST_FOREACH(const CScript& payee, itBlock->second) {
+            auto itPayee = mapScheduledPayees.find(payee);
+            if(itPayee == mapScheduledPayees.end()) continue;
+            itPayee->second.erase(nBlockHeight);
+            if(itPayee->second.empty()) mapScheduledPayees.erase(itPayee);
+        }
+        mapScheduledBlocks.erase(itBlock);
+    }
+
+    if(nBlockHeight < nCachedBlockHeight || nBlockHeight > nScheduledWindowEnd) return;
+
+    auto it = mapSmartnodeBlocks.find(nBlockHeight);
     CScriptVector payees;
-    int interval = SmartNodePayments::PayoutInterval(nCachedBlockHeight);
+    if(it == mapSmartnodeBlocks.end() || !it->second.GetBestPayees(payees)) return;
+
+    BOOST_FOREACH(const CScript& payee, payees) {
+        mapScheduledPayees[payee].insert(nBlockHeight);
+    }
+    mapScheduledBlocks[nBlockHeight] = payees;
+}
 
-    for(int64_t h = nCachedBlockHeight; h <= nCachedBlockHeight + MNPAYMENTS_FUTURE_VOTES + interval - 1; h++){
+// Move the scheduled payee window to the current tip: it spans the heights
+// nCachedBlockHeight up to MNPAYMENTS_FUTURE_VOTES + payout interval ahead
+void CSmartnodePayments::RebuildScheduledPayees()
+{
+    AssertLockHeld(cs_mapSmartnodeBlocks);
+
+    int interval = SmartNodePayments::PayoutInterval(nCachedBlockHeight);
+    int h = nCachedBlockHeight;
+    while(h <= nCachedBlockHeight + MNPAYMENTS_FUTURE_VOTES + interval - 1) {
         interval = SmartNodePayments::PayoutInterval(h);
-        if(h == nNotBlockHeight) continue;
-        if(mapSmartnodeBlocks.count(h) &&
-           mapSmartnodeBlocks[h].GetBestPayees(payees) &&
-           std::find(payees.begin(),payees.end(), mnpayee) != payees.end() ) {
-            return true;
-        }
+        h++;
     }
+    nScheduledWindowEnd = h - 1;
 
-    return false;
+    mapScheduledBlocks.clear();
+    mapScheduledPayees.clear();
+    for(h = nCachedBlockHeight; h <= nScheduledWindowEnd; h++) {
+        UpdateScheduledPayees(h);
+    }
 }
 
 bool CSmartnodePayments::AddOrUpdatePaymentVote(const CSmartnodePaymentVote& vote)
@@ -523,14 +566,21 @@ bool CSmartnodePayments::AddOrUpdatePaymentVote(const CSmartnodePaymentVote& vot
 
     if(HasVerifiedPaymentVote(nVoteHash)) return false;
 
-    LOCK2(cs_mapSmartnodeBlocks, cs_mapSmartnodePaymentVotes);
+    {
+        LOCK2(cs_mapSmartnodeBlocks, cs_mapSmartnodePaymentVotes);
+
+        mapSmartnodePaymentVotes[nVoteHash] = vote;
 
-    mapSmartnodePaymentVotes[nVoteHash] = vote;
+        auto it = mapSmartnodeBlocks.emplace(vote.nBlockHeight, CSmartnodeBlockPayees(vote.nBlockHeight)).first;
+        it->second.AddPayees(vote);
+        UpdateScheduledPayees(vote.nBlockHeight);
 
-    auto it = mapSmartnodeBlocks.emplace(vote.nBlockHeight, CSmartnodeBlockPayees(vote.nBlockHeight)).first;
-    it->second.AddPayees(vote);
+        LogPrint("mnpayments", "CSmartnodePayments::AddOrUpdatePaymentVote -- added, nHeight=%d, hash=%s\n",it->second.nBlockHeight, nVoteHash.ToString());
+    }
 
-    LogPrint("mnpayments", "CSmartnodePayments::AddOrUpdatePaymentVote -- added, nHeight=%d, hash=%s\n",it->second.nBlockHeight, nVoteHash.ToString());
+    // The payees of a cached block template for this height may have changed.
+    // Done without our locks, block creation takes them under the cache lock.
+    blockTemplateCache.InvalidateCoinbase(vote.nBlockHeight);
 
     return true;
 }
@@ -821,6 +871,7 @@ void CSmartnodePayments::CheckAndRemove()
             LogPrint("mnpayments", "CSmartnodePayments::CheckAndRemove -- Removing old Smartnode payment: nBlockHeight=%d\n", vote.nBlockHeight);
             mapSmartnodePaymentVotes.erase(it++);
             mapSmartnodeBlocks.erase(vote.nBlockHeight);
+            UpdateScheduledPayees(vote.nBlockHeight);
         } else {
             ++it;
         }
@@ -1199,7 +1250,11 @@ void CSmartnodePayments::UpdatedBlockTip(const CBlockIndex *pindex, CConnman& co
 {
     if(!pindex) return;
 
-    nCachedBlockHeight = pindex->nHeight;
+    {
+        LOCK(cs_mapSmartnodeBlocks);
+        nCachedBlockHeight = pindex->nHeight;
+        RebuildScheduledPayees();
+    }
     LogPrint("mnpayments", "CSmartnodePayments::UpdatedBlockTip -- nCachedBlockHeight=%d\n", nCachedBlockHeight);
 
     int interval = SmartNodePayments::PayoutInterval(nCachedBlockHeight);
@@ -23,6 +23,7 @@ static const int MNPAYMENTS_FUTURE_VOTES                = 20;
 
 extern CCriticalSection cs_vecPayees;
 extern CCriticalSection cs_mapSmartnodeBlocks;
+extern CCriticalSection cs_mapSmartnodePaymentVotes;
 extern CCriticalSection cs_mapSmartnodePayeeVotes;
 
 extern CSmartnodePayments mnpayments;
@@ -211,13 +212,22 @@ private:
     // Keep track of current block height
     int nCachedBlockHeight;
 
+    // Best payees of the heights IsScheduled() looks at, by payee script.
+    // Updated as votes come in and the tip moves, guarded by cs_mapSmartnodeBlocks.
+    int nScheduledWindowEnd;
+    std::map<int, CScriptVector> mapScheduledBlocks;
+    std::map<CScript, std::set<int> > mapScheduledPayees;
+
+    void UpdateScheduledPayees(int nBlockHeight);
+    void RebuildScheduledPayees();
+
 public:
     std::map<uint256, CSmartnodePaymentVote> mapSmartnodePaymentVotes;
     std::map<int, CSmartnodeBlockPayees> mapSmartnodeBlocks;
     std::map<COutPoint, int> mapSmartnodesLastVote;
     std::map<COutPoint, int> mapSmartnodesDidNotVote;
 
-    CSmartnodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000) {}
+    CSmartnodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000), nCachedBlockHeight(0), nScheduledWindowEnd(-1) {}
 
     ADD_SERIALIZE_METHODS
 
@@ -227,6 +237,14 @@ public:
         READWRITE(mapSmartnodeBlocks);
     }
 
+    /** List the serialized state as records for CFlatLog */
+    template <typename Visitor>
+    void LogRecords(Visitor& v) {
+        LOCK2(cs_mapSmartnodeBlocks, cs_mapSmartnodePaymentVotes);
+        v.Map(1, mapSmartnodePaymentVotes);
+        v.Map(2, mapSmartnodeBlocks);
+    }
+
     void Clear();
 
     bool AddOrUpdatePaymentVote(const CSmartnodePaymentVote& vote);
@@ -8,6 +8,7 @@
 #include "smartnode.h"
 #include "smartnodepayments.h"
 #include "smartnodesync.h"
+#include "smartnodemaintenance.h"
 #include "smartnodeman.h"
 #include "smartvoting/manager.h"
 #include "netfulfilledman.h"
@@ -20,6 +21,7 @@
 class CSmartnodeSync;
 CSmartnodeSync smartnodeSync;
 
+CCriticalSection cs_mapSmartnodeListCounts;
 std::map<int, int> mapSmartnodeListCounts;
 
 CCriticalSection cs_unknownpings;
@@ -28,6 +30,7 @@ std::map<COutPoint,int> mapTryUnknownPings;
 int GetMeanListCount()
 {
     int nTotal = 0;
+    LOCK(cs_mapSmartnodeListCounts);
     auto it = mapSmartnodeListCounts.begin();
 
     while(it != mapSmartnodeListCounts.end() ){
@@ -213,8 +216,10 @@ void CSmartnodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         int nCount;
         vRecv >> nItemID >> nCount;
 
-        if( nItemID == SMARTNODE_SYNC_LIST && !mapSmartnodeListCounts.count(pfrom->id))
+        if( nItemID == SMARTNODE_SYNC_LIST) {
+            LOCK(cs_mapSmartnodeListCounts);
             mapSmartnodeListCounts.insert(std::make_pair(pfrom->id,nCount));
+        }
 
         LogPrintf("SYNCSTATUSCOUNT -- got inventory count: nItemID=%d  nCount=%d  peer=%d\n", nItemID, nCount, pfrom->id);
     }
@@ -505,6 +510,7 @@ void CSmartnodeSync::UpdatedBlockTip(const CBlockIndex *pindexNew, bool fInitial
         if (IsBlockchainSynced()) {
             LogPrint("mnsync", "CSmartnodeSync::UpdatedBlockTip -- Reset, switched too early!\n");
             Reset();
+            smartnodeMaintenance.NotifySyncReset();
         }
 
         // no need to check any further while still in IBD mode
@@ -520,6 +526,7 @@ void CSmartnodeSync::UpdatedBlockTip(const CBlockIndex *pindexNew, bool fInitial
         // probably initial timeout was not enough,
         // because there is no way we can update tip not having best header
         Reset();
+        smartnodeMaintenance.NotifySyncReset();
         LogPrint("mnsync", "CSmartnodeSync::UpdatedBlockTip -- Reset, stucked on header sync?\n");
         fReachedBestHeader = false;
         return;
@@ -13,6 +13,8 @@ static const bool DEFAULT_CACHE_NODES = false;
 static const bool DEFAULT_CACHE_WINNERS= true;
 static const bool DEFAULT_CACHE_NETFULLFILLED = true;
 static const bool DEFAULT_CACHE_VOTING = true;
+//! Seconds between writes of the smartnode caches while running, 0 = only at shutdown
+static const int64_t DEFAULT_CACHE_FLUSH_INTERVAL = 10 * 60;
 
 class CSmartnodeSync;
 
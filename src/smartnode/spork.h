@@ -34,6 +34,9 @@ static const int SPORK_21_SMARTNODE_PROTOCOL_REQUIREMENT                = 10020;
 static const int SPORK_START                                            = SPORK_2_INSTANTSEND_ENABLED;
 static const int SPORK_END                                              = SPORK_21_SMARTNODE_PROTOCOL_REQUIREMENT;
 
+/** Protects mapSporks and the active sporks of sporkManager, which are
+ *  accessed from all message processing threads. */
+extern CCriticalSection cs_mapSporks;
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, int64_t> mapSporkDefaults;
 extern CSporkManager sporkManager;
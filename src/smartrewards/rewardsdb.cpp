@@ -31,7 +31,7 @@ static const char DB_TX_HASH = 't';
 
 static const char DB_VERSION = 'V';
 
-CSmartRewardsDB::CSmartRewardsDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "rewards", nCacheSize, fMemory, fWipe)
+CSmartRewardsDB::CSmartRewardsDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "rewards", nCacheSize, fMemory, fWipe, false, "rewards")
 {
     if (!Exists(DB_VERSION)) {
         Write(DB_VERSION, REWARDS_DB_VERSION);
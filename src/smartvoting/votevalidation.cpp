@@ -18,124 +18,109 @@ static std::map<CVoteKey, CVotingPower> mapActiveVoteKeys;
 
 bool GetBalanceDelta(const CSmartAddress &address, int nStartBlock, int nEndBlock, CAmount &delta);
 
-void ThreadSmartVoting()
+void UpdateVotingPower()
 {
-    static bool fOneThread;
-    if(fOneThread) return;
-    fOneThread = true;
-
     // We don't need to calculate any voting power in litemode.
     if( fLiteMode ) return;
 
-    // Make this thread recognisable as the SmartVoting thread
-    RenameThread("smartvoting");
+    if( !smartnodeSync.IsBlockchainSynced() ) return;
 
     // Check if we have some unparsed votekey registrations every block
-    int nLastChecked = 0;
-
-    while (true)
-    {
-        MilliSleep(1000);
-
-        if( ShutdownRequested() ) return;
+    static int nLastChecked = 0;
 
-        if(smartnodeSync.IsBlockchainSynced() ) {
+    int nHeight = chainActive.Height();
 
-            int nHeight = chainActive.Height();
+    if( nHeight == nLastChecked ) return;
 
-            if( nHeight == nLastChecked ) continue;
+    nLastChecked = nHeight;
 
-            nLastChecked = nHeight;
+    std::set<CVoteKey> setActiveKeys;
 
-            std::set<CVoteKey> setActiveKeys;
+    // Update votekeys active from proposals
+    if( smartnodeSync.IsSynced() ){
 
-            // Update votekeys active from proposals
-            if( smartnodeSync.IsSynced() ){
+        std::vector<const CProposal*> vecProposals = smartVoting.GetAllNewerThan(0);
 
-                std::vector<const CProposal*> vecProposals = smartVoting.GetAllNewerThan(0);
-
-                for( auto proposal : vecProposals ){
-                    proposal->GetActiveVoteKeys(setActiveKeys);
-                }
-
-                for( auto it : setActiveKeys ){
-                    AddActiveVoteKey(it);
-                }
+        for( auto proposal : vecProposals ){
+            proposal->GetActiveVoteKeys(setActiveKeys);
+        }
 
-            }
+        for( auto it : setActiveKeys ){
+            AddActiveVoteKey(it);
+        }
 
-            if( pwalletMain ){
+    }
 
-                // Add votekeys available in the wallet to the validation
-                // and update the meta data of the votekeys if necessary
+    if( pwalletMain ){
 
-                std::set<CKeyID> setWalletKeyIds;
+        // Add votekeys available in the wallet to the validation
+        // and update the meta data of the votekeys if necessary
 
-                {
-                    LOCK(pwalletMain->cs_wallet);
-                    pwalletMain->GetVotingKeys(setWalletKeyIds);
-                }
+        std::set<CKeyID> setWalletKeyIds;
 
-                for( auto keyId : setWalletKeyIds ){
+        {
+            LOCK(pwalletMain->cs_wallet);
+            pwalletMain->GetVotingKeys(setWalletKeyIds);
+        }
 
-                    CVoteKey voteKey(keyId);
-                    CVoteKeyValue value;
+        for( auto keyId : setWalletKeyIds ){
 
-                    if( IsRegisteredForVoting(voteKey) ){
+            CVoteKey voteKey(keyId);
+            CVoteKeyValue value;
 
-                        if( !setActiveKeys.count(voteKey) )
-                            setActiveKeys.insert(voteKey);
+            if( IsRegisteredForVoting(voteKey) ){
 
-                        AddActiveVoteKey(voteKey);
-                    }
-                }
+                if( !setActiveKeys.count(voteKey) )
+                    setActiveKeys.insert(voteKey);
 
+                AddActiveVoteKey(voteKey);
             }
+        }
 
-            LOCK(cs);
-
-            for (auto it = mapActiveVoteKeys.begin(); it != mapActiveVoteKeys.end();){
+    }
 
-                // Check if the address we validate is not longer active
-                if( setActiveKeys.size() && !setActiveKeys.count(it->first) ){
-                    it = mapActiveVoteKeys.erase(it);
-                    continue;
-                }
+    LOCK(cs);
 
-                int nStart = 0;
+    for (auto it = mapActiveVoteKeys.begin(); it != mapActiveVoteKeys.end();){
 
-                if( it->second.IsValid() ){
+        // Check if the address we validate is not longer active
+        if( setActiveKeys.size() && !setActiveKeys.count(it->first) ){
+            it = mapActiveVoteKeys.erase(it);
+            continue;
+        }
 
-                    if( it->second.nBlockHeight < nHeight ){
-                        nStart = it->second.nBlockHeight + 1;
-                    }else{
-                        ++it;
-                        continue;
-                    }
+        int nStart = 0;
 
-                }
+        if( it->second.IsValid() ){
 
-                if( nHeight < nValidationConfirmations ){
-                    ++it;
-                    continue;
-                }
+            if( it->second.nBlockHeight < nHeight ){
+                nStart = it->second.nBlockHeight + 1;
+            }else{
+                ++it;
+                continue;
+            }
 
-                if( ( nHeight - nStart ) < nValidationConfirmations ){
-                    ++it;
-                    continue;
-                }
+        }
 
-                CAmount nDelta = 0;
+        if( nHeight < nValidationConfirmations ){
+            ++it;
+            continue;
+        }
 
-                if( GetBalanceDelta(it->second.address, nStart, nHeight, nDelta) ){
-                    it->second.nPower += nDelta;
-                    it->second.nBlockHeight = nHeight;
-                }
+        if( ( nHeight - nStart ) < nValidationConfirmations ){
+            ++it;
+            continue;
+        }
 
-                ++it;
+        CAmount nDelta = 0;
 
-            }
+        if( GetBalanceDelta(it->second.address, nStart, nHeight, nDelta) ){
+            it->second.nPower += nDelta;
+            it->second.nBlockHeight = nHeight;
         }
+
+        ++it;
+
     }
 }
 
@@ -36,7 +36,8 @@ struct CVotingPower{
     }
 };
 
-void ThreadSmartVoting();
+/** Update the voting power of the active vote keys, only does work once per new chain tip */
+void UpdateVotingPower();
 void AddActiveVoteKey(const CVoteKey &voteKey);
 void GetVotingPower(const CVoteKey &voteKey, CVotingPower &votingPower);
 int64_t GetVotingPower(const CVoteKey &voteKey);
@@ -0,0 +1,161 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addresswatch.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "test/test_bitcoin.h"
+#include "validationinterface.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addresswatch_tests, BasicTestingSetup)
+
+static uint160 MakeAddress(unsigned char n)
+{
+    uint160 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+static uint256 MakeTxHash(unsigned char n)
+{
+    uint256 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+/** Address index entries of a block: A receives twice and spends once in tx 1, B receives in tx 1, A receives in tx 2 */
+static std::vector<std::pair<CAddressIndexKey, CAmount> > MakeAddressIndex()
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, MakeAddress(1), 10, 1, MakeTxHash(1), 0, true), -500));
+    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, MakeAddress(1), 10, 1, MakeTxHash(1), 0, false), 100));
+    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, MakeAddress(1), 10, 1, MakeTxHash(1), 1, false), 200));
+    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, MakeAddress(2), 10, 1, MakeTxHash(1), 2, false), 50));
+    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, MakeAddress(1), 10, 2, MakeTxHash(2), 0, false), 70));
+    return addressIndex;
+}
+
+BOOST_AUTO_TEST_CASE(addresswatch_add_remove)
+{
+    CAddressWatchList watchList;
+    BOOST_CHECK(watchList.IsEmpty());
+
+    std::vector<std::pair<uint160, int> > addresses;
+    addresses.push_back(std::make_pair(MakeAddress(1), 1));
+    addresses.push_back(std::make_pair(MakeAddress(2), 2));
+    BOOST_CHECK_EQUAL(watchList.Add(addresses), 2U);
+    BOOST_CHECK_EQUAL(watchList.Add(addresses), 0U);
+    BOOST_CHECK_EQUAL(watchList.Size(), 2U);
+
+    // The same hash with another type is another address
+    addresses.resize(1);
+    addresses[0].second = 2;
+    BOOST_CHECK_EQUAL(watchList.Remove(addresses), 0U);
+    addresses[0].second = 1;
+    BOOST_CHECK_EQUAL(watchList.Remove(addresses), 1U);
+    BOOST_CHECK_EQUAL(watchList.Size(), 1U);
+
+    watchList.Clear();
+    BOOST_CHECK(watchList.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(addresswatch_match_block)
+{
+    CAddressWatchList watchList;
+    std::vector<CAddressWatchEvent> events;
+
+    // Nothing watched, nothing matched
+    watchList.Match(MakeAddressIndex(), events);
+    BOOST_CHECK(events.empty());
+
+    watchList.Add(std::vector<std::pair<uint160, int> >(1, std::make_pair(MakeAddress(1), 1)));
+    watchList.Match(MakeAddressIndex(), events);
+
+    // One event per watched address and transaction, with the amounts summed up
+    BOOST_REQUIRE_EQUAL(events.size(), 2U);
+    BOOST_CHECK(events[0].hashBytes == MakeAddress(1));
+    BOOST_CHECK(events[0].txhash == MakeTxHash(1));
+    BOOST_CHECK_EQUAL(events[0].credit, 300);
+    BOOST_CHECK_EQUAL(events[0].debit, 500);
+    BOOST_CHECK(events[1].txhash == MakeTxHash(2));
+    BOOST_CHECK_EQUAL(events[1].credit, 70);
+    BOOST_CHECK_EQUAL(events[1].debit, 0);
+}
+
+BOOST_AUTO_TEST_CASE(addresswatch_match_mempool)
+{
+    CAddressWatchList watchList;
+    watchList.Add(std::vector<std::pair<uint160, int> >(1, std::make_pair(MakeAddress(2), 2)));
+
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > deltas;
+    deltas.push_back(std::make_pair(CMempoolAddressDeltaKey(2, MakeAddress(2), MakeTxHash(3), 0, 1), CMempoolAddressDelta(0, -40, MakeTxHash(4), 1)));
+    deltas.push_back(std::make_pair(CMempoolAddressDeltaKey(2, MakeAddress(2), MakeTxHash(3), 1, 0), CMempoolAddressDelta(0, 25)));
+    deltas.push_back(std::make_pair(CMempoolAddressDeltaKey(1, MakeAddress(2), MakeTxHash(3), 2, 0), CMempoolAddressDelta(0, 99)));
+
+    std::vector<CAddressWatchEvent> events;
+    watchList.Match(deltas, events);
+    BOOST_REQUIRE_EQUAL(events.size(), 1U);
+    BOOST_CHECK_EQUAL(events[0].type, 2);
+    BOOST_CHECK(events[0].txhash == MakeTxHash(3));
+    BOOST_CHECK_EQUAL(events[0].credit, 25);
+    BOOST_CHECK_EQUAL(events[0].debit, 40);
+}
+
+/** Matches the address index entries handed out with the block signals, like the zmq address notifier */
+class CAddressWatchListener : public CValidationInterface
+{
+public:
+    CAddressWatchList watchList;
+    std::vector<CAddressWatchEvent> vConnected;
+    std::vector<CAddressWatchEvent> vDisconnected;
+    const CBlockIndex* pindexLast;
+
+    CAddressWatchListener() : pindexLast(NULL) {}
+
+protected:
+    void BlockConnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+    {
+        pindexLast = pindex;
+        watchList.Match(addressIndex, vConnected);
+    }
+    void BlockDisconnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+    {
+        pindexLast = pindex;
+        watchList.Match(addressIndex, vDisconnected);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(addresswatch_block_signals)
+{
+    CAddressWatchListener listener;
+    listener.watchList.Add(std::vector<std::pair<uint160, int> >(1, std::make_pair(MakeAddress(2), 2)));
+    RegisterValidationInterface(&listener);
+
+    CBlock block;
+    CBlockIndex index;
+    GetMainSignals().BlockConnected(block, &index, MakeAddressIndex());
+    BOOST_CHECK(listener.pindexLast == &index);
+    BOOST_REQUIRE_EQUAL(listener.vConnected.size(), 1U);
+    BOOST_CHECK_EQUAL(listener.vConnected[0].credit, 50);
+    BOOST_CHECK(listener.vDisconnected.empty());
+
+    // The entries removed on a disconnect carry the same amounts
+    listener.pindexLast = NULL;
+    GetMainSignals().BlockDisconnected(block, &index, MakeAddressIndex());
+    BOOST_CHECK(listener.pindexLast == &index);
+    BOOST_REQUIRE_EQUAL(listener.vDisconnected.size(), 1U);
+    BOOST_CHECK_EQUAL(listener.vDisconnected[0].credit, 50);
+
+    // Without -addressindex the signals come with no entries
+    GetMainSignals().BlockConnected(block, &index, std::vector<std::pair<CAddressIndexKey, CAmount> >());
+    BOOST_CHECK_EQUAL(listener.vConnected.size(), 1U);
+
+    UnregisterValidationInterface(&listener);
+    GetMainSignals().BlockConnected(block, &index, MakeAddressIndex());
+    BOOST_CHECK_EQUAL(listener.vConnected.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
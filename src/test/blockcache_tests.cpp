@@ -0,0 +1,126 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "primitives/block.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static CBlockCache::BlockData MakeData(size_t nSize, unsigned char nFill)
+{
+    return std::make_shared<const std::vector<unsigned char> >(nSize, nFill);
+}
+
+static uint256 MakeHash(unsigned char n)
+{
+    uint256 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_get_put)
+{
+    CBlockCache cache(1000);
+    BOOST_CHECK(!cache.Get(MakeHash(1)));
+
+    CBlockCache::BlockData data = MakeData(100, 1);
+    cache.Put(MakeHash(1), data);
+    BOOST_CHECK(cache.Get(MakeHash(1)) == data);
+    BOOST_CHECK(!cache.Get(MakeHash(2)));
+
+    // Putting a cached block again keeps the first data
+    cache.Put(MakeHash(1), MakeData(100, 2));
+    BOOST_CHECK(cache.Get(MakeHash(1)) == data);
+
+    cache.Clear();
+    BOOST_CHECK(!cache.Get(MakeHash(1)));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_block_roundtrip)
+{
+    CBlock block;
+    block.nVersion = 42;
+    block.nTime = 1234;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 5;
+    block.vtx.push_back(CTransaction(tx));
+
+    CBlockCache cache(1000);
+    CBlock blockOut;
+    BOOST_CHECK(!cache.Get(block.GetHash(), blockOut));
+
+    cache.Put(block.GetHash(), CBlockCache::Serialize(block));
+    BOOST_CHECK(cache.Get(block.GetHash(), blockOut));
+    BOOST_CHECK(blockOut.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(blockOut.vtx.size(), 1U);
+    BOOST_CHECK(blockOut.vtx[0].GetHash() == block.vtx[0].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru_eviction)
+{
+    CBlockCache cache(300);
+    cache.Put(MakeHash(1), MakeData(100, 1));
+    cache.Put(MakeHash(2), MakeData(100, 2));
+    cache.Put(MakeHash(3), MakeData(100, 3));
+
+    // Reading 1 makes 2 the least recently used entry
+    BOOST_CHECK(cache.Get(MakeHash(1)));
+    cache.Put(MakeHash(4), MakeData(100, 4));
+    BOOST_CHECK(!cache.Get(MakeHash(2)));
+    BOOST_CHECK(cache.Get(MakeHash(1)));
+    BOOST_CHECK(cache.Get(MakeHash(3)));
+    BOOST_CHECK(cache.Get(MakeHash(4)));
+
+    // Putting a cached block again refreshes it as well, 1 is the oldest now
+    cache.Put(MakeHash(3), MakeData(100, 3));
+    cache.Put(MakeHash(5), MakeData(100, 5));
+    BOOST_CHECK(!cache.Get(MakeHash(1)));
+    BOOST_CHECK(cache.Get(MakeHash(3)));
+    BOOST_CHECK(cache.Get(MakeHash(4)));
+    BOOST_CHECK(cache.Get(MakeHash(5)));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_size_bound)
+{
+    CBlockCache cache(250);
+
+    // Entries are bounded by their bytes, not their count
+    cache.Put(MakeHash(1), MakeData(100, 1));
+    cache.Put(MakeHash(2), MakeData(100, 2));
+    cache.Put(MakeHash(3), MakeData(10, 3));
+    BOOST_CHECK(cache.Get(MakeHash(1)));
+    BOOST_CHECK(cache.Get(MakeHash(2)));
+    BOOST_CHECK(cache.Get(MakeHash(3)));
+
+    // A large entry pushes out as many old ones as it needs
+    cache.Put(MakeHash(4), MakeData(200, 4));
+    BOOST_CHECK(!cache.Get(MakeHash(1)));
+    BOOST_CHECK(!cache.Get(MakeHash(2)));
+    BOOST_CHECK(cache.Get(MakeHash(3)));
+    BOOST_CHECK(cache.Get(MakeHash(4)));
+
+    // One larger than the whole cache isn't kept
+    cache.Put(MakeHash(5), MakeData(251, 5));
+    BOOST_CHECK(!cache.Get(MakeHash(5)));
+    BOOST_CHECK(cache.Get(MakeHash(4)));
+
+    // Shrinking trims the least recently used entries
+    cache.SetMaxSize(200);
+    BOOST_CHECK(!cache.Get(MakeHash(3)));
+    BOOST_CHECK(cache.Get(MakeHash(4)));
+
+    // A size of 0 disables the cache
+    cache.SetMaxSize(0);
+    BOOST_CHECK(!cache.IsEnabled());
+    BOOST_CHECK(!cache.Get(MakeHash(4)));
+    cache.Put(MakeHash(6), MakeData(1, 6));
+    BOOST_CHECK(!cache.Get(MakeHash(6)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,9 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/keccak256.h"
+#include "crypto/sph_keccak.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -55,6 +58,7 @@ void TestSHA1(const std::string &in, const std::string &hexout) { TestVector(CSH
 void TestSHA256(const std::string &in, const std::string &hexout) { TestVector(CSHA256(), in, ParseHex(hexout));}
 void TestSHA512(const std::string &in, const std::string &hexout) { TestVector(CSHA512(), in, ParseHex(hexout));}
 void TestRIPEMD160(const std::string &in, const std::string &hexout) { TestVector(CRIPEMD160(), in, ParseHex(hexout));}
+void TestKeccak256(const std::string &in, const std::string &hexout) { TestVector(CKeccak256(), in, ParseHex(hexout));}
 
 void TestHMACSHA256(const std::string &hexkey, const std::string &hexin, const std::string &hexout) {
     std::vector<unsigned char> key = ParseHex(hexkey);
@@ -233,26 +237,56 @@ BOOST_AUTO_TEST_CASE(sha1_testvectors) {
     TestSHA1(test1, "b7755760681cbfd971451668f32af5774f4656b5");
 }
 
+// Every implementation SHA256AutoDetect can pick, one at a time, and all
+// the CPU has together
+static const sha256_implementation::UseImplementation sha256_impls[] = {
+    sha256_implementation::USE_STANDARD, sha256_implementation::USE_SSE4, sha256_implementation::USE_AVX2,
+    sha256_implementation::USE_SHANI, sha256_implementation::USE_ALL
+};
+
 BOOST_AUTO_TEST_CASE(sha256_testvectors) {
-    TestSHA256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
-    TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
-    TestSHA256("message digest",
-               "f7846f55cf23e14eebeab5b4e1550cad5b509e3348fbc4efa3a1413d393cb650");
-    TestSHA256("secure hash algorithm",
-               "f30ceb2bb2829e79e4ca9753d35a8ecc00262d164cc077080295381cbd643f0d");
-    TestSHA256("SHA256 is considered to be safe",
-               "6819d915c73f4d1e77e4e1b52d1fa0f9cf9beaead3939f15874bd988e2a23630");
-    TestSHA256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
-               "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
-    TestSHA256("For this sample, this 63-byte string will be used as input data",
-               "f08a78cbbaee082b052ae0708f32fa1e50c5c421aa772ba5dbb406a2ea6be342");
-    TestSHA256("This is exactly 64 bytes long, not counting the terminating byte",
-               "ab64eff7e88e2e46165e29f2bce41826bd4c7b3552f6b382a9e7d3af47c245f8");
-    TestSHA256("As Bitcoin relies on 80 byte header hashes, we want to have an example for that.",
-               "7406e8de7d6e4fffc573daef05aefb8806e7790f55eab5576f31349743cca743");
-    TestSHA256(std::string(1000000, 'a'),
-               "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
-    TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
+    for (size_t n = 0; n < sizeof(sha256_impls) / sizeof(sha256_impls[0]); n++) {
+        BOOST_TEST_MESSAGE("Using SHA256 implementation " << SHA256AutoDetect(sha256_impls[n]));
+        TestSHA256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        TestSHA256("message digest",
+                   "f7846f55cf23e14eebeab5b4e1550cad5b509e3348fbc4efa3a1413d393cb650");
+        TestSHA256("secure hash algorithm",
+                   "f30ceb2bb2829e79e4ca9753d35a8ecc00262d164cc077080295381cbd643f0d");
+        TestSHA256("SHA256 is considered to be safe",
+                   "6819d915c73f4d1e77e4e1b52d1fa0f9cf9beaead3939f15874bd988e2a23630");
+        TestSHA256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                   "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        TestSHA256("For this sample, this 63-byte string will be used as input data",
+                   "f08a78cbbaee082b052ae0708f32fa1e50c5c421aa772ba5dbb406a2ea6be342");
+        TestSHA256("This is exactly 64 bytes long, not counting the terminating byte",
+                   "ab64eff7e88e2e46165e29f2bce41826bd4c7b3552f6b382a9e7d3af47c245f8");
+        TestSHA256("As Bitcoin relies on 80 byte header hashes, we want to have an example for that.",
+                   "7406e8de7d6e4fffc573daef05aefb8806e7790f55eab5576f31349743cca743");
+        TestSHA256(std::string(1000000, 'a'),
+                   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
+    }
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    for (size_t n = 0; n < sizeof(sha256_impls) / sizeof(sha256_impls[0]); n++) {
+        BOOST_TEST_MESSAGE("Using SHA256 implementation " << SHA256AutoDetect(sha256_impls[n]));
+        for (size_t blocks = 0; blocks <= 32; blocks++) {
+            std::vector<unsigned char> in(64 * blocks + 1), out(32 * blocks + 1), expected(32 * blocks + 1);
+            for (size_t j = 0; j < in.size(); j++)
+                in[j] = insecure_rand();
+            for (size_t i = 0; i < blocks; i++)
+                CHash256().Write(&in[64 * i], 64).Finalize(&expected[32 * i]);
+            SHA256D64(&out[0], &in[0], blocks);
+            BOOST_CHECK(std::equal(out.begin(), out.begin() + 32 * blocks, expected.begin()));
+            // In place, as ComputeMerkleRoot does
+            SHA256D64(&in[0], &in[0], blocks);
+            BOOST_CHECK(std::equal(in.begin(), in.begin() + 32 * blocks, expected.begin()));
+        }
+    }
+    SHA256AutoDetect();
 }
 
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
@@ -292,6 +326,66 @@ BOOST_AUTO_TEST_CASE(sha512_testvectors) {
                "37de8c3ef5459d76a52cedc02dc499a3c9ed9dedbfb3281afd9653b8a112fafc");
 }
 
+BOOST_AUTO_TEST_CASE(keccak256_testvectors) {
+    // Keccak-256 with the original Keccak padding, as used for block hashes
+    // (not the SHA3-256 padding), from the Keccak team's ShortMsgKAT_256.
+    TestKeccak256("", "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+    TestKeccak256("\xcc", "eead6dbfc7340a56caedc044696a168870549a6a7f6f56961e84a54bd9970b8a");
+    TestKeccak256("\x41\xfb", "a8eaceda4d47b3281a795ad9e1ea2122b407baf9aabcb9e18b5717b7873537d2");
+    TestKeccak256("abc", "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+    TestKeccak256("The quick brown fox jumps over the lazy dog",
+                  "4d741b6f1eb29cb2a9b9911c82f56fa8d73b04959d3d9d222895df6c0b28aa15");
+    TestKeccak256("The quick brown fox jumps over the lazy dog.",
+                  "578951e24efd62a3d63a86f7cd19aaa53c898fe287d2552133220370240b572d");
+    // 200 bytes, longer than one 136-byte block
+    TestKeccak256(std::string(200, '\xa3'), "3a57666b048777f2c953dc4456f45a2588e1cb6f2da760122d530ac2ce607d4a");
+}
+
+static std::vector<unsigned char> Keccak256Sph(const std::vector<unsigned char>& in)
+{
+    std::vector<unsigned char> hash(32);
+    sph_keccak256_context ctx;
+    sph_keccak256_init(&ctx);
+    sph_keccak256(&ctx, in.data(), in.size());
+    sph_keccak256_close(&ctx, &hash[0]);
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(keccak256_sph) {
+    // The block hash moved from sphlib to CKeccak256, they must agree for any input
+    for (int i = 0; i < 1000; i++) {
+        std::vector<unsigned char> in(i < 300 ? i : insecure_rand() % 2000);
+        for (size_t j = 0; j < in.size(); j++)
+            in[j] = insecure_rand();
+        TestVector(CKeccak256(), in, Keccak256Sph(in));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(keccak256_short) {
+    // Check the portable and the multi-lane implementations, whichever the CPU has
+    const keccak256_implementation::UseImplementation impls[] = {keccak256_implementation::USE_STANDARD, keccak256_implementation::USE_ALL};
+    const size_t lens[] = {0, 1, 31, 32, 33, 64, 79, 80, 81, 135};
+    for (size_t n = 0; n < sizeof(impls) / sizeof(impls[0]); n++) {
+        BOOST_TEST_MESSAGE("Using Keccak-256 implementation " << Keccak256AutoDetect(impls[n]));
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+            for (size_t count = 0; count <= 9; count++) {
+                std::vector<unsigned char> in(lens[l] * count + 1);
+                for (size_t j = 0; j < in.size(); j++)
+                    in[j] = insecure_rand();
+                std::vector<unsigned char> out(32 * count + 1), expected(32 * count + 1);
+                Keccak256Short(&out[0], &in[0], lens[l], count);
+                for (size_t i = 0; i < count; i++) {
+                    std::vector<unsigned char> one(in.begin() + lens[l] * i, in.begin() + lens[l] * (i + 1));
+                    std::vector<unsigned char> hash = Keccak256Sph(one);
+                    std::copy(hash.begin(), hash.end(), expected.begin() + 32 * i);
+                }
+                BOOST_CHECK(std::equal(out.begin(), out.begin() + 32 * count, expected.begin()));
+            }
+        }
+    }
+    Keccak256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(hmac_sha256_testvectors) {
     // test cases 1, 2, 3, 4, 6 and 7 of RFC 4231
     TestHMACSHA256("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
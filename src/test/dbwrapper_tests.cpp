@@ -5,15 +5,22 @@
 #include "dbwrapper.h"
 #include "uint256.h"
 #include "random.h"
+#include "txdb.h"
+#include "validation.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/assign/std/vector.hpp> // for 'operator+=()'
 #include <boost/assert.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
                     
 using namespace std;
 using namespace boost::assign; // bring 'operator+=()' into scope
 using namespace boost::filesystem;
+
+extern bool fAddressIndex;
+extern bool fSpentIndex;
          
 // Test if a string consists entirely of null characters
 bool is_null_key(const vector<unsigned char>& key) {
@@ -126,6 +133,116 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    CDBProfile profile = GetDBProfile("chainstate");
+    BOOST_CHECK_EQUAL(profile.strName, "chainstate");
+    BOOST_CHECK(!profile.fCompression);
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 4096U);
+    BOOST_CHECK_EQUAL(profile.nWriteBuffer, 0U);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 10);
+
+    profile = GetDBProfile("indexes");
+    BOOST_CHECK(profile.fCompression);
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 16U * 1024);
+
+    BOOST_CHECK(GetDBProfile("rewards").fCompression);
+    BOOST_CHECK(!GetDBProfile("blockindex").fCompression);
+    BOOST_CHECK(!GetDBProfile("").fCompression);
+
+    // Overrides only apply to the database they name, later ones win
+    std::string strError;
+    mapMultiArgs["-dbprofile"].push_back("indexes:compression=0,blocksize=8192");
+    mapMultiArgs["-dbprofile"].push_back("rewards:bloombits=0,writebuffer=65536");
+    mapMultiArgs["-dbprofile"].push_back("indexes:blocksize=32768");
+    BOOST_CHECK(CheckDBProfileArgs(strError));
+    profile = GetDBProfile("indexes");
+    BOOST_CHECK(!profile.fCompression);
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 32768U);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 10);
+    profile = GetDBProfile("rewards");
+    BOOST_CHECK(profile.fCompression);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(profile.nWriteBuffer, 65536U);
+    BOOST_CHECK(!GetDBProfile("chainstate").fCompression);
+    BOOST_CHECK_EQUAL(GetDBProfile("chainstate").nBlockSize, 4096U);
+
+    const char* const vBadArgs[] = {
+        "unknown:compression=1",
+        "indexes",
+        "indexes:compression",
+        "indexes:compression=2",
+        "indexes:blocksize=512",
+        "indexes:writebuffer=1024",
+        "indexes:bloombits=-1",
+        "indexes:blocksize=8192,foo=1",
+    };
+    for (const char* strArg : vBadArgs) {
+        mapMultiArgs["-dbprofile"].assign(1, strArg);
+        strError.clear();
+        BOOST_CHECK_MESSAGE(!CheckDBProfileArgs(strError), strArg);
+        BOOST_CHECK(!strError.empty());
+    }
+
+    mapMultiArgs.erase("-dbprofile");
+    BOOST_CHECK(CheckDBProfileArgs(strError));
+}
+
+// Test that every profile stores and reads back data and counts its reads
+BOOST_AUTO_TEST_CASE(dbwrapper_profile_stats)
+{
+    const char* const vProfiles[] = {"chainstate", "blockindex", "indexes", "rewards"};
+    for (const char* strProfile : vProfiles) {
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, (1 << 20), false, false, false, strProfile);
+
+        CDBWrapperStats stats = dbw.GetStats();
+        BOOST_CHECK_EQUAL(stats.profile.strName, strProfile);
+        BOOST_CHECK_EQUAL(stats.strPath, ph.string());
+        BOOST_CHECK_EQUAL(stats.nCacheSize, 1U << 20);
+        uint64_t nReads = stats.nReads;
+        uint64_t nBatches = stats.nBatches;
+
+        // Repetitive values, so the compressing profiles have something to do
+        std::vector<uint256> vValues;
+        CDBBatch batch(dbw);
+        for (uint32_t i = 0; i < 1000; i++) {
+            vValues.push_back(uint256S(strprintf("%064x", i % 7)));
+            batch.Write(std::make_pair('d', i), vValues.back());
+        }
+        BOOST_CHECK(dbw.WriteBatch(batch, true));
+
+        uint256 res;
+        for (uint32_t i = 0; i < 1000; i += 10) {
+            BOOST_CHECK(dbw.Read(std::make_pair('d', i), res));
+            BOOST_CHECK(res == vValues[i]);
+        }
+        BOOST_CHECK(!dbw.Exists(std::make_pair('d', 1000U)));
+
+        boost::scoped_ptr<CDBIterator> it(dbw.NewIterator());
+        int nIterated = 0;
+        for (it->Seek(std::make_pair('d', 0U)); it->Valid(); it->Next()) {
+            std::pair<char, uint32_t> key;
+            BOOST_CHECK(it->GetKey(key));
+            BOOST_CHECK(it->GetValue(res));
+            BOOST_CHECK(res == vValues[key.second]);
+            nIterated++;
+        }
+        BOOST_CHECK_EQUAL(nIterated, 1000);
+
+        dbw.CompactRange(std::make_pair('d', 0U), std::make_pair('d', 1000U));
+
+        stats = dbw.GetStats();
+        // 100 lookups, one miss and 1000 iterated values
+        BOOST_CHECK_EQUAL(stats.nReads - nReads, 1101U);
+        BOOST_CHECK(stats.nBytesRead >= 1100U * 32);
+        BOOST_CHECK_EQUAL(stats.nBatches - nBatches, 1U);
+        BOOST_CHECK(stats.nBytesWritten >= 1000U * 32);
+        BOOST_CHECK(stats.nDiskSize > 0);
+        BOOST_CHECK(!stats.vFilesPerLevel.empty());
+    }
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -323,5 +440,62 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 }
 
 
+// Blocks handed to the index writer must be readable right after Push()
+static void PushAndReadIndexBlocks(CIndexDB& indexdb, int nBlocks)
+{
+    uint160 addressHash;
+    GetRandBytes(addressHash.begin(), addressHash.size());
+    std::vector<uint256> vTxids;
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        CIndexUpdate update;
+        update.hashBestBlock = GetRandHash();
+        vTxids.push_back(GetRandHash());
+        update.vAddressIndex.push_back(make_pair(CAddressIndexKey(1, addressHash, nHeight, 1, vTxids.back(), 0, false), nHeight * COIN));
+        update.vSpentIndex.push_back(make_pair(CSpentIndexKey(vTxids.back(), 0), CSpentIndexValue(GetRandHash(), 0, nHeight, COIN, 1, addressHash)));
+        BOOST_CHECK(indexdb.Push(std::move(update)));
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(GetAddressIndex(addressHash, 1, addressIndex));
+    BOOST_CHECK_EQUAL(addressIndex.size(), (size_t)nBlocks);
+    for (int i = 0; i < (int)addressIndex.size(); i++) {
+        BOOST_CHECK_EQUAL(addressIndex[i].first.blockHeight, i + 1);
+        BOOST_CHECK(addressIndex[i].first.txhash == vTxids[i]);
+        BOOST_CHECK_EQUAL(addressIndex[i].second, (i + 1) * COIN);
+    }
+
+    CSpentIndexKey spentKey(vTxids.back(), 0);
+    CSpentIndexValue spentValue;
+    BOOST_CHECK(GetSpentIndex(spentKey, spentValue));
+    BOOST_CHECK_EQUAL(spentValue.blockHeight, nBlocks);
+}
+
+BOOST_FIXTURE_TEST_CASE(indexdb_read_your_writes, TestingSetup)
+{
+    bool fAddressIndexOld = fAddressIndex, fSpentIndexOld = fSpentIndex;
+    fAddressIndex = fSpentIndex = true;
+
+    // Written by the caller while no writer runs
+    {
+        CIndexDB indexdb(1 << 20, true, true);
+        pindexdb = &indexdb;
+        PushAndReadIndexBlocks(indexdb, 10);
+    }
+
+    // Written by ThreadIndexWriter, with more blocks than fit into the queue
+    {
+        CIndexDB indexdb(1 << 20, true, true, 4);
+        pindexdb = &indexdb;
+        boost::thread writer(boost::bind(&CIndexDB::ThreadIndexWriter, &indexdb));
+        PushAndReadIndexBlocks(indexdb, 100);
+        writer.interrupt();
+        writer.join();
+        BOOST_CHECK(indexdb.Flush());
+    }
+
+    pindexdb = NULL;
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+}
 
 BOOST_AUTO_TEST_SUITE_END()
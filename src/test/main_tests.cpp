@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "random.h"
 #include "validation.h"
 
 #include "test/test_bitcoin.h"
@@ -72,4 +73,34 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(header_hash_check)
+{
+    // Counts around the group size of the check and the batch size of HashBlockHeaders
+    const size_t counts[] = {0, 1, 15, 16, 17, 33, 128, 129, 300};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        std::vector<CBlockHeader> headers(counts[c]);
+        for (size_t i = 0; i < headers.size(); i++) {
+            headers[i].nVersion = insecure_rand();
+            headers[i].hashPrevBlock = GetRandHash();
+            headers[i].hashMerkleRoot = GetRandHash();
+            headers[i].nTime = insecure_rand();
+            headers[i].nBits = insecure_rand();
+            headers[i].nNonce = insecure_rand();
+        }
+
+        std::vector<uint256> hashes(headers.size());
+        if (!headers.empty())
+            BOOST_CHECK(CBlockHeaderHashCheck(&headers[0], &headers[0] + headers.size(), &hashes[0])());
+        std::vector<uint256> batched;
+        HashBlockHeaders(headers, batched);
+        BOOST_CHECK_EQUAL(batched.size(), headers.size());
+
+        for (size_t i = 0; i < headers.size(); i++) {
+            BOOST_CHECK(hashes[i] == headers[i].GetHash());
+            BOOST_CHECK(batched[i] == headers[i].GetHash());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "policy/policy.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -578,4 +579,124 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAddressIndexTest)
+{
+    std::vector<unsigned char> vchKey1(33, 0x11), vchKey2(33, 0x22);
+    vchKey1[0] = vchKey2[0] = 0x02;
+    CPubKey key1(vchKey1), key2(vchKey2);
+    std::vector<CPubKey> vKeys;
+    vKeys.push_back(key1);
+    vKeys.push_back(key2);
+    CScript scriptMultisig = GetScriptForMultisig(1, vKeys);
+    uint160 hashMultisig = CScriptID(scriptMultisig);
+
+    // Every template the indexes track, and some they don't
+    uint160 hash;
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(GetScriptForDestination(key1.GetID()), hash), 1);
+    BOOST_CHECK(hash == key1.GetID());
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(GetScriptForRawPubKey(key2), hash), 1);
+    BOOST_CHECK(hash == key2.GetID());
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(GetLockedScriptForDestination(key1.GetID(), 500000), hash), 1);
+    BOOST_CHECK(hash == key1.GetID());
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(GetScriptForDestination(CScriptID(scriptMultisig)), hash), 2);
+    BOOST_CHECK(hash == hashMultisig);
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(GetLockedScriptForDestination(CScriptID(scriptMultisig), 500000), hash), 2);
+    BOOST_CHECK(hash == hashMultisig);
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(scriptMultisig, hash), 0);
+    BOOST_CHECK(hash.IsNull());
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(CScript() << OP_RETURN << vchKey1, hash), 0);
+    BOOST_CHECK(hash.IsNull());
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(CScript() << OP_1 << OP_CHECKMULTISIG, hash), 0);
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(CScript(), hash), 0);
+
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // tx1 spends a pay-to-pubkey coin of key2 and pays key1 and the multisig
+    // P2SH address, and has a bare multisig output the indexes skip
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    tx1.vout.resize(3);
+    tx1.vout[0].scriptPubKey = GetScriptForDestination(key1.GetID());
+    tx1.vout[0].nValue = 10000;
+    tx1.vout[1].scriptPubKey = GetScriptForDestination(CScriptID(scriptMultisig));
+    tx1.vout[1].nValue = 20000;
+    tx1.vout[2].scriptPubKey = scriptMultisig;
+    tx1.vout[2].nValue = 30000;
+    std::vector<CMempoolSpentCoin> vSpent1(1);
+    vSpent1[0].nValue = 70000;
+    vSpent1[0].addressType = ExtractIndexAddress(GetScriptForRawPubKey(key2), vSpent1[0].addressHash);
+
+    // tx2 spends the key1 output of tx1 and pays key1 again
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = GetScriptForDestination(key1.GetID());
+    tx2.vout[0].nValue = 5000;
+    std::vector<CMempoolSpentCoin> vSpent2(1);
+    vSpent2[0].nValue = 10000;
+    vSpent2[0].addressType = ExtractIndexAddress(tx1.vout[0].scriptPubKey, vSpent2[0].addressHash);
+
+    CTxMemPoolEntry entry1 = entry.FromTx(tx1);
+    pool.addUnchecked(tx1.GetHash(), entry1);
+    pool.addAddressAndSpentIndex(entry1, vSpent1, true, true);
+    CTxMemPoolEntry entry2 = entry.FromTx(tx2);
+    pool.addUnchecked(tx2.GetHash(), entry2);
+    pool.addAddressAndSpentIndex(entry2, vSpent2, true, true);
+
+    std::vector<std::pair<uint160, int> > vKey1, vKey2, vMultisig;
+    vKey1.push_back(std::make_pair(uint160(key1.GetID()), 1));
+    vKey2.push_back(std::make_pair(uint160(key2.GetID()), 1));
+    vMultisig.push_back(std::make_pair(hashMultisig, 2));
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+
+    BOOST_CHECK(pool.getAddressIndex(vKey1, results));
+    BOOST_CHECK_EQUAL(results.size(), 3U);
+    CAmount nBalance = 0;
+    for (const auto& result : results)
+        nBalance += result.second.amount;
+    BOOST_CHECK_EQUAL(nBalance, 5000);
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(vKey2, results));
+    BOOST_CHECK_EQUAL(results.size(), 1U);
+    BOOST_CHECK_EQUAL(results[0].second.amount, -70000);
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(vMultisig, results));
+    BOOST_CHECK_EQUAL(results.size(), 1U);
+    BOOST_CHECK_EQUAL(results[0].second.amount, 20000);
+    results.clear();
+    BOOST_CHECK(pool.getAddressDeltas(tx2.GetHash(), results));
+    BOOST_CHECK_EQUAL(results.size(), 2U);
+    results.clear();
+
+    CSpentIndexKey spentKey(tx1.GetHash(), 0);
+    CSpentIndexValue spentValue;
+    BOOST_CHECK(pool.getSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(spentValue.txid == tx2.GetHash());
+    BOOST_CHECK_EQUAL(spentValue.satoshis, 10000);
+    BOOST_CHECK_EQUAL(spentValue.addressType, 1);
+    BOOST_CHECK(spentValue.addressHash == key1.GetID());
+
+    // Removing tx1 only drops its own deltas, also from the shared key1 bucket
+    pool.removeAddressIndex(tx1.GetHash());
+    BOOST_CHECK(!pool.getAddressDeltas(tx1.GetHash(), results));
+    BOOST_CHECK(pool.getAddressIndex(vKey1, results));
+    BOOST_CHECK_EQUAL(results.size(), 2U);
+    for (const auto& result : results)
+        BOOST_CHECK(result.first.txhash == tx2.GetHash());
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(vKey2, results));
+    BOOST_CHECK(results.empty());
+    BOOST_CHECK(pool.getAddressIndex(vMultisig, results));
+    BOOST_CHECK(results.empty());
+
+    pool.removeSpentIndex(tx2.GetHash());
+    BOOST_CHECK(!pool.getSpentIndex(spentKey, spentValue));
+    pool.removeAddressIndex(tx2.GetHash());
+    BOOST_CHECK(pool.getAddressIndex(vKey1, results));
+    BOOST_CHECK(results.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -54,6 +54,44 @@ static std::vector<uint256> BlockGetMerkleBranch(const CBlock& block, const std:
     return vMerkleBranch;
 }
 
+// Older recursive version of the merkle root computation, one leaf at a time,
+// for comparison with the level-wise ComputeMerkleRoot.
+static uint256 OldComputeMerkleRoot(const std::vector<uint256>& leaves, bool* pmutated) {
+    if (leaves.size() == 0) {
+        if (pmutated) *pmutated = false;
+        return uint256();
+    }
+    bool mutated = false;
+    uint32_t count = 0;
+    uint256 inner[32];
+    while (count < leaves.size()) {
+        uint256 h = leaves[count];
+        count++;
+        int level;
+        for (level = 0; !(count & (((uint32_t)1) << level)); level++) {
+            mutated |= (inner[level] == h);
+            CHash256().Write(inner[level].begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
+        }
+        inner[level] = h;
+    }
+    int level = 0;
+    while (!(count & (((uint32_t)1) << level))) {
+        level++;
+    }
+    uint256 h = inner[level];
+    while (count != (((uint32_t)1) << level)) {
+        CHash256().Write(h.begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
+        count += (((uint32_t)1) << level);
+        level++;
+        while (!(count & (((uint32_t)1) << level))) {
+            CHash256().Write(inner[level].begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
+            level++;
+        }
+    }
+    if (pmutated) *pmutated = mutated;
+    return h;
+}
+
 static inline int ctz(uint32_t i) {
     if (i == 0) return 0;
     int j = 0;
@@ -133,4 +171,30 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_test_levelwise)
+{
+    for (int i = 0; i < 64; i++) {
+        // All sizes up to 40, odd ones included, then random ones.
+        size_t nLeaves = (i <= 40) ? i : 41 + (insecure_rand() % 2000);
+        std::vector<uint256> leaves(nLeaves);
+        for (size_t j = 0; j < nLeaves; j++)
+            leaves[j] = GetRandHash();
+        for (int mutate = 0; mutate <= 2; mutate++) {
+            // Make a pair of siblings equal, anywhere in the tree.
+            if (mutate > 0 && nLeaves >= 2) {
+                size_t pos = (insecure_rand() % (nLeaves / 2)) * 2;
+                leaves[pos + 1] = leaves[pos];
+            }
+            bool oldMutated = false, newMutated = false;
+            uint256 oldRoot = OldComputeMerkleRoot(leaves, &oldMutated);
+            uint256 newRoot = ComputeMerkleRoot(leaves, &newMutated);
+            BOOST_CHECK(oldRoot == newRoot);
+            BOOST_CHECK(oldMutated == newMutated);
+            BOOST_CHECK(ComputeMerkleRoot(leaves) == newRoot);
+            if (mutate > 0 && nLeaves >= 2)
+                BOOST_CHECK(newMutated);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
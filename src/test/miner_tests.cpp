@@ -502,4 +502,150 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static CMutableTransaction TemplateCacheTx(const uint256& hashPrevTx, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = hashPrevTx;
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(CBlockTemplateCache_incremental)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlockTemplateCache cache;
+    cache.Connect(pool);
+    TestMemPoolEntryHelper entry;
+
+    uint256 hashPrev = GetRandHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashPrev;
+    indexPrev.nHeight = 100;
+    int64_t nCutoff = GetTime();
+
+    CMutableTransaction txParent = TemplateCacheTx(GetRandHash(), 100000);
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(10000).FromTx(txParent));
+    unsigned int nTxSize = pool.mapTx.find(txParent.GetHash())->GetTxSize();
+    {
+        LOCK2(pool.cs, cache.cs);
+        cache.ResetSelection(&indexPrev, nCutoff, 1000000, 0);
+        cache.AddToSelection(pool.mapTx.find(txParent.GetHash()));
+    }
+
+    // New transactions are appended, children only after their parents
+    CMutableTransaction txChild = TemplateCacheTx(txParent.GetHash(), 90000);
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(10000).FromTx(txChild));
+    CMutableTransaction txOther = TemplateCacheTx(GetRandHash(), 100000);
+    pool.addUnchecked(txOther.GetHash(), entry.Fee(20000).FromTx(txOther));
+    {
+        LOCK2(pool.cs, cache.cs);
+        BOOST_CHECK(cache.IsSelectionValid(&indexPrev, nCutoff, 1000000, 0));
+        BOOST_CHECK_EQUAL(cache.GetSelection().size(), 3U);
+        BOOST_CHECK(cache.GetSelection()[1]->GetTx().GetHash() == txChild.GetHash());
+        BOOST_CHECK_EQUAL(cache.GetFees(), 40000);
+    }
+
+    // Removing the parent drops its child as well and keeps the rest
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2U);
+    {
+        LOCK2(pool.cs, cache.cs);
+        BOOST_CHECK(cache.IsSelectionValid(&indexPrev, nCutoff, 1000000, 0));
+        BOOST_CHECK_EQUAL(cache.GetSelection().size(), 1U);
+        BOOST_CHECK(cache.GetSelection()[0]->GetTx().GetHash() == txOther.GetHash());
+        BOOST_CHECK_EQUAL(cache.GetFees(), 20000);
+        BOOST_CHECK_EQUAL(cache.GetBlockSize(), 1000 + nTxSize);
+
+        // Start over with room for exactly one transaction
+        cache.ResetSelection(&indexPrev, nCutoff, 1000 + nTxSize + 1, 0);
+        cache.AddToSelection(pool.mapTx.find(txOther.GetHash()));
+    }
+
+    // A cheaper transaction that doesn't fit is left out
+    CMutableTransaction txCheap = TemplateCacheTx(GetRandHash(), 100000);
+    pool.addUnchecked(txCheap.GetHash(), entry.Fee(10000).FromTx(txCheap));
+    {
+        LOCK2(pool.cs, cache.cs);
+        BOOST_CHECK(cache.IsSelectionValid(&indexPrev, nCutoff, 1000 + nTxSize + 1, 0));
+        BOOST_CHECK_EQUAL(cache.GetSelection().size(), 1U);
+    }
+
+    // A better paying one forces a rebuild
+    CMutableTransaction txRich = TemplateCacheTx(GetRandHash(), 100000);
+    pool.addUnchecked(txRich.GetHash(), entry.Fee(30000).FromTx(txRich));
+    {
+        LOCK2(pool.cs, cache.cs);
+        BOOST_CHECK(!cache.IsSelectionValid(&indexPrev, nCutoff, 1000 + nTxSize + 1, 0));
+
+        // A new lock time cutoff may make skipped transactions final
+        cache.ResetSelection(&indexPrev, nCutoff, 1000000, 0);
+        BOOST_CHECK(cache.IsSelectionValid(&indexPrev, nCutoff, 1000000, 0));
+        BOOST_CHECK(!cache.IsSelectionValid(&indexPrev, nCutoff + 1, 1000000, 0));
+    }
+
+    // So may a fee delta change the order of the selection
+    pool.PrioritiseTransaction(txCheap.GetHash(), txCheap.GetHash().ToString(), 0, 50000);
+    {
+        LOCK2(pool.cs, cache.cs);
+        BOOST_CHECK(!cache.IsSelectionValid(&indexPrev, nCutoff, 1000000, 0));
+        cache.ResetSelection(&indexPrev, nCutoff, 1000000, 0);
+        BOOST_CHECK(cache.IsSelectionValid(&indexPrev, nCutoff, 1000000, 0));
+    }
+
+    cache.Disconnect();
+}
+
+BOOST_AUTO_TEST_CASE(ScanHeaderNonces_matches_GetHash)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1500000000;
+    header.nBits = 0x1e0ffff0;
+    header.nNonce = 1000;
+
+    // The scan hashes the serialized 80-byte header, as GetHash() does
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    BOOST_CHECK_EQUAL(ss.size(), 80U);
+    BOOST_CHECK(HashKeccak(ss.begin(), ss.end()) == header.GetHash());
+
+    // Find the lowest hash of a range of nonces which is no multiple of the batch size
+    const uint32_t nCount = 21;
+    arith_uint256 bestHash;
+    uint32_t nBestNonce = 0;
+    for (uint32_t i = 0; i < nCount; i++) {
+        CBlockHeader candidate = header;
+        candidate.nNonce = header.nNonce + i;
+        arith_uint256 hash = UintToArith256(candidate.GetHash());
+        if (i == 0 || hash < bestHash) {
+            bestHash = hash;
+            nBestNonce = candidate.nNonce;
+        }
+    }
+
+    // Only the nonce with the lowest hash meets it as target
+    CBlockHeader scan = header;
+    BOOST_CHECK(ScanHeaderNonces(scan, bestHash, nCount));
+    BOOST_CHECK_EQUAL(scan.nNonce, nBestNonce);
+    BOOST_CHECK(UintToArith256(scan.GetHash()) == bestHash);
+
+    // No nonce meets a lower target, all of them are skipped
+    scan = header;
+    BOOST_CHECK(!ScanHeaderNonces(scan, bestHash - 1, nCount));
+    BOOST_CHECK_EQUAL(scan.nNonce, header.nNonce + nCount);
+
+    // Every nonce meets the highest target, the first one is taken
+    scan = header;
+    BOOST_CHECK(ScanHeaderNonces(scan, ~arith_uint256(0), nCount));
+    BOOST_CHECK_EQUAL(scan.nNonce, header.nNonce);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
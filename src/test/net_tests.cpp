@@ -3,13 +3,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include "addrman.h"
 #include "test/test_bitcoin.h"
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include "hash.h"
 #include "serialize.h"
 #include "streams.h"
 #include "net.h"
 #include "chainparams.h"
+#include "utiltime.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 using namespace std;
 
@@ -164,4 +174,227 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+class TestSocketEvents
+{
+public:
+    static void Start(CConnman& connman, SocketEventsMode mode, bool fBrokenListenSocket = false)
+    {
+        connman.socketEventsMode = mode;
+        if (fBrokenListenSocket)
+            connman.vhListenSocket.push_back(CConnman::ListenSocket(INVALID_SOCKET, false));
+        connman.StartSocketEvents();
+    }
+
+    static SocketEventsMode GetMode(const CConnman& connman) { return connman.socketEventsMode; }
+    static int GetEpollFd(const CConnman& connman) { return connman.epollfd; }
+    static void AddNode(CConnman& connman, CNode* pnode) { connman.AddNodeToSocketHandler(pnode); }
+};
+
+BOOST_AUTO_TEST_CASE(socketevents_mode_parse)
+{
+    SocketEventsMode mode = SOCKETEVENTS_EPOLL;
+    BOOST_CHECK(ParseSocketEventsMode("select", mode));
+    BOOST_CHECK_EQUAL(mode, SOCKETEVENTS_SELECT);
+#ifdef HAVE_SYS_EPOLL_H
+    BOOST_CHECK(ParseSocketEventsMode("epoll", mode));
+    BOOST_CHECK_EQUAL(mode, SOCKETEVENTS_EPOLL);
+#else
+    BOOST_CHECK(!ParseSocketEventsMode("epoll", mode));
+#endif
+    BOOST_CHECK(!ParseSocketEventsMode("poll", mode));
+    BOOST_CHECK(!ParseSocketEventsMode("", mode));
+
+    // The default is always available
+    BOOST_CHECK(ParseSocketEventsMode(GetSocketEventsModeName(DEFAULT_SOCKETEVENTS), mode));
+    BOOST_CHECK_EQUAL(mode, DEFAULT_SOCKETEVENTS);
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_fallback)
+{
+    CConnman connSelect(0x1337, 0x1337);
+    TestSocketEvents::Start(connSelect, SOCKETEVENTS_SELECT);
+    BOOST_CHECK_EQUAL(TestSocketEvents::GetMode(connSelect), SOCKETEVENTS_SELECT);
+    BOOST_CHECK_EQUAL(TestSocketEvents::GetEpollFd(connSelect), -1);
+
+#ifdef HAVE_SYS_EPOLL_H
+    CConnman connEpoll(0x1337, 0x1337);
+    TestSocketEvents::Start(connEpoll, SOCKETEVENTS_EPOLL);
+    BOOST_CHECK_EQUAL(TestSocketEvents::GetMode(connEpoll), SOCKETEVENTS_EPOLL);
+    BOOST_CHECK(TestSocketEvents::GetEpollFd(connEpoll) != -1);
+#endif
+
+    // A socket epoll can't watch makes the handler fall back to select()
+    CConnman connBroken(0x1337, 0x1337);
+    TestSocketEvents::Start(connBroken, SOCKETEVENTS_EPOLL, true);
+    BOOST_CHECK_EQUAL(TestSocketEvents::GetMode(connBroken), SOCKETEVENTS_SELECT);
+    BOOST_CHECK_EQUAL(TestSocketEvents::GetEpollFd(connBroken), -1);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+BOOST_AUTO_TEST_CASE(socketevents_epoll_unregister)
+{
+    CConnman connman(0x1337, 0x1337);
+    TestSocketEvents::Start(connman, SOCKETEVENTS_EPOLL);
+    int epollfd = TestSocketEvents::GetEpollFd(connman);
+    BOOST_REQUIRE(epollfd != -1);
+
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode* pnode = new CNode(0, NODE_NETWORK, 0, fds[0], addr, 0, 0, "", true);
+    TestSocketEvents::AddNode(connman, pnode);
+    BOOST_CHECK_EQUAL(pnode->nSocketEvents, EPOLLIN);
+
+    struct epoll_event events[1];
+    BOOST_CHECK_EQUAL(send(fds[1], "x", 1, 0), 1);
+    BOOST_CHECK_EQUAL(epoll_wait(epollfd, events, 1, 0), 1);
+    BOOST_CHECK(events[0].data.ptr == pnode);
+
+    // A copy of the socket, as a child started with system() holds it,
+    // must not keep the closed node in the epoll set.
+    int fdChild = dup(fds[0]);
+    pnode->CloseSocketDisconnect(&connman);
+    BOOST_CHECK(pnode->hSocket == INVALID_SOCKET);
+    BOOST_CHECK_EQUAL(pnode->nSocketEvents, -1);
+    BOOST_CHECK_EQUAL(send(fds[1], "y", 1, 0), 1);
+    BOOST_CHECK_EQUAL(epoll_wait(epollfd, events, 1, 0), 0);
+
+    close(fdChild);
+    close(fds[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(cnode_process_time_per_msg)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+
+    node.RecordProcessTime(NetMsgType::PING, 10);
+    node.RecordProcessTime(NetMsgType::PING, 5);
+    node.RecordProcessTime(NetMsgType::SPORK, 7);
+    node.RecordProcessTime("unknowncmd", 3);
+
+    CNodeStats stats;
+    node.copyStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd[NetMsgType::PING], 15U);
+    BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd[NetMsgType::SPORK], 7U);
+    BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd["*other*"], 3U);
+    BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd[NetMsgType::MNPING], 0U);
+    BOOST_CHECK(!stats.mapProcessTimePerMsgCmd.count("unknowncmd"));
+}
+
+class TestMessageHandler
+{
+public:
+    static void Start(CConnman& connman, int nThreads)
+    {
+        connman.nMsgProcThreads = nThreads;
+        connman.vMsgProcWake.assign(nThreads, false);
+        for (int i = 0; i < nThreads; i++)
+            connman.threadMessageHandlers.push_back(std::thread(&CConnman::ThreadMessageHandler, &connman, i));
+    }
+
+    static void AddNode(CConnman& connman, CNode* pnode)
+    {
+        {
+            LOCK(connman.cs_vNodes);
+            connman.vNodes.push_back(pnode);
+        }
+        connman.WakeMessageHandler(pnode);
+    }
+};
+
+/** Messages queued per node, and by which threads and in which order they got processed */
+static std::mutex mutexTestMessages;
+static std::map<NodeId, std::deque<int> > mapTestPending;
+static std::map<NodeId, std::vector<int> > mapTestProcessed;
+static std::map<NodeId, std::set<std::thread::id> > mapTestThreads;
+static std::set<NodeId> setTestInFlight;
+static int nTestOverlaps = 0;
+
+static bool ProcessTestMessage(CNode* pnode, CConnman& connman, std::atomic<bool>& interruptMsgProc)
+{
+    int nMessage;
+    {
+        std::lock_guard<std::mutex> lock(mutexTestMessages);
+        std::deque<int>& queue = mapTestPending[pnode->GetId()];
+        if (queue.empty())
+            return false;
+        if (!setTestInFlight.insert(pnode->GetId()).second)
+            nTestOverlaps++;
+        nMessage = queue.front();
+        queue.pop_front();
+    }
+
+    // Give another thread the chance to pick up the same node meanwhile
+    MilliSleep(1);
+
+    std::lock_guard<std::mutex> lock(mutexTestMessages);
+    mapTestProcessed[pnode->GetId()].push_back(nMessage);
+    mapTestThreads[pnode->GetId()].insert(std::this_thread::get_id());
+    setTestInFlight.erase(pnode->GetId());
+    return !mapTestPending[pnode->GetId()].empty();
+}
+
+static bool SendTestMessages(CNode* pnode, CConnman& connman, std::atomic<bool>& interruptMsgProc)
+{
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(msgproc_per_node_order)
+{
+    const int nThreads = 4;
+    const int nNodes = 2 * nThreads;
+    const int nMessages = 50;
+
+    boost::signals2::scoped_connection connProcess(GetNodeSignals().ProcessMessages.connect(&ProcessTestMessage));
+    boost::signals2::scoped_connection connSend(GetNodeSignals().SendMessages.connect(&SendTestMessages));
+
+    for (NodeId id = 0; id < nNodes; id++)
+        for (int i = 0; i < nMessages; i++)
+            mapTestPending[id].push_back(i);
+
+    CConnman connman(0x1337, 0x1337);
+    TestMessageHandler::Start(connman, nThreads);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    for (NodeId id = 0; id < nNodes; id++)
+        TestMessageHandler::AddNode(connman, new CNode(id, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true));
+
+    for (int nWait = 0; nWait < 1000; nWait++) {
+        {
+            std::lock_guard<std::mutex> lock(mutexTestMessages);
+            size_t nProcessed = 0;
+            for (NodeId id = 0; id < nNodes; id++)
+                nProcessed += mapTestProcessed[id].size();
+            if (nProcessed == nNodes * nMessages)
+                break;
+        }
+        MilliSleep(10);
+    }
+    connman.Interrupt();
+    connman.Stop();
+
+    // Every node is handled by one thread only, in the order of its messages
+    BOOST_CHECK_EQUAL(nTestOverlaps, 0);
+    std::set<std::thread::id> setThreads;
+    for (NodeId id = 0; id < nNodes; id++) {
+        BOOST_CHECK_EQUAL(mapTestProcessed[id].size(), (size_t)nMessages);
+        for (size_t i = 0; i < mapTestProcessed[id].size(); i++)
+            BOOST_CHECK_EQUAL(mapTestProcessed[id][i], (int)i);
+        BOOST_REQUIRE_EQUAL(mapTestThreads[id].size(), 1U);
+        setThreads.insert(*mapTestThreads[id].begin());
+    }
+
+    // and the nodes are spread over all the threads
+    BOOST_CHECK_EQUAL(setThreads.size(), (size_t)nThreads);
+    for (NodeId id = nThreads; id < nNodes; id++)
+        BOOST_CHECK(mapTestThreads[id] == mapTestThreads[id - nThreads]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
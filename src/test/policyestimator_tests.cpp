@@ -2,8 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -222,4 +224,192 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+// Confirm a fixed stream of transactions in TxConfirmStats and check that the
+// averages it writes out match averages decayed block by block
+static void CheckDecayMatchesPerBlock(double decay, int nBlocks)
+{
+    std::vector<double> buckets;
+    for (double bucketBoundary = 1000; bucketBoundary <= 64000; bucketBoundary *= 2)
+        buckets.push_back(bucketBoundary);
+    buckets.push_back(INF_FEERATE);
+    const unsigned int maxConfirms = 10;
+
+    TxConfirmStats stats;
+    stats.Initialize(buckets, maxConfirms, decay, "FeeRate");
+
+    std::vector<double> avg(buckets.size()), txCtAvg(buckets.size());
+    std::vector<std::vector<double> > confAvg(maxConfirms, std::vector<double>(buckets.size()));
+    for (int nBlock = 1; nBlock <= nBlocks; nBlock++) {
+        stats.ClearCurrent(nBlock);
+        for (unsigned int j = 0; j < buckets.size(); j++) {
+            for (unsigned int i = 0; i < maxConfirms; i++)
+                confAvg[i][j] *= decay;
+            avg[j] *= decay;
+            txCtAvg[j] *= decay;
+        }
+        for (int k = 0; k <= nBlock % 7; k++) {
+            unsigned int bucket = (nBlock * 3 + k) % (buckets.size() - 1);
+            unsigned int blocksToConfirm = (nBlock + k) % maxConfirms + 1;
+            stats.Record(blocksToConfirm, buckets[bucket]);
+            for (unsigned int i = blocksToConfirm; i <= maxConfirms; i++)
+                confAvg[i - 1][bucket]++;
+            avg[bucket] += buckets[bucket];
+            txCtAvg[bucket]++;
+        }
+    }
+
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    stats.Write(file);
+    rewind(file.Get());
+    double fileDecay;
+    std::vector<double> fileBuckets, fileAvg, fileTxCtAvg;
+    std::vector<std::vector<double> > fileConfAvg;
+    file >> fileDecay >> fileBuckets >> fileAvg >> fileTxCtAvg >> fileConfAvg;
+
+    BOOST_CHECK_EQUAL(fileDecay, decay);
+    BOOST_CHECK(fileBuckets == buckets);
+    BOOST_REQUIRE_EQUAL(fileConfAvg.size(), maxConfirms);
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        BOOST_CHECK_CLOSE(fileAvg[j], avg[j], 1e-6);
+        BOOST_CHECK_CLOSE(fileTxCtAvg[j], txCtAvg[j], 1e-6);
+        for (unsigned int i = 0; i < maxConfirms; i++)
+            BOOST_CHECK_CLOSE(fileConfAvg[i][j], confAvg[i][j], 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TxConfirmStatsDecay)
+{
+    CheckDecayMatchesPerBlock(DEFAULT_DECAY, 200);
+    // A fast decay grows the scale factor past MAX_AVERAGES_SCALE after 333
+    // blocks, the averages must survive their normalization
+    CheckDecayMatchesPerBlock(0.5, 400);
+}
+
+/**
+ * Feeds the estimator transactions at each of ten fee levels every block.
+ * A block confirms the waiting transactions at nMinLevel and above, or all of
+ * them if nMinLevel is 0.
+ */
+class FeeLevelStream
+{
+public:
+    FeeLevelStream() : nBlockHeight(0) {}
+
+    void NextBlock(CBlockPolicyEstimator& estimator, int nMinLevel)
+    {
+        TestMemPoolEntryHelper entry;
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(128, 'X');
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 0;
+        for (int j = 0; j < 10; j++) {
+            // Uneven counts per level, so the median never sits on a bucket boundary
+            for (int k = 0; k <= j % 3; k++) {
+                tx.vin[0].prevout.n = 1000 * nBlockHeight + 10 * j + k; // make transaction unique
+                vPending.push_back(entry.Fee(2000 * (j + 1)).Height(nBlockHeight).HadNoDependencies(true).FromTx(tx));
+                estimator.processTransaction(vPending.back(), true);
+            }
+        }
+
+        std::vector<CTxMemPoolEntry> vBlock;
+        for (std::vector<CTxMemPoolEntry>::iterator it = vPending.begin(); it != vPending.end(); ) {
+            if (it->GetFee() >= 2000 * (nMinLevel + 1)) {
+                vBlock.push_back(*it);
+                it = vPending.erase(it);
+            } else
+                ++it;
+        }
+        // Like the mempool, stop tracking them before processing the block
+        for (unsigned int i = 0; i < vBlock.size(); i++)
+            estimator.removeTx(vBlock[i].GetTx().GetHash());
+        estimator.processBlock(++nBlockHeight, vBlock, true);
+    }
+
+private:
+    int nBlockHeight;
+    std::vector<CTxMemPoolEntry> vPending;
+};
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesWriteRead)
+{
+    CBlockPolicyEstimator estimator(CFeeRate(1000)), estimatorRead(CFeeRate(1000));
+    FeeLevelStream stream;
+    for (int i = 0; i < 100; i++)
+        stream.NextBlock(estimator, i % 5);
+    // Leave no transactions waiting, they aren't part of the file
+    stream.NextBlock(estimator, 0);
+
+    std::vector<CAmount> vFeeEst;
+    for (int i = 1; i <= 10; i++)
+        vFeeEst.push_back(estimator.estimateFee(i).GetFeePerK());
+    BOOST_CHECK(vFeeEst[1] > 0);
+
+    // Writing normalizes the averages, which must not move the estimates
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    estimator.Write(file);
+    for (int i = 1; i <= 10; i++)
+        BOOST_CHECK_EQUAL(estimator.estimateFee(i).GetFeePerK(), vFeeEst[i - 1]);
+
+    rewind(file.Get());
+    estimatorRead.Read(file);
+    for (int i = 1; i <= 10; i++) {
+        BOOST_CHECK_EQUAL(estimatorRead.estimateFee(i).GetFeePerK(), vFeeEst[i - 1]);
+        BOOST_CHECK_EQUAL(estimatorRead.estimatePriority(i), estimator.estimatePriority(i));
+    }
+
+    // And the data written again is the same
+    CAutoFile file2(tmpfile(), SER_DISK, CLIENT_VERSION), file3(tmpfile(), SER_DISK, CLIENT_VERSION);
+    estimator.Write(file2);
+    estimatorRead.Write(file3);
+    std::vector<FILE*> vFiles;
+    vFiles.push_back(file.Get());
+    vFiles.push_back(file2.Get());
+    vFiles.push_back(file3.Get());
+    std::vector<std::vector<char> > vData(vFiles.size());
+    for (unsigned int i = 0; i < vFiles.size(); i++) {
+        rewind(vFiles[i]);
+        char buf[4096];
+        size_t nRead;
+        while ((nRead = fread(buf, 1, sizeof(buf), vFiles[i])) > 0)
+            vData[i].insert(vData[i].end(), buf, buf + nRead);
+    }
+    BOOST_CHECK(!vData[0].empty());
+    BOOST_CHECK(vData[0] == vData[1]);
+    BOOST_CHECK(vData[0] == vData[2]);
+}
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesMemo)
+{
+    CTxMemPool mpool(CFeeRate(1000));
+    CBlockPolicyEstimator estimator(CFeeRate(1000)), estimatorUnqueried(CFeeRate(1000));
+    FeeLevelStream stream, streamUnqueried;
+    int answerFound;
+
+    // Every level confirms at once, then only the top levels get mined and the
+    // estimates have to rise. Query all targets after every block, a memo
+    // surviving a block would keep them from moving.
+    CAmount nFirstEst = 0;
+    for (int i = 0; i < 200; i++) {
+        stream.NextBlock(estimator, i < 100 ? 0 : 7);
+        streamUnqueried.NextBlock(estimatorUnqueried, i < 100 ? 0 : 7);
+        for (int j = 1; j <= 10; j++) {
+            estimator.estimateFee(j);
+            estimator.estimateSmartFee(j, &answerFound, mpool);
+            estimator.estimatePriority(j);
+            estimator.estimateSmartPriority(j, &answerFound, mpool);
+        }
+        if (i == 99)
+            nFirstEst = estimator.estimateFee(2).GetFeePerK();
+    }
+    BOOST_CHECK(nFirstEst > 0);
+    BOOST_CHECK(estimator.estimateFee(2).GetFeePerK() > nFirstEst);
+
+    for (int j = 1; j <= 10; j++) {
+        BOOST_CHECK(estimator.estimateFee(j) == estimatorUnqueried.estimateFee(j));
+        BOOST_CHECK(estimator.estimateSmartFee(j, &answerFound, mpool) == estimatorUnqueried.estimateSmartFee(j, &answerFound, mpool));
+        BOOST_CHECK_EQUAL(estimator.estimatePriority(j), estimatorUnqueried.estimatePriority(j));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,375 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net_processing.h"
+#include "primitives/block.h"
+#include "protocol.h"
+#include "random.h"
+#include "smartnode/flat-database.h"
+#include "smartnode/smartnode.h"
+#include "smartnode/smartnodeman.h"
+#include "smartnode/smartnodemaintenance.h"
+#include "smartnode/smartnodesync.h"
+#include "test/test_bitcoin.h"
+#include "test/testutil.h"
+#include "util.h"
+#include "version.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(smartnode_tests, BasicTestingSetup)
+
+static bool IsCollateralSpent(CSmartnodeMan& man, const COutPoint& outpoint)
+{
+    CSmartnode mn;
+    BOOST_REQUIRE(man.Get(outpoint, mn));
+    return mn.IsOutpointSpent();
+}
+
+BOOST_AUTO_TEST_CASE(smartnode_collateral_spent_reorg)
+{
+    CSmartnodeMan man;
+
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFund.vout.resize(1);
+    txFund.vout[0].nValue = SMARTNODE_COIN_REQUIRED * COIN;
+    COutPoint collateral(txFund.GetHash(), 0);
+
+    CSmartnode mn(CService(), collateral, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    mn.fUnitTest = true;
+    BOOST_CHECK(man.Add(mn));
+    BOOST_CHECK(!IsCollateralSpent(man, collateral));
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = collateral;
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = SMARTNODE_COIN_REQUIRED * COIN;
+    CBlock blockSpend;
+    blockSpend.vtx.push_back(CTransaction(txSpend));
+
+    // A spend in the mempool doesn't count, one in a block does
+    man.SyncTransaction(txSpend, NULL);
+    BOOST_CHECK(!IsCollateralSpent(man, collateral));
+    man.SyncTransaction(txSpend, &blockSpend);
+    BOOST_CHECK(IsCollateralSpent(man, collateral));
+
+    // Disconnecting the spending block puts the collateral back
+    man.BlockDisconnected(blockSpend);
+    BOOST_CHECK(!IsCollateralSpent(man, collateral));
+
+    // Disconnecting the block that created it removes it again
+    CBlock blockFund;
+    blockFund.vtx.push_back(CTransaction(txFund));
+    man.BlockDisconnected(blockFund);
+    BOOST_CHECK(IsCollateralSpent(man, collateral));
+}
+
+BOOST_AUTO_TEST_CASE(smartnode_message_dispatch)
+{
+    std::map<std::string, SmartCashMessageHandler> mapExpected;
+    mapExpected[NetMsgType::MNANNOUNCE] = ProcessSmartnodeManMessage;
+    mapExpected[NetMsgType::MNPING] = ProcessSmartnodeManMessage;
+    mapExpected[NetMsgType::DSEG] = ProcessSmartnodeManMessage;
+    mapExpected[NetMsgType::MNVERIFY] = ProcessSmartnodeManMessage;
+    mapExpected[NetMsgType::SMARTNODEPAYMENTSYNC] = ProcessSmartnodePaymentsMessage;
+    mapExpected[NetMsgType::SMARTNODEPAYMENTVOTE] = ProcessSmartnodePaymentsMessage;
+    mapExpected[NetMsgType::TXLOCKVOTE] = ProcessInstantSendMessage;
+    mapExpected[NetMsgType::SPORK] = ProcessSporkMessage;
+    mapExpected[NetMsgType::GETSPORKS] = ProcessSporkMessage;
+    mapExpected[NetMsgType::SYNCSTATUSCOUNT] = ProcessSmartnodeSyncMessage;
+
+    // Every known message type goes to the one manager processing it, or
+    // to none if it is handled by ProcessMessage itself or not at all
+    size_t nHandled = 0;
+    BOOST_FOREACH(const std::string& strCommand, getAllNetMessageTypes()) {
+        std::map<std::string, SmartCashMessageHandler>::const_iterator it = mapExpected.find(strCommand);
+        SmartCashMessageHandler handler = GetSmartCashMessageHandler(strCommand);
+        if (it == mapExpected.end()) {
+            BOOST_CHECK_MESSAGE(handler == NULL, strCommand);
+        } else {
+            BOOST_CHECK_MESSAGE(handler == it->second, strCommand);
+            nHandled++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nHandled, mapExpected.size());
+
+    BOOST_CHECK(GetSmartCashMessageHandler("") == NULL);
+    BOOST_CHECK(GetSmartCashMessageHandler("unknowncmd") == NULL);
+}
+
+class TestSmartnodeMaintenance
+{
+public:
+    static size_t QueueSize(CSmartnodeMaintenance& maintenance)
+    {
+        boost::chrono::system_clock::time_point first, last;
+        return maintenance.scheduler.getQueueInfo(first, last);
+    }
+
+    /** Run the sync task on the caller's thread, as the maintenance thread would */
+    static void ProcessSync(CSmartnodeMaintenance& maintenance, CConnman& connman)
+    {
+        maintenance.connman = &connman;
+        maintenance.ProcessSync();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(smartnode_maintenance_start_stop)
+{
+    CSmartnodeMaintenance maintenance;
+    CConnman connman(0x1337, 0x1337);
+    boost::thread_group threadGroup;
+
+    // Start services the scheduler on a thread of its own and queues the sync
+    maintenance.Start(threadGroup, connman);
+    BOOST_CHECK_EQUAL(threadGroup.size(), 1U);
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 1U);
+    BOOST_CHECK_EQUAL(maintenance.GetTaskStats()["sync"].nPeriod, SMARTNODE_SYNC_TICK_SECONDS);
+
+    // The thread stops when interrupted at shutdown, leaving the tasks queued
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(smartnode_maintenance_lite_sync)
+{
+    bool fLiteModeSaved = fLiteMode;
+    fLiteMode = true;
+    CSmartnodeMaintenance maintenance;
+    CConnman connman(0x1337, 0x1337);
+
+    // The sync task queues itself again until the sync finished
+    smartnodeSync.Reset();
+    TestSmartnodeMaintenance::ProcessSync(maintenance, connman);
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 1U);
+    BOOST_CHECK_EQUAL(maintenance.GetTaskStats()["sync"].nRuns, 1U);
+
+    // then stops, lite mode has nothing to maintain afterwards
+    smartnodeSync.SwitchToNextAsset(connman);
+    smartnodeSync.SwitchToNextAsset(connman);
+    BOOST_REQUIRE(smartnodeSync.IsSynced());
+    TestSmartnodeMaintenance::ProcessSync(maintenance, connman);
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 1U);
+    BOOST_CHECK_EQUAL(maintenance.GetTaskStats()["sync"].nRuns, 2U);
+
+    // A reset of the sync restarts it once
+    maintenance.NotifySyncReset();
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 2U);
+    maintenance.NotifySyncReset();
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 2U);
+
+    // and no list checks are queued without the maintenance tasks
+    maintenance.NotifyListChanged();
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 2U);
+
+    smartnodeSync.Reset();
+    fLiteMode = fLiteModeSaved;
+}
+
+BOOST_AUTO_TEST_CASE(smartnode_maintenance_sync_tasks)
+{
+    CSmartnodeMaintenance maintenance;
+    CConnman connman(0x1337, 0x1337);
+
+    // Before the smartnode sync started only the sync task runs
+    smartnodeSync.Reset();
+    TestSmartnodeMaintenance::ProcessSync(maintenance, connman);
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), 1U);
+    BOOST_CHECK(!maintenance.GetTaskStats().count("check"));
+
+    // Once it started, the maintenance tasks are scheduled exactly once
+    smartnodeSync.SwitchToNextAsset(connman);
+    smartnodeSync.SwitchToNextAsset(connman);
+    BOOST_REQUIRE(smartnodeSync.IsSmartNodeSyncStarted());
+    TestSmartnodeMaintenance::ProcessSync(maintenance, connman);
+    size_t nQueued = TestSmartnodeMaintenance::QueueSize(maintenance);
+    BOOST_CHECK(nQueued > 2);
+    std::map<std::string, CMaintenanceTaskStats> mapStats = maintenance.GetTaskStats();
+    BOOST_CHECK_EQUAL(mapStats["check"].nPeriod, SMARTNODE_CHECK_SECONDS);
+    BOOST_CHECK_EQUAL(mapStats["smartnodes"].nPeriod, SMARTNODE_CLEANUP_SECONDS);
+    BOOST_CHECK_EQUAL(mapStats["payments"].nPeriod, SMARTNODE_CLEANUP_SECONDS);
+
+    TestSmartnodeMaintenance::ProcessSync(maintenance, connman);
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), nQueued + 1);
+
+    // List changes queue one check until it ran
+    maintenance.NotifyListChanged();
+    maintenance.NotifyListChanged();
+    BOOST_CHECK_EQUAL(TestSmartnodeMaintenance::QueueSize(maintenance), nQueued + 2);
+
+    smartnodeSync.Reset();
+}
+
+/** A cache with a map and a value, logged like the smartnode managers */
+struct CFlatLogTestCache
+{
+    std::map<int, std::string> mapItems;
+    int64_t nValue;
+
+    CFlatLogTestCache() : nValue(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(mapItems);
+        READWRITE(nValue);
+    }
+
+    template <typename Visitor>
+    void LogRecords(Visitor& v) {
+        v.Format("CFlatLogTestCache-Version-1");
+        v.Map(1, mapItems);
+        v.Value(2, nValue);
+    }
+
+    void Clear() { mapItems.clear(); nValue = 0; }
+    void CheckAndRemove() {}
+    std::string ToString() const { return strprintf("Items: %d", mapItems.size()); }
+};
+
+struct FlatLogTestingSetup : public BasicTestingSetup {
+    boost::filesystem::path pathTemp;
+
+    FlatLogTestingSetup()
+    {
+        pathTemp = GetTempPath() / strprintf("test_smartcash_flatlog_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        ClearDatadirCache();
+    }
+    ~FlatLogTestingSetup()
+    {
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+
+    uint64_t FileSize() { return boost::filesystem::file_size(GetDataDir() / "flatlog.dat"); }
+};
+
+static void FillCache(CFlatLogTestCache& cache, int nItems, const std::string& strValue)
+{
+    for (int i = 0; i < nItems; i++)
+        cache.mapItems[i] = strprintf("%s-%d", strValue, i);
+}
+
+BOOST_FIXTURE_TEST_CASE(flatlog_append_and_replay, FlatLogTestingSetup)
+{
+    CFlatLogTestCache cache;
+    FillCache(cache, 100, "first");
+    cache.nValue = 7;
+
+    CFlatLog<CFlatLogTestCache> flatlog("flatlog.dat", "magicFlatLogTest");
+    BOOST_CHECK(flatlog.Load(cache));
+    BOOST_CHECK(flatlog.Flush(cache));
+    uint64_t nSnapshotSize = FileSize();
+
+    // Nothing changed, nothing written
+    BOOST_CHECK(flatlog.Flush(cache));
+    BOOST_CHECK_EQUAL(FileSize(), nSnapshotSize);
+
+    // Only the changed, added and erased entries are appended
+    cache.mapItems[3] = "changed";
+    cache.mapItems[1000] = "added";
+    cache.mapItems.erase(5);
+    cache.nValue = 8;
+    BOOST_CHECK(flatlog.Flush(cache));
+    BOOST_CHECK(FileSize() > nSnapshotSize);
+    BOOST_CHECK(FileSize() - nSnapshotSize < nSnapshotSize / 10);
+
+    CFlatLogTestCache cacheLoaded;
+    CFlatLog<CFlatLogTestCache> flatlogLoaded("flatlog.dat", "magicFlatLogTest");
+    BOOST_CHECK(flatlogLoaded.Load(cacheLoaded));
+    BOOST_CHECK(cacheLoaded.mapItems == cache.mapItems);
+    BOOST_CHECK_EQUAL(cacheLoaded.nValue, 8);
+
+    // The replayed log continues where the old one stopped
+    uint64_t nSize = FileSize();
+    BOOST_CHECK(flatlogLoaded.Flush(cacheLoaded));
+    BOOST_CHECK_EQUAL(FileSize(), nSize);
+
+    // A log of another kind isn't loaded
+    CFlatLog<CFlatLogTestCache> flatlogOther("flatlog.dat", "magicFlatLogOther");
+    BOOST_CHECK(!flatlogOther.Load(cacheLoaded));
+}
+
+BOOST_FIXTURE_TEST_CASE(flatlog_torn_tail, FlatLogTestingSetup)
+{
+    CFlatLogTestCache cache;
+    FillCache(cache, 10, "first");
+    CFlatLog<CFlatLogTestCache> flatlog("flatlog.dat", "magicFlatLogTest");
+    BOOST_CHECK(flatlog.Flush(cache));
+    uint64_t nGoodSize = FileSize();
+
+    // A crash in the middle of an append leaves half a record behind
+    cache.mapItems[2] = "changed";
+    BOOST_CHECK(flatlog.Flush(cache));
+    boost::filesystem::resize_file(GetDataDir() / "flatlog.dat", FileSize() - 3);
+
+    CFlatLogTestCache cacheLoaded;
+    CFlatLog<CFlatLogTestCache> flatlogLoaded("flatlog.dat", "magicFlatLogTest");
+    BOOST_CHECK(flatlogLoaded.Load(cacheLoaded));
+    BOOST_CHECK_EQUAL(cacheLoaded.mapItems.size(), 10U);
+    BOOST_CHECK_EQUAL(cacheLoaded.mapItems[2], "first-2");
+    BOOST_CHECK_EQUAL(FileSize(), nGoodSize);
+
+    // Appending after the cut off record works
+    cacheLoaded.mapItems[2] = "changed";
+    BOOST_CHECK(flatlogLoaded.Flush(cacheLoaded));
+    CFlatLogTestCache cacheReloaded;
+    BOOST_CHECK(CFlatLog<CFlatLogTestCache>("flatlog.dat", "magicFlatLogTest").Load(cacheReloaded));
+    BOOST_CHECK(cacheReloaded.mapItems == cache.mapItems);
+}
+
+BOOST_FIXTURE_TEST_CASE(flatlog_compaction, FlatLogTestingSetup)
+{
+    CFlatLogTestCache cache;
+    FillCache(cache, 600, "round0");
+    CFlatLog<CFlatLogTestCache> flatlog("flatlog.dat", "magicFlatLogTest");
+    BOOST_CHECK(flatlog.Flush(cache));
+    uint64_t nSnapshotSize = FileSize();
+
+    // Rewriting every entry over and over keeps the log bounded
+    for (int nRound = 1; nRound <= 6; nRound++) {
+        FillCache(cache, 600, strprintf("round%d", nRound));
+        BOOST_CHECK(flatlog.Flush(cache));
+        BOOST_CHECK(FileSize() <= 2 * nSnapshotSize + 100);
+    }
+
+    CFlatLogTestCache cacheLoaded;
+    BOOST_CHECK(CFlatLog<CFlatLogTestCache>("flatlog.dat", "magicFlatLogTest").Load(cacheLoaded));
+    BOOST_CHECK(cacheLoaded.mapItems == cache.mapItems);
+}
+
+BOOST_FIXTURE_TEST_CASE(flatlog_legacy_snapshot, FlatLogTestingSetup)
+{
+    CFlatLogTestCache cache;
+    FillCache(cache, 10, "snapshot");
+    cache.nValue = 3;
+    CFlatDB<CFlatLogTestCache> flatdb("flatlog.dat", "magicFlatLogTestSnapshot");
+    BOOST_CHECK(flatdb.Dump(cache));
+
+    // The snapshot is loaded once and replaced by a log on the next flush
+    CFlatLogTestCache cacheLoaded;
+    CFlatLog<CFlatLogTestCache> flatlog("flatlog.dat", "magicFlatLogTest", "magicFlatLogTestSnapshot");
+    BOOST_CHECK(flatlog.Load(cacheLoaded));
+    BOOST_CHECK(cacheLoaded.mapItems == cache.mapItems);
+    BOOST_CHECK_EQUAL(cacheLoaded.nValue, 3);
+    BOOST_CHECK(flatlog.Flush(cacheLoaded));
+
+    CFlatLogTestCache cacheReloaded;
+    BOOST_CHECK(CFlatLog<CFlatLogTestCache>("flatlog.dat", "magicFlatLogTest").Load(cacheReloaded));
+    BOOST_CHECK(cacheReloaded.mapItems == cache.mapItems);
+    BOOST_CHECK_EQUAL(cacheReloaded.nValue, 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
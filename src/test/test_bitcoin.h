@@ -10,6 +10,7 @@
 #include "pubkey.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "test/test_random.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
@@ -7,6 +7,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <type_traits>
 #include <univalue.h>
 #include "test/test_bitcoin.h"
 
@@ -332,5 +333,162 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+// Output of the string based writer before UniValueWriter was added
+static const char *jsonCompact =
+    "{\"text\":\"plain \\\"quoted\\\" \\\\ back/slash\\ttab\\n\\u0001\\u0000 end \xc3""\xa4""\",\"count\":-42,\"amount\":21000000.00000000,\"flag\":true,\"none\":null,\"list\":[1,\"x\",{},[]],\"nested\":{\"inner\":[1,\"x\",{},[]],\"long\":\"aaaaaaaaaaaaaaaaaaaa\"}}";
+static const char *jsonPretty =
+    "{\n"
+    "    \"text\": \"plain \\\"quoted\\\" \\\\ back/slash\\ttab\\n\\u0001\\u0000 end \xc3""\xa4""\",\n"
+    "    \"count\": -42,\n"
+    "    \"amount\": 21000000.00000000,\n"
+    "    \"flag\": true,\n"
+    "    \"none\": null,\n"
+    "    \"list\": [\n"
+    "        1, \n"
+    "        \"x\", \n"
+    "        {\n"
+    "        }, \n"
+    "        [\n"
+    "        ]\n"
+    "    ],\n"
+    "    \"nested\": {\n"
+    "        \"inner\": [\n"
+    "            1, \n"
+    "            \"x\", \n"
+    "            {\n"
+    "            }, \n"
+    "            [\n"
+    "            ]\n"
+    "        ],\n"
+    "        \"long\": \"aaaaaaaaaaaaaaaaaaaa\"\n"
+    "    }\n"
+    "}";
+
+static UniValue MakeWriteTestDocument()
+{
+    UniValue doc(UniValue::VOBJ);
+    std::string strEscapes("plain \"quoted\" \\ back/slash\ttab\n");
+    strEscapes.push_back('\x01');
+    strEscapes.push_back('\0');
+    strEscapes += " end \xc3\xa4";
+    doc.pushKV("text", strEscapes);
+    doc.pushKV("count", (int64_t)-42);
+    doc.pushKV("amount", UniValue(UniValue::VNUM, "21000000.00000000"));
+    doc.pushKV("flag", UniValue(true));
+    doc.pushKV("none", NullUniValue);
+    UniValue arr(UniValue::VARR);
+    arr.push_back((int64_t)1);
+    arr.push_back("x");
+    arr.push_back(UniValue(UniValue::VOBJ));
+    arr.push_back(UniValue(UniValue::VARR));
+    doc.pushKV("list", arr);
+    UniValue nested(UniValue::VOBJ);
+    nested.pushKV("inner", arr);
+    nested.pushKV("long", std::string(20, 'a'));
+    doc.pushKV("nested", nested);
+    return doc;
+}
+
+/** Collects the output of UniValue::write(UniValueWriter&) and counts the appends */
+class TestUniValueWriter : public UniValueWriter
+{
+public:
+    std::string str;
+    int nAppends;
+
+    TestUniValueWriter() : nAppends(0) {}
+    void append(const char *data, size_t len) { str.append(data, len); nAppends++; }
+};
+
+BOOST_AUTO_TEST_CASE(univalue_writer)
+{
+    UniValue doc = MakeWriteTestDocument();
+    BOOST_CHECK_EQUAL(doc.write(), jsonCompact);
+    BOOST_CHECK_EQUAL(doc.write(4), jsonPretty);
+
+    for (unsigned int nIndent = 0; nIndent <= 4; nIndent += 2) {
+        TestUniValueWriter writer;
+        doc.write(writer, nIndent);
+        BOOST_CHECK_EQUAL(writer.str, doc.write(nIndent));
+
+        // Reading the output back gives the same document
+        UniValue docRead;
+        BOOST_CHECK(docRead.read(writer.str));
+        BOOST_CHECK_EQUAL(docRead.write(nIndent), writer.str);
+        BOOST_CHECK_EQUAL(docRead["text"].get_str(), doc["text"].get_str());
+        BOOST_CHECK_EQUAL(docRead["nested"]["long"].get_str(), std::string(20, 'a'));
+    }
+
+    // Unescaped runs are appended in one piece: the quotes and the run
+    UniValue str(std::string(100000, 'x'));
+    TestUniValueWriter writer;
+    str.write(writer);
+    BOOST_CHECK_EQUAL(writer.nAppends, 3);
+    BOOST_CHECK_EQUAL(writer.str.size(), 100002U);
+
+    UniValue readBack;
+    BOOST_CHECK(readBack.read("[" + writer.str + "]"));
+    BOOST_CHECK_EQUAL(readBack[0].get_str(), str.get_str());
+}
+
+BOOST_AUTO_TEST_CASE(univalue_move)
+{
+    BOOST_CHECK(std::is_nothrow_move_constructible<UniValue>::value);
+    BOOST_CHECK(std::is_nothrow_move_assignable<UniValue>::value);
+
+    UniValue arr(UniValue::VARR);
+    for (int i = 0; i < 100; i++)
+        arr.push_back(i);
+    std::string strArr = arr.write();
+
+    // Moving hands over the elements without copying them
+    const UniValue *pFirst = &arr[0];
+    UniValue arrMoved(std::move(arr));
+    BOOST_CHECK(&arrMoved[0] == pFirst);
+    BOOST_CHECK_EQUAL(arrMoved.write(), strArr);
+    BOOST_CHECK(arr.empty());
+
+    UniValue arrAssigned;
+    arrAssigned = std::move(arrMoved);
+    BOOST_CHECK(&arrAssigned[0] == pFirst);
+    BOOST_CHECK_EQUAL(arrAssigned.write(), strArr);
+    BOOST_CHECK(arrMoved.empty());
+
+    // push_back, pushKV and Pair move their argument into the container
+    UniValue outer(UniValue::VARR);
+    BOOST_CHECK(outer.push_back(std::move(arrAssigned)));
+    BOOST_CHECK(&outer[0][0] == pFirst);
+    BOOST_CHECK(arrAssigned.empty());
+
+    UniValue inner = outer[0];
+    BOOST_CHECK(&inner[0] != pFirst);
+    UniValue obj(UniValue::VOBJ);
+    pFirst = &inner[0];
+    BOOST_CHECK(obj.pushKV("moved", std::move(inner)));
+    BOOST_CHECK(&obj["moved"][0] == pFirst);
+    BOOST_CHECK(inner.empty());
+
+    UniValue pairValue = outer[0];
+    pFirst = &pairValue[0];
+    BOOST_CHECK(obj.push_back(Pair("paired", std::move(pairValue))));
+    BOOST_CHECK(&obj["paired"][0] == pFirst);
+    BOOST_CHECK(pairValue.empty());
+
+    BOOST_CHECK_EQUAL(obj["moved"].write(), strArr);
+    BOOST_CHECK_EQUAL(obj["paired"].write(), strArr);
+
+    // The rvalue overloads keep the type checks of the copying ones
+    UniValue num((int64_t)1);
+    BOOST_CHECK(!num.push_back(UniValue(UniValue::VARR)));
+    BOOST_CHECK(!num.pushKV("key", UniValue(UniValue::VARR)));
+    BOOST_CHECK(!outer.pushKV("key", UniValue(UniValue::VARR)));
+    BOOST_CHECK(!obj.push_back(UniValue(UniValue::VARR)));
+
+    // Copies stay independent of the original
+    UniValue copy(obj);
+    BOOST_CHECK_EQUAL(copy.write(), obj.write());
+    BOOST_CHECK(&copy["moved"][0] != &obj["moved"][0]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -8,6 +8,7 @@
 #include "chainparams.h"
 #include "hash.h"
 #include "pow.h"
+#include "reverselock.h"
 #include "uint256.h"
 #include "ui_interface.h"
 #include "init.h"
@@ -64,7 +65,7 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, "chainstate") 
 {
 }
 
@@ -113,7 +114,7 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, "blockindex") {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -213,11 +214,191 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+CIndexDB::CIndexDB(size_t nCacheSize, bool fMemory, bool fWipe, unsigned int nQueueSizeIn) : CDBWrapper(GetDataDir() / "indexes", nCacheSize, fMemory, fWipe, false, "indexes"),
+    nQueueSize(std::max(1u, nQueueSizeIn)), fRunning(false), fWriting(false), fFailed(false),
+    nPushed(0), nWritten(0)
+{
+}
+
+bool CIndexDB::Push(CIndexUpdate&& update)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fRunning && queue.size() >= nQueueSize)
+        condWritten.wait(lock);
+    if (fFailed)
+        return false;
+    if (!fRunning) {
+        // No writer (yet): write it here, in order with anything the writer left.
+        if (!WriteIndexUpdate(update)) {
+            LogPrintf("%s: failed to write index update for block %s\n", __func__, update.hashBestBlock.ToString());
+            fFailed = true;
+            return false;
+        }
+        return true;
+    }
+    queue.push_back(std::move(update));
+    nPushed++;
+    condWriter.notify_one();
+    return true;
+}
+
+bool CIndexDB::WaitForWriter()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // Only wait for what is queued now, later blocks must not starve the reader.
+    uint64_t nTarget = nPushed;
+    while (fRunning && nWritten < nTarget)
+        condWritten.wait(lock);
+    return !fFailed;
+}
+
+bool CIndexDB::Flush()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fRunning && (fWriting || !queue.empty()))
+            condWritten.wait(lock);
+        if (fFailed)
+            return false;
+    }
+    return Sync();
+}
+
+void CIndexDB::ThreadIndexWriter()
+{
+    RenameThread("smartcash-indexwriter");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = true;
+    try {
+        while (true) {
+            while (queue.empty())
+                condWriter.wait(lock);
+            fWriting = true;
+            const CIndexUpdate& update = queue.front();
+            {
+                // Writing does not need the lock: Push() only appends to the
+                // queue, which leaves references to its elements valid.
+                reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+                if (!WriteIndexUpdate(update))
+                    throw std::runtime_error("failed to write index update");
+            }
+            queue.pop_front();
+            nWritten++;
+            fWriting = false;
+            condWritten.notify_all();
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Shutting down: write what is left before Push() takes over.
+        try {
+            for (; !queue.empty(); queue.pop_front(), nWritten++) {
+                if (!WriteIndexUpdate(queue.front()))
+                    throw std::runtime_error("failed to write index update");
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            fFailed = true;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("*** %s: %s\n", __func__, e.what());
+        uiInterface.ThreadSafeMessageBox(_("Error: A fatal internal error occurred, see debug.log for details"), "", CClientUIInterface::MSG_ERROR);
+        StartShutdown();
+        fFailed = true;
+        queue.clear();
+    }
+    fRunning = false;
+    fWriting = false;
+    condWritten.notify_all();
+}
+
+bool CIndexDB::WriteIndexUpdate(const CIndexUpdate& update) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=update.vAddressIndex.begin(); it!=update.vAddressIndex.end(); it++) {
+        if (update.fConnect)
+            batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        else
+            batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=update.vAddressUnspentIndex.begin(); it!=update.vAddressUnspentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it=update.vSpentIndex.begin(); it!=update.vSpentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    for (std::vector<CTimestampIndexKey>::const_iterator it=update.vTimestampIndex.begin(); it!=update.vTimestampIndex.end(); it++)
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, *it), 0);
+    for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=update.vDepositIndex.begin(); it!=update.vDepositIndex.end(); it++) {
+        if (update.fConnect)
+            batch.Write(make_pair(DB_DEPOSITINDEX, it->first), it->second);
+        else
+            batch.Erase(make_pair(DB_DEPOSITINDEX, it->first));
+    }
+    batch.Write(DB_BEST_BLOCK, update.hashBestBlock);
+    return WriteBatch(batch);
+}
+
+bool CIndexDB::ReadBestBlock(uint256& hashBlock) {
+    return Read(DB_BEST_BLOCK, hashBlock);
+}
+
+bool CIndexDB::WriteBestBlock(const uint256& hashBlock) {
+    return Write(DB_BEST_BLOCK, hashBlock, true);
+}
+
+/** Move all records with the given key prefix from one database to another. */
+template<typename K, typename V>
+static size_t MoveIndexRecords(CDBWrapper& from, CDBWrapper& to, char chPrefix)
+{
+    size_t nMoved = 0;
+    CDBBatch batchTo(to), batchFrom(from);
+    boost::scoped_ptr<CDBIterator> pcursor(from.NewIterator());
+    for (pcursor->Seek(chPrefix); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        V value;
+        if (!pcursor->GetKey(key) || key.first != chPrefix)
+            break;
+        if (!pcursor->GetValue(value))
+            throw std::runtime_error(strprintf("%s: unreadable index record", __func__));
+        batchTo.Write(key, value);
+        batchFrom.Erase(key);
+        if (batchTo.SizeEstimate() > (16 << 20)) {
+            to.WriteBatch(batchTo);
+            from.WriteBatch(batchFrom);
+            batchTo.Clear();
+            batchFrom.Clear();
+        }
+        if (++nMoved % 1000000 == 0)
+            LogPrintf("Moved %u index records...\n", nMoved);
+    }
+    to.WriteBatch(batchTo, true);
+    from.WriteBatch(batchFrom, true);
+    if (nMoved)
+        from.CompactRange(chPrefix, (char)(chPrefix + 1));
+    return nMoved;
+}
+
+size_t CIndexDB::MigrateFrom(CBlockTreeDB& blocktree) {
+    size_t nMoved = 0;
+    nMoved += MoveIndexRecords<CAddressIndexKey, CAmount>(blocktree, *this, DB_ADDRESSINDEX);
+    nMoved += MoveIndexRecords<CAddressUnspentKey, CAddressUnspentValue>(blocktree, *this, DB_ADDRESSUNSPENTINDEX);
+    nMoved += MoveIndexRecords<CSpentIndexKey, CSpentIndexValue>(blocktree, *this, DB_SPENTINDEX);
+    nMoved += MoveIndexRecords<CTimestampIndexKey, int>(blocktree, *this, DB_TIMESTAMPINDEX);
+    nMoved += MoveIndexRecords<CDepositIndexKey, CDepositValue>(blocktree, *this, DB_DEPOSITINDEX);
+    nMoved += MoveIndexRecords<CInstantPayIndexKey, CInstantPayValue>(blocktree, *this, DB_INSTANTPAY_INDEX);
+    return nMoved;
+}
+
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+bool CIndexDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -229,7 +410,7 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+bool CIndexDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -241,7 +422,7 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndexCount(uint160 addressHash, int type, int &nCount, CAddressUnspentKey &lastIndex) {
+bool CIndexDB::ReadAddressUnspentIndexCount(uint160 addressHash, int type, int &nCount, CAddressUnspentKey &lastIndex) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -273,7 +454,7 @@ bool CBlockTreeDB::ReadAddressUnspentIndexCount(uint160 addressHash, int type, i
     return true;
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
                                            const CAddressUnspentKey &start, int offset, int limit, bool reverse) {
 
@@ -314,14 +495,14 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CIndexDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CIndexDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
@@ -329,7 +510,7 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
 }
 
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
@@ -364,7 +545,7 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
 }
 
 
-bool CBlockTreeDB::ReadAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, bool excludeZeroBalances) {
+bool CIndexDB::ReadAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, bool excludeZeroBalances) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -428,13 +609,13 @@ bool CBlockTreeDB::ReadAddresses(std::vector<CAddressListEntry> &addressList, in
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+bool CIndexDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+bool CIndexDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -454,7 +635,7 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &timestamp, uint256 &blockHash) {
+bool CIndexDB::ReadTimestampIndex(const unsigned int &timestamp, uint256 &blockHash) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -474,21 +655,21 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &timestamp, uint256 &bl
     return false;
 }
 
-bool CBlockTreeDB::WriteDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
+bool CIndexDB::WriteDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_DEPOSITINDEX, it->first), it->second);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
+bool CIndexDB::EraseDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_DEPOSITINDEX, it->first));
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadDepositIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadDepositIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CDepositIndexKey, CDepositValue> > &depositIndex,
                                     int start, int offset, int limit, bool reverse) {
 
@@ -528,7 +709,7 @@ bool CBlockTreeDB::ReadDepositIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::ReadDepositIndexCount(uint160 addressHash, int type,
+bool CIndexDB::ReadDepositIndexCount(uint160 addressHash, int type,
                                     int &count,
                                     int &firstTime, int &lastTime,
                                     int start, int end) {
@@ -569,7 +750,7 @@ bool CBlockTreeDB::ReadDepositIndexCount(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteInstantPayLocks(std::map<CInstantPayIndexKey, CInstantPayValue> &mapLocks)
+bool CIndexDB::WriteInstantPayLocks(std::map<CInstantPayIndexKey, CInstantPayValue> &mapLocks)
 {
     CDBBatch batch(*this);
     for (auto& lock : mapLocks ){
@@ -582,7 +763,7 @@ bool CBlockTreeDB::WriteInstantPayLocks(std::map<CInstantPayIndexKey, CInstantPa
     return batch.SizeEstimate() ? WriteBatch(batch) : true;
 }
 
-bool CBlockTreeDB::ReadInstantPayIndex( std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > &instantPayIndex,
+bool CIndexDB::ReadInstantPayIndex( std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > &instantPayIndex,
                                         int start, int offset, int limit, bool reverse) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -621,7 +802,7 @@ bool CBlockTreeDB::ReadInstantPayIndex( std::vector<std::pair<CInstantPayIndexKe
     return true;
 }
 
-bool CBlockTreeDB::ReadInstantPayIndexCount(int &count, int &firstTime, int &lastTime,
+bool CIndexDB::ReadInstantPayIndexCount(int &count, int &firstTime, int &lastTime,
                                             int start, int end) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -835,43 +1016,65 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex,
+                                      boost::function<void(const std::vector<CBlockHeader>&, std::vector<uint256>&)> hashBlockHeaders)
 {
+    // Number of records decoded before their headers are hashed as one batch
+    static const size_t nBatchSize = 4096;
+
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    vDiskIndex.reserve(nBatchSize);
+    vHeaders.reserve(nBatchSize);
+
     // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->nHeight, pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
 
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+        // Decode the next batch of records
+        vDiskIndex.clear();
+        vHeaders.clear();
+        while (vDiskIndex.size() < nBatchSize) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                fDone = true;
+                break;
             }
-        } else {
-            break;
+            vDiskIndex.push_back(CDiskBlockIndex());
+            if (!pcursor->GetValue(vDiskIndex.back()))
+                return error("%s: failed to read value", __func__);
+            vHeaders.push_back(vDiskIndex.back().GetBlockHeader());
+            pcursor->Next();
+        }
+
+        // Hash the headers in parallel, then insert the records in order
+        hashBlockHeaders(vHeaders, vHashes);
+        for (size_t i = 0; i < vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(vHashes[i]);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            if (!CheckProofOfWork(pindexNew->nHeight, pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
+                return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
         }
     }
 
@@ -11,12 +11,15 @@
 #include "chain.h"
 #include "spentindex.h"
 
+#include <deque>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
@@ -41,6 +44,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the address/spent/deposit index DB cache (MiB)
+static const int64_t nMaxIndexDBCache = 256;
+//! -indexqueue default, blocks whose index updates may wait for the index writer
+static const unsigned int DEFAULT_INDEX_QUEUE_SIZE = 64;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -124,6 +131,93 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    /** SmartVoting start **/
+    bool WriteInvalidVoteKeyRegistrations(std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> vecInvalidRegistrations);
+    bool EraseInvalidVoteKeyRegistrations(std::vector<CVoteKeyRegistrationKey> vecInvalidRegistrations);
+    bool ReadInvalidVoteKeyRegistration(const uint256 &txHash, CVoteKeyRegistrationKey &registrationKey, VoteKeyParseResult &result);
+    bool WriteVoteKeys(const std::map<CVoteKey, CVoteKeyValue> &mapVoteKeys);
+    bool EraseVoteKeys(const std::map<CVoteKey, CSmartAddress> &mapVoteKeys);
+    bool ReadVoteKeyForAddress(const CSmartAddress &voteAddress, CVoteKey &voteKey);
+    bool ReadVoteKeys(std::vector<std::pair<CVoteKey,CVoteKeyValue>> &vecVoteKeys);
+    bool ReadVoteKeyValue(const CVoteKey &voteKey, CVoteKeyValue &voteKeyValue);
+    /** SmartVoting end **/
+
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue);
+    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex,
+                            boost::function<void(const std::vector<CBlockHeader>&, std::vector<uint256>&)> hashBlockHeaders);
+};
+
+/** Optional index entries of one connected or disconnected block. */
+struct CIndexUpdate
+{
+    //! the block the indexes are at once this update is written
+    uint256 hashBestBlock;
+    //! true if the block was connected, false if it was disconnected
+    bool fConnect;
+    //! written on connect, erased on disconnect
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    //! null values are erased, others written
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    //! null values are erased, others written
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+    //! written on connect
+    std::vector<CTimestampIndexKey> vTimestampIndex;
+    //! written on connect, erased on disconnect
+    std::vector<std::pair<CDepositIndexKey, CDepositValue> > vDepositIndex;
+
+    CIndexUpdate() : fConnect(true) {}
+};
+
+/** Access to the optional address, spent, timestamp, deposit and InstantPay
+ *  indexes (indexes/).
+ *
+ *  Block updates are queued with Push() and written by ThreadIndexWriter(),
+ *  so that connecting a block does not wait for index I/O. Each update is
+ *  written together with the hash of the block it brings the indexes to, so
+ *  that the indexes can be caught up with the chain after an unclean shutdown.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, unsigned int nQueueSizeIn = DEFAULT_INDEX_QUEUE_SIZE);
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+
+    boost::mutex mutex;
+    //! signalled when an update is queued or the writer should stop
+    boost::condition_variable condWriter;
+    //! signalled when an update was written or the writer stopped
+    boost::condition_variable condWritten;
+    std::deque<CIndexUpdate> queue;
+    unsigned int nQueueSize;
+    //! whether ThreadIndexWriter() is running, otherwise Push() writes directly
+    bool fRunning;
+    //! whether the front of the queue is being written
+    bool fWriting;
+    //! set after a write failed, later updates are dropped and caught up on restart
+    bool fFailed;
+    //! number of updates queued and written by the writer, lets readers wait for their updates
+    uint64_t nPushed;
+    uint64_t nWritten;
+
+public:
+    /** Queue an update, blocking while the queue is full. Returns false if it could not be written. */
+    bool Push(CIndexUpdate&& update);
+    /** Wait until all queued updates are written and sync them to disk. */
+    bool Flush();
+    /** Wait until the updates queued so far are written, so reads see them. */
+    bool WaitForWriter();
+    /** Write queued updates until interrupted, then write the rest. */
+    void ThreadIndexWriter();
+
+    bool WriteIndexUpdate(const CIndexUpdate& update);
+    bool ReadBestBlock(uint256& hashBlock);
+    bool WriteBestBlock(const uint256& hashBlock);
+    /** Move index entries written by older versions from the block tree, returns the number moved. */
+    size_t MigrateFrom(CBlockTreeDB& blocktree);
+
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
@@ -156,21 +250,6 @@ public:
                                             int start, int offset, int limit, bool reverse);
     bool ReadInstantPayIndexCount(int &count, int &firstTime, int &lastTime,
                                   int start, int end);
-
-    /** SmartVoting start **/
-    bool WriteInvalidVoteKeyRegistrations(std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> vecInvalidRegistrations);
-    bool EraseInvalidVoteKeyRegistrations(std::vector<CVoteKeyRegistrationKey> vecInvalidRegistrations);
-    bool ReadInvalidVoteKeyRegistration(const uint256 &txHash, CVoteKeyRegistrationKey &registrationKey, VoteKeyParseResult &result);
-    bool WriteVoteKeys(const std::map<CVoteKey, CVoteKeyValue> &mapVoteKeys);
-    bool EraseVoteKeys(const std::map<CVoteKey, CSmartAddress> &mapVoteKeys);
-    bool ReadVoteKeyForAddress(const CSmartAddress &voteAddress, CVoteKey &voteKey);
-    bool ReadVoteKeys(std::vector<std::pair<CVoteKey,CVoteKeyValue>> &vecVoteKeys);
-    bool ReadVoteKeyValue(const CVoteKey &voteKey, CVoteKeyValue &voteKeyValue);
-    /** SmartVoting end **/
-
-    bool WriteFlag(const std::string &name, bool fValue);
-    bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
 #endif // BITCOIN_TXDB_H
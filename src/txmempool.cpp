@@ -11,6 +11,7 @@
 #include "validation.h"
 #include "policy/fees.h"
 #include "random.h"
+#include "script/standard.h"
 #include "streams.h"
 #include "timedata.h"
 #include "util.h"
@@ -326,7 +327,7 @@ void CTxMemPoolEntry::UpdateState(int64_t modifySize, CAmount modifyFee, int64_t
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nDeltasUpdated(0)
 {
     _clear(); //lock free clear
 
@@ -362,6 +363,12 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+unsigned int CTxMemPool::GetDeltasUpdated() const
+{
+    LOCK(cs);
+    return nDeltasUpdated;
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate)
 {
     // Add to memory pool without checking anything.
@@ -413,113 +420,60 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
 
+    NotifyEntryAdded(*newit);
+
     return true;
 }
 
-void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
+void CTxMemPool::addAddressAndSpentIndex(const CTxMemPoolEntry &entry, const std::vector<CMempoolSpentCoin> &vSpentCoins, bool fAddress, bool fSpent)
 {
+    if (!fAddress && !fSpent)
+        return;
+
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
-
-    uint256 txhash = tx.GetHash();
+    const uint256& txhash = tx.GetHash();
+    std::vector<CMempoolAddressKey> vAddressInserted;
+    std::vector<COutPoint> vSpentInserted;
+
+    // Only keep one bucket reference per address, a transaction often
+    // spends several coins of the same address.
+    auto addDelta = [&](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+        CMempoolAddressKey addressKey(key.type, key.addressBytes);
+        mapAddress[addressKey][key.txhash].push_back(CMempoolAddressDeltaEntry(key, delta));
+        if (std::find(vAddressInserted.begin(), vAddressInserted.end(), addressKey) == vAddressInserted.end())
+            vAddressInserted.push_back(addressKey);
+    };
+
+    assert(vSpentCoins.size() == tx.vin.size());
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
-        const Coin& coin = view.AccessCoin(input.prevout);
-        const CTxOut &prevout = coin.out;
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
-
-            uint160 nPubKeyHash;
-
-            if( prevout.scriptPubKey.IsPayToPublicKey() ){
-                vector<unsigned char> pubKeyBytes(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.begin()+34);
-                CPubKey pubKey(pubKeyBytes);
-                nPubKeyHash = pubKey.GetID();
-            }else{
-                vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
-                nPubKeyHash = uint160(hashBytes);
-            }
-
-            CMempoolAddressDeltaKey key(1, nPubKeyHash, txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked() ) {
-
-            int nOffset = prevout.scriptPubKey[0] + 6;
-
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20);
+        const CTxIn& input = tx.vin[j];
+        const CMempoolSpentCoin& coin = vSpentCoins[j];
 
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToScriptHashLocked() ) {
-
-            int nOffset = prevout.scriptPubKey[0] + 5;
-
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20);
+        if (fAddress && coin.addressType != 0) {
+            addDelta(CMempoolAddressDeltaKey(coin.addressType, coin.addressHash, txhash, j, 1),
+                     CMempoolAddressDelta(entry.GetTime(), coin.nValue * -1, input.prevout.hash, input.prevout.n));
+        }
 
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+        if (fSpent) {
+            mapSpent[input.prevout] = CSpentIndexValue(txhash, j, -1, coin.nValue, coin.addressType, coin.addressHash);
+            vSpentInserted.push_back(input.prevout);
         }
     }
 
-    for (unsigned int k = 0; k < tx.vout.size(); k++) {
-        const CTxOut &out = tx.vout[k];
-        if (out.scriptPubKey.IsPayToScriptHash()) {
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToPublicKeyHash() || out.scriptPubKey.IsPayToPublicKey() ) {
-
-            uint160 nPubKeyHash;
-
-            if( out.scriptPubKey.IsPayToPublicKey() ){
-                vector<unsigned char> pubKeyBytes(out.scriptPubKey.begin()+1, out.scriptPubKey.begin()+34);
-                CPubKey pubKey(pubKeyBytes);
-                nPubKeyHash = pubKey.GetID();
-            }else{
-                vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-                nPubKeyHash = uint160(hashBytes);
-            }
-
-            std::pair<addressDeltaMap::iterator,bool> ret;
-            CMempoolAddressDeltaKey key(1, nPubKeyHash, txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked() ) {
-
-            int nOffset = out.scriptPubKey[0] + 6;
-
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20);
-
-            std::pair<addressDeltaMap::iterator,bool> ret;
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToScriptHashLocked() ) {
-
-            int nOffset = out.scriptPubKey[0] + 5;
-
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20);
-
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+    if (fAddress) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            uint160 addressHash;
+            int addressType = ExtractIndexAddress(out.scriptPubKey, addressHash);
+            if (addressType != 0)
+                addDelta(CMempoolAddressDeltaKey(addressType, addressHash, txhash, k, 0), CMempoolAddressDelta(entry.GetTime(), out.nValue));
         }
+        mapAddressInserted.emplace(txhash, std::move(vAddressInserted));
     }
 
-    mapAddressInserted.insert(make_pair(txhash, inserted));
+    if (fSpent)
+        mapSpentInserted.emplace(txhash, std::move(vSpentInserted));
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
@@ -527,86 +481,56 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
 {
     LOCK(cs);
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
+        addressDeltaMap::const_iterator ait = mapAddress.find(CMempoolAddressKey((*it).second, (*it).first));
+        if (ait == mapAddress.end())
+            continue;
+        for (const auto& txDeltas : ait->second) {
+            for (const CMempoolAddressDeltaEntry& deltaEntry : txDeltas.second)
+                results.push_back(std::make_pair(deltaEntry.key, deltaEntry.delta));
         }
     }
     return true;
 }
 
-bool CTxMemPool::removeAddressIndex(const uint256 txhash)
+bool CTxMemPool::getAddressDeltas(const uint256& txhash,
+                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
     LOCK(cs);
-    addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
+    addressDeltaMapInserted::const_iterator it = mapAddressInserted.find(txhash);
+    if (it == mapAddressInserted.end())
+        return false;
 
-    if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
-        }
-        mapAddressInserted.erase(it);
+    for (const CMempoolAddressKey& addressKey : it->second) {
+        addressDeltaMap::const_iterator ait = mapAddress.find(addressKey);
+        if (ait == mapAddress.end())
+            continue;
+        addressTxDeltaMap::const_iterator tit = ait->second.find(txhash);
+        if (tit == ait->second.end())
+            continue;
+        for (const CMempoolAddressDeltaEntry& deltaEntry : tit->second)
+            results.push_back(std::make_pair(deltaEntry.key, deltaEntry.delta));
     }
-
     return true;
 }
 
-void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
+bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
     LOCK(cs);
+    addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
 
-    const CTransaction& tx = entry.GetTx();
-    std::vector<CSpentIndexKey> inserted;
-
-    uint256 txhash = tx.GetHash();
-    for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
-        const Coin& coin = view.AccessCoin(input.prevout);
-        const CTxOut &prevout = coin.out;
-        uint160 addressHash;
-        int addressType;
-
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-            addressType = 2;
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
-
-            if( prevout.scriptPubKey.IsPayToPublicKey() ){
-                vector<unsigned char> pubKeyBytes(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.begin()+34);
-                CPubKey pubKey(pubKeyBytes);
-                addressHash = pubKey.GetID();
-            }else{
-                addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-            }
-
-            addressType = 1;
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-
-            int nOffset = prevout.scriptPubKey[0] + 6;
-
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-            addressType = 1;
-        } else if (prevout.scriptPubKey.IsPayToScriptHashLocked()) {
-
-            int nOffset = prevout.scriptPubKey[0] + 5;
-
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-            addressType = 2;
-        } else {
-            addressHash.SetNull();
-            addressType = 0;
+    if (it != mapAddressInserted.end()) {
+        for (const CMempoolAddressKey& addressKey : it->second) {
+            addressDeltaMap::iterator ait = mapAddress.find(addressKey);
+            if (ait == mapAddress.end())
+                continue;
+            ait->second.erase(txhash);
+            if (ait->second.empty())
+                mapAddress.erase(ait);
         }
-
-        CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
-        CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
-
-        mapSpent.insert(make_pair(key, value));
-        inserted.push_back(key);
-
+        mapAddressInserted.erase(it);
     }
 
-    mapSpentInserted.insert(make_pair(txhash, inserted));
+    return true;
 }
 
 bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
@@ -614,7 +538,7 @@ bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     LOCK(cs);
     mapSpentIndex::iterator it;
 
-    it = mapSpent.find(key);
+    it = mapSpent.find(COutPoint(key.txid, key.outputIndex));
     if (it != mapSpent.end()) {
         value = it->second;
         return true;
@@ -628,9 +552,8 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
 
     if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapSpent.erase(*mit);
+        for (const COutPoint& outpoint : it->second) {
+            mapSpent.erase(outpoint);
         }
         mapSpentInserted.erase(it);
     }
@@ -640,6 +563,8 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
 
 void CTxMemPool::removeUnchecked(txiter it)
 {
+    NotifyEntryRemoved(*it);
+
     const uint256 hash = it->GetTx().GetHash();
     BOOST_FOREACH(const CTxIn& txin, it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
@@ -807,9 +732,16 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 
 void CTxMemPool::_clear()
 {
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); ++it)
+        NotifyEntryRemoved(*it);
+
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapAddressInserted.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -1013,6 +945,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        nDeltasUpdated++;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(deltas.second));
@@ -1232,3 +1165,11 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
+SaltedAddressHasher::SaltedAddressHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedAddressHasher::operator()(const CMempoolAddressKey& key) const
+{
+    // The 64 bit write has to come first, see CSipHasher::Write
+    return CSipHasher(k0, k1).Write(key.type).Write(key.addressBytes.begin(), key.addressBytes.size()).Finalize();
+}
+
@@ -7,12 +7,15 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <map>
 #include <set>
+#include <unordered_map>
 
 #include "addressindex.h"
 #include "spentindex.h"
 #include "amount.h"
 #include "coins.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
@@ -20,6 +23,8 @@
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
+#include <boost/signals2/signal.hpp>
+
 class CAutoFile;
 class CBlockIndex;
 
@@ -290,6 +295,52 @@ public:
     }
 };
 
+/** The address a mempool address index bucket collects the deltas of */
+struct CMempoolAddressKey
+{
+    uint160 addressBytes;
+    int type;
+
+    CMempoolAddressKey(int addressType, const uint160& addressHash) : addressBytes(addressHash), type(addressType) {}
+
+    bool operator==(const CMempoolAddressKey& other) const
+    {
+        return type == other.type && addressBytes == other.addressBytes;
+    }
+};
+
+class SaltedAddressHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedAddressHasher();
+
+    size_t operator()(const CMempoolAddressKey& key) const;
+};
+
+struct CMempoolAddressDeltaEntry
+{
+    CMempoolAddressDeltaKey key;
+    CMempoolAddressDelta delta;
+
+    CMempoolAddressDeltaEntry() : key(0, uint160()), delta(0, 0) {}
+    CMempoolAddressDeltaEntry(const CMempoolAddressDeltaKey& keyIn, const CMempoolAddressDelta& deltaIn) : key(keyIn), delta(deltaIn) {}
+};
+
+/** A coin spent by a new mempool transaction, classified for the address and spent indexes */
+struct CMempoolSpentCoin
+{
+    CAmount nValue;
+    //! see ExtractIndexAddress
+    int addressType;
+    uint160 addressHash;
+
+    CMempoolSpentCoin() : nValue(0), addressType(0) {}
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -372,6 +423,7 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //! Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated;
+    unsigned int nDeltasUpdated; //! Bumped by every PrioritiseTransaction call
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
@@ -435,16 +487,21 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    //! Deltas one transaction added to an address, usually one or two
+    typedef prevector<2, CMempoolAddressDeltaEntry> addressDeltaList;
+    //! Deltas of one address by transaction, so removing a transaction doesn't scan all deltas of a busy address
+    typedef std::map<uint256, addressDeltaList> addressTxDeltaMap;
+    typedef std::unordered_map<CMempoolAddressKey, addressTxDeltaMap, SaltedAddressHasher> addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
+    //! Addresses each transaction added deltas to
+    typedef std::unordered_map<uint256, std::vector<CMempoolAddressKey>, SaltedTxidHasher> addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    typedef std::unordered_map<COutPoint, CSpentIndexValue, SaltedOutpointHasher> mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
+    typedef std::unordered_map<uint256, std::vector<COutPoint>, SaltedTxidHasher> mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
@@ -478,12 +535,17 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
 
-    void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
+    /** Add the address and/or spent index entries of a new mempool transaction.
+     *  vSpentCoins holds the coins spent by each input, as AcceptToMemoryPool
+     *  classified them for both indexes. */
+    void addAddressAndSpentIndex(const CTxMemPoolEntry &entry, const std::vector<CMempoolSpentCoin> &vSpentCoins, bool fAddress, bool fSpent);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
+    /** Deltas classified by addAddressAndSpentIndex for a single mempool transaction */
+    bool getAddressDeltas(const uint256& txhash,
+                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
     bool removeAddressIndex(const uint256 txhash);
 
-    void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool removeSpentIndex(const uint256 txhash);
 
@@ -498,6 +560,7 @@ public:
     bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    unsigned int GetDeltasUpdated() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -612,6 +675,11 @@ public:
 
     size_t DynamicMemoryUsage() const;
 
+    /** Notifies listeners of an entry added to mapTx (called with cs held) */
+    boost::signals2::signal<void (const CTxMemPoolEntry &)> NotifyEntryAdded;
+    /** Notifies listeners of an entry about to be erased from mapTx (called with cs held) */
+    boost::signals2::signal<void (const CTxMemPoolEntry &)> NotifyEntryRemoved;
+
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
      *  the descendants for a single transaction that has been added to the
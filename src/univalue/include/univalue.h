@@ -18,6 +18,17 @@
 
 bool ParsePrechecks(const std::string& str);
 
+/**
+ * Output sink for UniValue::write. Lets large documents be serialized
+ * straight into their destination buffer instead of into a temporary string.
+ */
+class UniValueWriter {
+public:
+    virtual ~UniValueWriter() {}
+    virtual void append(const char *data, size_t len) = 0;
+    void append(const std::string& s) { append(s.data(), s.size()); }
+};
+
 class UniValue {
 public:
     enum VType { VNULL, VOBJ, VARR, VSTR, VNUM, VBOOL, };
@@ -49,6 +60,10 @@ public:
         std::string s(val_);
         setStr(s);
     }
+    UniValue(const UniValue&) = default;
+    UniValue(UniValue&&) = default;
+    UniValue& operator=(const UniValue&) = default;
+    UniValue& operator=(UniValue&&) = default;
     ~UniValue() {}
 
     void clear();
@@ -86,9 +101,9 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
-        UniValue tmpVal(VSTR, val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(VSTR, val_));
     }
     bool push_back(const char *val_) {
         std::string s(val_);
@@ -97,34 +112,32 @@ public:
     bool push_backV(const std::vector<UniValue>& vec);
 
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val) {
-        UniValue tmpVal(VSTR, val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(VSTR, val));
     }
     bool pushKV(const std::string& key, const char *val_) {
         std::string val(val_);
         return pushKV(key, val);
     }
     bool pushKV(const std::string& key, int64_t val) {
-        UniValue tmpVal(val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val));
     }
     bool pushKV(const std::string& key, uint64_t val) {
-        UniValue tmpVal(val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val));
     }
     bool pushKV(const std::string& key, int val) {
-        UniValue tmpVal((int64_t)val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue((int64_t)val));
     }
     bool pushKV(const std::string& key, double val) {
-        UniValue tmpVal(val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val));
     }
     bool pushKVs(const UniValue& obj);
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
+    void write(UniValueWriter& out, unsigned int prettyIndent = 0,
+               unsigned int indentLevel = 0) const;
 
     bool read(const char *raw);
     bool read(const std::string& rawStr) {
@@ -138,8 +151,8 @@ private:
     std::vector<UniValue> values;
 
     int findKey(const std::string& key) const;
-    void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
-    void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
+    void writeArray(unsigned int prettyIndent, unsigned int indentLevel, UniValueWriter& out) const;
+    void writeObject(unsigned int prettyIndent, unsigned int indentLevel, UniValueWriter& out) const;
 
 public:
     // Strict type-specific getters, these throw std::runtime_error if the
@@ -157,7 +170,7 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        return pushKV(pear.first, std::move(pear.second));
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
@@ -170,49 +183,49 @@ static inline std::pair<std::string,UniValue> Pair(const char *cKey, const char
 {
     std::string key(cKey);
     UniValue uVal(cVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, std::string strVal)
 {
     std::string key(cKey);
     UniValue uVal(strVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, uint64_t u64Val)
 {
     std::string key(cKey);
     UniValue uVal(u64Val);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, int64_t i64Val)
 {
     std::string key(cKey);
     UniValue uVal(i64Val);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, bool iVal)
 {
     std::string key(cKey);
     UniValue uVal(iVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, int iVal)
 {
     std::string key(cKey);
     UniValue uVal(iVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, double dVal)
 {
     std::string key(cKey);
     UniValue uVal(dVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, const UniValue& uVal)
@@ -221,9 +234,19 @@ static inline std::pair<std::string,UniValue> Pair(const char *cKey, const UniVa
     return std::make_pair(key, uVal);
 }
 
+static inline std::pair<std::string,UniValue> Pair(const char *cKey, UniValue&& uVal)
+{
+    return std::make_pair(std::string(cKey), std::move(uVal));
+}
+
 static inline std::pair<std::string,UniValue> Pair(std::string key, const UniValue& uVal)
 {
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), uVal);
+}
+
+static inline std::pair<std::string,UniValue> Pair(std::string key, UniValue&& uVal)
+{
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 enum jtokentype {
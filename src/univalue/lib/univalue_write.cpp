@@ -5,27 +5,46 @@
 #include <iomanip>
 #include <sstream>
 #include <stdio.h>
+#include <string.h>
 #include "univalue.h"
 #include "univalue_escapes.h"
 
 using namespace std;
 
-static string json_escape(const string& inS)
+namespace {
+
+class StringWriter : public UniValueWriter
+{
+public:
+    string& s;
+
+    explicit StringWriter(string& sIn) : s(sIn) {}
+    void append(const char *data, size_t len) { s.append(data, len); }
+};
+
+}
+
+static void json_escape(const string& inS, UniValueWriter& out)
 {
-    string outS;
-    outS.reserve(inS.size() * 2);
+    // Emit unescaped runs in one piece, the escapes table only hits a few
+    // characters in practice.
+    const char *data = inS.data();
+    size_t nRunStart = 0;
 
-    for (unsigned int i = 0; i < inS.size(); i++) {
+    for (size_t i = 0; i < inS.size(); i++) {
         unsigned char ch = inS[i];
         const char *escStr = escapes[ch];
 
-        if (escStr)
-            outS += escStr;
-        else
-            outS += ch;
+        if (escStr) {
+            if (i != nRunStart)
+                out.append(data + nRunStart, i - nRunStart);
+            out.append(escStr, strlen(escStr));
+            nRunStart = i + 1;
+        }
     }
 
-    return outS;
+    if (nRunStart != inS.size())
+        out.append(data + nRunStart, inS.size() - nRunStart);
 }
 
 string UniValue::write(unsigned int prettyIndent,
@@ -34,84 +53,104 @@ string UniValue::write(unsigned int prettyIndent,
     string s;
     s.reserve(1024);
 
+    StringWriter out(s);
+    write(out, prettyIndent, indentLevel);
+
+    return s;
+}
+
+void UniValue::write(UniValueWriter& out, unsigned int prettyIndent,
+                     unsigned int indentLevel) const
+{
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
 
     switch (typ) {
     case VNULL:
-        s += "null";
+        out.append("null", 4);
         break;
     case VOBJ:
-        writeObject(prettyIndent, modIndent, s);
+        writeObject(prettyIndent, modIndent, out);
         break;
     case VARR:
-        writeArray(prettyIndent, modIndent, s);
+        writeArray(prettyIndent, modIndent, out);
         break;
     case VSTR:
-        s += "\"" + json_escape(val) + "\"";
+        out.append("\"", 1);
+        json_escape(val, out);
+        out.append("\"", 1);
         break;
     case VNUM:
-        s += val;
+        out.append(val);
         break;
     case VBOOL:
-        s += (val == "1" ? "true" : "false");
+        if (val == "1")
+            out.append("true", 4);
+        else
+            out.append("false", 5);
         break;
     }
-
-    return s;
 }
 
-static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, string& s)
+static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, UniValueWriter& out)
 {
-    s.append(prettyIndent * indentLevel, ' ');
+    static const string spaces(64, ' ');
+
+    size_t n = prettyIndent * indentLevel;
+    while (n > 0) {
+        size_t chunk = n < spaces.size() ? n : spaces.size();
+        out.append(spaces.data(), chunk);
+        n -= chunk;
+    }
 }
 
-void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
+void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, UniValueWriter& out) const
 {
-    s += "[";
+    out.append("[", 1);
     if (prettyIndent)
-        s += "\n";
+        out.append("\n", 1);
 
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
-            indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+            indentStr(prettyIndent, indentLevel, out);
+        values[i].write(out, prettyIndent, indentLevel + 1);
         if (i != (values.size() - 1)) {
-            s += ",";
+            out.append(",", 1);
             if (prettyIndent)
-                s += " ";
+                out.append(" ", 1);
         }
         if (prettyIndent)
-            s += "\n";
+            out.append("\n", 1);
     }
 
     if (prettyIndent)
-        indentStr(prettyIndent, indentLevel - 1, s);
-    s += "]";
+        indentStr(prettyIndent, indentLevel - 1, out);
+    out.append("]", 1);
 }
 
-void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
+void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, UniValueWriter& out) const
 {
-    s += "{";
+    out.append("{", 1);
     if (prettyIndent)
-        s += "\n";
+        out.append("\n", 1);
 
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (prettyIndent)
-            indentStr(prettyIndent, indentLevel, s);
-        s += "\"" + json_escape(keys[i]) + "\":";
+            indentStr(prettyIndent, indentLevel, out);
+        out.append("\"", 1);
+        json_escape(keys[i], out);
+        out.append("\":", 2);
         if (prettyIndent)
-            s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+            out.append(" ", 1);
+        values.at(i).write(out, prettyIndent, indentLevel + 1);
         if (i != (values.size() - 1))
-            s += ",";
+            out.append(",", 1);
         if (prettyIndent)
-            s += "\n";
+            out.append("\n", 1);
     }
 
     if (prettyIndent)
-        indentStr(prettyIndent, indentLevel - 1, s);
-    s += "}";
+        indentStr(prettyIndent, indentLevel - 1, out);
+    out.append("}", 1);
 }
-
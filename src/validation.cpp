@@ -13,6 +13,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/keccak256.h"
 #include "hash.h"
 #include "init.h"
 #include "messagesigner.h"
@@ -68,11 +70,14 @@ using namespace std;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+/** Storage of the entries of mapBlockIndex. Protected by cs_main. */
+static CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nHeaderHashThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
@@ -276,6 +281,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CIndexDB *pindexdb = NULL;
 
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 {
@@ -823,11 +829,19 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
 
         // Keep track of transactions that spend a coinbase, which we re-scan
         // during reorgs to ensure COINBASE_MATURITY is still met.
+        // The same walk classifies the spent coins for the mempool address
+        // and spent indexes.
         bool fSpendsCoinbase = false;
-        BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const Coin &coin = view.AccessCoin(txin.prevout);
-            if (coin.IsCoinBase()) {
+        const bool fIndexInputs = fAddressIndex || fSpentIndex;
+        std::vector<CMempoolSpentCoin> vSpentCoins(fIndexInputs ? tx.vin.size() : 0);
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const Coin &coin = view.AccessCoin(tx.vin[j].prevout);
+            if (coin.IsCoinBase())
                 fSpendsCoinbase = true;
+            if (fIndexInputs) {
+                vSpentCoins[j].nValue = coin.out.nValue;
+                vSpentCoins[j].addressType = ExtractIndexAddress(coin.out.scriptPubKey, vSpentCoins[j].addressHash);
+            } else if (fSpendsCoinbase) {
                 break;
             }
         }
@@ -1100,15 +1114,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
 
-        // Add memory address index
-        if (fAddressIndex) {
-            pool.addAddressIndex(entry, view);
-        }
-
-        // Add memory spent index
-        if (fSpentIndex) {
-            pool.addSpentIndex(entry, view);
-        }
+        // Add memory address and spent index
+        pool.addAddressAndSpentIndex(entry, vSpentCoins, fAddressIndex, fSpentIndex);
 
         // trim mempool and check if tx was trimmed
         if (!fOverrideMempoolLimit) {
@@ -1131,7 +1138,7 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::v
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, hashes))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadTimestampIndex(high, low, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -1145,7 +1152,7 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadSpentIndex(key, value))
         return false;
 
     return true;
@@ -1157,7 +1164,7 @@ bool GetAddressIndex(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
@@ -1168,7 +1175,7 @@ bool GetAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, b
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddresses(addressList, nEndHeight, excludeZeroBalances))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadAddresses(addressList, nEndHeight, excludeZeroBalances))
         return error("unable to get all addresses");
 
     return true;
@@ -1179,7 +1186,7 @@ bool GetAddressUnspentCount(uint160 addressHash, int type, int &count, CAddressU
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndexCount(addressHash, type, count, lastIndex))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadAddressUnspentIndexCount(addressHash, type, count, lastIndex))
         return error("unable to get unspent count for address");
 
     return true;
@@ -1193,7 +1200,7 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, start, offset, limit, reverse))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, start, offset, limit, reverse))
         return error("unable to get txids for address");
 
     return true;
@@ -1204,7 +1211,7 @@ bool GetDepositIndexCount(uint160 addressHash, int type, int &count, int &firstT
     if (!fDepositIndex)
         return error("deposit index not enabled");
 
-    if (!pblocktree->ReadDepositIndexCount(addressHash, type, count, firstTime, lastTime, start, end))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadDepositIndexCount(addressHash, type, count, firstTime, lastTime, start, end))
         return error("unable to get deposits count for address");
 
     return true;
@@ -1217,7 +1224,7 @@ bool GetDepositIndex(uint160 addressHash, int type,
     if (!fDepositIndex)
         return error("deposit index not enabled");
 
-    if (!pblocktree->ReadDepositIndex(addressHash, type, depositIndex, start, offset, limit, reverse))
+    if (!pindexdb->WaitForWriter() || !pindexdb->ReadDepositIndex(addressHash, type, depositIndex, start, offset, limit, reverse))
         return error("unable to get deposits for address");
 
     return true;
@@ -1228,7 +1235,7 @@ bool GetInstantPayIndexCount(int &count, int &firstTime, int &lastTime, int star
     if (!fInstantPayIndex)
         return error("instantpay index not enabled");
 
-    if (!pblocktree->ReadInstantPayIndexCount(count, firstTime, lastTime, start, end))
+    if (!pindexdb->ReadInstantPayIndexCount(count, firstTime, lastTime, start, end))
         return error("unable to get instantpay index count");
 
     return true;
@@ -1240,7 +1247,7 @@ bool GetInstantPayIndex(std::vector<std::pair<CInstantPayIndexKey, CInstantPayVa
     if (!fInstantPayIndex)
         return error("instantpay index not enabled");
 
-    if (!pblocktree->ReadInstantPayIndex(instantPayIndex, start, offset, limit, reverse))
+    if (!pindexdb->ReadInstantPayIndex(instantPayIndex, start, offset, limit, reverse))
         return error("unable to get instantpay index");
 
     return true;
@@ -1822,9 +1829,103 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/** Collect the address, spent, timestamp and deposit index entries of a block
+ *  being connected (fConnect) or disconnected, from the block and its undo data. */
+static void GetIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, bool fConnect, CIndexUpdate& update)
+{
+    update.fConnect = fConnect;
+    update.hashBestBlock = fConnect ? pindex->GetBlockHash() : pindex->pprev->GetBlockHash();
+
+    if (fConnect && fTimestampIndex)
+        update.vTimestampIndex.push_back(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+
+    for (size_t n = 0; n < block.vtx.size(); n++) {
+        // Disconnecting walks the block backwards, so an output spent within
+        // the block leaves the unspent index last.
+        const unsigned int i = fConnect ? n : block.vtx.size() - 1 - n;
+        const CTransaction &tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        std::map<std::pair<uint160, int>, CAmount> mapInputs;
+        std::map<std::pair<uint160, int>, CAmount> mapOutputs;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vInputsUnspent, vOutputsUnspent;
+        uint160 hashBytes;
+        int addressType;
+
+        if (i > 0 && !tx.IsZerocoinSpend()) {
+            const CTxUndo &txundo = blockundo.vtxundo[i-1];
+            for (unsigned int j = 0; j < tx.vin.size() && j < txundo.vprevout.size(); j++) {
+                const COutPoint &prevout = tx.vin[j].prevout;
+                const Coin &coin = txundo.vprevout[j];
+                addressType = ExtractIndexAddress(coin.out.scriptPubKey, hashBytes);
+
+                if (fSpentIndex && fConnect) {
+                    // add the spent index to determine the txid and input that spent an output
+                    // and to find the amount and address from an input
+                    update.vSpentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, coin.out.nValue, addressType, hashBytes)));
+                }
+
+                if (addressType == 0)
+                    continue;
+
+                if (fDepositIndex)
+                    mapInputs[std::make_pair(hashBytes, addressType)] += coin.out.nValue;
+
+                if (fAddressIndex) {
+                    // spending activity
+                    update.vAddressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), coin.out.nValue * -1));
+
+                    // the spent output leaves the unspent index, or is restored
+                    CAddressUnspentKey key(addressType, hashBytes, prevout.hash, prevout.n, coin.nHeight);
+                    vInputsUnspent.push_back(make_pair(key, fConnect ? CAddressUnspentValue() : CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight)));
+                }
+            }
+        }
+
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            addressType = ExtractIndexAddress(out.scriptPubKey, hashBytes);
+            if (addressType == 0)
+                continue;
+
+            if (fDepositIndex)
+                mapOutputs[std::make_pair(hashBytes, addressType)] += out.nValue;
+
+            if (fAddressIndex) {
+                // receiving activity
+                update.vAddressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+
+                // the new output enters the unspent index, or leaves it again
+                CAddressUnspentKey key(addressType, hashBytes, txhash, k, pindex->nHeight);
+                vOutputsUnspent.push_back(make_pair(key, fConnect ? CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight) : CAddressUnspentValue()));
+            }
+        }
+
+        if (fConnect) {
+            update.vAddressUnspentIndex.insert(update.vAddressUnspentIndex.end(), vInputsUnspent.begin(), vInputsUnspent.end());
+            update.vAddressUnspentIndex.insert(update.vAddressUnspentIndex.end(), vOutputsUnspent.begin(), vOutputsUnspent.end());
+        } else {
+            update.vAddressUnspentIndex.insert(update.vAddressUnspentIndex.end(), vOutputsUnspent.begin(), vOutputsUnspent.end());
+            update.vAddressUnspentIndex.insert(update.vAddressUnspentIndex.end(), vInputsUnspent.begin(), vInputsUnspent.end());
+        }
+
+        for (auto const &output : mapOutputs) {
+            auto input = mapInputs.find(output.first);
+            if (input == mapInputs.end()) {
+                // If there is no input related to the address of this output just add it as deposit
+                update.vDepositIndex.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, txhash), CDepositValue(output.second, pindex->nHeight)));
+            } else if (output.second > input->second) {
+                // If the outputs exceed the inputs add the difference as deposit
+                update.vDepositIndex.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, txhash), CDepositValue(output.second - input->second, pindex->nHeight)));
+            }
+        }
+    }
+}
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state. */
-static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool fIsVerifyDB = false)
+ *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state.
+ *  The address index entries removed for the block are returned in pvAddressIndex if given. */
+static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool fIsVerifyDB = false,
+                                        std::vector<std::pair<CAddressIndexKey, CAmount> >* pvAddressIndex = NULL)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -1847,10 +1948,13 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
         return DISCONNECT_FAILED;
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-    std::vector<std::pair<CDepositIndexKey, CDepositValue> > depositIndex;
+    // Collect the index updates before the undo data is moved into the view.
+    CIndexUpdate indexUpdate;
+    bool fIndexUpdate = !fIsVerifyDB && (fAddressIndex || fSpentIndex || fTimestampIndex || fDepositIndex);
+    if (fIndexUpdate)
+        GetIndexUpdate(block, blockUndo, pindex, false, indexUpdate);
+    if (pvAddressIndex)
+        *pvAddressIndex = indexUpdate.vAddressIndex;
     /* WIP-VOTING uncomment
     std::map<CVoteKey, CSmartAddress> mapVoteKeys;
     std::vector<CVoteKeyRegistrationKey> vecInvalidVoteKeyRegistrations;
@@ -1864,73 +1968,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
         bool is_coinbase = tx.IsCoinBase();
-        std::map<std::pair<uint160, int>, CAmount> vecInputs;
-        std::map<std::pair<uint160, int>, CAmount> vecOutputs;
-
-        if (fAddressIndex || fDepositIndex) {
-
-            uint160 hashBytes;
-            int addressType;
-
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23));
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-
-                    vector<unsigned char> pubKeyBytes(out.scriptPubKey.begin()+1, out.scriptPubKey.begin()+34);
-                    CPubKey pubKey(pubKeyBytes);
-                    hashBytes = pubKey.GetID();
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToScriptHashLocked()) {
-
-                    int nOffset = out.scriptPubKey[0] + 5;
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-
-                    int nOffset = out.scriptPubKey[0] + 6;
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20));
-                    addressType = 1;
-                } else {
-                    continue;
-                }
-
-                if( fAddressIndex ){
-
-                    // undo receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k, pindex->nHeight), CAddressUnspentValue()));
-                }
-
-                if ( fDepositIndex ) {
-
-                    auto it = vecOutputs.find(std::make_pair(hashBytes,addressType));
-
-                    if( it == vecOutputs.end() ){
-                        // For the first occurrence of the address it
-                        vecOutputs.insert(std::make_pair(std::make_pair(hashBytes,addressType), out.nValue));
-                    }else{
-                        // For further ones add up the amount
-                        it->second += out.nValue;
-                    }
-
-                }
-
-            }
-
-        }
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
@@ -1954,85 +1991,9 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                int undoHeight = txundo.vprevout[j].nHeight;
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
-
-                const CTxIn input = tx.vin[j];
-
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
-
-                if (fAddressIndex || fDepositIndex) {
-
-                    const Coin &coin = view.AccessCoin(tx.vin[j].prevout);
-                    const CTxOut &prevout = coin.out;
-
-                    uint160 hashBytes;
-                    int addressType = 0;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-
-                        vector<unsigned char> pubKeyBytes(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.begin()+34);
-                        CPubKey pubKey(pubKeyBytes);
-                        hashBytes = pubKey.GetID();
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToScriptHashLocked()) {
-
-                        int nOffset = prevout.scriptPubKey[0] + 5;
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-                        addressType = 2;
-
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-
-                        int nOffset = prevout.scriptPubKey[0] + 6;
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-                        addressType = 1;
-
-                    } else {
-                        continue;
-                    }
-
-                    if ( fDepositIndex ) {
-
-                        auto it = vecInputs.find(std::make_pair(hashBytes,addressType));
-
-                        if( it == vecInputs.end() ){
-                            // For the first occurrence of the address it
-                            vecInputs.insert(std::make_pair(std::make_pair(hashBytes,addressType), prevout.nValue));
-                        }else{
-                            // For further ones add up the amount
-                            it->second += prevout.nValue;
-                        }
-
-                    }
-
-                    if( fAddressIndex ){
-
-                        // undo spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n, undoHeight), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undoHeight)));
-                    }
-
-                }
-
             }
 
             /* WIP-VOTING uncomment
@@ -2062,28 +2023,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
             }
             */
 
-            if( fDepositIndex ){
-
-                for( auto const &output : vecOutputs ){
-
-                    auto input = vecInputs.find(std::make_pair( output.first.first, output.first.second ));
-
-                    if( input == vecInputs.end() ){
-                        // If there is no input related to the address of this output just add it as deposit
-                        depositIndex.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, tx.GetHash() ),CDepositValue(output.second,pindex->nHeight)));
-                    }else{
-
-                        // If there is an input related to the address of this output evaluate if the outputs exceed the inputs
-                        CAmount nDeposit = output.second - input->second;
-
-                        if( nDeposit > 0 ){
-                            // If the outputs exceed the inputs add the deposit.
-                            depositIndex.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, tx.GetHash() ),CDepositValue(nDeposit,pindex->nHeight)));
-                        }
-                    }
-                }
-            }
-
             // At this point, all of txundo.vprevout should have been moved out.
         }
 
@@ -2096,23 +2035,9 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (!fIsVerifyDB && fDepositIndex) {
-
-        if( !pblocktree->EraseDepositIndex(depositIndex) ){
-            AbortNode(state, "Failed to write deposit index");
-            return DISCONNECT_FAILED;
-        }
-    }
-
-    if (!fIsVerifyDB && fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            AbortNode(state, "Failed to delete address index");
-            return DISCONNECT_FAILED;
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            AbortNode(state, "Failed to write address unspent index");
-            return DISCONNECT_FAILED;
-        }
+    if (fIndexUpdate && !pindexdb->Push(std::move(indexUpdate))) {
+        AbortNode(state, "Failed to write index update");
+        return DISCONNECT_FAILED;
     }
 
     if( !fIsVerifyDB && !prewards->CommitUndoBlock( (CBlockIndex*) pindex, smartRewardsResult) ){
@@ -2167,6 +2092,73 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CBlockHeaderHashCheck> headerhashqueue(16);
+// Only one batch of headers can be in flight on headerhashqueue at a time
+static CCriticalSection cs_headerhashqueue;
+
+void ThreadHeaderHash() {
+    RenameThread("smartcash-hdrhash");
+    headerhashqueue.Thread();
+}
+
+void ThreadIndexWriter() {
+    pindexdb->ThreadIndexWriter();
+}
+
+bool CBlockHeaderHashCheck::operator()() {
+    // Lay the headers out the way CBlockHeader::GetHash() hashes them and
+    // hash them in groups, which lets Keccak256Short use its multi-lane kernel.
+    static const size_t nGroup = 16;
+    static const size_t nHeaderSize = 80;
+    unsigned char in[nGroup * nHeaderSize];
+    unsigned char out[nGroup * CKeccak256::OUTPUT_SIZE];
+    while (pbegin != pend) {
+        size_t n = std::min<size_t>(nGroup, pend - pbegin);
+        for (size_t i = 0; i < n; i++) {
+            const CBlockHeader& header = pbegin[i];
+            unsigned char* p = in + i * nHeaderSize;
+            WriteLE32(p, header.nVersion);
+            memcpy(p + 4, header.hashPrevBlock.begin(), 32);
+            memcpy(p + 36, header.hashMerkleRoot.begin(), 32);
+            WriteLE32(p + 68, header.nTime);
+            WriteLE32(p + 72, header.nBits);
+            WriteLE32(p + 76, header.nNonce);
+        }
+        Keccak256Short(out, in, nHeaderSize, n);
+        for (size_t i = 0; i < n; i++)
+            memcpy(phashes[i].begin(), out + i * CKeccak256::OUTPUT_SIZE, CKeccak256::OUTPUT_SIZE);
+        pbegin += n;
+        phashes += n;
+    }
+    return true;
+}
+
+void HashBlockHeaders(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes)
+{
+    // Number of headers per check; smaller batches are hashed on the calling thread
+    static const size_t nHeadersPerCheck = 128;
+
+    hashes.resize(headers.size());
+    if (headers.empty())
+        return;
+
+    if (!nHeaderHashThreads || headers.size() <= nHeadersPerCheck) {
+        CBlockHeaderHashCheck(&headers[0], &headers[0] + headers.size(), &hashes[0])();
+        return;
+    }
+
+    LOCK(cs_headerhashqueue);
+    CCheckQueueControl<CBlockHeaderHashCheck> control(&headerhashqueue);
+    std::vector<CBlockHeaderHashCheck> vChecks;
+    vChecks.reserve((headers.size() + nHeadersPerCheck - 1) / nHeadersPerCheck);
+    for (size_t i = 0; i < headers.size(); i += nHeadersPerCheck) {
+        size_t nEnd = std::min(i + nHeadersPerCheck, headers.size());
+        vChecks.push_back(CBlockHeaderHashCheck(&headers[0] + i, &headers[0] + nEnd, &hashes[i]));
+    }
+    control.Add(vChecks);
+    control.Wait();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2242,7 +2234,8 @@ static int64_t nTimeTotal = 0;
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
-static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false, bool fIsVerifyDB = false)
+static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false, bool fIsVerifyDB = false,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> >* pvAddressIndex = NULL)
 {
     const CChainParams& chainparams = Params();
     AssertLockHeld(cs_main);
@@ -2372,10 +2365,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-    std::vector<std::pair<CDepositIndexKey, CDepositValue> > depositIndex;
     /* WIP-VOTING uncomment
     std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> vecInvalidVoteKeyRegistrations;
     std::map<CVoteKey, CVoteKeyValue> mapVoteKeys;
@@ -2390,8 +2379,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     {
         const CTransaction &tx = block.vtx[i];
         const uint256 txhash = tx.GetHash();
-        std::map<std::pair<uint160, int>, CAmount> vecInputs;
-        std::map<std::pair<uint160, int>, CAmount> vecOutputs;
 
         int nCurrentRewardsRound = prewards->GetCurrentRound()->number;
         bool fProcessRewards = !fIsVerifyDB && prewards->ProcessTransaction(pindex, tx, nCurrentRewardsRound);
@@ -2433,67 +2420,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 if( fProcessRewards && !input.scriptSig.IsZerocoinSpend() ){
                     prewards->ProcessInput(tx, prevout, coin.nHeight, nCurrentRewardsRound, smartRewardsResult);
                 }
-
-                if (fAddressIndex || fSpentIndex || fDepositIndex)
-                {
-                    uint160 hashBytes;
-                    int addressType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-                        vector<unsigned char> pubKeyBytes(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.begin()+34);
-                        CPubKey pubKey(pubKeyBytes);
-                        hashBytes = pubKey.GetID();
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToScriptHashLocked()) {
-                        int nOffset = prevout.scriptPubKey[0] + 5;
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-                        int nOffset = prevout.scriptPubKey[0] + 6;
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-                        addressType = 1;
-                    } else {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-
-                    if (fDepositIndex && addressType) {
-
-                        auto it = vecInputs.find(std::make_pair(hashBytes,addressType));
-
-                        if( it == vecInputs.end() ){
-                            // For the first occurrence of the address it
-                            vecInputs.insert(std::make_pair(std::make_pair(hashBytes,addressType), prevout.nValue));
-                        }else{
-                            // For further ones add up the amount
-                            it->second += prevout.nValue;
-                        }
-
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n, coin.nHeight), CAddressUnspentValue()));
-                    }
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-
             }
 
             if (fStrictPayToScriptHash)
@@ -2524,82 +2450,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             if( fProcessRewards && !out.scriptPubKey.IsZerocoinMint() ){
                 prewards->ProcessOutput(tx, out, nCurrentRewardsRound, pindex->nHeight, smartRewardsResult);
             }
-
-            if (fAddressIndex || fDepositIndex) {
-
-                uint160 hashBytes;
-                int addressType;
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    hashBytes = uint160(vector <unsigned char>(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    hashBytes = uint160(vector <unsigned char>(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23));
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-                    vector<unsigned char> pubKeyBytes(out.scriptPubKey.begin()+1, out.scriptPubKey.begin()+34);
-                    CPubKey pubKey(pubKeyBytes);
-                    hashBytes = pubKey.GetID();
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToScriptHashLocked()) {
-                    int nOffset = out.scriptPubKey[0] + 5;
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-                    int nOffset = out.scriptPubKey[0] + 6;
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20));
-                    addressType = 1;
-                } else {
-                    continue;
-                }
-
-                if ( fDepositIndex ) {
-
-                    auto it = vecOutputs.find(std::make_pair(hashBytes,addressType));
-
-                    if( it == vecOutputs.end() ){
-                        // For the first occurrence of the address it
-                        vecOutputs.insert(std::make_pair(std::make_pair(hashBytes,addressType), out.nValue));
-                    }else{
-                        // For further ones add up the amount
-                        it->second += out.nValue;
-                    }
-
-                }
-
-                if( fAddressIndex ){
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k, pindex->nHeight), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                }
-
-            }
-
-            if( fDepositIndex ){
-
-                for( auto const &output : vecOutputs ){
-
-                    auto input = vecInputs.find(std::make_pair( output.first.first, output.first.second ));
-
-                    if( input == vecInputs.end() ){
-                        // If there is no input related to the address of this output just add it as deposit
-                        depositIndex.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, tx.GetHash() ),CDepositValue(output.second,pindex->nHeight)));
-                    }else{
-
-                        // If there is an input related to the address of this output evaluate if the outputs exceed the inputs
-                        CAmount nDeposit = output.second - input->second;
-
-                        if( nDeposit > 0 ){
-                            // If the outputs exceed the inputs add the deposit.
-                            depositIndex.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, tx.GetHash() ),CDepositValue(nDeposit,pindex->nHeight)));
-                        }
-                    }
-                }
-            }
         }
 
         /* WIP-VOTING uncomment
@@ -2715,29 +2565,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
-    if (!fIsVerifyDB && fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (!fIsVerifyDB && fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write spent index");
-
-    if (!fIsVerifyDB && fTimestampIndex)
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
+    if (!fIsVerifyDB && (fAddressIndex || fSpentIndex || fTimestampIndex || fDepositIndex)) {
+        CIndexUpdate indexUpdate;
+        GetIndexUpdate(block, blockundo, pindex, true, indexUpdate);
+        if (pvAddressIndex)
+            *pvAddressIndex = indexUpdate.vAddressIndex;
 
-    if (!fIsVerifyDB && fDepositIndex) {
-
-        if( !pblocktree->WriteDepositIndex(depositIndex) ){
-            return AbortNode(state, "Failed to write deposit index");
-        }
+        // Written by ThreadIndexWriter, so index I/O does not hold up the tip.
+        if (!pindexdb->Push(std::move(indexUpdate)))
+            return AbortNode(state, "Failed to write index update");
     }
 
     /* WIP-VOTING uncomment
@@ -2857,6 +2693,10 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // overwrite one. Still, use a conservative safety factor of 2.
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
+        // Let the indexes catch up first, so they are never behind the
+        // chainstate on disk.
+        if (pindexdb && !pindexdb->Flush())
+            return AbortNode(state, "Failed to write to index database");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
@@ -2961,9 +2801,10 @@ bool static DisconnectTip(CValidationState& state, const Consensus::Params& cons
         return AbortNode(state, "Failed to read block");
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
     {
         CCoinsViewCache view(pcoinsTip);
-        if (DisconnectBlock(block, state, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, state, pindexDelete, view, false, &vAddressIndex) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
@@ -2992,6 +2833,7 @@ bool static DisconnectTip(CValidationState& state, const Consensus::Params& cons
     mempool.UpdateTransactionsFromBlock(vHashUpdate);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    GetMainSignals().BlockDisconnected(block, pindexDelete, vAddressIndex);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     BOOST_FOREACH(const CTransaction &tx, block.vtx) {
@@ -3025,9 +2867,10 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, false);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, false, &vAddressIndex);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -3059,6 +2902,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
         GetMainSignals().SyncTransaction(tx, pblock);
     }
+    GetMainSignals().BlockConnected(*pblock, pindexNew, vAddressIndex);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
@@ -3435,17 +3279,15 @@ bool ReconsiderBlock(CValidationState &state, CBlockIndex *pindex) {
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Create(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3469,6 +3311,11 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     return pindexNew;
 }
 
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+{
+    return AddToBlockIndex(block, block.GetHash());
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos)
 {
@@ -3603,16 +3450,22 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+/** CheckBlockHeader for a header whose hash is already known */
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, bool fCheckPOW)
 {
     // Check proof of work matches claimed amount
     int nHeight = getNHeight(block);
-    if (fCheckPOW && !CheckProofOfWork(nHeight, block.GetHash(), block.nBits, Params().GetConsensus()))
+    if (fCheckPOW && !CheckProofOfWork(nHeight, hash, block.nBits, Params().GetConsensus()))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
 }
 
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+{
+    return CheckBlockHeader(block, fCheckPOW ? block.GetHash() : uint256(), state, fCheckPOW);
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool isVerifyDB)
 {
      // These are checks that are independent of context.
@@ -3891,11 +3744,10 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+static bool AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
 
@@ -3912,7 +3764,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, hash, state, true))
             return false;
 
         // Get prev block index
@@ -3932,7 +3784,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return false;
     }
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3947,10 +3799,14 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
+    // Hashing the headers is the expensive part of checking their proof of
+    // work, do it up front and in parallel before taking cs_main.
+    std::vector<uint256> vHashes;
+    HashBlockHeaders(headers, vHashes);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
-            if (!AcceptBlockHeader(header, state, chainparams, ppindex)) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!AcceptBlockHeader(headers[i], vHashes[i], state, chainparams, ppindex)) {
                 return false;
             }
         }
@@ -3968,7 +3824,7 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    if (!AcceptBlockHeader(block, block.GetHash(), state, chainparams, &pindex))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -4259,9 +4115,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Create();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4271,7 +4125,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, HashBlockHeaders))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4498,10 +4352,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 }
 
@@ -4573,6 +4425,76 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+bool CatchUpIndexes(const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+
+    if (!fAddressIndex && !fSpentIndex && !fTimestampIndex && !fDepositIndex)
+        return true;
+    if (chainActive.Tip() == NULL)
+        return true;
+
+    CBlockIndex* pindex = chainActive.Genesis();
+    uint256 hashIndexed;
+    if (pindexdb->ReadBestBlock(hashIndexed)) {
+        BlockMap::iterator mi = mapBlockIndex.find(hashIndexed);
+        if (mi == mapBlockIndex.end())
+            return error("%s: indexes are at unknown block %s", __func__, hashIndexed.ToString());
+        pindex = mi->second;
+    } else {
+        // Older versions kept the indexes in the block tree, synchronously
+        // updated up to the chainstate.
+        LogPrintf("Moving the indexes to their own database...\n");
+        size_t nMoved = pindexdb->MigrateFrom(*pblocktree);
+        LogPrintf("Moved %u index records\n", nMoved);
+        if (nMoved) {
+            pindex = chainActive.Tip();
+            pindexdb->WriteBestBlock(pindex->GetBlockHash());
+        }
+    }
+
+    if (pindex == chainActive.Tip())
+        return true;
+    LogPrintf("Catching up the indexes from block %s (height %d)\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
+
+    // Undo blocks the indexes saw that did not make it into the active chain...
+    while (!chainActive.Contains(pindex)) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        if (!UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        CIndexUpdate update;
+        GetIndexUpdate(block, blockundo, pindex, false, update);
+        if (!pindexdb->WriteIndexUpdate(update))
+            return false;
+        pindex = pindex->pprev;
+    }
+
+    // ...then add the ones connected since.
+    int nStart = pindex->nHeight;
+    while (pindex != chainActive.Tip()) {
+        if (ShutdownRequested())
+            return false;
+        pindex = chainActive.Next(pindex);
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        if (!UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        CIndexUpdate update;
+        GetIndexUpdate(block, blockundo, pindex, true, update);
+        if (!pindexdb->WriteIndexUpdate(update))
+            return false;
+        if ((pindex->nHeight - nStart) % 10000 == 0)
+            LogPrintf("Indexes caught up to height %d\n", pindex->nHeight);
+    }
+    LogPrintf("Indexes caught up with %d blocks\n", pindex->nHeight - nStart);
+    return pindexdb->Sync();
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4888,10 +4810,8 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
 
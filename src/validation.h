@@ -35,6 +35,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CIndexDB;
 class CBloomFilter;
 class CChainParams;
 class CCoinsViewDB;
@@ -92,6 +93,10 @@ static const int64_t DUST_HARD_LIMIT = 1000;   // 0.00001 SMART mininput
 static const int MAX_SCRIPTCHECK_THREADS = 15;  // was 16
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of header-hashing threads allowed */
+static const int MAX_HEADERHASH_THREADS = 8;
+/** -parheaders default (number of threads helping to hash received headers) */
+static const int DEFAULT_HEADERHASH_THREADS = 2;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;  //was 16
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -190,7 +195,9 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nHeaderHashThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
 extern bool fInstantPayIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
@@ -295,6 +302,14 @@ bool LoadBlockIndex();
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header hashing thread */
+void ThreadHeaderHash();
+/** Run the thread writing queued index updates */
+void ThreadIndexWriter();
+/** Bring the index database up to the active chain after startup */
+bool CatchUpIndexes(const CChainParams& chainparams);
+/** Compute the hashes of a batch of block headers, spread over the -par verification threads */
+void HashBlockHeaders(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -507,6 +522,31 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure computing the hashes of a range of block headers
+ * Note that this stores pointers into the caller's header and hash vectors
+ */
+class CBlockHeaderHashCheck
+{
+private:
+    const CBlockHeader *pbegin;
+    const CBlockHeader *pend;
+    uint256 *phashes;
+
+public:
+    CBlockHeaderHashCheck(): pbegin(NULL), pend(NULL), phashes(NULL) {}
+    CBlockHeaderHashCheck(const CBlockHeader* pbeginIn, const CBlockHeader* pendIn, uint256* phashesIn) :
+        pbegin(pbeginIn), pend(pendIn), phashes(phashesIn) { }
+
+    bool operator()();
+
+    void swap(CBlockHeaderHashCheck &check) {
+        std::swap(pbegin, check.pbegin);
+        std::swap(pend, check.pend);
+        std::swap(phashes, check.phashes);
+    }
+};
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
@@ -609,6 +649,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the address/spent/deposit index database */
+extern CIndexDB *pindexdb;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
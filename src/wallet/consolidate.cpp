@@ -0,0 +1,235 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/consolidate.h"
+
+#include "coincontrol.h"
+#include "init.h"
+#include "net.h"
+#include "policy/policy.h"
+#include "protocol.h"
+#include "scheduler.h"
+#include "script/sign.h"
+#include "util.h"
+#include "utilmoneystr.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+CWalletConsolidator walletConsolidator;
+
+static bool CompareDepthDescending(const COutput& a, const COutput& b)
+{
+    return a.nDepth > b.nDepth;
+}
+
+void SelectConsolidationCandidates(const std::vector<COutput>& vCoins, const CConsolidationParams& params, CAmount nInputFee, std::vector<COutput>& vCandidates)
+{
+    vCandidates.clear();
+    BOOST_FOREACH(const COutput& out, vCoins) {
+        const CTxOut& txout = out.tx->vout[out.i];
+        if (!out.fSpendable || out.nDepth < params.nMinDepth)
+            continue;
+        if (txout.nValue <= nInputFee || (params.nMaxValue > 0 && txout.nValue > params.nMaxValue))
+            continue;
+        if (!params.setFromAddresses.empty()) {
+            CTxDestination dest;
+            if (!ExtractDestination(txout.scriptPubKey, dest) || !params.setFromAddresses.count(dest))
+                continue;
+        }
+        vCandidates.push_back(out);
+    }
+    std::stable_sort(vCandidates.begin(), vCandidates.end(), CompareDepthDescending);
+}
+
+size_t PlanConsolidationStep(const CKeyStore& keystore, const std::vector<COutput>& vCandidates, const CScript& scriptDestination, int nMaxInputs, CCoinControl& coinControl, CAmount& nTotal)
+{
+    // Multisig inputs are much larger than CONSOLIDATE_INPUT_SIZE, so
+    // every input is sized with a dummy signature before it is added.
+    CMutableTransaction txDummy;
+    txDummy.vout.push_back(CTxOut(0, scriptDestination));
+    // the input count may need up to two more bytes for its compact size
+    size_t nBytes = ::GetSerializeSize(txDummy, SER_NETWORK, PROTOCOL_VERSION) + 2;
+
+    nTotal = 0;
+    size_t nInputs = 0;
+    for (size_t i = 0; i < vCandidates.size() && nInputs < (size_t)nMaxInputs; i++) {
+        const CTxOut& txout = vCandidates[i].tx->vout[vCandidates[i].i];
+        CTxIn txin(vCandidates[i].tx->GetHash(), vCandidates[i].i);
+        if (!ProduceSignature(DummySignatureCreator(&keystore), txout.scriptPubKey, txin.scriptSig))
+            continue;
+        size_t nInputBytes = ::GetSerializeSize(txin, SER_NETWORK, PROTOCOL_VERSION);
+        if ((nBytes + nInputBytes) * WITNESS_SCALE_FACTOR >= MAX_STANDARD_TX_WEIGHT)
+            break;
+        nBytes += nInputBytes;
+        coinControl.Select(txin.prevout);
+        nTotal += txout.nValue;
+        nInputs++;
+    }
+    return nInputs;
+}
+
+CWalletConsolidator::CWalletConsolidator() :
+    scheduler(NULL),
+    pwallet(NULL),
+    fStopRequested(false)
+{
+}
+
+void CWalletConsolidator::SetScheduler(CScheduler& schedulerIn)
+{
+    LOCK(cs);
+    scheduler = &schedulerIn;
+}
+
+bool CWalletConsolidator::Start(CWallet* pwalletIn, const CConsolidationParams& paramsIn, std::string& strError)
+{
+    LOCK(cs);
+    if (!scheduler) {
+        strError = "The node is not ready to consolidate yet";
+        return false;
+    }
+    if (status.fRunning) {
+        strError = "A consolidation is already running";
+        return false;
+    }
+
+    pwallet = pwalletIn;
+    params = paramsIn;
+    params.nMaxInputs = std::max(2, std::min(params.nMaxInputs, MAX_CONSOLIDATE_INPUTS));
+    status = CConsolidationStatus();
+    status.fRunning = true;
+    status.nStartTime = GetTime();
+    fStopRequested = false;
+
+    LogPrintf("CWalletConsolidator::%s -- consolidating to %s, up to %d inputs per transaction\n",
+              __func__, CBitcoinAddress(params.destination).ToString(), params.nMaxInputs);
+    ScheduleStep(0);
+    return true;
+}
+
+void CWalletConsolidator::Stop()
+{
+    fStopRequested = true;
+}
+
+CConsolidationStatus CWalletConsolidator::GetStatus() const
+{
+    LOCK(cs);
+    return status;
+}
+
+void CWalletConsolidator::ScheduleStep(int64_t nDelay)
+{
+    AssertLockHeld(cs);
+    scheduler->scheduleFromNow(boost::bind(&CWalletConsolidator::Step, this), nDelay);
+}
+
+void CWalletConsolidator::Finish(const std::string& strError)
+{
+    LOCK(cs);
+    status.fRunning = false;
+    status.nEndTime = GetTime();
+    status.strError = strError;
+    LogPrintf("CWalletConsolidator::%s -- %s after %d transactions spending %d inputs, %s consolidated%s\n",
+              __func__, strError.empty() ? "finished" : "failed", status.nTransactions, status.nInputs,
+              FormatMoney(status.nAmount), strError.empty() ? "" : ": " + strError);
+}
+
+void CWalletConsolidator::Step()
+{
+    if (ShutdownRequested())
+        return;
+    if (fStopRequested) {
+        Finish("");
+        return;
+    }
+
+    CConsolidationParams paramsStep;
+    {
+        LOCK(cs);
+        paramsStep = params;
+    }
+
+    std::string strError;
+    size_t nRemaining = 0;
+    size_t nSpent = 0;
+    CAmount nAmount = 0;
+    CAmount nFee = 0;
+    uint256 txid;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+
+        // Outputs which don't even pay for being spent are left alone
+        CAmount nInputFee = CWallet::GetMinimumFee(CONSOLIDATE_INPUT_SIZE, nTxConfirmTarget, mempool);
+
+        std::vector<COutput> vCoins;
+        std::vector<COutput> vCandidates;
+        pwallet->AvailableCoins(vCoins, true, NULL, false, ALL_COINS);
+        SelectConsolidationCandidates(vCoins, paramsStep, nInputFee, vCandidates);
+
+        nRemaining = vCandidates.size();
+        if (nRemaining >= 2) {
+            CScript scriptDestination = GetScriptForDestination(paramsStep.destination);
+            CCoinControl coinControl;
+            CAmount nTotal = 0;
+            size_t nInputs = PlanConsolidationStep(*pwallet, vCandidates, scriptDestination, paramsStep.nMaxInputs, coinControl, nTotal);
+
+            if (nInputs >= 2) {
+                std::vector<CRecipient> vecSend;
+                CRecipient recipient = {scriptDestination, nTotal, true};
+                vecSend.push_back(recipient);
+
+                CWalletTx wtx;
+                CReserveKey reservekey(pwallet);
+                int nChangePosRet = -1;
+                if (pwallet->CreateTransaction(vecSend, wtx, reservekey, nFee, nChangePosRet, strError, &coinControl)) {
+                    if (!pwallet->CommitTransaction(wtx, reservekey, g_connman.get(), NetMsgType::TX)) {
+                        strError = "Transaction commit failed";
+                    } else {
+                        txid = wtx.GetHash();
+                        nSpent = nInputs;
+                        nAmount = nTotal - nFee;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!strError.empty()) {
+        Finish(strError);
+        return;
+    }
+    if (nSpent == 0) {
+        // Nothing left to merge
+        {
+            LOCK(cs);
+            status.nRemaining = nRemaining;
+        }
+        Finish("");
+        return;
+    }
+
+    LogPrint("wallet", "CWalletConsolidator::%s -- %s spends %d inputs, %d left\n", __func__, txid.ToString(), nSpent, nRemaining - nSpent);
+
+    bool fDone;
+    {
+        LOCK(cs);
+        status.nTransactions++;
+        status.nInputs += nSpent;
+        status.nRemaining = nRemaining - nSpent;
+        status.nAmount += nAmount;
+        status.nFees += nFee;
+        status.vTxids.push_back(txid);
+
+        fDone = paramsStep.nMaxTransactions > 0 && status.nTransactions >= paramsStep.nMaxTransactions;
+        if (!fDone)
+            ScheduleStep(CONSOLIDATE_STEP_DELAY);
+    }
+    if (fDone)
+        Finish("");
+}
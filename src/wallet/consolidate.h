@@ -0,0 +1,124 @@
+// Copyright (c) 2017 - 2020 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_WALLET_CONSOLIDATE_H
+#define SMARTCASH_WALLET_CONSOLIDATE_H
+
+#include "amount.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+class CCoinControl;
+class CKeyStore;
+class COutput;
+class CScheduler;
+class CWallet;
+
+//! Size of a signed P2PKH input, outputs worth less than the fee for spending it are not consolidated
+static const unsigned int CONSOLIDATE_INPUT_SIZE = 149;
+//! Most inputs a consolidation transaction may spend, keeps it below the standard transaction size
+static const int MAX_CONSOLIDATE_INPUTS = 500;
+//! Seconds between two consolidation transactions, gives the wallet and the mempool time to process the last one
+static const int64_t CONSOLIDATE_STEP_DELAY = 5;
+//! Default minimum number of confirmations of the outputs to consolidate
+static const int DEFAULT_CONSOLIDATE_MINCONF = 1;
+
+/** What to consolidate and where to */
+struct CConsolidationParams
+{
+    //! Receives the consolidated amounts
+    CTxDestination destination;
+    //! Only consolidate outputs paying to these addresses, any address if empty
+    std::set<CTxDestination> setFromAddresses;
+    //! Only consolidate outputs with at least this many confirmations
+    int nMinDepth;
+    //! Only consolidate outputs worth at most this much, 0 for no limit
+    CAmount nMaxValue;
+    //! Inputs per consolidation transaction
+    int nMaxInputs;
+    //! Stop after this many transactions, 0 for no limit
+    int nMaxTransactions;
+
+    CConsolidationParams() : nMinDepth(DEFAULT_CONSOLIDATE_MINCONF), nMaxValue(0), nMaxInputs(MAX_CONSOLIDATE_INPUTS), nMaxTransactions(0) {}
+};
+
+/** Progress of the current or last consolidation */
+struct CConsolidationStatus
+{
+    bool fRunning;
+    int64_t nStartTime;
+    int64_t nEndTime;
+    int nTransactions;
+    int nInputs;
+    //! Inputs which are still left to consolidate as of the last step
+    int nRemaining;
+    CAmount nAmount;
+    CAmount nFees;
+    std::vector<uint256> vTxids;
+    std::string strError;
+
+    CConsolidationStatus() : fRunning(false), nStartTime(0), nEndTime(0), nTransactions(0), nInputs(0), nRemaining(0), nAmount(0), nFees(0) {}
+};
+
+/**
+ * Fill vCandidates with the outputs of vCoins a consolidation may spend:
+ * spendable, confirmed and worth enough per params, and more than
+ * nInputFee. The most confirmed ones come first.
+ */
+void SelectConsolidationCandidates(const std::vector<COutput>& vCoins, const CConsolidationParams& params, CAmount nInputFee, std::vector<COutput>& vCandidates);
+
+/**
+ * Select the inputs of one consolidation transaction into coinControl,
+ * taking vCandidates in order. Stops at nMaxInputs, or before the
+ * transaction would no longer be standard. The size is estimated with
+ * dummy signatures. Candidates keystore can't sign are skipped.
+ * Returns the number of inputs selected; nTotal is set to their value.
+ */
+size_t PlanConsolidationStep(const CKeyStore& keystore, const std::vector<COutput>& vCandidates, const CScript& scriptDestination, int nMaxInputs, CCoinControl& coinControl, CAmount& nTotal);
+
+/**
+ * Merges many small wallet outputs into few large ones in the background.
+ * Every step of the scheduler builds and commits one transaction which
+ * spends as many of the matching outputs as fit into a standard
+ * transaction, until fewer than two of them are left. The steps are
+ * CONSOLIDATE_STEP_DELAY seconds apart.
+ */
+class CWalletConsolidator
+{
+private:
+    mutable CCriticalSection cs;
+    CScheduler* scheduler;
+    CWallet* pwallet;
+    CConsolidationParams params;
+    CConsolidationStatus status;
+    std::atomic<bool> fStopRequested;
+
+    void ScheduleStep(int64_t nDelay);
+    void Step();
+    void Finish(const std::string& strError);
+
+public:
+    CWalletConsolidator();
+
+    /** Called once at startup */
+    void SetScheduler(CScheduler& schedulerIn);
+
+    /** Start consolidating the outputs of a wallet, returns false if that is not possible right now */
+    bool Start(CWallet* pwalletIn, const CConsolidationParams& paramsIn, std::string& strError);
+    /** Stop after the transaction which is being built */
+    void Stop();
+
+    CConsolidationStatus GetStatus() const;
+};
+
+extern CWalletConsolidator walletConsolidator;
+
+#endif // SMARTCASH_WALLET_CONSOLIDATE_H
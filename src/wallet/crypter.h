@@ -179,7 +179,7 @@ public:
         return result;
     }
 
-    bool Lock();
+    virtual bool Lock();
 
     bool IsVotingCrypted() const
     {
@@ -19,6 +19,7 @@
 #include "utilmoneystr.h"
 #include "wallet.h"
 #include "walletdb.h"
+#include "wallet/consolidate.h"
 
 #include <stdint.h>
 
@@ -2199,7 +2200,8 @@ UniValue keypoolrefill(const UniValue& params, bool fHelp)
 
 static void LockWallet(CWallet* pWallet)
 {
-    LOCK(cs_nWalletUnlockTime);
+    // Same lock order as walletpassphrase and walletlock
+    LOCK2(pWallet->cs_wallet, cs_nWalletUnlockTime);
     nWalletUnlockTime = 0;
     pWallet->Lock();
 }
@@ -2789,6 +2791,156 @@ UniValue listunspent(const UniValue& params, bool fHelp)
     return results;
 }
 
+static UniValue ConsolidationStatusToJSON(const CConsolidationStatus& status)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("running", status.fRunning));
+    obj.push_back(Pair("starttime", status.nStartTime));
+    if (!status.fRunning && status.nEndTime)
+        obj.push_back(Pair("endtime", status.nEndTime));
+    obj.push_back(Pair("transactions", status.nTransactions));
+    obj.push_back(Pair("inputs", status.nInputs));
+    obj.push_back(Pair("remaining", status.nRemaining));
+    obj.push_back(Pair("amount", ValueFromAmount(status.nAmount)));
+    obj.push_back(Pair("fees", ValueFromAmount(status.nFees)));
+    UniValue txids(UniValue::VARR);
+    BOOST_FOREACH(const uint256& txid, status.vTxids)
+        txids.push_back(txid.GetHex());
+    obj.push_back(Pair("txids", txids));
+    if (!status.strError.empty())
+        obj.push_back(Pair("error", status.strError));
+    return obj;
+}
+
+UniValue consolidateutxos(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    std::string strCommand;
+    if (params.size() >= 1)
+        strCommand = params[0].get_str();
+
+    if (fHelp || (strCommand != "start" && strCommand != "stop" && strCommand != "status") ||
+        (strCommand == "start" && (params.size() < 2 || params.size() > 3)) ||
+        (strCommand != "start" && params.size() != 1))
+        throw runtime_error(
+            "consolidateutxos \"command\" ( \"address\" options )\n"
+            "\nMerges many small unspent outputs of the wallet into few large ones in the background.\n"
+            "Each transaction spends as many of the selected outputs as fit into a standard transaction,\n"
+            "the fee is deducted from the consolidated amount. Outputs worth less than the fee of\n"
+            "spending them are left alone."
+            + HelpRequiringPassphrase() + "\n"
+            "\nArguments:\n"
+            "1. \"command\"              (string, required) \"start\" to start consolidating, \"stop\" to stop\n"
+            "                                           after the current transaction, \"status\" to show the progress\n"
+            "2. \"address\"              (string, required for start) The SmartCash address to send the outputs to\n"
+            "3. options                (object, optional)\n"
+            "   {\n"
+            "     \"fromaddresses\"      (array, optional) Only consolidate outputs paying to these SmartCash addresses\n"
+            "     \"minconf\"            (numeric, optional, default=" + strprintf("%d", DEFAULT_CONSOLIDATE_MINCONF) + ") Only consolidate outputs with at least this many confirmations\n"
+            "     \"maxamount\"          (numeric, optional) Only consolidate outputs worth at most this much " + CURRENCY_UNIT + "\n"
+            "     \"maxinputs\"          (numeric, optional, default=" + strprintf("%d", MAX_CONSOLIDATE_INPUTS) + ") Inputs per transaction, at most " + strprintf("%d", MAX_CONSOLIDATE_INPUTS) + "\n"
+            "     \"maxtransactions\"    (numeric, optional) Stop after this many transactions\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"running\" : true|false,      (boolean) Whether the consolidation is still running\n"
+            "  \"starttime\" : ttt,           (numeric) The time the consolidation started in seconds since epoch\n"
+            "  \"endtime\" : ttt,             (numeric) The time the consolidation ended in seconds since epoch\n"
+            "  \"transactions\" : n,          (numeric) The number of transactions sent\n"
+            "  \"inputs\" : n,                (numeric) The number of outputs consolidated\n"
+            "  \"remaining\" : n,             (numeric) The number of matching outputs left to consolidate\n"
+            "  \"amount\" : x.xxx,            (numeric) The consolidated amount in " + CURRENCY_UNIT + " after fees\n"
+            "  \"fees\" : x.xxx,              (numeric) The fees paid in " + CURRENCY_UNIT + "\n"
+            "  \"txids\" : [\"txid\",...],      (array) The ids of the transactions sent\n"
+            "  \"error\" : \"message\"          (string) Why the consolidation stopped early, if it did\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("consolidateutxos", "start \"SXun9XDHLdBhG4Yd1ueZfLfRpC9kZgwT1b\"")
+            + HelpExampleCli("consolidateutxos", "start \"SXun9XDHLdBhG4Yd1ueZfLfRpC9kZgwT1b\" \"{\\\"minconf\\\":100,\\\"maxamount\\\":1}\"")
+            + HelpExampleCli("consolidateutxos", "status")
+            + HelpExampleRpc("consolidateutxos", "\"start\", \"SXun9XDHLdBhG4Yd1ueZfLfRpC9kZgwT1b\"")
+        );
+
+    if (strCommand == "status")
+        return ConsolidationStatusToJSON(walletConsolidator.GetStatus());
+
+    if (strCommand == "stop") {
+        walletConsolidator.Stop();
+        return ConsolidationStatusToJSON(walletConsolidator.GetStatus());
+    }
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VSTR)(UniValue::VSTR)(UniValue::VOBJ));
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    if (pwalletMain->GetBroadcastTransactions() && !g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    CConsolidationParams consolidation;
+    CBitcoinAddress address(params[1].get_str());
+    if (!address.IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid SmartCash address");
+    consolidation.destination = address.Get();
+
+    if (params.size() > 2) {
+        UniValue options = params[2];
+
+        RPCTypeCheckObj(options,
+            {
+                {"fromaddresses", UniValueType(UniValue::VARR)},
+                {"minconf", UniValueType(UniValue::VNUM)},
+                {"maxamount", UniValueType()}, // will be checked below
+                {"maxinputs", UniValueType(UniValue::VNUM)},
+                {"maxtransactions", UniValueType(UniValue::VNUM)},
+            },
+            true, true);
+
+        if (options.exists("fromaddresses")) {
+            UniValue addresses = options["fromaddresses"].get_array();
+            for (unsigned int idx = 0; idx < addresses.size(); idx++) {
+                CBitcoinAddress from(addresses[idx].get_str());
+                if (!from.IsValid())
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid SmartCash address: ")+addresses[idx].get_str());
+                consolidation.setFromAddresses.insert(from.Get());
+            }
+        }
+
+        if (options.exists("minconf")) {
+            consolidation.nMinDepth = options["minconf"].get_int();
+            if (consolidation.nMinDepth < 1)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "minconf must be at least 1");
+        }
+
+        if (options.exists("maxamount")) {
+            consolidation.nMaxValue = AmountFromValue(options["maxamount"]);
+            if (consolidation.nMaxValue <= 0)
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid maxamount");
+        }
+
+        if (options.exists("maxinputs")) {
+            consolidation.nMaxInputs = options["maxinputs"].get_int();
+            if (consolidation.nMaxInputs < 2 || consolidation.nMaxInputs > MAX_CONSOLIDATE_INPUTS)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("maxinputs must be between 2 and %d", MAX_CONSOLIDATE_INPUTS));
+        }
+
+        if (options.exists("maxtransactions")) {
+            consolidation.nMaxTransactions = options["maxtransactions"].get_int();
+            if (consolidation.nMaxTransactions < 0)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid maxtransactions");
+        }
+    }
+
+    EnsureWalletIsUnlocked();
+
+    std::string strError;
+    if (!walletConsolidator.Start(pwalletMain, consolidation, strError))
+        throw JSONRPCError(RPC_WALLET_ERROR, strError);
+
+    return ConsolidationStatusToJSON(walletConsolidator.GetStatus());
+}
+
 UniValue fundrawtransaction(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -2934,6 +3086,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true  },
     { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true  },
     { "wallet",             "backupwallet",             &backupwallet,             true  },
+    { "wallet",             "consolidateutxos",         &consolidateutxos,         false },
     { "wallet",             "dumpprivkey",              &dumpprivkey,              true  },
     { "wallet",             "dumpwallet",               &dumpwallet,               true  },
     { "wallet",             "encryptwallet",            &encryptwallet,            true  },
@@ -3,6 +3,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "wallet/wallet.h"
+#include "wallet/consolidate.h"
+
+#include "coincontrol.h"
+#include "keystore.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "scheduler.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "smartnode/spork.h"
+#include "validation.h"
+#include "validationinterface.h"
 
 #include <set>
 #include <stdint.h>
@@ -48,7 +60,7 @@ static void add_coin(const CAmount& nValue, int nAge = 6*24, bool fIsFromMe = fa
         wtx->fDebitCached = true;
         wtx->nDebitCached = 1;
     }
-    COutput output(wtx, nInput, nAge, true, true);
+    COutput output(wtx, nInput, nAge, true, true, 0);
     vCoins.push_back(output);
 }
 
@@ -351,4 +363,452 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    bool fChangeless;
+    CAmount nCostOfChange = CWallet::GetCostOfChange();
+    BOOST_REQUIRE(nCostOfChange >= 4);
+
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < RUN_TESTS; i++)
+    {
+        // an exact match needs no change
+        empty_wallet();
+        add_coin( 1 * CENT);
+        add_coin( 2 * CENT);
+        add_coin( 5 * CENT);
+        add_coin(10 * CENT);
+        BOOST_CHECK( wallet.SelectCoinsMinConf( 7 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+        BOOST_CHECK(fChangeless);
+        BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+        // so does an excess up to the cost of change
+        BOOST_CHECK( wallet.SelectCoinsMinConf( 8 * CENT - nCostOfChange, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+        BOOST_CHECK(fChangeless);
+        BOOST_CHECK_EQUAL(nValueRet, 8 * CENT);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+        // one more and the knapsack solver has to make change
+        BOOST_CHECK( wallet.SelectCoinsMinConf( 8 * CENT - nCostOfChange - 1, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+        BOOST_CHECK(!fChangeless);
+        BOOST_CHECK(nValueRet >= 8 * CENT - nCostOfChange - 1);
+
+        // no subset lies within the cost of change
+        empty_wallet();
+        add_coin(2 * CENT);
+        add_coin(2 * CENT);
+        add_coin(2 * CENT);
+        BOOST_CHECK( wallet.SelectCoinsMinConf( 3 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+        BOOST_CHECK(!fChangeless);
+        BOOST_CHECK_EQUAL(nValueRet, 4 * CENT);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    }
+    empty_wallet();
+}
+
+BOOST_AUTO_TEST_CASE(coin_selection_bnb_duplicates)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    bool fChangeless;
+
+    LOCK(wallet.cs_wallet);
+
+    // many coins of one value, the search must not try every permutation of them
+    empty_wallet();
+    for (int i = 0; i < 100; i++)
+        add_coin(1 * CENT);
+    BOOST_CHECK( wallet.SelectCoinsMinConf(50 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, 50 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 50U);
+
+    // an odd target can't be hit with even coins, so the search exhausts
+    // and the knapsack solver picks the next multiple
+    empty_wallet();
+    for (int i = 0; i < 40; i++)
+        add_coin(2 * CENT);
+    BOOST_CHECK( wallet.SelectCoinsMinConf(51 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+    BOOST_CHECK(!fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, 52 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 26U);
+    empty_wallet();
+}
+
+BOOST_AUTO_TEST_CASE(coin_selection_bnb_instantsend)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    bool fChangeless;
+    CAmount nMaxValue = sporkManager.GetSporkValue(SPORK_5_INSTANTSEND_MAX_VALUE) * COIN;
+    CAmount nDelta = CWallet::GetCostOfChange() / 4;
+    BOOST_REQUIRE(nDelta > 0);
+
+    LOCK(wallet.cs_wallet);
+
+    // the only changeless selection is above the InstantSend limit
+    empty_wallet();
+    add_coin(nMaxValue + nDelta);
+    BOOST_CHECK( wallet.SelectCoinsMinConf(nMaxValue - nDelta, 1, 6, 0, vCoins, setCoinsRet, nValueRet, false, &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, nMaxValue + nDelta);
+    BOOST_CHECK( wallet.SelectCoinsMinConf(nMaxValue - nDelta, 1, 6, 0, vCoins, setCoinsRet, nValueRet, true, &fChangeless));
+    BOOST_CHECK(!fChangeless);
+
+    // one below the limit is taken instead
+    add_coin(nMaxValue / 2);
+    add_coin(nMaxValue - nMaxValue / 2 - nDelta);
+    BOOST_CHECK( wallet.SelectCoinsMinConf(nMaxValue - nDelta, 1, 6, 0, vCoins, setCoinsRet, nValueRet, true, &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, nMaxValue - nDelta);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    empty_wallet();
+}
+
+static CMutableTransaction CreateSpend(const COutPoint& prevout, const CAmount& nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+static size_t CountAvailableCoins()
+{
+    vector<COutput> vAvailable;
+    pwalletMain->AvailableCoins(vAvailable, false);
+    return vAvailable.size();
+}
+
+BOOST_AUTO_TEST_CASE(coin_index)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+
+    // two coins of ours, unconfirmed but in the mempool
+    CMutableTransaction fund = CreateSpend(COutPoint(GetRandHash(), 0), 1 * COIN);
+    fund.vout.resize(2);
+    fund.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    fund.vout[1].nValue = 2 * COIN;
+    fund.vout[1].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    TestMemPoolEntryHelper entry;
+    mempool.addUnchecked(fund.GetHash(), entry.FromTx(fund));
+    pwalletMain->SyncTransaction(fund, NULL);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 2U);
+
+    // spending one removes it, abandoning the spend brings it back
+    CMutableTransaction spend = CreateSpend(COutPoint(fund.GetHash(), 0), 1 * COIN);
+    pwalletMain->SyncTransaction(spend, NULL);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 1U);
+    BOOST_CHECK(pwalletMain->AbandonTransaction(spend.GetHash()));
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 2U);
+
+    // a spend conflicted by a block in the active chain doesn't spend
+    CBlock block;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = chainActive.Tip()->nTime + 1;
+    CBlockIndex index(block);
+    index.pprev = chainActive.Tip();
+    index.nHeight = chainActive.Height() + 1;
+    index.phashBlock = &mapBlockIndex.insert(make_pair(block.GetHash(), &index)).first->first;
+    chainActive.SetTip(&index);
+
+    CMutableTransaction spend2 = CreateSpend(COutPoint(fund.GetHash(), 1), 2 * COIN);
+    pwalletMain->SyncTransaction(spend2, NULL);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 1U);
+    pwalletMain->SyncTransaction(spend2, &block);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 2U);
+
+    // until that block is reorganized away
+    chainActive.SetTip(index.pprev);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 1U);
+
+    // and connected again
+    chainActive.SetTip(&index);
+    pwalletMain->SyncTransaction(spend2, &block);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(), 2U);
+
+    chainActive.SetTip(index.pprev);
+    mapBlockIndex.erase(block.GetHash());
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(balance_cache_import)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    CKey key, keyImported;
+    key.MakeNewKey(true);
+    keyImported.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 0);
+
+    // one output of ours, one to a key imported later
+    CMutableTransaction fund = CreateSpend(COutPoint(GetRandHash(), 0), 1 * COIN);
+    fund.vout.resize(2);
+    fund.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    fund.vout[1].nValue = 2 * COIN;
+    fund.vout[1].scriptPubKey = GetScriptForDestination(keyImported.GetPubKey().GetID());
+    TestMemPoolEntryHelper entry;
+    mempool.addUnchecked(fund.GetHash(), entry.FromTx(fund));
+    pwalletMain->SyncTransaction(fund, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 1 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedWatchOnlyBalance(), 0);
+
+    // importing as watch-only, then the key itself, as the import RPCs do
+    BOOST_CHECK(pwalletMain->AddWatchOnly(fund.vout[1].scriptPubKey));
+    pwalletMain->MarkDirty();
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 1 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedWatchOnlyBalance(), 2 * COIN);
+
+    BOOST_CHECK(pwalletMain->RemoveWatchOnly(fund.vout[1].scriptPubKey));
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(keyImported, keyImported.GetPubKey()));
+    pwalletMain->MarkDirty();
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 3 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedWatchOnlyBalance(), 0);
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(balance_cache_erase)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+
+    CMutableTransaction fund = CreateSpend(COutPoint(GetRandHash(), 0), 1 * COIN);
+    fund.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    TestMemPoolEntryHelper entry;
+    mempool.addUnchecked(fund.GetHash(), entry.FromTx(fund));
+    pwalletMain->SyncTransaction(fund, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 1 * COIN);
+
+    // erasing the spend makes the output it spent available again
+    CMutableTransaction spend = CreateSpend(COutPoint(fund.GetHash(), 0), 1 * COIN);
+    pwalletMain->SyncTransaction(spend, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 0);
+    BOOST_CHECK(pwalletMain->EraseFromWallet(spend.GetHash()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 1 * COIN);
+
+    // erasing the funding transaction removes its contribution
+    BOOST_CHECK(pwalletMain->EraseFromWallet(fund.GetHash()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 0);
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(balance_cache_reorg)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), 0);
+
+    CMutableTransaction fund = CreateSpend(COutPoint(GetRandHash(), 0), 1 * COIN);
+    fund.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CBlock block;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = chainActive.Tip()->nTime + 1;
+    block.vtx.push_back(CTransaction(fund));
+    CBlockIndex index(block);
+    index.pprev = chainActive.Tip();
+    index.nHeight = chainActive.Height() + 1;
+    index.phashBlock = &mapBlockIndex.insert(make_pair(block.GetHash(), &index)).first->first;
+
+    // confirmed in the new tip
+    chainActive.SetTip(&index);
+    pwalletMain->SyncTransaction(fund, &block);
+    GetMainSignals().UpdatedBlockTip(&index, index.pprev, false);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), 1 * COIN);
+
+    // gone once the block is reorganized away
+    chainActive.SetTip(index.pprev);
+    GetMainSignals().UpdatedBlockTip(index.pprev, index.pprev, false);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), 0);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 0);
+
+    // and back when it is connected again
+    chainActive.SetTip(&index);
+    GetMainSignals().UpdatedBlockTip(&index, index.pprev, false);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), 1 * COIN);
+
+    chainActive.SetTip(index.pprev);
+    mapBlockIndex.erase(block.GetHash());
+}
+
+/** A wallet transaction paying nValue to each of the scripts */
+static CWalletTx* CreateConsolidationTx(const std::vector<CScript>& vScripts, const CAmount& nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    BOOST_FOREACH(const CScript& script, vScripts)
+        tx.vout.push_back(CTxOut(nValue, script));
+    return new CWalletTx(&wallet, tx);
+}
+
+BOOST_AUTO_TEST_CASE(consolidate_candidates)
+{
+    CKey keyA, keyB;
+    keyA.MakeNewKey(true);
+    keyB.MakeNewKey(true);
+    CScript scriptA = GetScriptForDestination(keyA.GetPubKey().GetID());
+    CScript scriptB = GetScriptForDestination(keyB.GetPubKey().GetID());
+
+    std::vector<CScript> vScripts(6, scriptA);
+    vScripts[1] = scriptB;
+    CWalletTx* wtx = CreateConsolidationTx(vScripts, 1 * COIN);
+    wtx->vout[2].nValue = 1000;
+    wtx->vout[3].nValue = 100 * COIN;
+
+    std::vector<COutput> vCoins;
+    vCoins.push_back(COutput(wtx, 0, 5, true, true, 0));
+    vCoins.push_back(COutput(wtx, 1, 20, true, true, 0));
+    vCoins.push_back(COutput(wtx, 2, 20, true, true, 0));   // doesn't pay for its input
+    vCoins.push_back(COutput(wtx, 3, 20, true, true, 0));   // above the maximum value
+    vCoins.push_back(COutput(wtx, 4, 20, false, true, 0));  // not spendable
+    vCoins.push_back(COutput(wtx, 5, 0, true, true, 0));    // unconfirmed
+
+    CConsolidationParams params;
+    params.nMaxValue = 10 * COIN;
+    std::vector<COutput> vCandidates;
+    SelectConsolidationCandidates(vCoins, params, 1000, vCandidates);
+
+    // the most confirmed output first
+    BOOST_REQUIRE_EQUAL(vCandidates.size(), 2U);
+    BOOST_CHECK_EQUAL(vCandidates[0].i, 1);
+    BOOST_CHECK_EQUAL(vCandidates[1].i, 0);
+
+    params.setFromAddresses.insert(keyA.GetPubKey().GetID());
+    SelectConsolidationCandidates(vCoins, params, 1000, vCandidates);
+    BOOST_REQUIRE_EQUAL(vCandidates.size(), 1U);
+    BOOST_CHECK_EQUAL(vCandidates[0].i, 0);
+
+    delete wtx;
+}
+
+BOOST_AUTO_TEST_CASE(consolidate_input_sizing)
+{
+    CBasicKeyStore keystore;
+    CKey key, keyUncompressed, keyOther;
+    key.MakeNewKey(true);
+    keyUncompressed.MakeNewKey(false);
+    keyOther.MakeNewKey(true);
+    BOOST_CHECK(keystore.AddKey(key));
+    BOOST_CHECK(keystore.AddKey(keyUncompressed));
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptDestination = script;
+
+    // Up to the maximum number of inputs, skipping those which can't be signed
+    std::vector<CScript> vScripts(150, script);
+    vScripts[0] = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    CWalletTx* wtx = CreateConsolidationTx(vScripts, 1 * COIN);
+    std::vector<COutput> vCandidates;
+    for (unsigned int i = 0; i < wtx->vout.size(); i++)
+        vCandidates.push_back(COutput(wtx, i, 10, true, true, 0));
+
+    CCoinControl coinControl;
+    CAmount nTotal = 0;
+    BOOST_CHECK_EQUAL(PlanConsolidationStep(keystore, vCandidates, scriptDestination, 100, coinControl, nTotal), 100U);
+    BOOST_CHECK_EQUAL(nTotal, 100 * COIN);
+    BOOST_CHECK(!coinControl.IsSelected(COutPoint(wtx->GetHash(), 0)));
+    BOOST_CHECK(coinControl.IsSelected(COutPoint(wtx->GetHash(), 100)));
+    BOOST_CHECK(!coinControl.IsSelected(COutPoint(wtx->GetHash(), 101)));
+    delete wtx;
+
+    // Larger inputs stop the transaction before it gets too large to be standard
+    wtx = CreateConsolidationTx(std::vector<CScript>(MAX_CONSOLIDATE_INPUTS, GetScriptForDestination(keyUncompressed.GetPubKey().GetID())), 1 * COIN);
+    vCandidates.clear();
+    for (unsigned int i = 0; i < wtx->vout.size(); i++)
+        vCandidates.push_back(COutput(wtx, i, 10, true, true, 0));
+
+    coinControl.UnSelectAll();
+    size_t nInputs = PlanConsolidationStep(keystore, vCandidates, scriptDestination, MAX_CONSOLIDATE_INPUTS, coinControl, nTotal);
+    BOOST_CHECK(nInputs >= 2);
+    BOOST_REQUIRE(nInputs < (size_t)MAX_CONSOLIDATE_INPUTS);
+    BOOST_CHECK_EQUAL(nTotal, (CAmount)nInputs * COIN);
+
+    CMutableTransaction tx;
+    tx.vout.push_back(CTxOut(nTotal, scriptDestination));
+    for (size_t i = 0; i <= nInputs; i++) {
+        CTxIn txin(wtx->GetHash(), i);
+        BOOST_CHECK(ProduceSignature(DummySignatureCreator(&keystore), wtx->vout[i].scriptPubKey, txin.scriptSig));
+        tx.vin.push_back(txin);
+    }
+    CTxIn txinNext = tx.vin.back();
+    tx.vin.pop_back();
+    size_t nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    size_t nSizeNext = nSize + ::GetSerializeSize(txinNext, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(nSize * WITNESS_SCALE_FACTOR < MAX_STANDARD_TX_WEIGHT);
+    BOOST_CHECK(nSizeNext * WITNESS_SCALE_FACTOR >= MAX_STANDARD_TX_WEIGHT);
+    delete wtx;
+}
+
+BOOST_AUTO_TEST_CASE(consolidate_start)
+{
+    CWalletConsolidator consolidator;
+    CConsolidationParams params;
+    CKey key;
+    key.MakeNewKey(true);
+    params.destination = key.GetPubKey().GetID();
+    std::string strError;
+
+    // Nothing is started before the node is ready
+    BOOST_CHECK(!consolidator.Start(pwalletMain, params, strError));
+    BOOST_CHECK(!consolidator.GetStatus().fRunning);
+
+    // The first step is queued right away, a second consolidation is refused
+    CScheduler scheduler;
+    consolidator.SetScheduler(scheduler);
+    BOOST_CHECK(consolidator.Start(pwalletMain, params, strError));
+    BOOST_CHECK(consolidator.GetStatus().fRunning);
+    boost::chrono::system_clock::time_point first, last;
+    BOOST_CHECK_EQUAL(scheduler.getQueueInfo(first, last), 1U);
+    BOOST_CHECK(!consolidator.Start(pwalletMain, params, strError));
+    BOOST_CHECK_EQUAL(scheduler.getQueueInfo(first, last), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(hd_key_cache_locked)
+{
+    mapArgs["-hdseed"] = "000102030405060708090a0b0c0d0e0f";
+    pwalletMain->GenerateNewHDChain();
+    CPubKey pubkey;
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pubkey = pwalletMain->GenerateNewKey(0, false);
+    }
+
+    CKey key;
+    BOOST_CHECK(pwalletMain->GetKey(pubkey.GetID(), key));
+    BOOST_CHECK(key.VerifyPubKey(pubkey));
+
+    SecureString strPassphrase("passphrase");
+    BOOST_CHECK(pwalletMain->EncryptWallet(strPassphrase));
+    BOOST_CHECK(pwalletMain->IsLocked());
+    BOOST_CHECK_THROW(pwalletMain->GetKey(pubkey.GetID(), key), std::runtime_error);
+
+    // Deriving the key while unlocked caches the chain key, locking must drop it
+    BOOST_CHECK(pwalletMain->Unlock(strPassphrase));
+    key = CKey();
+    BOOST_CHECK(pwalletMain->GetKey(pubkey.GetID(), key));
+    BOOST_CHECK(key.VerifyPubKey(pubkey));
+    BOOST_CHECK(pwalletMain->Lock());
+    BOOST_CHECK_THROW(pwalletMain->GetKey(pubkey.GetID(), key), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
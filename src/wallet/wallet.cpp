@@ -19,8 +19,10 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "random.h"
+#include "reverselock.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "spentindex.h"
 #include "smartnode/instantx.h"
 #include "smartnode/smartnode.h"
 #include "smarthive/hive.h"
@@ -31,7 +33,9 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <atomic>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -131,8 +135,19 @@ CPubKey CWallet::GenerateNewKey(uint32_t nAccountIndex, bool fInternal) {
     return pubkey;
 }
 
-void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal)
+void CWallet::GetHDChainKey(uint32_t nAccountIndex, bool fInternal, CExtKey& extKeyRet) const
 {
+    AssertLockHeld(cs_wallet);
+
+    // A locked wallet must not sign with keys derived before it was locked
+    if (!IsLocked(true)) {
+        std::map<std::pair<uint32_t, bool>, CExtKey>::const_iterator it = mapHDChainKeys.find(std::make_pair(nAccountIndex, fInternal));
+        if (it != mapHDChainKeys.end()) {
+            extKeyRet = it->second;
+            return;
+        }
+    }
+
     CHDChain hdChainTmp;
     if (!GetHDChain(hdChainTmp)) {
         throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
@@ -144,22 +159,90 @@ void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, u
     if (hdChainTmp.GetID() != hdChainTmp.GetSeedHash())
         throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
 
+    hdChainTmp.DeriveChainExtKey(nAccountIndex, fInternal, extKeyRet);
+    // a locked wallet can't decrypt the seed, so this only caches while unlocked
+    mapHDChainKeys[std::make_pair(nAccountIndex, fInternal)] = extKeyRet;
+}
+
+static void ThreadDeriveHDKeys(const CExtKey& chainKey, uint32_t nChildIndex, std::vector<std::pair<CExtKey, CExtPubKey> >& vKeys, std::atomic<size_t>& nNext)
+{
+    for (size_t i = nNext++; i < vKeys.size(); i = nNext++) {
+        chainKey.Derive(vKeys[i].first, nChildIndex + i);
+        vKeys[i].second = vKeys[i].first.Neuter();
+        assert(vKeys[i].first.key.VerifyPubKey(vKeys[i].second.pubkey));
+    }
+}
+
+void CWallet::DeriveHDKeysAhead(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, uint32_t nCount)
+{
+    AssertLockHeld(cs_wallet);
+
+    if (nCount == 0)
+        return;
+
+    CExtKey chainKey;
+    GetHDChainKey(nAccountIndex, fInternal, chainKey);
+
+    std::vector<std::pair<CExtKey, CExtPubKey> > vKeys(nCount);
+    std::atomic<size_t> nNext(0);
+    int nThreads = std::min(GetNumCores(), (int)(nCount / 16));
+    if (nThreads > 1) {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&ThreadDeriveHDKeys, boost::cref(chainKey), nChildIndex, boost::ref(vKeys), boost::ref(nNext)));
+        threadGroup.join_all();
+    } else {
+        ThreadDeriveHDKeys(chainKey, nChildIndex, vKeys, nNext);
+    }
+
+    std::map<uint32_t, std::pair<CExtKey, CExtPubKey> >& mapKeys = mapHDKeysAhead[std::make_pair(nAccountIndex, fInternal)];
+    for (uint32_t i = 0; i < nCount; i++)
+        mapKeys[nChildIndex + i] = vKeys[i];
+}
+
+void CWallet::ClearHDKeyCache() const
+{
+    LOCK(cs_wallet);
+    mapHDChainKeys.clear();
+    mapHDKeysAhead.clear();
+}
+
+void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal)
+{
+    CHDChain hdChainTmp;
+    if (!GetHDChain(hdChainTmp)) {
+        throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
+    }
+
     CHDAccount acc;
     if (!hdChainTmp.GetAccount(nAccountIndex, acc))
         throw std::runtime_error(std::string(__func__) + ": Wrong HD account!");
 
+    CExtKey chainKey;
+    GetHDChainKey(nAccountIndex, fInternal, chainKey);
+    std::map<uint32_t, std::pair<CExtKey, CExtPubKey> >& mapKeysAhead = mapHDKeysAhead[std::make_pair(nAccountIndex, fInternal)];
+
     // derive child key at next index, skip keys already known to the wallet
     CExtKey childKey;
+    CExtPubKey childPubKey;
     uint32_t nChildIndex = fInternal ? acc.nInternalChainCounter : acc.nExternalChainCounter;
     do {
-        hdChainTmp.DeriveChildExtKey(nAccountIndex, fInternal, nChildIndex, childKey);
+        std::map<uint32_t, std::pair<CExtKey, CExtPubKey> >::iterator it = mapKeysAhead.find(nChildIndex);
+        if (it != mapKeysAhead.end()) {
+            childKey = it->second.first;
+            childPubKey = it->second.second;
+            mapKeysAhead.erase(it);
+        } else {
+            chainKey.Derive(childKey, nChildIndex);
+            childPubKey = childKey.Neuter();
+            assert(childKey.key.VerifyPubKey(childPubKey.pubkey));
+        }
         // increment childkey index
         nChildIndex++;
-    } while (HaveKey(childKey.key.GetPubKey().GetID()));
+    } while (HaveKey(childPubKey.pubkey.GetID()));
     secretRet = childKey.key;
 
-    CPubKey pubkey = secretRet.GetPubKey();
-    assert(secretRet.VerifyPubKey(pubkey));
+    const CPubKey& pubkey = childPubKey.pubkey;
 
     // store metadata
     mapKeyMetadata[pubkey.GetID()] = metadata;
@@ -189,7 +272,7 @@ void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, u
             throw std::runtime_error(std::string(__func__) + ": SetHDChain failed");
     }
 
-    if (!AddHDPubKey(childKey.Neuter(), fInternal))
+    if (!AddHDPubKey(childPubKey, fInternal))
         throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
 }
 
@@ -215,17 +298,11 @@ bool CWallet::GetKey(const CKeyID &address, CKey& keyOut) const
     {
         // if the key has been found in mapHdPubKeys, derive it on the fly
         const CHDPubKey &hdPubKey = (*mi).second;
-        CHDChain hdChainCurrent;
-        if (!GetHDChain(hdChainCurrent))
-            throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
-        if (!DecryptHDChain(hdChainCurrent))
-            throw std::runtime_error(std::string(__func__) + ": DecryptHDChainSeed failed");
-        // make sure seed matches this chain
-        if (hdChainCurrent.GetID() != hdChainCurrent.GetSeedHash())
-            throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
+        CExtKey chainKey;
+        GetHDChainKey(hdPubKey.nAccountIndex, hdPubKey.nChangeIndex != 0, chainKey);
 
         CExtKey extkey;
-        hdChainCurrent.DeriveChildExtKey(hdPubKey.nAccountIndex, hdPubKey.nChangeIndex != 0, hdPubKey.extPubKey.nChild, extkey);
+        chainKey.Derive(extkey, hdPubKey.extPubKey.nChild);
         keyOut = extkey.key;
 
         return true;
@@ -496,6 +573,15 @@ bool CWallet::Unlock(const SecureString &strWalletPassphrase) {
     return false;
 }
 
+bool CWallet::Lock() {
+    // Don't keep derived private keys around once the seed is locked away.
+    // Hold cs_wallet until the master key is gone, so GetKey() can't refill
+    // the cache in between.
+    LOCK(cs_wallet);
+    ClearHDKeyCache();
+    return CCryptoKeyStore::Lock();
+}
+
 bool CWallet::ChangeWalletPassphrase(const SecureString &strOldWalletPassphrase,
                                      const SecureString &strNewWalletPassphrase) {
     bool fWasLocked = IsLocked();
@@ -1008,6 +1094,9 @@ void CWallet::AddToSpends(const COutPoint &outpoint, const uint256 &wtxid) {
     pair <TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
+
+    // The spent outpoint no longer counts towards the balance
+    MarkBalanceDirty(outpoint.hash);
 }
 
 
@@ -1107,10 +1196,13 @@ bool CWallet::AccountMove(std::string strFrom, std::string strTo, CAmount nAmoun
 
 void CWallet::MarkDirty() {
     {
-        LOCK(cs_wallet);
+        LOCK2(cs_main, cs_wallet);
+        InvalidateBalanceCache();
         BOOST_FOREACH(PAIRTYPE(
         const uint256, CWalletTx)&item, mapWallet)
         item.second.MarkDirty();
+        // Rebuild now rather than on the next balance query
+        UpdateBalanceCache();
     }
 }
 
@@ -1400,6 +1492,19 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+
+    if (fBalanceCacheValid)
+        UpdateBalanceCache();
+}
+
+void CWallet::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    // Confirmations, maturity and reorganizations are accounted for here,
+    // so the balance queries only have to read the cached totals.
+    if (fBalanceCacheValid)
+        UpdateBalanceCache();
 }
 
 
@@ -1507,6 +1612,9 @@ bool CWallet::SetHDChain(const CHDChain& chain, bool memonly)
 {
     LOCK(cs_wallet);
 
+    if (chain.GetID() != hdChain.GetID())
+        ClearHDKeyCache();
+
     if (!CCryptoKeyStore::SetHDChain(chain))
         return false;
 
@@ -1520,6 +1628,10 @@ bool CWallet::SetCryptedHDChain(const CHDChain& chain, bool memonly)
 {
     LOCK(cs_wallet);
 
+    CHDChain hdChainCurrent;
+    if (!GetHDChain(hdChainCurrent) || chain.GetID() != hdChainCurrent.GetID())
+        ClearHDKeyCache();
+
     if (!CCryptoKeyStore::SetCryptedHDChain(chain))
         return false;
 
@@ -1738,12 +1850,210 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb)
     return pwalletdb->WriteTx(GetHash(), *this);
 }
 
+void CWallet::GetAddressIndexKeys(std::set<std::pair<uint160, int> >& setAddresses) const {
+    AssertLockHeld(cs_wallet);
+
+    std::set<CKeyID> setKeyIds;
+    GetKeys(setKeyIds);
+    BOOST_FOREACH(const CKeyID& keyid, setKeyIds)
+        setAddresses.insert(std::make_pair(uint160(keyid), 1));
+    for (std::map<CKeyID, CHDPubKey>::const_iterator it = mapHdPubKeys.begin(); it != mapHdPubKeys.end(); ++it)
+        setAddresses.insert(std::make_pair(uint160(it->first), 1));
+
+    LOCK(cs_KeyStore);
+    for (WatchKeyMap::const_iterator it = mapWatchKeys.begin(); it != mapWatchKeys.end(); ++it)
+        setAddresses.insert(std::make_pair(uint160(it->first), 1));
+    for (ScriptMap::const_iterator it = mapScripts.begin(); it != mapScripts.end(); ++it)
+        setAddresses.insert(std::make_pair(uint160(it->first), 2));
+    BOOST_FOREACH(const CScript& script, setWatchOnly) {
+        CTxDestination dest;
+        if (!ExtractDestination(script, dest))
+            continue;
+        if (const CKeyID* keyid = boost::get<CKeyID>(&dest))
+            setAddresses.insert(std::make_pair(uint160(*keyid), 1));
+        else if (const CScriptID* scriptid = boost::get<CScriptID>(&dest))
+            setAddresses.insert(std::make_pair(uint160(*scriptid), 2));
+    }
+}
+
+/** Reads the blocks of a rescan batch by batch, on threads kept for the whole rescan */
+class CRescanBlockReader
+{
+public:
+    std::vector<CDiskBlockPos> vPos;
+    std::vector<CBlock> vBlocks;
+    //! whether each block was read successfully
+    std::vector<char> vRead;
+
+    explicit CRescanBlockReader(int nThreads) : nNext(0), nBusy(0), fStop(false)
+    {
+        for (int i = 0; i < nThreads && nThreads > 1; i++)
+            threadGroup.create_thread(boost::bind(&CRescanBlockReader::ThreadRead, this));
+    }
+
+    ~CRescanBlockReader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        condWork.notify_all();
+        threadGroup.join_all();
+    }
+
+    /** Read the blocks at vPos into vBlocks */
+    void Read()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        vBlocks.assign(vPos.size(), CBlock());
+        vRead.assign(vPos.size(), 0);
+        nNext = 0;
+        if (threadGroup.size() == 0) {
+            for (; nNext < vPos.size(); nNext++)
+                vRead[nNext] = ReadBlockFromDisk(vBlocks[nNext], vPos[nNext], Params().GetConsensus());
+            return;
+        }
+        condWork.notify_all();
+        while (nNext < vPos.size() || nBusy > 0)
+            condDone.wait(lock);
+    }
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    boost::thread_group threadGroup;
+    size_t nNext;
+    int nBusy;
+    bool fStop;
+
+    void ThreadRead()
+    {
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            while (!fStop && nNext >= vPos.size())
+                condWork.wait(lock);
+            if (fStop)
+                return;
+            size_t i = nNext++;
+            nBusy++;
+            {
+                // Read() does not touch the vectors before all reads are done
+                reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+                vRead[i] = ReadBlockFromDisk(vBlocks[i], vPos[i], consensusParams);
+            }
+            nBusy--;
+            if (nNext >= vPos.size() && nBusy == 0)
+                condDone.notify_all();
+        }
+    }
+};
+
+int CWallet::ScanForWalletTransactionsIndexed(CBlockIndex *pindexStart, bool fUpdate) {
+    int ret = 0;
+    int64_t nStart = GetTimeMillis();
+
+    int nStartHeight, nTipHeight;
+    {
+        LOCK(cs_main);
+        // no need to look at blocks created before our wallet birthday
+        // (as adjusted for block time variability)
+        CBlockIndex *pindex = pindexStart;
+        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
+            pindex = chainActive.Next(pindex);
+        if (!pindex)
+            return 0;
+        nStartHeight = pindex->nHeight;
+        nTipHeight = chainActive.Height();
+    }
+
+    std::set<std::pair<uint160, int> > setAddresses;
+    {
+        LOCK(cs_wallet);
+        GetAddressIndexKeys(setAddresses);
+    }
+
+    // Heights of all blocks that credit or debit one of our addresses. Blocks
+    // connected after this point reach the wallet through SyncTransaction.
+    // GetAddressIndex() waits for the index writer, so all blocks up to
+    // nTipHeight are indexed by the time it reads.
+    std::set<int> setHeights;
+    for (std::set<std::pair<uint160, int> >::const_iterator it = setAddresses.begin(); it != setAddresses.end(); ++it) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, std::max(1, nStartHeight), nTipHeight))
+            return -1;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator jt = addressIndex.begin(); jt != addressIndex.end(); ++jt) {
+            if (jt->first.blockHeight >= nStartHeight)
+                setHeights.insert(jt->first.blockHeight);
+        }
+    }
+
+    LogPrintf("%s: %u addresses, %u of %d blocks to scan\n", __func__,
+              setAddresses.size(), setHeights.size(), nTipHeight - nStartHeight + 1);
+
+    const std::vector<int> vHeights(setHeights.begin(), setHeights.end());
+    CRescanBlockReader reader(std::min(vHeights.size(), (size_t)std::max(1, (int)GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS))));
+
+    ShowProgress(_("Rescanning..."), 0);
+    for (size_t nBatchStart = 0; nBatchStart < vHeights.size(); nBatchStart += RESCAN_BATCH_SIZE) {
+        boost::this_thread::interruption_point();
+        size_t nBatchEnd = std::min(vHeights.size(), nBatchStart + RESCAN_BATCH_SIZE);
+
+        std::vector<CBlockIndex*> vIndex;
+        reader.vPos.clear();
+        {
+            LOCK(cs_main);
+            for (size_t i = nBatchStart; i < nBatchEnd; i++) {
+                CBlockIndex *pindex = chainActive[vHeights[i]];
+                if (!pindex)
+                    break;
+                vIndex.push_back(pindex);
+                reader.vPos.push_back(pindex->GetBlockPos());
+            }
+        }
+
+        // Read the batch without holding any lock
+        reader.Read();
+
+        {
+            LOCK2(cs_main, cs_wallet);
+            for (size_t i = 0; i < vIndex.size(); i++) {
+                // Skip blocks that were read unsuccessfully or reorganized away
+                // meanwhile, the replacing blocks are synced on connect.
+                if (!reader.vRead[i] || !chainActive.Contains(vIndex[i]))
+                    continue;
+                BOOST_FOREACH(CTransaction & tx, reader.vBlocks[i].vtx)
+                {
+                    if (AddToWalletIfInvolvingMe(tx, &reader.vBlocks[i], fUpdate))
+                        ret++;
+                }
+            }
+            if (fBalanceCacheValid)
+                UpdateBalanceCache();
+        }
+
+        ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(nBatchEnd * 100 / vHeights.size()))));
+    }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+    LogPrintf("%s: found %d transactions in %dms\n", __func__, ret, GetTimeMillis() - nStart);
+    return ret;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate) {
+    if (GetBoolArg("-rescanindex", DEFAULT_RESCAN_ADDRESSINDEX)) {
+        int ret = ScanForWalletTransactionsIndexed(pindexStart, fUpdate);
+        if (ret >= 0)
+            return ret;
+        LogPrintf("%s: address index not usable, scanning all blocks\n", __func__);
+    }
+
     int ret = 0;
     int64_t nNow = GetTime();
     const CChainParams &chainParams = Params();
@@ -1784,6 +2094,8 @@ int CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate) {
                           Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
             }
         }
+        if (fBalanceCacheValid)
+            UpdateBalanceCache();
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
@@ -1855,6 +2167,20 @@ set <uint256> CWalletTx::GetConflicts() const {
     return result;
 }
 
+void CWalletTx::MarkDirty() {
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+
+    if (pwallet)
+        pwallet->MarkBalanceDirty(GetHash());
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter &filter) const {
     if (vin.empty())
         return 0;
@@ -2099,18 +2425,152 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
+void CWallet::MarkBalanceDirty(const uint256 &hash) const {
+    LOCK(cs_wallet);
+    if (fBalanceCacheValid)
+        setBalanceDirty.insert(hash);
+    if (fCoinIndexValid)
+        setCoinIndexDirty.insert(hash);
+}
+
+void CWallet::InvalidateBalanceCache() const {
+    LOCK(cs_wallet);
+    fBalanceCacheValid = false;
+    balanceCached.SetNull();
+    mapBalanceContributions.clear();
+    setBalanceDirty.clear();
+    setBalanceVolatile.clear();
+    hashBalanceTip.SetNull();
+    nBalanceTipHeight = -1;
+
+    fCoinIndexValid = false;
+    mapCoinIndex.clear();
+    setCoinIndexDirty.clear();
+    hashCoinIndexTip.SetNull();
+    nCoinIndexTipHeight = -1;
+}
+
+void CWallet::IndexCoins(const uint256 &hash, const CWalletTx &wtx) const {
+    std::vector<std::pair<unsigned int, isminetype> > vOutputs;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        isminetype mine = IsMine(wtx.vout[i]);
+        if (mine != ISMINE_NO && !IsSpent(hash, i))
+            vOutputs.push_back(std::make_pair(i, mine));
+    }
+    if (vOutputs.empty())
+        mapCoinIndex.erase(hash);
+    else
+        mapCoinIndex[hash].swap(vOutputs);
+}
+
+void CWallet::UpdateCoinIndex() const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Spends confirmed in blocks that got disconnected are not necessarily
+    // marked dirty, start over after a reorganization.
+    if (fCoinIndexValid && nCoinIndexTipHeight >= 0 &&
+        (chainActive.Height() < nCoinIndexTipHeight || chainActive[nCoinIndexTipHeight]->GetBlockHash() != hashCoinIndexTip))
+        InvalidateBalanceCache();
+
+    if (!fCoinIndexValid) {
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            IndexCoins(it->first, it->second);
+        fCoinIndexValid = true;
+    } else {
+        std::set<uint256> setUpdate;
+        setUpdate.swap(setCoinIndexDirty);
+        BOOST_FOREACH(const uint256& hash, setUpdate) {
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                mapCoinIndex.erase(hash);
+            else
+                IndexCoins(hash, it->second);
+        }
+    }
+
+    nCoinIndexTipHeight = chainActive.Height();
+    hashCoinIndexTip = nCoinIndexTipHeight >= 0 ? chainActive.Tip()->GetBlockHash() : uint256();
+}
+
+CWalletBalance CWallet::GetBalanceContribution(const CWalletTx &wtx, bool &fVolatile) const {
+    CWalletBalance balance;
+    if (wtx.IsTrusted()) {
+        balance.nTrusted = wtx.GetAvailableCredit();
+        balance.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (wtx.GetDepthInMainChain() == 0 && wtx.InMempool()) {
+        balance.nUntrustedPending = wtx.GetAvailableCredit();
+        balance.nWatchOnlyUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balance.nImmature = wtx.GetImmatureCredit();
+    balance.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+
+    fVolatile = wtx.GetDepthInMainChain(false) <= 0 || (wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0);
+    return balance;
+}
+
+void CWallet::UpdateBalanceCache() const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Transactions confirmed in blocks that got disconnected are not
+    // necessarily marked dirty, start over after a reorganization.
+    if (fBalanceCacheValid && nBalanceTipHeight >= 0 &&
+        (chainActive.Height() < nBalanceTipHeight || chainActive[nBalanceTipHeight]->GetBlockHash() != hashBalanceTip))
+        InvalidateBalanceCache();
+
+    // The volatile transactions only change state with the tip
+    bool fTipChanged = chainActive.Tip() && chainActive.Tip()->GetBlockHash() != hashBalanceTip;
+
+    if (!fBalanceCacheValid) {
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+            bool fVolatile;
+            CWalletBalance balance = GetBalanceContribution(it->second, fVolatile);
+            if (!balance.IsNull()) {
+                mapBalanceContributions[it->first] = balance;
+                balanceCached += balance;
+            }
+            if (fVolatile)
+                setBalanceVolatile.insert(it->first);
+        }
+        fBalanceCacheValid = true;
+    } else {
+        std::set<uint256> setUpdate;
+        setUpdate.swap(setBalanceDirty);
+        if (fTipChanged)
+            setUpdate.insert(setBalanceVolatile.begin(), setBalanceVolatile.end());
+        BOOST_FOREACH(const uint256& hash, setUpdate) {
+            std::map<uint256, CWalletBalance>::iterator mi = mapBalanceContributions.find(hash);
+            if (mi != mapBalanceContributions.end()) {
+                balanceCached -= mi->second;
+                mapBalanceContributions.erase(mi);
+            }
+            setBalanceVolatile.erase(hash);
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            bool fVolatile;
+            CWalletBalance balance = GetBalanceContribution(it->second, fVolatile);
+            if (!balance.IsNull()) {
+                mapBalanceContributions[hash] = balance;
+                balanceCached += balance;
+            }
+            if (fVolatile)
+                setBalanceVolatile.insert(hash);
         }
     }
 
-    return nTotal;
+    if (chainActive.Tip()) {
+        hashBalanceTip = chainActive.Tip()->GetBlockHash();
+        nBalanceTipHeight = chainActive.Height();
+    }
+}
+
+CAmount CWallet::GetBalance() const {
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nTrusted;
 }
 
 // CAmount CWallet::GetAnonymizableBalance(bool fSkipDenominated, bool fSkipUnconfirmed) const
@@ -2237,55 +2697,27 @@ CAmount CWallet::GetBalance() const {
 // }
 
 CAmount CWallet::GetUnconfirmedBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nWatchOnlyUntrustedPending;
 }
 
 // bool CWallet::IsDenominated(const CTxIn &txin) const
@@ -2329,15 +2761,9 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
 // }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nWatchOnlyImmature;
 }
 
 void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl,
@@ -2346,9 +2772,10 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, cons
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        UpdateCoinIndex();
+        for (std::map<uint256, std::vector<std::pair<unsigned int, isminetype> > >::const_iterator it = mapCoinIndex.begin(); it != mapCoinIndex.end(); ++it) {
             const uint256 &wtxid = it->first;
-            const CWalletTx *pcoin = &(*it).second;
+            const CWalletTx *pcoin = &mapWallet.at(wtxid);
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -2369,7 +2796,8 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, cons
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            BOOST_FOREACH(const PAIRTYPE(unsigned int, isminetype)& output, it->second) {
+                unsigned int i = output.first;
                 bool found = false;
                 if(nCoinType == ONLY_DENOMINATED) {
                     //found = CPrivateSend::IsDenominatedAmount(pcoin->vout[i].nValue);
@@ -2385,11 +2813,11 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, cons
                 }
                 if(!found) continue;
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    (!IsLockedCoin((*it).first, i) || nCoinType == ONLY_10000) &&
+                isminetype mine = output.second;
+                if (!(IsSpent(wtxid, i)) &&
+                    (!IsLockedCoin(wtxid, i) || nCoinType == ONLY_10000) &&
                     (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint((*it).first, i)))){
+                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint(wtxid, i)))){
 
                         vCoins.push_back(COutput(pcoin, i, nDepth,
                                                  ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
@@ -2410,9 +2838,10 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, const CSmartAddress& addr
 
         CScript addressScript = address.GetScript();
 
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        UpdateCoinIndex();
+        for (std::map<uint256, std::vector<std::pair<unsigned int, isminetype> > >::const_iterator it = mapCoinIndex.begin(); it != mapCoinIndex.end(); ++it) {
             const uint256 &wtxid = it->first;
-            const CWalletTx *pcoin = &(*it).second;
+            const CWalletTx *pcoin = &mapWallet.at(wtxid);
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -2430,14 +2859,15 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, const CSmartAddress& addr
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            BOOST_FOREACH(const PAIRTYPE(unsigned int, isminetype)& output, it->second) {
+                unsigned int i = output.first;
 
                 if( pcoin->vout[i].scriptPubKey != addressScript)
                     continue;
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) &&
+                isminetype mine = output.second;
+                if (!(IsSpent(wtxid, i)) &&
+                    !IsLockedCoin(wtxid, i) &&
                     pcoin->vout[i].nValue > 0){                        
                         vCoins.push_back(COutput(pcoin, i, nDepth,
                                                  ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
@@ -2546,7 +2976,7 @@ bool CWallet::GetSmartnodeOutpointAndKeys(COutPoint& outpointRet, CPubKey& pubKe
 //     return true;
 // }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
+static void ApproximateBestSubset(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   vector<char>& vfBest, CAmount& nBest, int iterations = 1000, bool fUseInstantSend = false)
 {
     vector<char> vfIncluded;
@@ -2605,27 +3035,84 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
     }
 }
 
-bool less_then_denom (const COutput& out1, const COutput& out2)
+/**
+ * Depth first search for a subset of vValue, which is sorted by descending
+ * value, whose total lies within [nTargetValue, nTargetValue + nCostOfChange],
+ * i.e. a selection which needs no change output. Among those found it keeps
+ * the one with the smallest excess. Gives up after a bounded number of tries.
+ */
+static bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nCostOfChange,
+                           vector<char>& vfBest, CAmount& nBest, bool fUseInstantSend)
 {
-    // const CWalletTx *pcoin1 = out1.tx;
-    // const CWalletTx *pcoin2 = out2.tx;
-
-    // bool found1 = false;
-    // bool found2 = false;
-    // BOOST_FOREACH(CAmount d, CPrivateSend::GetStandardDenominations()) // loop through predefined denoms
-    // {
-    //     if(pcoin1->vout[out1.i].nValue == d) found1 = true;
-    //     if(pcoin2->vout[out2.i].nValue == d) found2 = true;
-    // }
-    // return (!found1 && found2);
-    return false;
+    CAmount nMaxValue = fUseInstantSend ? sporkManager.GetSporkValue(SPORK_5_INSTANTSEND_MAX_VALUE)*COIN : std::numeric_limits<CAmount>::max();
+
+    // Value of the coins at and after each position, to prune branches
+    // which can't reach the target anymore
+    vector<CAmount> vRemaining(vValue.size() + 1, 0);
+    for (size_t i = vValue.size(); i-- > 0; )
+        vRemaining[i] = vRemaining[i + 1] + vValue[i].first;
+
+    vector<char> vfIncluded(vValue.size(), false);
+    CAmount nTotal = 0;
+    nBest = std::numeric_limits<CAmount>::max();
+    size_t nDepth = 0;
+
+    for (size_t nTries = 0; nTries < COIN_SELECTION_BNB_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nTotal + vRemaining[nDepth] < nTargetValue || nTotal > nTargetValue + nCostOfChange || nTotal > nMaxValue) {
+            fBacktrack = true;
+        } else if (nTotal >= nTargetValue) {
+            if (nTotal < nBest) {
+                nBest = nTotal;
+                vfBest = vfIncluded;
+                if (nBest == nTargetValue)
+                    break;
+            }
+            fBacktrack = true;
+        } else if (nDepth == vValue.size()) {
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last included coin and try the branch without it
+            while (nDepth > 0 && !vfIncluded[nDepth - 1])
+                nDepth--;
+            if (nDepth == 0)
+                break;
+            nDepth--;
+            vfIncluded[nDepth] = false;
+            nTotal -= vValue[nDepth].first;
+            nDepth++;
+        } else {
+            // Skip coins of the same value as an excluded predecessor, the
+            // resulting selections have already been tried
+            if (nDepth > 0 && !vfIncluded[nDepth - 1] && vValue[nDepth].first == vValue[nDepth - 1].first) {
+                nDepth++;
+                continue;
+            }
+            vfIncluded[nDepth] = true;
+            nTotal += vValue[nDepth].first;
+            nDepth++;
+        }
+    }
+
+    return nBest != std::numeric_limits<CAmount>::max();
+}
+
+CAmount CWallet::GetCostOfChange()
+{
+    // Creating a P2PKH change output and spending it later, capped to
+    // the change the knapsack solver aims for
+    return std::min(MIN_CHANGE, GetRequiredFee(34 + 148));
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const uint64_t nMaxAncestors, vector<COutput> vCoins,
-                                 set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend) const
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const uint64_t nMaxAncestors, const vector<COutput>& vCoins,
+                                 set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend, bool* pfChangelessRet) const
 {
         setCoinsRet.clear();
     nValueRet = 0;
+    if (pfChangelessRet)
+        *pfChangelessRet = false;
 
     // List of values less than target
     pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
@@ -2636,10 +3123,12 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
-    // move denoms down on the list
-    sort(vCoins.begin(), vCoins.end(), less_then_denom);
+    // Shuffle the candidates rather than the caller's coins, which are
+    // tried again with relaxed depth requirements
+    vector<size_t> vOrder(vCoins.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    random_shuffle(vOrder.begin(), vOrder.end(), GetRandInt);
 
     // try to find nondenom first to prevent unneeded spending of mixed coins
     for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++)
@@ -2647,8 +3136,9 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         LogPrint("selectcoins", "tryDenom: %d\n", tryDenom);
         vValue.clear();
         nTotalLower = 0;
-        BOOST_FOREACH(const COutput &output, vCoins)
+        BOOST_FOREACH(size_t nCoin, vOrder)
         {
+            const COutput &output = vCoins[nCoin];
             if (!output.fSpendable)
                 continue;
 
@@ -2712,14 +3202,32 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
 
     }
 
-    // Solve subset sum by stochastic approximation
     sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, fUseInstantSend);
+    // Prefer a selection which needs no change output at all
+    if (SelectCoinsBnB(vValue, nTargetValue, GetCostOfChange(), vfBest, nBest, fUseInstantSend)) {
+        string s = "CWallet::SelectCoinsMinConf branch and bound: ";
+        for (unsigned int i = 0; i < vValue.size(); i++)
+        {
+            if (vfBest[i])
+            {
+                setCoinsRet.insert(vValue[i].second);
+                nValueRet += vValue[i].first;
+                s += FormatMoney(vValue[i].first) + " ";
+            }
+        }
+        LogPrint("selectcoins", "%s - total %s\n", s, FormatMoney(nBest));
+        if (pfChangelessRet)
+            *pfChangelessRet = true;
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000, fUseInstantSend);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, fUseInstantSend);
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, 1000, fUseInstantSend);
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
@@ -2746,8 +3254,11 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     return true;
 }
 
-bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType nCoinType, bool fUseInstantSend) const
+bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType nCoinType, bool fUseInstantSend, bool* pfChangelessRet) const
 {
+    if (pfChangelessRet)
+        *pfChangelessRet = false;
+
     vector<COutput> vCoins;
     AvailableCoins(vCoins, true, coinControl, false, nCoinType, fUseInstantSend);
 
@@ -2800,22 +3311,22 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
     bool fRejectLongChains = GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-               SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend) ||
-               SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend) ||
+               SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend, pfChangelessRet) ||
+               SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend, pfChangelessRet) ||
                (bSpendZeroConfChange &&
-                SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, fUseInstantSend)) ||
+                SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, fUseInstantSend, pfChangelessRet)) ||
                (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1,
                                                            std::min((size_t) 4, nMaxChainLength / 3), vCoins,
-                                                           setCoinsRet, nValueRet, fUseInstantSend)) ||
+                                                           setCoinsRet, nValueRet, fUseInstantSend, pfChangelessRet)) ||
                (bSpendZeroConfChange &&
                 SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength / 2, vCoins,
-                                   setCoinsRet, nValueRet, fUseInstantSend)) ||
+                                   setCoinsRet, nValueRet, fUseInstantSend, pfChangelessRet)) ||
                (bSpendZeroConfChange &&
                 SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet,
-                                   nValueRet, fUseInstantSend)) ||
+                                   nValueRet, fUseInstantSend, pfChangelessRet)) ||
                (bSpendZeroConfChange && !fRejectLongChains &&
                 SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(),
-                                   vCoins, setCoinsRet, nValueRet, fUseInstantSend));
+                                   vCoins, setCoinsRet, nValueRet, fUseInstantSend, pfChangelessRet));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -3052,9 +3563,6 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
     {
         LOCK2(cs_main, cs_wallet);
         {
-            std::vector <COutput> vAvailableCoins;
-            AvailableCoins(vAvailableCoins, true, coinControl);
-
             nFeeRet = payTxFee.GetFeePerK();
             // Start with no fee and loop until there is enough fee
             while (true) {
@@ -3102,7 +3610,8 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 // Choose coins to use
                 set <pair<const CWalletTx *, unsigned int>> setCoins;
                 CAmount nValueIn = 0;
-                if (!SelectCoins(nValueToSelect, setCoins, nValueIn, coinControl, nCoinType, fUseInstantSend))
+                bool fChangeless = false;
+                if (!SelectCoins(nValueToSelect, setCoins, nValueIn, coinControl, nCoinType, fUseInstantSend, &fChangeless))
                 {
                     if (nValueIn < nValueToSelect) {
                         strFailReason = _("Insufficient funds.");
@@ -3266,9 +3775,11 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                         }
                     }
 
-                    // Never create dust outputs; if we would, just
-                    // add the dust to the fee.
-                    if (newTxOut.IsDust(::minRelayTxFee)) {
+                    // Never create dust outputs; if we would, just add the
+                    // dust to the fee. The same goes for the excess of a
+                    // branch and bound selection, which was chosen to need
+                    // no change output.
+                    if (newTxOut.IsDust(::minRelayTxFee) || (fChangeless && nSubtractFeeFromAmount == 0 && nChange <= GetCostOfChange())) {
                         nChangePosInOut = -1;
                         nFeeRet += nChange;
                         reservekey.ReturnKey();
@@ -3452,9 +3963,21 @@ bool CWallet::EraseFromWallet(uint256 hash)
     if (!fFileBacked)
         return false;
     {
-        LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        LOCK2(cs_main, cs_wallet);
+        map<uint256, CWalletTx>::iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            // The outputs it spent may be available again
+            BOOST_FOREACH(const CTxIn& txin, it->second.vin) {
+                map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+                if (mi != mapWallet.end())
+                    mi->second.MarkDirty();
+            }
+            mapWallet.erase(it);
             CWalletDB(strWalletFile).EraseTx(hash);
+            MarkBalanceDirty(hash);
+        }
+        if (fBalanceCacheValid)
+            UpdateBalanceCache();
     }
     return true;
 }
@@ -3676,6 +4199,16 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize) {
             missingInternal = 0;
         }
 
+        // Derive the HD keys in parallel upfront, writing them stays serial
+        if (IsHDEnabled()) {
+            CHDChain hdChainTmp;
+            CHDAccount acc;
+            if (GetHDChain(hdChainTmp) && hdChainTmp.GetAccount(0, acc)) {
+                DeriveHDKeysAhead(0, false, acc.nExternalChainCounter, missingExternal);
+                DeriveHDKeysAhead(0, true, acc.nInternalChainCounter, missingInternal);
+            }
+        }
+
         bool fInternal = false;
         CWalletDB walletdb(strWalletFile);
         for (int64_t i = missingInternal + missingExternal; i--;)
@@ -3705,6 +4238,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize) {
             std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
             uiInterface.InitMessage(strMsg);
         }
+        // Keys derived ahead but skipped because the wallet already knew them
+        mapHDKeysAhead.clear();
     }
     return true;
 }
@@ -4232,6 +4767,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug) {
                                strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                          CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanindex", strprintf(_("Only read the blocks the address index lists for wallet addresses when rescanning (default: %u)"), DEFAULT_RESCAN_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Number of threads reading blocks during an address index rescan (default: %d)"), DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions",
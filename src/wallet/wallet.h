@@ -52,6 +52,8 @@ static const CAmount DEFAULT_FALLBACK_FEE = 20000;
 static const CAmount DEFAULT_TRANSACTION_MINFEE = 1000;
 //! minimum change amount
 static const CAmount MIN_CHANGE = .1 * CENT;
+//! Number of search steps branch and bound coin selection may take before falling back to the knapsack solver
+static const size_t COIN_SELECTION_BNB_TRIES = 100000;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -sendfreetransactions
@@ -69,6 +71,13 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
 
+//! -rescanindex default: only read blocks listed in the address index when rescanning
+static const bool DEFAULT_RESCAN_ADDRESSINDEX = true;
+//! -rescanthreads default
+static const int DEFAULT_RESCAN_THREADS = 4;
+//! Number of blocks read ahead by the rescan workers before they are scanned
+static const unsigned int RESCAN_BATCH_SIZE = 64;
+
 extern const char * DEFAULT_WALLET_DAT;
 
 class CBlockIndex;
@@ -401,17 +410,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -588,6 +587,56 @@ private:
 };
 
 
+/** Amounts a transaction contributes to each of the wallet balances */
+struct CWalletBalance
+{
+    CAmount nTrusted;
+    CAmount nUntrustedPending;
+    CAmount nImmature;
+    CAmount nWatchOnlyTrusted;
+    CAmount nWatchOnlyUntrustedPending;
+    CAmount nWatchOnlyImmature;
+
+    CWalletBalance()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nTrusted = nUntrustedPending = nImmature = 0;
+        nWatchOnlyTrusted = nWatchOnlyUntrustedPending = nWatchOnlyImmature = 0;
+    }
+
+    bool IsNull() const
+    {
+        return nTrusted == 0 && nUntrustedPending == 0 && nImmature == 0 &&
+               nWatchOnlyTrusted == 0 && nWatchOnlyUntrustedPending == 0 && nWatchOnlyImmature == 0;
+    }
+
+    CWalletBalance& operator+=(const CWalletBalance& b)
+    {
+        nTrusted += b.nTrusted;
+        nUntrustedPending += b.nUntrustedPending;
+        nImmature += b.nImmature;
+        nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending += b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        return *this;
+    }
+
+    CWalletBalance& operator-=(const CWalletBalance& b)
+    {
+        nTrusted -= b.nTrusted;
+        nUntrustedPending -= b.nUntrustedPending;
+        nImmature -= b.nImmature;
+        nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending -= b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        return *this;
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -598,9 +647,9 @@ private:
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
-     * if they are not ours
+     * if they are not ours. See SelectCoinsMinConf for pfChangelessRet.
      */
-    bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType nCoinType=ALL_COINS, bool fUseInstantSend = false) const;
+    bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType nCoinType=ALL_COINS, bool fUseInstantSend = false, bool* pfChangelessRet = NULL) const;
 
     CWalletDB *pwalletdbEncryption;
     CWalletDB *pvotingdbEncryption;
@@ -620,6 +669,43 @@ private:
     mutable bool fAnonymizableTallyCachedNonDenom;
     mutable std::vector<CompactTallyItem> vecAnonymizableTallyCachedNonDenom;
 
+    /**
+     * Balance totals and the per-transaction contributions they are made of.
+     * They are brought up to date as transactions and blocks come in, not
+     * when queried: transactions marked dirty are re-evaluated right away,
+     * the volatile ones (unconfirmed, conflicted or immature, whose state
+     * changes with the chain height) once per new tip, and a reorganization
+     * of the cached tip rebuilds the whole cache.
+     */
+    mutable bool fBalanceCacheValid;
+    mutable CWalletBalance balanceCached;
+    mutable std::map<uint256, CWalletBalance> mapBalanceContributions;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable std::set<uint256> setBalanceVolatile;
+    mutable uint256 hashBalanceTip;
+    mutable int nBalanceTipHeight;
+
+    CWalletBalance GetBalanceContribution(const CWalletTx& wtx, bool& fVolatile) const;
+    /** Bring balanceCached up to date. Requires cs_main and cs_wallet. */
+    void UpdateBalanceCache() const;
+
+    /**
+     * Index of the outputs AvailableCoins may return: per transaction the
+     * outputs which are ours and not spent, with their IsMine type. It is
+     * kept up to date the same way as the balance cache, so AvailableCoins
+     * does not have to walk the whole wallet and solve every script again.
+     * The depth, lock and coin control filters still apply per call.
+     */
+    mutable bool fCoinIndexValid;
+    mutable std::map<uint256, std::vector<std::pair<unsigned int, isminetype> > > mapCoinIndex;
+    mutable std::set<uint256> setCoinIndexDirty;
+    mutable uint256 hashCoinIndexTip;
+    mutable int nCoinIndexTipHeight;
+
+    void IndexCoins(const uint256& hash, const CWalletTx& wtx) const;
+    /** Bring mapCoinIndex up to date. Requires cs_main and cs_wallet. */
+    void UpdateCoinIndex() const;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -637,6 +723,22 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Keys of the external and internal chains of the HD accounts, so new
+     * keys and signing keys are derived with a single step instead of
+     * decrypting the seed and deriving the whole path every time, and keys
+     * derived ahead in parallel by TopUpKeyPool. Both hold private keys and
+     * are dropped when the wallet gets locked or the HD chain changes.
+     */
+    mutable std::map<std::pair<uint32_t, bool>, CExtKey> mapHDChainKeys;
+    mutable std::map<std::pair<uint32_t, bool>, std::map<uint32_t, std::pair<CExtKey, CExtPubKey> > > mapHDKeysAhead;
+
+    /** Get the chain key of an HD account, derives and caches it when needed. Requires cs_wallet. */
+    void GetHDChainKey(uint32_t nAccountIndex, bool fInternal, CExtKey& extKeyRet) const;
+    /** Derive the next nCount keys of an HD chain starting at nChildIndex on all cores */
+    void DeriveHDKeysAhead(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, uint32_t nCount);
+    void ClearHDKeyCache() const;
+
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal /*= false*/);
 
@@ -719,6 +821,7 @@ public:
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        InvalidateBalanceCache();
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -756,9 +859,10 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. *pfChangelessRet tells whether the coins were chosen to need
+     * no change output, in which case their excess may go to the fee.
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend = false) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend = false, bool* pfChangelessRet = NULL) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vecTxInRet, std::vector<COutput>& vCoinsRet, CAmount& nValueRet, int nPrivateSendRoundsMin, int nPrivateSendRoundsMax); 
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vecTxInRet, CAmount& nValueRet, int nPrivateSendRoundsMin, int nPrivateSendRoundsMax) const; 
     bool SelectCoinsGrouppedByAddresses(std::vector<CompactTallyItem>& vecTallyRet, bool fSkipDenominated = true, bool fAnonymizable = true) const;
@@ -857,6 +961,7 @@ public:
     bool LoadWatchOnly(const CScript &dest);
 
     bool Unlock(const SecureString& strWalletPassphrase);
+    bool Lock();
     bool ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase);
     bool EncryptWallet(const SecureString& strWalletPassphrase);
 
@@ -875,10 +980,24 @@ public:
     bool GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bForceNew = false);
 
     void MarkDirty();
+    /** Re-evaluate the balance contribution and the indexed coins of a transaction on the next query */
+    void MarkBalanceDirty(const uint256& hash) const;
+    /** Recompute all balances and the coin index from scratch on the next query */
+    void InvalidateBalanceCache() const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    /**
+     * Rescan only the blocks the address index lists for the wallet's keys,
+     * scripts and watch-only addresses, reading them on -rescanthreads workers
+     * without holding cs_main. Returns -1 if the index can't be used, in which
+     * case the caller falls back to reading every block.
+     */
+    int ScanForWalletTransactionsIndexed(CBlockIndex* pindexStart, bool fUpdate = false);
+    /** Address index keys (hash, type) of everything IsMine() may match */
+    void GetAddressIndexKeys(std::set<std::pair<uint160, int> >& setAddresses) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman);
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
@@ -932,6 +1051,11 @@ public:
      * floating relay fee and user set minimum transaction fee
      */
     static CAmount GetRequiredFee(unsigned int nTxBytes);
+    /**
+     * Amount below which change isn't worth an output, used as the tolerated
+     * excess of changeless coin selections
+     */
+    static CAmount GetCostOfChange();
 
     bool NewKeyPool();
     size_t KeypoolCountExternalKeys();
@@ -25,3 +25,13 @@ bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transacti
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyBlockConnected(const CBlock &/*block*/, const CBlockIndex * /*pindex*/, const std::vector<std::pair<CAddressIndexKey, CAmount> > &/*addressIndex*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBlockDisconnected(const CBlock &/*block*/, const CBlockIndex * /*pindex*/, const std::vector<std::pair<CAddressIndexKey, CAmount> > &/*addressIndex*/)
+{
+    return true;
+}
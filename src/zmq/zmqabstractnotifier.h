@@ -7,6 +7,11 @@
 
 #include "zmqconfig.h"
 
+#include "amount.h"
+
+#include <vector>
+
+struct CAddressIndexKey;
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
@@ -35,6 +40,8 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    virtual bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+    virtual bool NotifyBlockDisconnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
 
 protected:
     void *psocket;
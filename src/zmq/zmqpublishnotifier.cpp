@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addresswatch.h"
 #include "chainparams.h"
 #include "streams.h"
 #include "zmqpublishnotifier.h"
@@ -16,6 +17,12 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_ADDRESS    = "address";
+
+static const unsigned char ADDRESS_EVENT_MEMPOOL = 0;
+static const unsigned char ADDRESS_EVENT_TXLOCK  = 1;
+static const unsigned char ADDRESS_EVENT_BLOCK   = 2;
+static const unsigned char ADDRESS_EVENT_UNBLOCK = 3;
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -211,3 +218,77 @@ bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransac
     ss << transaction;
     return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishAddressNotifier::SendEvents(unsigned char nEvent, const std::vector<CAddressWatchEvent> &events, int nHeight)
+{
+    for (const CAddressWatchEvent &event : events)
+    {
+        unsigned char data[1 + 1 + 20 + 32 + 8 + 8 + 4];
+        unsigned char *p = data;
+        *p++ = nEvent;
+        *p++ = (unsigned char)event.type;
+        memcpy(p, event.hashBytes.begin(), 20);
+        p += 20;
+        for (unsigned int i = 0; i < 32; i++)
+            p[31 - i] = event.txhash.begin()[i];
+        p += 32;
+        WriteLE64(p, (uint64_t)event.credit);
+        p += 8;
+        WriteLE64(p, (uint64_t)event.debit);
+        p += 8;
+        WriteLE32(p, (uint32_t)nHeight);
+
+        LogPrint("zmq", "zmq: Publish address event %d tx %s\n", (int)nEvent, event.txhash.GetHex());
+        if (!SendMessage(MSG_ADDRESS, data, sizeof(data)))
+            return false;
+    }
+    return true;
+}
+
+bool CZMQPublishAddressNotifier::NotifyMempoolTransaction(unsigned char nEvent, const CTransaction &transaction)
+{
+    if (addressWatchList.IsEmpty())
+        return true;
+
+    // Reuse the deltas addAddressAndSpentIndex classified when the transaction entered the pool
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > deltas;
+    if (!mempool.getAddressDeltas(transaction.GetHash(), deltas))
+        return true;
+
+    std::vector<CAddressWatchEvent> events;
+    addressWatchList.Match(deltas, events);
+    return SendEvents(nEvent, events, -1);
+}
+
+bool CZMQPublishAddressNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    // Transactions connected in a block are reported through NotifyBlockConnected,
+    // they are no longer in the mempool at this point.
+    return NotifyMempoolTransaction(ADDRESS_EVENT_MEMPOOL, transaction);
+}
+
+bool CZMQPublishAddressNotifier::NotifyTransactionLock(const CTransaction &transaction)
+{
+    return NotifyMempoolTransaction(ADDRESS_EVENT_TXLOCK, transaction);
+}
+
+bool CZMQPublishAddressNotifier::NotifyBlockAddresses(unsigned char nEvent, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    if (addressWatchList.IsEmpty())
+        return true;
+
+    // Reuse the entries ConnectBlock/DisconnectBlock classified for the address index
+    std::vector<CAddressWatchEvent> events;
+    addressWatchList.Match(addressIndex, events);
+    return SendEvents(nEvent, events, pindex->nHeight);
+}
+
+bool CZMQPublishAddressNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    return NotifyBlockAddresses(ADDRESS_EVENT_BLOCK, pindex, addressIndex);
+}
+
+bool CZMQPublishAddressNotifier::NotifyBlockDisconnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    return NotifyBlockAddresses(ADDRESS_EVENT_UNBLOCK, pindex, addressIndex);
+}
@@ -8,6 +8,7 @@
 #include "zmqabstractnotifier.h"
 
 class CBlockIndex;
+struct CAddressWatchEvent;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
@@ -64,4 +65,28 @@ public:
     bool NotifyTransactionLock(const CTransaction &transaction);
 };
 
+/* Publishes one "address" message per watched address and transaction:
+      * event (1 byte): 0 = mempool, 1 = transaction lock, 2 = block connected,
+        3 = block disconnected (the credit/debit of the block is reverted)
+      * address type (1 byte): 1 = pubkey hash, 2 = script hash
+      * hash160 (20 bytes)
+      * txid (32 bytes, same byte order as hashtx)
+      * credit, debit (8 bytes LE each, satoshis)
+      * block height (4 bytes LE, -1 if not in a block)
+   Only addresses registered with the watchaddresses RPC are published.
+*/
+class CZMQPublishAddressNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    bool SendEvents(unsigned char nEvent, const std::vector<CAddressWatchEvent> &events, int nHeight);
+    bool NotifyMempoolTransaction(unsigned char nEvent, const CTransaction &transaction);
+    bool NotifyBlockAddresses(unsigned char nEvent, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+
+public:
+    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+    bool NotifyBlockDisconnected(const CBlock &block, const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H